@@ -0,0 +1,83 @@
+// bench.hpp
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <string_view>
+
+#include "system.hpp"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+struct bench_options_t {
+   int         warmup_samples = 5;
+   int         samples = 31;
+   double      min_sample_seconds = 0.002;
+   bool        gl = true;
+   std::string filter;
+   std::string json_path = "bench_results.json";
+   std::string assets_path = "../kiwi/assets/";
+};
+
+struct bench_result_t {
+   std::string m_name;
+   int64       m_iterations = 0;
+   int         m_samples = 0;
+   double      m_median_ns = 0.0;
+   double      m_p95_ns = 0.0;
+   double      m_min_ns = 0.0;
+   double      m_mean_ns = 0.0;
+   double      m_items_per_second = 0.0;
+   int         m_workers = 1;
+};
+
+struct bench_suite_t {
+   // note: runs the measured operation 'iterations' times
+   using function_t = std::function<void(const int64 iterations)>;
+
+   struct entry_t {
+      std::string m_name;
+      function_t  m_function;
+      int64       m_items = 0;
+      bool        m_parallel = false;
+   };
+
+   bench_suite_t() = default;
+
+   // note: 'items' processed per iteration, when set the throughput at the median is reported too,
+   //       entries run without job workers so parallel_for stays on the calling thread
+   void add(const std::string_view &name, function_t function, const int64 items = 0);
+
+   // note: same, but with one job worker per core, name these '_parallel'
+   void add_parallel(const std::string_view &name, function_t function, const int64 items = 0);
+   void run(const bench_options_t &options);
+   bool save_json(const std::string_view &filename, const std::string_view &environment) const;
+
+   std::vector<entry_t>        m_entries;
+   std::vector<bench_result_t> m_results;
+};
+
+namespace bench
+{
+   // note: keeps the compiler from removing work whose result is unused
+   template <typename T>
+   inline void do_not_optimize(const T &value)
+   {
+#if defined(_MSC_VER)
+      static volatile const void *ms_sink = nullptr;
+      ms_sink = &value;
+      _ReadWriteBarrier();
+#else
+      asm volatile("" : : "r,m"(value) : "memory");
+#endif
+   }
+} // !bench
+
+void register_system_benchmarks(bench_suite_t &suite, const bench_options_t &options);
+bool register_graphics_benchmarks(bench_suite_t &suite, const bench_options_t &options);
+void release_graphics_benchmarks();
+std::string graphics_environment();
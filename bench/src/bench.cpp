@@ -0,0 +1,210 @@
+// bench.cpp
+
+#include "bench.hpp"
+#include "jobs.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+static double
+seconds_since(const std::chrono::steady_clock::time_point &start)
+{
+   return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void bench_suite_t::add(const std::string_view &name, function_t function, const int64 items)
+{
+   m_entries.push_back({ std::string(name), std::move(function), items, false });
+}
+
+void bench_suite_t::add_parallel(const std::string_view &name, function_t function, const int64 items)
+{
+   m_entries.push_back({ std::string(name), std::move(function), items, true });
+}
+
+void bench_suite_t::run(const bench_options_t &options)
+{
+   using clock = std::chrono::steady_clock;
+
+   printf("%-40s %12s %12s %12s %12s %12s\n", "benchmark", "iterations", "median(ns)", "p95(ns)", "min(ns)", "items/s");
+   for (auto &entry : m_entries) {
+      if (!options.filter.empty() && entry.m_name.find(options.filter) == std::string::npos) {
+         continue;
+      }
+
+      // note: workers only run for parallel entries so the others keep their single threaded numbers
+      if (entry.m_parallel != (job_system_t::worker_count() > 0)) {
+         if (entry.m_parallel) {
+            job_system_t::initialize();
+         }
+         else {
+            job_system_t::shutdown();
+         }
+      }
+
+      // note: grow the batch until one sample takes long enough to be above timer noise
+      int64 iterations = 1;
+      for (;;) {
+         const auto start = clock::now();
+         entry.m_function(iterations);
+         const double elapsed = seconds_since(start);
+         if (elapsed >= options.min_sample_seconds || iterations >= (int64(1) << 30)) {
+            break;
+         }
+
+         const double scale = elapsed > 0.0 ? options.min_sample_seconds / elapsed : 10.0;
+         iterations = std::max(iterations + 1, int64(iterations * std::min(scale * 1.2, 10.0)));
+      }
+
+      // note: warm caches, driver state and branch predictors before measuring
+      for (int sample = 0; sample < options.warmup_samples; sample++) {
+         entry.m_function(iterations);
+      }
+
+      std::vector<double> per_iteration_ns;
+      per_iteration_ns.reserve(options.samples);
+      for (int sample = 0; sample < options.samples; sample++) {
+         const auto start = clock::now();
+         entry.m_function(iterations);
+         per_iteration_ns.push_back(seconds_since(start) * 1e9 / double(iterations));
+      }
+
+      std::sort(per_iteration_ns.begin(), per_iteration_ns.end());
+      const size_t count = per_iteration_ns.size();
+      const size_t p95_index = std::min(count - 1, (count * 95 + 99) / 100 - 1);
+
+      double sum = 0.0;
+      for (const double value : per_iteration_ns) {
+         sum += value;
+      }
+
+      bench_result_t result;
+      result.m_name = entry.m_name;
+      result.m_iterations = iterations;
+      result.m_samples = int(count);
+      result.m_median_ns = count % 2 ? per_iteration_ns[count / 2] : 0.5 * (per_iteration_ns[count / 2 - 1] + per_iteration_ns[count / 2]);
+      result.m_p95_ns = per_iteration_ns[p95_index];
+      result.m_min_ns = per_iteration_ns.front();
+      result.m_mean_ns = sum / count;
+      result.m_items_per_second = entry.m_items > 0 && result.m_median_ns > 0.0 ? double(entry.m_items) * 1e9 / result.m_median_ns : 0.0;
+      result.m_workers = std::max(1, job_system_t::worker_count());
+      m_results.push_back(result);
+
+      printf("%-40s %12lld %12.2f %12.2f %12.2f %12.4g\n",
+             result.m_name.c_str(),
+             result.m_iterations,
+             result.m_median_ns,
+             result.m_p95_ns,
+             result.m_min_ns,
+             result.m_items_per_second);
+   }
+
+   job_system_t::shutdown();
+}
+
+static void
+append_json_string(std::string &content, const std::string_view &text)
+{
+   content += '"';
+   for (const char character : text) {
+      if (character == '"' || character == '\\') {
+         content += '\\';
+      }
+
+      if (character >= 0 && character < 0x20) {
+         content += ' ';
+         continue;
+      }
+
+      content += character;
+   }
+   content += '"';
+}
+
+bool bench_suite_t::save_json(const std::string_view &filename, const std::string_view &environment) const
+{
+   std::string content = "{\n  \"environment\": ";
+   append_json_string(content, environment);
+   content += ",\n  \"results\": [";
+
+   char line[512];
+   for (size_t index = 0; index < m_results.size(); index++) {
+      const bench_result_t &result = m_results[index];
+      content += index ? ",\n    { \"name\": " : "\n    { \"name\": ";
+      append_json_string(content, result.m_name);
+      snprintf(line, sizeof(line), 
+               ", \"iterations\": %lld, \"samples\": %d, \"median_ns\": %.3f, \"p95_ns\": %.3f, \"min_ns\": %.3f, \"mean_ns\": %.3f, \"items_per_second\": %.1f, \"workers\": %d }",
+               result.m_iterations,
+               result.m_samples,
+               result.m_median_ns,
+               result.m_p95_ns,
+               result.m_min_ns,
+               result.m_mean_ns,
+               result.m_items_per_second,
+               result.m_workers);
+      content += line;
+   }
+
+   content += "\n  ]\n}\n";
+
+   return file_system_t::save_content(filename, content);
+}
+
+static bench_options_t
+parse_options(int argc, char **argv)
+{
+   bench_options_t options;
+   for (int index = 1; index < argc; index++) {
+      const char *argument = argv[index];
+      if (strncmp(argument, "--filter=", 9) == 0) {
+         options.filter = argument + 9;
+      }
+      else if (strncmp(argument, "--samples=", 10) == 0) {
+         options.samples = std::max(1, atoi(argument + 10));
+      }
+      else if (strncmp(argument, "--warmup=", 9) == 0) {
+         options.warmup_samples = std::max(0, atoi(argument + 9));
+      }
+      else if (strncmp(argument, "--json=", 7) == 0) {
+         options.json_path = argument + 7;
+      }
+      else if (strncmp(argument, "--assets=", 9) == 0) {
+         options.assets_path = argument + 9;
+      }
+      else if (strcmp(argument, "--no-gl") == 0) {
+         options.gl = false;
+      }
+      else {
+         debug::warn("unknown argument '%s'", argument);
+      }
+   }
+
+   return options;
+}
+
+int main(int argc, char **argv)
+{
+   const bench_options_t options = parse_options(argc, argv);
+
+   bench_suite_t suite;
+   register_system_benchmarks(suite, options);
+
+   // note: gl benchmarks run against a headless context, skipped if none can be created
+   const bool gl = options.gl && register_graphics_benchmarks(suite, options);
+   const std::string environment = gl ? graphics_environment() : std::string("cpu only");
+
+   suite.run(options);
+
+   if (gl) {
+      release_graphics_benchmarks();
+   }
+
+   if (!suite.save_json(options.json_path, environment)) {
+      return 1;
+   }
+
+   return 0;
+}
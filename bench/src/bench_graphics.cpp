@@ -0,0 +1,155 @@
+// bench_graphics.cpp
+
+#include "bench.hpp"
+#include "graphics.hpp"
+#include "headless.hpp"
+#include "resources.hpp"
+
+#include <memory>
+#include <glad/glad.h>
+
+static const char *bench_vertex_source = R"(#version 330
+layout (location = 0) in vec3 a_position;
+uniform mat4 u_projection;
+uniform mat4 u_world;
+uniform vec4 u_color;
+void main() {
+   gl_Position = u_projection * u_world * vec4(a_position, 1.0);
+})";
+
+static const char *bench_fragment_source = R"(#version 330
+uniform vec4 u_color;
+out vec4 frag_color;
+void main() {
+   frag_color = u_color;
+})";
+
+struct graphics_bench_state_t {
+   headless_context_t          m_context;
+   std::unique_ptr<renderer_t> m_renderer;
+   shader_program_t            m_program;
+   resource_manager_t          m_resources;
+   std::vector<uint8_t>        m_pixels;
+};
+
+static std::unique_ptr<graphics_bench_state_t> bench_state;
+
+bool register_graphics_benchmarks(bench_suite_t &suite, [[maybe_unused]] const bench_options_t &options)
+{
+   bench_state = std::make_unique<graphics_bench_state_t>();
+   if (!bench_state->m_context.create(64, 64)) {
+      bench_state.reset();
+      return false;
+   }
+
+   bench_state->m_renderer = std::make_unique<renderer_t>();
+   if (!bench_state->m_program.create(bench_vertex_source, bench_fragment_source) ||
+       !bench_state->m_resources.create(resource_manager_t::desc_t{})) {
+      release_graphics_benchmarks();
+      return false;
+   }
+
+   graphics_bench_state_t *state = bench_state.get();
+
+   // note: a changing value goes through hashing and the gl call, 
+   //       an unchanged value only through the hash compare
+   suite.add("renderer_t::set_uniform/mat4", [state](const int64 iterations) {
+      state->m_renderer->set_shader_program(state->m_program);
+      glm::mat4 world(1.0f);
+      for (int64 iteration = 0; iteration < iterations; iteration++) {
+         world[3][0] = float(iteration);
+         state->m_renderer->set_uniform("u_world", world);
+      }
+      glFinish();
+   });
+
+   suite.add("renderer_t::set_uniform/mat4_unchanged", [state](const int64 iterations) {
+      state->m_renderer->set_shader_program(state->m_program);
+      const glm::mat4 world(1.0f);
+      for (int64 iteration = 0; iteration < iterations; iteration++) {
+         state->m_renderer->set_uniform("u_world", world);
+      }
+   });
+
+   suite.add("renderer_t::set_uniform/vec4", [state](const int64 iterations) {
+      state->m_renderer->set_shader_program(state->m_program);
+      glm::vec4 color(1.0f);
+      for (int64 iteration = 0; iteration < iterations; iteration++) {
+         color.x = float(iteration);
+         state->m_renderer->set_uniform("u_color", color);
+      }
+      glFinish();
+   });
+
+   // note: full compile and link against loading the linked binary back from disk
+   suite.add("shader_program_t::create/compiled", [](const int64 iterations) {
+      program_cache_t::set_directory("");
+      for (int64 iteration = 0; iteration < iterations; iteration++) {
+         shader_program_t program;
+         program.create(bench_vertex_source, bench_fragment_source);
+         program.destroy();
+      }
+      glFinish();
+      program_cache_t::set_directory("shader_cache");
+   });
+
+   if (program_cache_t::enabled()) {
+      suite.add("shader_program_t::create/cache_hit", [](const int64 iterations) {
+         for (int64 iteration = 0; iteration < iterations; iteration++) {
+            shader_program_t program;
+            program.create(bench_vertex_source, bench_fragment_source);
+            program.destroy();
+         }
+         glFinish();
+      });
+   }
+
+   constexpr int texture_size = 1024;
+   state->m_pixels.resize(texture_size * texture_size * 4, 0x7f);
+   suite.add("texture_t::create/1024x1024_rgba8", [state](const int64 iterations) {
+      for (int64 iteration = 0; iteration < iterations; iteration++) {
+         texture_t texture;
+         texture.create(texture_size, texture_size, state->m_pixels.data(), texture_t::pixel_format_t::rgba8);
+         texture.destroy();
+      }
+      glFinish();
+   });
+
+   // note: one frame per iteration, the released texture comes back out of the
+   //       recycle bin once the frame fence that retired it has passed
+   suite.add("resource_manager_t::create_texture/1024x1024_rgba8_recycled", [state](const int64 iterations) {
+      resource_manager_t &resources = state->m_resources;
+      for (int64 iteration = 0; iteration < iterations; iteration++) {
+         state->m_renderer->begin_frame();
+         resources.begin_frame(state->m_renderer->frame_index(), state->m_renderer->completed_frame());
+         const texture_handle_t handle = resources.create_texture(texture_size, texture_size, state->m_pixels.data(), texture_t::pixel_format_t::rgba8);
+         resources.release(handle);
+         state->m_renderer->end_frame();
+      }
+      glFinish();
+   });
+
+   return true;
+}
+
+void release_graphics_benchmarks()
+{
+   if (bench_state) {
+      bench_state->m_program.destroy();
+      bench_state->m_resources.destroy();
+      bench_state->m_renderer.reset();
+      bench_state->m_context.destroy();
+      bench_state.reset();
+   }
+}
+
+std::string graphics_environment()
+{
+   std::string environment;
+   environment += (const char *)glGetString(GL_VENDOR);
+   environment += " - ";
+   environment += (const char *)glGetString(GL_RENDERER);
+   environment += " - ";
+   environment += (const char *)glGetString(GL_VERSION);
+   return environment;
+}
@@ -0,0 +1,263 @@
+// bench_system.cpp
+
+#include "bench.hpp"
+#include "graphics.hpp"
+#include "lighting.hpp"
+#include "orbits.hpp"
+#include "scene.hpp"
+#include "jobs.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <stb_image.h>
+
+#include <memory>
+
+static void
+add_fnv1a32_benchmark(bench_suite_t &suite, const size_t size)
+{
+   std::vector<uint8_t> data(size);
+   for (size_t index = 0; index < size; index++) {
+      data[index] = uint8_t(index * 31);
+   }
+
+   suite.add("fnv1a32/" + std::to_string(size), [data](const int64 iterations) {
+      for (int64 iteration = 0; iteration < iterations; iteration++) {
+         bench::do_not_optimize(fnv1a32(data.data(), data.size()));
+      }
+   });
+}
+
+static void
+add_decode_benchmark(bench_suite_t &suite, const std::string &path)
+{
+   std::vector<uint8_t> content;
+   if (!file_system_t::load_content(path, content)) {
+      return;
+   }
+
+   suite.add("stb_decode/" + path.substr(path.find_last_of("/\\") + 1), [content](const int64 iterations) {
+      for (int64 iteration = 0; iteration < iterations; iteration++) {
+         int width = 0, height = 0, components = 0;
+         stbi_uc *bitmap = stbi_load_from_memory(content.data(), int(content.size()), &width, &height, &components, STBI_default);
+         bench::do_not_optimize(bitmap);
+         stbi_image_free(bitmap);
+      }
+   });
+}
+
+void register_system_benchmarks(bench_suite_t &suite, const bench_options_t &options)
+{
+   add_fnv1a32_benchmark(suite, 16);
+   add_fnv1a32_benchmark(suite, sizeof(glm::mat4));
+   add_fnv1a32_benchmark(suite, 4096);
+
+   suite.add("vertex_layout_t::add", [](const int64 iterations) {
+      vertex_layout_t layout;
+      for (int64 iteration = 0; iteration < iterations; iteration++) {
+         layout
+            .clear()
+            .add(attribute_type_t::float_, 3, false)
+            .add(attribute_type_t::float_, 2, false)
+            .add(attribute_type_t::float_, 4, false);
+         bench::do_not_optimize(layout);
+      }
+   });
+
+   // note: posting is a slot claim plus a copy, delivery happens in batches of 64
+   suite.add("event_dispatcher_t::post+process", [](const int64 iterations) {
+      struct bench_listener_t {
+         void on_event(const mouse_moved_t &event) { m_sum += event.x; }
+         int64 m_sum = 0;
+      } listener;
+
+      const listener_id_t id = event_dispatcher_t::add_listener<mouse_moved_t>(listener);
+      for (int64 iteration = 0; iteration < iterations; iteration++) {
+         event_dispatcher_t::post(mouse_moved_t{ int(iteration), 0, timespan_t{} });
+         if ((iteration & 63) == 63) {
+            event_dispatcher_t::process();
+         }
+      }
+      event_dispatcher_t::process();
+      event_dispatcher_t::remove_listener<mouse_moved_t>(id);
+      bench::do_not_optimize(listener.m_sum);
+   });
+
+   const std::string image_path = options.assets_path + "2k_neptune.jpg";
+   suite.add("file_system_t::load_content/string", [image_path](const int64 iterations) {
+      for (int64 iteration = 0; iteration < iterations; iteration++) {
+         std::string content;
+         file_system_t::load_content(image_path, content);
+         bench::do_not_optimize(content.data());
+      }
+   });
+
+   suite.add("file_system_t::load_content/bytes", [image_path](const int64 iterations) {
+      for (int64 iteration = 0; iteration < iterations; iteration++) {
+         std::vector<uint8_t> content;
+         file_system_t::load_content(image_path, content);
+         bench::do_not_optimize(content.data());
+      }
+   });
+
+   suite.add("file_system_t::load_content/scratch", [image_path](const int64 iterations) {
+      for (int64 iteration = 0; iteration < iterations; iteration++) {
+         scratch_scope_t scratch;
+         std::span<uint8_t> content;
+         file_system_t::load_content(image_path, scratch.arena(), content);
+         bench::do_not_optimize(content.data());
+      }
+   });
+
+   // note: 64 small allocations per frame, then the frame ends
+   suite.add("linear_arena_t::allocate/64", [](const int64 iterations) {
+      linear_arena_t arena;
+      arena.create(64 * 1024);
+      for (int64 iteration = 0; iteration < iterations; iteration++) {
+         for (int index = 0; index < 64; index++) {
+            bench::do_not_optimize(arena.allocate(48, 16));
+         }
+         arena.reset();
+      }
+   });
+
+   suite.add("operator new/64", [](const int64 iterations) {
+      void *allocations[64];
+      for (int64 iteration = 0; iteration < iterations; iteration++) {
+         for (int index = 0; index < 64; index++) {
+            allocations[index] = ::operator new(48);
+            bench::do_not_optimize(allocations[index]);
+         }
+         for (int index = 0; index < 64; index++) {
+            ::operator delete(allocations[index]);
+         }
+      }
+   });
+
+   // note: a serial entry, no workers, this is the single threaded cost
+   suite.add("cubemap_image_t::create_from_equirect/512", [image_path](const int64 iterations) {
+      image_t image;
+      image.load_from_file(image_path);
+      for (int64 iteration = 0; iteration < iterations; iteration++) {
+         cubemap_image_t cubemap;
+         cubemap.create_from_equirect(image, 512);
+         bench::do_not_optimize(cubemap.m_pixels);
+         cubemap.destroy();
+      }
+      image.destroy();
+   });
+
+   // note: cpu binning only, upload() needs a gl context
+   suite.add("light_clusters_t::bin/1024", [](const int64 iterations) {
+      std::vector<point_light_t> lights(light_clusters_t::max_lights);
+      for (size_t index = 0; index < lights.size(); index++) {
+         const float angle = float(index) * 0.37f;
+         lights[index].m_position = glm::vec3(std::cos(angle) * 20.0f, float(index % 17) - 8.0f, -55.0f + std::sin(angle) * 20.0f);
+         lights[index].m_radius = 1.0f + float(index % 5) * 0.5f;
+      }
+
+      const glm::mat4 projection = glm::perspective(0.785f, 16.0f / 9.0f, 1.0f, 100.0f);
+      linear_arena_t arena;
+      arena.create(1024 * 1024);
+      light_clusters_t clusters;
+      for (int64 iteration = 0; iteration < iterations; iteration++) {
+         clusters.bin(lights.data(), uint32_t(lights.size()), glm::mat4(1.0f), projection, viewport_t{ 0, 0, 1280, 720 }, arena);
+         bench::do_not_optimize(clusters.m_grid);
+         arena.reset();
+      }
+   });
+
+   // note: the plain entries run one range on this thread, items/s is bodies
+   //       per second per core, '_parallel' is the whole machine through evaluate()
+   constexpr uint32_t kepler_bodies = 100000;
+   kepler_orbits_t orbits;
+   orbits.create(kepler_bodies, 420.0f);
+   for (uint32_t index = 0; index < kepler_bodies; index++) {
+      kepler_elements_t elements;
+      elements.m_semi_major_axis = 10.0f + float(index % 97) * 0.02f;
+      elements.m_eccentricity = float(index % 13) * 0.01f;
+      elements.m_inclination = float(index % 7) * 0.01f;
+      elements.m_ascending_node = float(index) * 0.37f;
+      elements.m_argument_of_periapsis = float(index) * 0.73f;
+      elements.m_mean_anomaly = float(index) * 0.11f;
+      orbits.add(elements, 0.05f);
+   }
+
+   suite.add("kepler_orbits_t::evaluate/100000", [orbits, output = std::vector<float>(size_t(kepler_bodies) * 4)](const int64 iterations) mutable {
+      for (int64 iteration = 0; iteration < iterations; iteration++) {
+         orbits.evaluate_range(double(iteration) * (1.0 / 60.0), 0, kepler_bodies, output.data());
+         bench::do_not_optimize(output.data());
+      }
+   }, kepler_bodies);
+
+   suite.add_parallel("kepler_orbits_t::evaluate/100000_parallel", [orbits, output = std::vector<float>(size_t(kepler_bodies) * 4)](const int64 iterations) mutable {
+      for (int64 iteration = 0; iteration < iterations; iteration++) {
+         orbits.evaluate(double(iteration) * (1.0 / 60.0), output.data());
+         bench::do_not_optimize(output.data());
+      }
+   }, kepler_bodies);
+
+   // note: per core is one o(n^2) acceleration pass on this thread, the step
+   //       (one pass plus the leapfrog integration) is measured over every
+   //       core, the system keeps evolving across samples, the cost per step does not change
+   constexpr uint32_t nbody_bodies = 1024;
+   nbody_system_t system;
+   system.create(nbody_bodies, 420.0f, 0.05f);
+   for (uint32_t index = 0; index < nbody_bodies; index++) {
+      const float angle = float(index) * 0.37f;
+      const float radius = 12.0f + float(index % 31) * 0.1f;
+      const float speed = std::sqrt(420.0f / radius);
+      const float position[3] = { std::cos(angle) * radius, float(index % 5) * 0.05f, std::sin(angle) * radius };
+      const float velocity[3] = { -std::sin(angle) * speed, 0.0f, std::cos(angle) * speed };
+      system.add(position, velocity, 0.002f, 0.05f);
+   }
+
+   suite.add("nbody_system_t::compute_accelerations/1024", [system](const int64 iterations) mutable {
+      for (int64 iteration = 0; iteration < iterations; iteration++) {
+         system.compute_accelerations(0, nbody_bodies);
+         bench::do_not_optimize(system.m_ax.data());
+      }
+   }, nbody_bodies);
+
+   suite.add_parallel("nbody_system_t::step/1024_parallel", [system](const int64 iterations) mutable {
+      for (int64 iteration = 0; iteration < iterations; iteration++) {
+         system.step(1.0f / 60.0f);
+         bench::do_not_optimize(system.m_x.data());
+      }
+   }, nbody_bodies);
+
+   // note: the 1M nodes within 16 ms target, a quad tree ten levels deep, 'full'
+   //       moves the root so every node is updated, 'sparse' moves every 100th
+   //       leaf (about 1% of the nodes), items/s is nodes per second either way
+   constexpr uint32_t scene_nodes = 1024 * 1024;
+   auto scene = std::make_shared<scene_graph_t>();
+   scene->reserve(scene_nodes);
+   for (uint32_t index = 0; index < scene_nodes; index++) {
+      scene->add_node(index == 0 ? scene_graph_t::invalid_node : (index - 1) / 4);
+      scene->set_position(index, glm::vec3(1.0f, 0.0f, 0.0f));
+   }
+   scene->update(false);
+
+   for (const bool parallel : { false, true }) {
+      const std::string suffix = parallel ? "_parallel" : "";
+      const auto add = parallel ? &bench_suite_t::add_parallel : &bench_suite_t::add;
+      (suite.*add)("scene_graph_t::update/1M_full" + suffix, [scene, parallel](const int64 iterations) {
+         for (int64 iteration = 0; iteration < iterations; iteration++) {
+            scene->set_position(0, glm::vec3(float(iteration & 7), 0.0f, 0.0f));
+            bench::do_not_optimize(scene->update(parallel));
+         }
+      }, scene_nodes);
+
+      (suite.*add)("scene_graph_t::update/1M_sparse" + suffix, [scene, parallel](const int64 iterations) {
+         for (int64 iteration = 0; iteration < iterations; iteration++) {
+            for (uint32_t node = scene_nodes / 4 + uint32_t(iteration % 100); node < scene_nodes; node += 100) {
+               scene->set_position(node, glm::vec3(float(iteration & 7), 0.0f, 0.0f));
+            }
+            bench::do_not_optimize(scene->update(parallel));
+         }
+      }, scene_nodes);
+   }
+
+   add_decode_benchmark(suite, options.assets_path + "crate.png");
+   add_decode_benchmark(suite, image_path);
+}
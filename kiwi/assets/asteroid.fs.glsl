@@ -0,0 +1,18 @@
+#version 330
+
+#include "lighting.glsl"
+
+// note: x - emissive, y - ambient
+uniform vec4 u_material;
+
+in  vec3 f_world_position;
+in  vec3 f_normal;
+in  float f_view_depth;
+flat in float f_shade;
+out vec4 frag_color;
+
+void main() {
+   vec3 albedo = vec3(0.62, 0.56, 0.5) * f_shade;
+   vec3 lighting = u_material.y + clustered_lighting(gl_FragCoord.xy, f_view_depth, f_world_position, normalize(f_normal));
+   frag_color = vec4(albedo * lighting, 1.0);
+}
@@ -0,0 +1,24 @@
+#version 330
+
+layout (location = 0) in vec3 a_position;
+// note: per instance, xyz - position in the system frame, w - size
+layout (location = 3) in vec4 a_instance;
+
+uniform mat4 u_projection;
+uniform mat4 u_view;
+uniform mat4 u_world;
+
+out vec3 f_world_position;
+out vec3 f_normal;
+out float f_view_depth;
+flat out float f_shade;
+
+void main() {
+   vec4 world_position = u_world * vec4(a_instance.xyz + a_position * a_instance.w, 1.0);
+   gl_Position = u_projection * u_view * world_position;
+   f_world_position = world_position.xyz;
+   f_normal = mat3(u_world) * a_position;
+   f_view_depth = -(u_view * world_position).z;
+   // note: cheap hash so neighbouring rocks do not all look the same
+   f_shade = 0.55 + 0.45 * fract(sin(float(gl_InstanceID) * 12.9898) * 43758.5453);
+}
@@ -0,0 +1,8 @@
+// common.glsl - shared by the kiwi shaders, pulled in with #include
+
+#ifdef DEBUG_WIREFRAME
+// note: flat color from the texture coordinates, shows the mapping of each face
+vec4 debug_wireframe_color(vec2 texcoord) {
+   return vec4(texcoord, 1.0, 1.0);
+}
+#endif
@@ -0,0 +1,40 @@
+// lighting.glsl - clustered point lights, the tables are built by light_clusters_t
+
+uniform samplerBuffer  u_lights;
+uniform usamplerBuffer u_light_grid;
+uniform usamplerBuffer u_light_indices;
+
+// note: tile width, tile height, viewport x, viewport y
+uniform vec4 u_cluster_tile;
+// note: tiles x, tiles y, slices
+uniform vec4 u_cluster_count;
+// note: slice = log(view depth) * x + y
+uniform vec4 u_cluster_depth;
+
+int cluster_index(vec2 frag_coord, float view_depth) {
+   ivec2 count = ivec2(u_cluster_count.xy);
+   ivec2 tile = clamp(ivec2((frag_coord - u_cluster_tile.zw) / u_cluster_tile.xy), ivec2(0), count - 1);
+   int slice = clamp(int(log(view_depth) * u_cluster_depth.x + u_cluster_depth.y), 0, int(u_cluster_count.z) - 1);
+   return (slice * count.y + tile.y) * count.x + tile.x;
+}
+
+// note: only the lights binned into this fragment's cluster are visited,
+//       falloff is a smooth window that reaches zero at the light radius
+vec3 clustered_lighting(vec2 frag_coord, float view_depth, vec3 position, vec3 normal) {
+   uvec2 cell = texelFetch(u_light_grid, cluster_index(frag_coord, view_depth)).xy;
+
+   vec3 result = vec3(0.0);
+   for (uint index = 0u; index < cell.y; index++) {
+      int light = int(texelFetch(u_light_indices, int(cell.x + index)).x);
+      vec4 position_radius = texelFetch(u_lights, light * 2 + 0);
+      vec4 color_intensity = texelFetch(u_lights, light * 2 + 1);
+
+      vec3 to_light = position_radius.xyz - position;
+      float distance_squared = max(dot(to_light, to_light), 1e-4);
+      float window = clamp(1.0 - distance_squared / (position_radius.w * position_radius.w), 0.0, 1.0);
+      float lambert = max(dot(normal, to_light * inversesqrt(distance_squared)), 0.0);
+      result += color_intensity.rgb * (color_intensity.a * window * window * lambert);
+   }
+
+   return result;
+}
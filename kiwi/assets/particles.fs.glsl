@@ -0,0 +1,16 @@
+#version 330
+
+#if defined(UPDATE)
+// note: never runs, the rasterizer is off during the update pass
+void main() {
+}
+#else
+in  vec2 f_corner;
+in  vec4 f_color;
+out vec4 frag_color;
+
+void main() {
+   float falloff = max(1.0 - dot(f_corner, f_corner), 0.0);
+   frag_color = vec4(f_color.rgb * f_color.a * falloff, 0.0);
+}
+#endif
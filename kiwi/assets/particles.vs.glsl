@@ -0,0 +1,87 @@
+#version 330
+
+// note: UPDATE is the transform feedback pass, one point per particle and nothing
+//       rasterized, otherwise one camera facing quad per particle instance
+
+#if defined(UPDATE)
+layout (location = 0) in vec4 a_position_age;
+layout (location = 1) in vec4 a_velocity_life;
+
+// note: x - step, y - time, z - gm of the central mass, w - emitter radius
+uniform vec4 u_simulation;
+// note: x - min speed, y - max speed, z - min life, w - max life
+uniform vec4 u_emitter;
+
+out vec4 v_position_age;
+out vec4 v_velocity_life;
+
+uint hash(uint value) {
+   value ^= value >> 16;
+   value *= 0x7feb352du;
+   value ^= value >> 15;
+   value *= 0x846ca68bu;
+   value ^= value >> 16;
+   return value;
+}
+
+float random(inout uint state) {
+   state = hash(state);
+   return float(state >> 8) * (1.0 / 16777216.0);
+}
+
+void main() {
+   float dt = u_simulation.x;
+   vec3 position = a_position_age.xyz;
+   vec3 velocity = a_velocity_life.xyz;
+   float age = a_position_age.w + dt;
+   float life = a_velocity_life.w;
+
+   if (age >= life) {
+      // note: seeded by particle and time, uniform direction over the sphere
+      uint state = hash(uint(gl_VertexID) * 0x9e3779b9u ^ floatBitsToUint(u_simulation.y));
+      float z = random(state) * 2.0 - 1.0;
+      float angle = random(state) * 6.2831853;
+      vec3 direction = vec3(sqrt(1.0 - z * z) * cos(angle), z, sqrt(1.0 - z * z) * sin(angle));
+      float speed = mix(u_emitter.x, u_emitter.y, random(state));
+
+      // note: never alive before, start somewhere along the first life
+      float start = life == 0.0 ? random(state) : 0.0;
+      life = mix(u_emitter.z, u_emitter.w, random(state));
+      age = start * life;
+      velocity = direction * speed;
+      position = direction * (u_simulation.w + speed * age);
+   }
+   else {
+      float distance_squared = max(dot(position, position), 0.01);
+      velocity -= position * (u_simulation.z * inversesqrt(distance_squared) / distance_squared) * dt;
+      position += velocity * dt;
+   }
+
+   v_position_age = vec4(position, age);
+   v_velocity_life = vec4(velocity, life);
+}
+#else
+layout (location = 0) in vec2 a_corner;
+// note: per instance, the state written by the update pass
+layout (location = 1) in vec4 a_position_age;
+layout (location = 2) in vec4 a_velocity_life;
+
+uniform mat4 u_projection;
+uniform mat4 u_view;
+uniform mat4 u_world;
+// note: x - size
+uniform vec4 u_sprite;
+
+out vec2 f_corner;
+out vec4 f_color;
+
+void main() {
+   float t = clamp(a_position_age.w / max(a_velocity_life.w, 0.001), 0.0, 1.0);
+   vec4 view_position = u_view * u_world * vec4(a_position_age.xyz, 1.0);
+   view_position.xy += a_corner * u_sprite.x;
+   gl_Position = u_projection * view_position;
+   f_corner = a_corner;
+   // note: white hot near the surface, cooling to a dim red as it fades out
+   f_color = vec4(mix(vec3(1.0, 0.9, 0.6), vec3(0.9, 0.25, 0.05), t), (1.0 - t) * 0.15);
+}
+#endif
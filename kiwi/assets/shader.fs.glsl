@@ -1,11 +1,31 @@
 #version 330
 
-uniform sampler2D u_diffuse;
+#include "common.glsl"
+#include "lighting.glsl"
 
+uniform samplerCube u_diffuse;
+
+// note: x - emissive, y - ambient
+uniform vec4 u_material;
+
+#if !defined(DEPTH_ONLY)
 in  vec2 f_texcoord;
+in  vec3 f_direction;
 in  vec4 f_color;
+in  vec3 f_world_position;
+in  vec3 f_normal;
+in  float f_view_depth;
+#endif
 out vec4 frag_color;
 
 void main() {
-   frag_color = texture(u_diffuse, f_texcoord);
+#if defined(DEPTH_ONLY)
+   // note: color writes are masked off, only the rasterized depth matters
+#elif defined(DEBUG_WIREFRAME)
+   frag_color = debug_wireframe_color(f_texcoord);
+#else
+   vec4 albedo = texture(u_diffuse, f_direction);
+   vec3 lighting = u_material.y + clustered_lighting(gl_FragCoord.xy, f_view_depth, f_world_position, normalize(f_normal));
+   frag_color = vec4(albedo.rgb * mix(lighting, vec3(1.0), u_material.x), albedo.a);
+#endif
 }
\ No newline at end of file
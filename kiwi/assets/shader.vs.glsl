@@ -5,13 +5,32 @@ layout (location = 1) in vec2 a_texcoord;
 layout (location = 2) in vec4 a_color;
 
 uniform mat4 u_projection;
+uniform mat4 u_view;
 uniform mat4 u_world;
 
+// note: the depth pre-pass and the shading pass test for equal depth, both
+//       permutations have to produce bit identical positions
+invariant gl_Position;
+
+#if !defined(DEPTH_ONLY)
 out vec2 f_texcoord;
+out vec3 f_direction;
 out vec4 f_color;
+out vec3 f_world_position;
+out vec3 f_normal;
+out float f_view_depth;
+#endif
 
 void main() {
-   gl_Position = u_projection * u_world * vec4(a_position, 1.0);
+   gl_Position = u_projection * u_view * u_world * vec4(a_position, 1.0);
+#if !defined(DEPTH_ONLY)
+   vec4 world_position = u_world * vec4(a_position, 1.0);
    f_texcoord = a_texcoord;
+   f_direction = a_position;
    f_color = a_color;
+   f_world_position = world_position.xyz;
+   // note: bodies are cubes textured as spheres, light them as spheres too
+   f_normal = mat3(u_world) * a_position;
+   f_view_depth = -(u_view * world_position).z;
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,10 @@
+#version 330
+
+uniform samplerCube u_skybox;
+
+in  vec3 f_direction;
+out vec4 frag_color;
+
+void main() {
+   frag_color = texture(u_skybox, f_direction);
+}
@@ -0,0 +1,16 @@
+#version 330
+
+layout (location = 0) in vec3 a_position;
+
+uniform mat4 u_projection;
+uniform mat4 u_view;
+
+out vec3 f_direction;
+
+void main() {
+   // note: rotation only so the sky stays at infinity, z = w puts it on the 
+   //       far plane where only pixels nothing else has covered pass the test
+   vec4 position = u_projection * mat4(mat3(u_view)) * vec4(a_position, 1.0);
+   gl_Position = position.xyww;
+   f_direction = a_position;
+}
\ No newline at end of file
@@ -4,24 +4,82 @@
 
 #include "system.hpp"
 #include "graphics.hpp"
+#include "scene.hpp"
+#include "shader.hpp"
+#include "lighting.hpp"
+#include "resources.hpp"
+#include "orbits.hpp"
+#include "particles.hpp"
+
+// note: everything the render side needs to draw a frame, produced by the
+//       simulation side and immutable once published
+struct render_snapshot_t {
+   uint64_t               m_frame = 0;
+   viewport_t             m_viewport;
+   glm::mat4              m_projection{ 1.0f };
+   std::vector<glm::mat4> m_world;
+   std::vector<uint32_t>  m_visible;
+   std::vector<point_light_t> m_lights;
+   glm::mat4              m_system_world{ 1.0f };
+   double                 m_orbit_time = 0.0;
+   std::vector<glm::vec4> m_debris;
+   input_latch_t::sample_t m_input;
+   bool                   m_late_latch = true;
+   bool                   m_occlusion_culling = true;
+   bool                   m_wireframe = false;
+   bool                   m_depth_prepass = false;
+   int                    m_msaa_samples = 1;
+};
+
+// note: one recorded draw, built per frame in the frame arena and sorted so
+//       draws sharing a program and texture are submitted back to back
+struct draw_packet_t {
+   uint64_t          m_sort_key = 0;
+   uint32_t          m_body = 0;
+   texture_handle_t  m_texture;
+   shader_program_t *m_program = nullptr;
+};
+
+// note: input-to-present latency of frames that showed new input
+struct input_latency_t {
+   int   m_frames = 0;
+   float m_total_ms = 0.0f;
+   float m_max_ms = 0.0f;
+};
 
 class application_t {
 public:
-   application_t();
+   static constexpr uint32_t default_asteroid_count = 20000;
+   static constexpr uint32_t default_particle_count = 262144;
+
+   explicit application_t(const uint32_t asteroid_count = default_asteroid_count,
+                          const uint32_t particle_count = default_particle_count);
+   ~application_t();
 
    // note: enter/exit
    bool on_initialize();
    bool makeObjects();
+   void makeScene();
    bool setTextures();
-   void putTexturesInVector();
    void on_shutdown();
 
    // note: mainloop
    bool on_update(const timespan_t &deltatime,
                   const timespan_t &apptime);
+   void on_interpolate(const float alpha);
+   void on_snapshot(const viewport_t &viewport, render_snapshot_t &snapshot);
    void on_render(const viewport_t &viewport);
 
-   void renderObject(glm::mat4& projection, unsigned int iterator);
+   // note: only touches gpu state and the snapshot, safe to call from a render thread
+   void on_render(const render_snapshot_t &snapshot);
+   void on_present(const timespan_t &present_time);
+   const gpu_profiler_t &gpu_profiler() const;
+
+   void renderObject(const render_snapshot_t &snapshot, const draw_packet_t &packet, depth_stencil_state_t &depth_stencil_state);
+   void renderDepthPrepass(const render_snapshot_t &snapshot, const draw_packet_t *packets, const size_t count);
+   void renderOcclusionProxies(const render_snapshot_t &snapshot);
+   void renderSkybox(const render_snapshot_t &snapshot);
+   void render_asteroids(const render_snapshot_t &snapshot);
 
    // note: events
    void on_event(const mouse_moved_t &event);
@@ -31,37 +89,127 @@ public:
    void on_event(const button_released_t &event);
 
 private:
-   bool make_cube(vertex_buffer_t &buffer, vertex_layout_t &layout, int &primitive_count, float size);
+   struct body_t {
+      uint32_t m_orbit_node = scene_graph_t::invalid_node;
+      uint32_t m_anchor_node = scene_graph_t::invalid_node;
+      uint32_t m_body_node = scene_graph_t::invalid_node;
+      uint32_t m_light_ring_node = scene_graph_t::invalid_node;
+      float    m_orbit_speed = 0.0f;
+      float    m_spin_speed = 0.0f;
+      float    m_orbit_angle = 0.0f;
+      float    m_spin_angle = 0.0f;
+      float    m_previous_orbit_angle = 0.0f;
+      float    m_previous_spin_angle = 0.0f;
+      float    m_emissive = 0.0f;
+      // note: owned by the render side, the rest by the simulation side
+      occlusion_query_t m_query;
+   };
+
+   // note: a point light that follows a scene node
+   struct light_t {
+      uint32_t      m_node = scene_graph_t::invalid_node;
+      point_light_t m_light;
+   };
+
+   bool make_cube(vertex_buffer_handle_t &buffer, vertex_layout_t &layout, int &primitive_count, float size);
+   bool make_belt();
+   static glm::mat4 camera_view(const input_latch_t::sample_t &input, const viewport_t &viewport);
+
+   // note: furthest the cursor can turn the camera from straight ahead, radians
+   static constexpr float camera_max_yaw = 0.3f;
+   static constexpr float camera_max_pitch = 0.2f;
 
 private:
+   listener_id_t m_listeners[5] = {};
    bool       m_running = true;
    renderer_t m_renderer;
 
    // note: for testing
-   shader_program_t m_program;
-   texture_t        m_textureSun;
-   texture_t        m_textureMercury;
-   texture_t        m_textureVenus;
-   texture_t        m_textureEarth;
-   texture_t        m_textureMoon;
-   texture_t        m_textureMars;
-   texture_t        m_textureJupiter;
-   texture_t        m_textureSaturn;
-   texture_t        m_textureUranus;
-   texture_t        m_textureNeptune;
-   std::vector<texture_t> m_textures;
-   sampler_state_t  m_sampler;
-   std::vector<vertex_buffer_t> m_objects;
-   vertex_buffer_t  m_cube;
+   shader_library_t m_shaders;
+   shader_program_t *m_program = nullptr;
+   shader_program_t *m_wireframe_program = nullptr;
+   shader_program_t *m_depth_only_program = nullptr;
+   shader_program_t *m_skybox_program = nullptr;
+   shader_program_t *m_asteroid_program = nullptr;
+   resource_manager_t m_resources;
+   texture_handle_t m_textureStars;
+   std::vector<texture_handle_t> m_textures;
+   sampler_handle_t m_sampler;
+   std::vector<vertex_buffer_handle_t> m_objects;
+   vertex_buffer_handle_t m_cube;
    vertex_layout_t  m_layout;
    
    blend_state_t    m_blend_state;
    depth_stencil_state_t m_depth_stencil_state;
    rasterizer_state_t m_rasterizer_state;
 
+   // note: bounding proxies are depth tested only, nothing is written
+   blend_state_t    m_proxy_blend_state;
+   depth_stencil_state_t m_proxy_depth_stencil_state;
+   rasterizer_state_t m_proxy_rasterizer_state;
+
+   // note: optional depth-only pass, the shading pass then only runs the
+   //       fragment shader where depth is equal to the nearest surface
+   blend_state_t    m_prepass_blend_state;
+   depth_stencil_state_t m_prepass_depth_stencil_state;
+   depth_stencil_state_t m_equal_depth_stencil_state;
+   bool             m_depth_prepass = false;
+
+   // note: fragments shaded and gpu time of the opaque bodies, indexed by depth pre-pass off/on
+   fragment_counter_t m_fragment_counters[2];
+
+   // note: the skybox is drawn last at far depth, only uncovered pixels are shaded
+   sampler_handle_t m_skybox_sampler;
+   depth_stencil_state_t m_skybox_depth_stencil_state;
+   rasterizer_state_t m_skybox_rasterizer_state;
+   bool             m_occlusion_culling = true;
+   bool             m_wireframe = false;
+   bool             m_late_latch = true;
+   int              m_msaa_samples = 1;
+
+   // note: written by on_event, read again right before the view is submitted
+   input_latch_t    m_input_latch;
+   timespan_t       m_frame_input_time;
+   timespan_t       m_last_input_time;
+   bool             m_frame_input_latched = false;
+   input_latency_t  m_input_latency[2];
+   glm::mat4        m_view{ 1.0f };
+
    int              m_cube_primitive_count = 0;
    unsigned int     iterator = 0;
-   glm::vec3        m_position;
-   glm::vec3        m_rotation;
-   glm::mat4        m_world;
+   scene_graph_t    m_scene;
+   uint32_t         m_root_node = scene_graph_t::invalid_node;
+   std::vector<body_t> m_bodies;
+   std::vector<light_t> m_lights;
+   uint64_t         m_frame = 0;
+   render_snapshot_t m_snapshot;
+
+   // note: the asteroid belt is on rails and evaluated straight into the mapped
+   //       instance buffer on the render side, only the debris swarm is integrated,
+   //       both are drawn as one instanced batch of cubes in the system frame
+   kepler_orbits_t  m_asteroids;
+   nbody_system_t   m_debris;
+   uint32_t         m_asteroid_count = 0;
+   double           m_orbit_time = 0.0;
+   double           m_previous_orbit_time = 0.0;
+   double           m_interpolated_orbit_time = 0.0;
+   float            m_step_seconds = 0.0f;
+   float            m_debris_offset = 0.0f;
+   vertex_buffer_handle_t m_instances;
+   vertex_layout_t  m_instance_layout;
+
+   // note: the corona is simulated on the gpu and stepped with the snapshot
+   //       time on the render side, drawn additively after the skybox
+   particle_system_t m_corona;
+   uint32_t         m_particle_count = 0;
+   double           m_corona_time = -1.0;
+   blend_state_t    m_particle_blend_state;
+   depth_stencil_state_t m_particle_depth_stencil_state;
+   rasterizer_state_t m_particle_rasterizer_state;
+
+   // note: lights are binned into view space clusters every frame on the render side
+   light_clusters_t m_light_clusters;
+
+   // note: render side scratch memory, everything in it lives for one frame
+   linear_arena_t   m_frame_arena;
 };
@@ -0,0 +1,209 @@
+// capture.hpp
+
+#pragma once
+
+#include "graphics.hpp"
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+// note: while a capture is active every renderer_t call and every gpu resource
+//       created, updated or destroyed (with its data) is appended to a binary
+//       stream, render_replay_t plays that stream back through a renderer_t of
+//       its own, so the same workload can be submitted again and again without
+//       any of the application logic that produced it
+//
+//       stream layout, native endianness:
+//         header - magic, version, framebuffer size
+//         commands - one byte opcode followed by its arguments, resources are
+//                    referred to by the gl name they had while capturing,
+//                    uniform and marker names are sent once and then by index
+//
+//       only one capture can be active and it has to be fed from the thread
+//       that owns the gl context
+struct render_capture_t {
+   static constexpr uint32_t version = 1;
+   static constexpr uint32_t max_names = 1024;
+   static constexpr uint32_t max_name_bytes = 32 * 1024;
+   static constexpr size_t   buffer_size = 1 << 20;
+
+   render_capture_t() = default;
+
+   // note: nullptr unless a capture is running
+   static render_capture_t *active();
+
+   bool begin(const std::string_view &filename, const int width, const int height);
+   void end();
+
+   void begin_frame();
+   void end_frame();
+   void clear(const color_t &color, const float depth);
+   void set_viewport(const viewport_t &viewport);
+   void set_render_target(const render_target_t *target);
+   void resolve_render_target(const render_target_t &source, const render_target_t *destination, const viewport_t &viewport);
+   void invalidate_render_target(const render_target_t &target, const bool color, const bool depth);
+   void acquire_render_target(const render_target_t::desc_t &desc, const render_target_t *target);
+   void release_render_target(const render_target_t &target);
+
+   void create_program(const uint32_t id,
+                       const std::string_view &vertex_source,
+                       const std::string_view &fragment_source,
+                       const std::span<const char *const> feedback_varyings);
+   void destroy_program(const uint32_t id);
+   void set_shader_program(const shader_program_t &program);
+   void set_uniform(const std::string_view &name, const int value);
+   void set_uniform(const std::string_view &name, const glm::vec3 &value);
+   void set_uniform(const std::string_view &name, const glm::vec4 &value);
+   void set_uniform(const std::string_view &name, const glm::mat4 &value);
+
+   void create_texture(const texture_t &texture, const void *data, const bool mipmap);
+   void create_texture_cube(const texture_t &texture, const void *const faces[cubemap_image_t::face_count], const bool mipmap);
+   void update_texture(const texture_t &texture, const void *data);
+   void update_texture_cube(const texture_t &texture, const void *const faces[cubemap_image_t::face_count]);
+   void destroy_texture(const uint32_t id);
+   void set_texture(const texture_t &texture, const int unit);
+
+   void create_sampler_state(const uint32_t id,
+                             const sampler_state_t::filter_mode_t filter,
+                             const sampler_state_t::address_mode_t address_u,
+                             const sampler_state_t::address_mode_t address_v,
+                             const sampler_state_t::address_mode_t address_w);
+   void destroy_sampler_state(const uint32_t id);
+   void set_sampler_state(const sampler_state_t &sampler, const int unit);
+
+   void create_vertex_buffer(const vertex_buffer_t &buffer, const void *data);
+   void update_vertex_buffer(const vertex_buffer_t &buffer, const void *data, const size_t size);
+   void destroy_vertex_buffer(const uint32_t id);
+   void set_vertex_buffer_and_layout(const vertex_buffer_t &buffer, const vertex_layout_t &layout);
+
+   // note: mapped vertex buffers are written into a staging copy instead, unmap
+   //       uploads it with update() which records the contents
+   void *map_staging(const size_t size);
+   const void *staging() const;
+   size_t unmap_staging();
+
+   void create_texture_buffer(const texture_buffer_t &buffer, const texture_buffer_t::format_t format);
+   void update_texture_buffer(const texture_buffer_t &buffer, const void *data, const size_t size);
+   void destroy_texture_buffer(const uint32_t id);
+   void set_texture_buffer(const texture_buffer_t &buffer, const int unit);
+
+   void set_blend_state(const blend_state_t &state);
+   void set_depth_stencil_state(const depth_stencil_state_t &state);
+   void set_rasterizer_state(const rasterizer_state_t &state);
+   void draw(const topology_t topology, const int start, const int count);
+   void draw_instanced(const topology_t topology, const int start, const int count, const int instances);
+   void begin_transform_feedback(const vertex_buffer_t &buffer, const topology_t topology);
+   void end_transform_feedback();
+
+   void create_occlusion_query(const uint32_t id);
+   void destroy_occlusion_query(const uint32_t id);
+   void begin_occlusion_query(const occlusion_query_t &query);
+   void end_occlusion_query();
+   void begin_conditional_render(const occlusion_query_t &query);
+   void end_conditional_render();
+
+   void create_fragment_counter(const uint32_t id);
+   void destroy_fragment_counter(const uint32_t id);
+   void begin_fragment_count(const fragment_counter_t &counter);
+   void end_fragment_count();
+
+   void begin_gpu_marker(const char *name);
+   void end_gpu_marker();
+
+private:
+   void command(const uint8_t opcode);
+   void write(const void *data, const size_t size);
+   void write_string(const std::string_view &value);
+   template <typename T> void write(const T &value) { write(&value, sizeof(T)); }
+   uint16_t name_index(const std::string_view &name);
+   void flush();
+
+   // note: logs once, stops writing and has end() remove the file
+   template <typename... Args> void fail(const char *format, const Args &...args);
+
+public:
+   struct name_slot_t {
+      uint32_t m_hash = 0;
+      uint32_t m_offset = 0;
+      uint16_t m_length = 0;
+      uint16_t m_index = 0;
+      bool     m_used = false;
+   };
+
+   std::string          m_filename;
+   FILE                *m_file = nullptr;
+   bool                 m_failed = false;
+   std::vector<uint8_t> m_buffer;
+   std::vector<uint8_t> m_staging;
+   size_t               m_staging_size = 0;
+   bool                 m_staging_mapped = false;
+   name_slot_t          m_names[max_names * 2];
+   char                 m_name_bytes[max_name_bytes];
+   uint32_t             m_name_count = 0;
+   uint32_t             m_name_bytes_used = 0;
+   uint64_t             m_commands = 0;
+   uint64_t             m_frames = 0;
+   uint64_t             m_bytes = 0;
+};
+
+// note: plays a capture back, the whole stream is loaded up front so no file
+//       access happens while replaying, commands before the first frame create
+//       the initial resources and run once, play_frame() then submits one
+//       captured frame per call and rewind() starts over at the first frame
+struct render_replay_t {
+   render_replay_t() = default;
+
+   bool load(const std::string_view &filename);
+   void destroy();
+
+   // note: runs everything up to the first frame, needs a current gl context
+   bool prepare(renderer_t &renderer);
+   bool play_frame(renderer_t &renderer);
+   void rewind();
+
+   int width() const { return m_width; }
+   int height() const { return m_height; }
+   uint64_t frame_count() const { return m_frame_count; }
+
+private:
+   bool execute(renderer_t &renderer, const uint8_t opcode);
+   bool read(void *data, const size_t size);
+   template <typename T> bool read(T &value) { return read(&value, sizeof(T)); }
+   bool read_view(const uint8_t *&data, const size_t size);
+   bool read_string(std::string_view &value);
+
+   template <typename T>
+   static T *find(std::vector<std::unique_ptr<T>> &objects, const uint32_t id);
+   template <typename T>
+   static T &emplace(std::vector<std::unique_ptr<T>> &objects, const uint32_t id);
+
+public:
+   std::vector<uint8_t> m_stream;
+   size_t               m_cursor = 0;
+   size_t               m_first_frame = 0;
+   bool                 m_failed = false;
+   int32_t              m_width = 0;
+   int32_t              m_height = 0;
+   uint64_t             m_frame_count = 0;
+   uint64_t             m_commands = 0;
+   uint64_t             m_draws = 0;
+
+   // note: indexed by the gl name each object had while capturing
+   std::vector<std::unique_ptr<shader_program_t>>   m_programs;
+   std::vector<std::unique_ptr<texture_t>>          m_textures;
+   std::vector<std::unique_ptr<sampler_state_t>>    m_samplers;
+   std::vector<std::unique_ptr<vertex_buffer_t>>    m_vertex_buffers;
+   std::vector<std::unique_ptr<texture_buffer_t>>   m_texture_buffers;
+   std::vector<std::unique_ptr<occlusion_query_t>>  m_occlusion_queries;
+   std::vector<std::unique_ptr<fragment_counter_t>> m_fragment_counters;
+   std::vector<render_target_t *>                   m_render_targets;
+   std::vector<texture_t *>                         m_target_textures;
+   std::vector<std::string>                         m_names;
+
+   blend_state_t         m_blend_state;
+   depth_stencil_state_t m_depth_stencil_state;
+   rasterizer_state_t    m_rasterizer_state;
+   vertex_layout_t       m_layout;
+};
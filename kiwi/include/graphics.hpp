@@ -2,11 +2,20 @@
 
 #pragma once
 
+#include "memory.hpp"
+
 #include <cstdint>
 #include <vector>
 #include <string_view>
+#include <span>
+#include <memory>
 #include <glm/glm.hpp>
 
+// note: loads entry points beyond opengl v3.3 core when the driver exposes them,
+//       call once after gladLoadGLLoader with the same loader
+using opengl_loader_t = void *(*)(const char *name);
+void load_opengl_extensions(opengl_loader_t loader);
+
 struct color_t {
    float r = 0.0f;
    float g = 0.0f;
@@ -21,6 +30,30 @@ struct viewport_t {
    int height = 0;
 };
 
+struct program_cache_stats_t {
+   int   m_hits = 0;
+   int   m_misses = 0;
+   int   m_rejected = 0;
+   float m_load_ms = 0.0f;
+   float m_compile_ms = 0.0f;
+};
+
+// note: linked program binaries kept on disk between runs, keyed by the sources 
+//       and the driver identity, disabled when the driver has no binary formats
+struct program_cache_t {
+   program_cache_t() = delete;
+
+   static void set_directory(const std::string_view &path);
+   static bool enabled();
+   static uint64_t make_key(const std::string_view &vertex_source,
+                            const std::string_view &fragment_source,
+                            const std::span<const char *const> feedback_varyings = {});
+   static uint32_t load(const uint64_t key);
+   static void save(const uint64_t key, const uint32_t program);
+   static void discard(const uint64_t key);
+   static program_cache_stats_t &stats();
+};
+
 struct shader_program_t {
    struct uniform_t {
       int32_t  m_location;
@@ -31,15 +64,72 @@ struct shader_program_t {
 
    shader_program_t() = default;
 
+   // note: 'feedback_varyings' are vertex shader outputs captured by transform
+   //       feedback, interleaved in that order into one buffer, they are part of
+   //       the link so they cannot be changed afterwards
    bool valid() const;
    bool create(const std::string_view &vertex_source,
-               const std::string_view &fragment_source);
+               const std::string_view &fragment_source,
+               const std::span<const char *const> feedback_varyings = {});
    bool create_from_file(const std::string_view &vertex_path,
                          const std::string_view &fragment_path);
    void destroy();
 
+   // note: issues compile and link without waiting for the driver, poll() returns
+   //       true once the program is finished (valid() tells if it succeeded)
+   bool create_async(const std::string_view &vertex_source,
+                     const std::string_view &fragment_source,
+                     const std::span<const char *const> feedback_varyings = {});
+   bool poll();
+   bool wait();
+   bool pending() const;
+
+private:
+   bool finalize();
+
+public:
    uint32_t               m_id = 0;
    std::vector<uniform_t> m_uniforms;
+
+   // note: link in flight, see create_async
+   uint32_t               m_pending_id = 0;
+   uint64_t               m_cache_key = 0;
+   int64_t                m_pending_start = 0;
+   int64_t                m_issue_duration = 0;
+   bool                   m_cache_hit = false;
+};
+
+// note: decoded pixels in system memory, decoding touches no gpu state so it
+//       may run on any thread, texture_t::create_from_image uploads them
+struct image_t {
+   image_t() = default;
+
+   bool valid() const;
+   bool load_from_file(const std::string_view &filename);
+   void destroy();
+
+   int32_t  m_width = 0;
+   int32_t  m_height = 0;
+   int32_t  m_components = 0;
+   uint8_t *m_pixels = nullptr;
+};
+
+// note: six square faces back to back in opengl order (+x, -x, +y, -y, +z, -z),
+//       built on the cpu from an equirectangular (longitude/latitude) image
+struct cubemap_image_t {
+   static constexpr int face_count = 6;
+
+   cubemap_image_t() = default;
+
+   bool valid() const;
+   bool create_from_equirect(const image_t &image, const int face_size);
+   void destroy();
+
+   const uint8_t *face(const int index) const;
+
+   int32_t  m_size = 0;
+   int32_t  m_components = 0;
+   uint8_t *m_pixels = nullptr;
 };
 
 struct texture_t {
@@ -52,6 +142,11 @@ struct texture_t {
       unknown,
    };
 
+   enum class type_t {
+      texture_2d,
+      cube,
+   };
+
    texture_t() = default;
 
    bool valid() const;
@@ -60,13 +155,31 @@ struct texture_t {
                const void *data,
                const pixel_format_t format,
                const bool mipmap = false);
+   bool create_cube(const int size,
+                    const void *const faces[cubemap_image_t::face_count],
+                    const pixel_format_t format,
+                    const bool mipmap = false);
+   bool create_from_image(const image_t &image,
+                          const bool mipmap = false);
+   bool create_from_cubemap(const cubemap_image_t &image,
+                            const bool mipmap = false);
    bool create_from_file(const std::string_view &filename, 
                          const bool mipmap = false);
    void destroy();
 
-   uint32_t m_id = 0;
-   int32_t  m_width = 0;
-   int32_t  m_height = 0;
+   // note: replace the contents in place, size and format stay as created,
+   //       mipmaps are regenerated when the texture has them
+   bool update(const void *data);
+   bool update_cube(const void *const faces[cubemap_image_t::face_count]);
+
+   static pixel_format_t pixel_format_for(const int components);
+
+   uint32_t       m_id = 0;
+   int32_t        m_width = 0;
+   int32_t        m_height = 0;
+   int32_t        m_levels = 0;
+   type_t         m_type = type_t::texture_2d;
+   pixel_format_t m_format = pixel_format_t::unknown;
 };
 
 struct sampler_state_t {
@@ -91,7 +204,8 @@ struct sampler_state_t {
    bool valid() const;
    bool create(const filter_mode_t filter = filter_mode_t::nearest,
                const address_mode_t address_u = address_mode_t::clamp_to_edge,
-               const address_mode_t address_v = address_mode_t::clamp_to_edge);
+               const address_mode_t address_v = address_mode_t::clamp_to_edge,
+               const address_mode_t address_w = address_mode_t::clamp_to_edge);
    void destroy();
 
    uint32_t m_id = 0;
@@ -101,6 +215,7 @@ struct vertex_buffer_t {
    enum class usage_hint_t {
       immutable,
       dynamic,
+      gpu_written,
    };
 
    vertex_buffer_t() = default;
@@ -108,9 +223,40 @@ struct vertex_buffer_t {
    bool valid() const;
    bool create(const size_t size, const void *data,
                const usage_hint_t usage = usage_hint_t::immutable);
+   bool update(const void *data, const size_t size);
    void destroy();
 
-   uint32_t m_id = 0;
+   // note: write only, the previous contents are orphaned so the driver never
+   //       waits for draws still reading them, unmap() before drawing from it
+   void *map(const size_t size);
+   void unmap();
+
+   uint32_t     m_id = 0;
+   size_t       m_size = 0;
+   usage_hint_t m_usage = usage_hint_t::immutable;
+};
+
+// note: a buffer object read as a 1d texture (samplerBuffer in glsl), for per-frame
+//       tables too large for uniforms, update() orphans the previous contents
+struct texture_buffer_t {
+   enum class format_t {
+      r16ui,
+      r32ui,
+      rg32ui,
+      rgba32f,
+      count,
+   };
+
+   texture_buffer_t() = default;
+
+   bool valid() const;
+   bool create(const size_t capacity, const format_t format);
+   bool update(const void *data, const size_t size);
+   void destroy();
+
+   uint32_t m_buffer_id = 0;
+   uint32_t m_texture_id = 0;
+   size_t   m_capacity = 0;
 };
 
 enum class attribute_type_t {
@@ -136,8 +282,15 @@ struct vertex_layout_t {
                         const uint32_t count,
                         const bool normalized);
 
+   // note: attributes added after this advance once per instance instead of per
+   //       vertex and start at shader location 'first_index', so the layout can be
+   //       bound next to a per-vertex one
+   vertex_layout_t &per_instance(const uint32_t first_index);
+
    uint32_t    m_stride = 0;
    uint32_t    m_count = 0;
+   uint32_t    m_first_index = 0;
+   uint32_t    m_divisor = 0;
    attribute_t m_attributes[max_vertex_attributes] = {};
 };
 
@@ -171,6 +324,7 @@ struct blend_state_t {
    blend_state_t() = default;
 
    bool             m_enabled = true;
+   bool             m_color_write = true;
    blend_equation_t m_color_eq = blend_equation_t::add;
    blend_factor_t   m_color_src = blend_factor_t::src_alpha;
    blend_factor_t   m_color_dest = blend_factor_t::one_minus_src_alpha;
@@ -225,6 +379,171 @@ struct rasterizer_state_t {
    polygon_mode_t m_polygon_mode = polygon_mode_t::fill;
 };
 
+struct render_target_t {
+   enum class color_format_t {
+      none,
+      rgba8,
+      rgba16f,
+   };
+
+   enum class depth_format_t {
+      none,
+      depth24_stencil8,
+      depth32f,
+   };
+
+   struct desc_t {
+      bool operator==(const desc_t &rhs) const = default;
+
+      int32_t        m_width = 0;
+      int32_t        m_height = 0;
+      int32_t        m_samples = 1;
+      color_format_t m_color_format = color_format_t::rgba8;
+      depth_format_t m_depth_format = depth_format_t::depth24_stencil8;
+   };
+
+   render_target_t() = default;
+
+   bool valid() const;
+   bool create(const desc_t &desc);
+   void destroy();
+
+   // note: multisampled targets use renderbuffers and have to be resolved,
+   //       single sampled color is a texture that can be sampled directly
+   uint32_t  m_id = 0;
+   uint32_t  m_color_renderbuffer = 0;
+   uint32_t  m_depth_renderbuffer = 0;
+   texture_t m_color_texture;
+   desc_t    m_desc;
+};
+
+struct render_target_pool_t {
+   // note: targets not acquired for this many frames are destroyed
+   static constexpr int64_t max_idle_frames = 8;
+   static constexpr uint32_t max_targets = 16;
+
+   struct entry_t {
+      render_target_t m_target;
+      int64_t         m_last_used = 0;
+      bool            m_in_use = false;
+   };
+
+   render_target_pool_t() = default;
+
+   render_target_t *acquire(const render_target_t::desc_t &desc, const int64_t frame_index);
+   void release(render_target_t *target);
+   void trim(const int64_t frame_index);
+   void destroy();
+
+   pool_t<entry_t>       m_pool;
+   std::vector<entry_t *> m_entries;
+};
+
+struct occlusion_query_t {
+   // note: number of frames a query result may be in flight before the slot is reused
+   static constexpr int latency = 3;
+
+   occlusion_query_t() = default;
+
+   bool valid() const;
+   bool create();
+   void destroy();
+
+   uint32_t m_ids[latency] = {};
+   int64_t  m_issued_frame[latency] = {};
+   int64_t  m_resolved_frame = -1;
+   int64_t  m_polled_frame = -1;
+   int      m_latest_slot = -1;
+   bool     m_visible = true;
+};
+
+struct occlusion_stats_t {
+   int m_tested = 0;
+   int m_resolved = 0;
+   int m_occluded = 0;
+   int m_pending = 0;
+};
+
+// note: counts fragment shader invocations of the draws between begin and end,
+//       falls back to samples passed when pipeline statistics are not supported,
+//       results are read back without stalling and summed per counter
+struct fragment_counter_t {
+   static constexpr int latency = 4;
+
+   fragment_counter_t() = default;
+
+   bool valid() const;
+   bool create();
+   void destroy();
+
+   uint32_t m_ids[latency] = {};
+   int64_t  m_issued_frame[latency] = {};
+   int64_t  m_polled_frame = -1;
+   uint64_t m_latest = 0;
+   uint64_t m_total = 0;
+   int64_t  m_resolved = 0;
+};
+
+struct gpu_profiler_t {
+   static constexpr int latency = 4;
+   static constexpr int max_markers = 32;
+   static constexpr int max_passes = 32;
+   static constexpr int history_size = 240;
+
+   struct marker_t {
+      const char *m_name;
+      int         m_depth;
+      bool        m_ended;
+   };
+
+   struct frame_t {
+      uint32_t m_query_ids[max_markers * 2] = {};
+      marker_t m_markers[max_markers] = {};
+      int      m_marker_count = 0;
+      int      m_last_query = -1;
+      int64_t  m_frame_index = -1;
+      bool     m_complete = false;
+   };
+
+   struct pass_t {
+      float latest() const;
+      float average() const;
+
+      const char *m_name = nullptr;
+      uint32_t    m_name_hash = 0;
+      int         m_depth = 0;
+      int         m_count = 0;
+      int64_t     m_frames[history_size] = {};
+      float       m_milliseconds[history_size] = {};
+   };
+
+   gpu_profiler_t() = default;
+
+   bool valid() const;
+   bool create();
+   void destroy();
+
+   void begin_frame(const int64_t frame_index);
+   void end_frame();
+   void begin(const char *name);
+   void end();
+
+   const pass_t *find(const std::string_view &name) const;
+   bool save_csv(const std::string_view &filename) const;
+
+private:
+   void collect();
+   void record(const marker_t &marker, const int64_t frame_index, const float milliseconds);
+
+public:
+   frame_t             m_frames[latency];
+   frame_t            *m_current = nullptr;
+   int                 m_open[max_markers] = {};
+   int                 m_open_count = 0;
+   int64_t             m_dropped_frames = 0;
+   std::vector<pass_t> m_passes;
+};
+
 enum class topology_t {
    point_list,
    line_list,
@@ -235,20 +554,102 @@ struct renderer_t {
    renderer_t();
    ~renderer_t();
 
+   void begin_frame();
+   void end_frame();
    void clear(const color_t &color, const float depth = 1.0f);
    void set_viewport(const viewport_t &viewport);
+
+   // note: nullptr selects the framebuffer that was bound when the frame began,
+   //       binding a target also sets the viewport to cover all of it
+   void set_render_target(render_target_t *target);
+   void resolve_render_target(render_target_t &source, render_target_t *destination, const viewport_t &viewport);
+   void invalidate_render_target(render_target_t &target, const bool color, const bool depth);
+
+   // note: transient targets are pooled and reused across frames, release them when done
+   render_target_t *acquire_render_target(const render_target_t::desc_t &desc);
+   void release_render_target(render_target_t *target);
+
    void set_shader_program(shader_program_t &program);
+   void set_uniform(const std::string_view &name, const int value);
    void set_uniform(const std::string_view &name, const glm::vec3 &value);
    void set_uniform(const std::string_view &name, const glm::vec4 &value);
    void set_uniform(const std::string_view &name, const glm::mat4 &value);
    void set_texture(texture_t &texture, const int unit = 0);
    void set_sampler_state(sampler_state_t &sampler, const int unit = 0);
+   void set_texture_buffer(texture_buffer_t &buffer, const int unit);
    void set_blend_state(blend_state_t &state);
    void set_depth_stencil_state(depth_stencil_state_t &state);
    void set_rasterizer_state(rasterizer_state_t &state);
+   // note: a per-vertex layout disables every location outside its own, bind
+   //       it before the per-instance layout that goes next to it
    void set_vertex_buffer_and_layout(vertex_buffer_t &buffer, vertex_layout_t &layout);
    void draw(const topology_t topology, const int start, const int count);
+   void draw_instanced(const topology_t topology, const int start, const int count, const int instances);
+
+   // note: draws in between write the current program's feedback varyings into
+   //       'buffer' instead of rasterizing them, 'topology' has to match those draws
+   void begin_transform_feedback(vertex_buffer_t &buffer, const topology_t topology);
+   void end_transform_feedback();
+
+   // note: occlusion queries are read back asynchronously, a draw wrapped in
+   //       conditional rendering uses the most recent issued query and never waits for it
+   bool begin_occlusion_query(occlusion_query_t &query);
+   void end_occlusion_query();
+   void begin_conditional_render(occlusion_query_t &query);
+   void end_conditional_render();
+   const occlusion_stats_t &occlusion_stats() const;
+
+   // note: one counter may be active at a time, it does not nest with occlusion queries
+   bool begin_fragment_count(fragment_counter_t &counter);
+   void end_fragment_count();
+   bool fragment_invocations_supported() const;
+
+   // note: gpu timings are resolved 'latency' frames later without stalling,
+   //       marker names must outlive the profiler (string literals)
+   void begin_gpu_marker(const char *name);
+   void end_gpu_marker();
+   const gpu_profiler_t &gpu_profiler() const;
+
+   // note: every frame ends with a fence, completed_frame() is the newest frame
+   //       the gpu is known to have finished, resources last used in it or
+   //       earlier can be destroyed or reused without stalling
+   static constexpr int64_t max_frames_in_flight = 4;
+   int64_t frame_index() const;
+   int64_t completed_frame() const;
+
+private:
+   void poll_occlusion_query(occlusion_query_t &query);
+   void poll_fragment_counter(fragment_counter_t &counter);
+   void poll_frame_fences(const int64_t wait_for_frame);
 
 private:
    shader_program_t *m_program = nullptr;
+   render_target_t  *m_render_target = nullptr;
+   uint32_t          m_default_framebuffer = 0;
+   render_target_pool_t m_render_target_pool;
+   int64_t           m_frame_index = 0;
+   bool              m_occlusion_query_active = false;
+   bool              m_conditional_render_active = false;
+   bool              m_fragment_count_active = false;
+   bool              m_transform_feedback_active = false;
+   uint32_t          m_enabled_attributes = 0;
+   occlusion_stats_t m_occlusion_stats;
+   gpu_profiler_t    m_gpu_profiler;
+   void             *m_frame_fences[max_frames_in_flight] = {};
+   int64_t           m_completed_frame = 0;
+};
+
+struct gpu_scope_t {
+   gpu_scope_t(renderer_t &renderer, const char *name) 
+      : m_renderer(renderer)
+   {
+      m_renderer.begin_gpu_marker(name);
+   }
+
+   ~gpu_scope_t()
+   {
+      m_renderer.end_gpu_marker();
+   }
+
+   renderer_t &m_renderer;
 };
@@ -0,0 +1,23 @@
+// headless.hpp
+
+#pragma once
+
+#include "graphics.hpp"
+
+// note: opengl 3.3 core context without a visible window, rendering into an
+//       offscreen framebuffer. uses egl (surfaceless or pbuffer) on linux so it
+//       runs on mesa llvmpipe, and a hidden glfw window everywhere else
+struct headless_context_t {
+   headless_context_t() = default;
+
+   bool valid() const;
+   bool create(const int width, const int height);
+   void destroy();
+
+   void *m_display = nullptr;
+   void *m_context = nullptr;
+   void *m_surface = nullptr;
+   void *m_window = nullptr;
+
+   render_target_t m_target;
+};
@@ -0,0 +1,127 @@
+// jobs.hpp
+
+#pragma once
+
+#include <new>
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <type_traits>
+
+#pragma warning(push)
+#pragma warning(disable: 4324) // structure was padded due to alignment specifier
+// note: one unit of work with its callable stored inline, so creating a job
+//       never allocates, 'm_unfinished' counts the job itself plus every
+//       child that has not finished yet
+struct alignas(64) job_t {
+   static constexpr size_t max_data_size = 96;
+   using function_t = void (*)(job_t &job);
+
+   function_t           m_function = nullptr;
+   job_t               *m_parent = nullptr;
+   std::atomic<int32_t> m_unfinished = 0;
+   alignas(16) uint8_t  m_data[max_data_size];
+};
+
+// note: fixed size chase-lev deque, the owning worker pushes and pops at the
+//       bottom (lifo, cache warm) while other threads steal from the top
+class job_deque_t {
+public:
+   static constexpr int64_t capacity = 4096;
+   static constexpr int64_t mask = capacity - 1;
+
+   job_deque_t() = default;
+
+   bool push(job_t *job);
+   job_t *pop();
+   job_t *steal();
+
+private:
+   alignas(64) std::atomic<int64_t> m_top = 0;
+   alignas(64) std::atomic<int64_t> m_bottom = 0;
+   std::atomic<job_t *>             m_jobs[capacity] = {};
+};
+#pragma warning(pop)
+
+// note: a job handle is the job itself, valid until the creating thread has
+//       made another 'max_jobs_per_thread' jobs
+using job_handle_t = job_t *;
+
+struct job_worker_stats_t {
+   uint64_t m_executed = 0;
+   uint64_t m_stolen = 0;
+   float    m_utilization = 0.0f;
+};
+
+// note: one worker per core, the thread calling initialize() is worker 0 and
+//       only works while it waits, jobs run() from threads that are not
+//       workers go to a shared queue the workers take from before stealing,
+//       and those threads help out while they wait like workers do
+class job_system_t {
+public:
+   static constexpr int      max_workers = 64;
+   static constexpr uint32_t max_jobs_per_thread = 4096;
+
+   job_system_t() = delete;
+
+   // note: zero workers means one per hardware thread
+   static bool initialize(const int worker_count = 0);
+   static void shutdown();
+   static int worker_count();
+
+   template <typename F>
+   static job_handle_t create(F &&function, job_handle_t parent = nullptr)
+   {
+      using callable_t = std::decay_t<F>;
+      static_assert(sizeof(callable_t) <= job_t::max_data_size, "job callable too large, capture by reference");
+      static_assert(alignof(callable_t) <= 16, "job callable alignment too strict");
+
+      job_t *job = allocate(parent);
+      new (job->m_data) callable_t(std::forward<F>(function));
+      job->m_function = [](job_t &job) {
+         callable_t *callable = std::launder(reinterpret_cast<callable_t *>(job.m_data));
+         (*callable)();
+         callable->~callable_t();
+      };
+
+      return job;
+   }
+
+   // note: children have to be run before their parent is waited on
+   static void run(job_handle_t job);
+   static bool finished(const job_handle_t job);
+
+   // note: executes other jobs until 'job' and all its children are done
+   static void wait(job_handle_t job);
+
+   // note: calls function(begin, end) over [0, count) in batches of at least
+   //       'batch_size' and returns once every batch is done
+   template <typename F>
+   static void parallel_for(const uint32_t count, const uint32_t batch_size, F &&function)
+   {
+      const uint32_t batches = batch_count(count, batch_size);
+      if (batches <= 1) {
+         if (count > 0) {
+            function(0u, count);
+         }
+         return;
+      }
+
+      const uint32_t batch = (count + batches - 1) / batches;
+      job_handle_t root = create([] {});
+      for (uint32_t begin = 0; begin < count; begin += batch) {
+         const uint32_t end = begin + batch < count ? begin + batch : count;
+         run(create([&function, begin, end] { function(begin, end); }, root));
+      }
+
+      run(root);
+      wait(root);
+   }
+
+   static job_worker_stats_t stats(const int worker);
+   static void reset_stats();
+
+private:
+   static job_t *allocate(job_handle_t parent);
+   static uint32_t batch_count(const uint32_t count, const uint32_t batch_size);
+};
@@ -0,0 +1,76 @@
+// lighting.hpp
+
+#pragma once
+
+#include "graphics.hpp"
+
+#include <glm/glm.hpp>
+
+struct linear_arena_t;
+
+// note: world space, the contribution fades out smoothly at 'm_radius'
+struct point_light_t {
+   glm::vec3 m_position{ 0.0f };
+   float     m_radius = 1.0f;
+   glm::vec3 m_color{ 1.0f };
+   float     m_intensity = 1.0f;
+};
+
+struct light_cluster_stats_t {
+   uint32_t m_lights = 0;
+   uint32_t m_indices = 0;
+   uint32_t m_max_per_cluster = 0;
+   uint32_t m_overflowed = 0;
+};
+
+// note: clustered forward lighting, the view frustum is split into screen tiles
+//       and exponential depth slices, every frame the lights are binned into the
+//       clusters they touch on the cpu and the fragment shader only loops over
+//       the lights of its own cluster
+//
+//       gpu layout, all texture buffers:
+//         lights  - rgba32f, two texels per light: position + radius, color + intensity
+//         grid    - rg32ui, one texel per cluster: first index, index count
+//         indices - r16ui, light indices of all clusters back to back
+struct light_clusters_t {
+   static constexpr uint32_t tiles_x = 16;
+   static constexpr uint32_t tiles_y = 9;
+   static constexpr uint32_t slices = 24;
+   static constexpr uint32_t cluster_count = tiles_x * tiles_y * slices;
+   static constexpr uint32_t max_lights = 1024;
+   static constexpr uint32_t max_lights_per_cluster = 128;
+
+   light_clusters_t() = default;
+
+   bool create();
+   void destroy();
+
+   // note: cpu only, spread over the job system one batch of depth slices per
+   //       job, temporaries come from 'arena' and have to live until upload()
+   void bin(const point_light_t *lights,
+            const uint32_t count,
+            const glm::mat4 &view,
+            const glm::mat4 &projection,
+            const viewport_t &viewport,
+            linear_arena_t &arena);
+   void upload();
+
+   // note: binds the three tables to consecutive texture units starting at 'first_unit'
+   //       and sets the uniforms the lighting shader code expects
+   void bind(renderer_t &renderer, const int first_unit);
+
+   const light_cluster_stats_t &stats() const { return m_stats; }
+
+   texture_buffer_t m_light_buffer;
+   texture_buffer_t m_grid_buffer;
+   texture_buffer_t m_index_buffer;
+
+   // note: results of the last bin(), owned by the arena passed to it
+   const point_light_t *m_lights = nullptr;
+   const uint32_t      *m_grid = nullptr;
+   const uint16_t      *m_indices = nullptr;
+   viewport_t           m_viewport;
+   float                m_znear = 1.0f;
+   float                m_zfar = 100.0f;
+   light_cluster_stats_t m_stats;
+};
@@ -0,0 +1,167 @@
+// memory.hpp
+
+#pragma once
+
+#include <new>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace memory
+{
+   // note: every global operator new/delete is counted, process wide
+   struct heap_stats_t {
+      uint64_t m_allocations = 0;
+      uint64_t m_frees = 0;
+      uint64_t m_allocated_bytes = 0;
+   };
+
+   heap_stats_t heap_stats();
+} // !memory
+
+// note: bump allocator over a chain of blocks, nothing is freed individually,
+//       reset() releases everything at once and folds the chain into a single
+//       block sized for the peak, so a steady workload stops touching the heap
+struct linear_arena_t {
+   struct block_t {
+      block_t *m_previous;
+      size_t   m_size;
+      size_t   m_used;
+   };
+
+   struct marker_t {
+      block_t *m_block = nullptr;
+      size_t   m_used = 0;
+   };
+
+   linear_arena_t() = default;
+   ~linear_arena_t();
+
+   linear_arena_t(const linear_arena_t &) = delete;
+   linear_arena_t &operator=(const linear_arena_t &) = delete;
+
+   bool create(const size_t block_size);
+   void destroy();
+
+   void *allocate(const size_t size, const size_t alignment = alignof(std::max_align_t));
+   void reset();
+
+   // note: for scoped scratch use, rewinding frees blocks added since mark()
+   marker_t mark() const;
+   void rewind(const marker_t &marker);
+
+   size_t used() const;
+   size_t peak() const;
+   size_t capacity() const;
+
+   // note: storage only, nothing is constructed nor ever destroyed
+   template <typename T>
+   T *allocate_array(const size_t count)
+   {
+      static_assert(std::is_trivially_destructible_v<T>, "arena memory is never destructed");
+      return static_cast<T *>(allocate(sizeof(T) * count, alignof(T)));
+   }
+
+   block_t *m_current = nullptr;
+   size_t   m_block_size = 0;
+   size_t   m_used = 0;
+   size_t   m_peak = 0;
+};
+
+// note: fixed number of fixed size slots threaded on a free list, allocate()
+//       returns nullptr when full rather than growing
+template <typename T>
+struct pool_t {
+   pool_t() = default;
+   ~pool_t() { destroy(); }
+
+   pool_t(const pool_t &) = delete;
+   pool_t &operator=(const pool_t &) = delete;
+
+   bool create(const uint32_t capacity)
+   {
+      destroy();
+
+      m_slots = static_cast<slot_t *>(::operator new(sizeof(slot_t) * capacity, std::align_val_t(alignof(slot_t))));
+      m_capacity = capacity;
+      for (uint32_t index = 0; index < capacity; index++) {
+         m_slots[index].m_next = index + 1 < capacity ? &m_slots[index + 1] : nullptr;
+      }
+      m_free = capacity > 0 ? &m_slots[0] : nullptr;
+
+      return m_slots != nullptr;
+   }
+
+   void destroy()
+   {
+      // note: objects still alive would be leaked without their destructor
+      assert(m_count == 0);
+      ::operator delete(m_slots, std::align_val_t(alignof(slot_t)));
+      m_slots = nullptr;
+      m_free = nullptr;
+      m_capacity = 0;
+      m_count = 0;
+   }
+
+   template <typename... Args>
+   T *allocate(Args &&...args)
+   {
+      if (m_free == nullptr) {
+         return nullptr;
+      }
+
+      slot_t *slot = m_free;
+      m_free = slot->m_next;
+      m_count++;
+
+      return new (slot->m_storage) T(static_cast<Args &&>(args)...);
+   }
+
+   void release(T *object)
+   {
+      if (object == nullptr) {
+         return;
+      }
+
+      object->~T();
+
+      slot_t *slot = reinterpret_cast<slot_t *>(object);
+      slot->m_next = m_free;
+      m_free = slot;
+      m_count--;
+   }
+
+   uint32_t count() const { return m_count; }
+   uint32_t capacity() const { return m_capacity; }
+
+private:
+   union slot_t {
+      slot_t *m_next;
+      alignas(T) unsigned char m_storage[sizeof(T)];
+   };
+
+   slot_t  *m_slots = nullptr;
+   slot_t  *m_free = nullptr;
+   uint32_t m_capacity = 0;
+   uint32_t m_count = 0;
+};
+
+// note: per-thread arena for load-time temporaries (file contents, decode
+//       buffers), whatever is allocated inside a scope is dropped on exit,
+//       the outermost scope keeps up to 'retained_size' bytes for the next
+//       one and hands anything bigger (e.g. a decoded texture) back
+struct scratch_scope_t {
+   static constexpr size_t retained_size = 1024 * 1024;
+
+   scratch_scope_t();
+   ~scratch_scope_t();
+
+   scratch_scope_t(const scratch_scope_t &) = delete;
+   scratch_scope_t &operator=(const scratch_scope_t &) = delete;
+
+   linear_arena_t &arena() const { return m_arena; }
+
+   linear_arena_t          &m_arena;
+   linear_arena_t::marker_t m_marker;
+};
@@ -0,0 +1,94 @@
+// orbits.hpp
+
+#pragma once
+
+#include "orbits_kernels.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// note: classical elements of an orbit around the central mass, angles in
+//       radians, the reference plane is xz with +y up like the scene
+struct kepler_elements_t {
+   float m_semi_major_axis = 1.0f;
+   float m_eccentricity = 0.0f;
+   float m_inclination = 0.0f;
+   float m_ascending_node = 0.0f;
+   float m_argument_of_periapsis = 0.0f;
+   float m_mean_anomaly = 0.0f;
+};
+
+// note: on-rails bodies, a position is a pure function of time so nothing is
+//       integrated and the elements never change after add(), evaluate() may
+//       run on the render side while the simulation side only advances time
+//
+//       storage is structure-of-arrays padded to the widest simd kernel, the orbit
+//       plane is baked into two axes p and q:
+//         position = a * (cos E - e) * p + b * sin E * q
+//       where E solves kepler's equation M = E - e * sin E
+struct kepler_orbits_t {
+   static constexpr int solver_iterations = orbit_kernels::solver_iterations;
+
+   kepler_orbits_t() = default;
+
+   // note: 'gm' is the gravitational parameter of the central mass
+   bool create(const uint32_t capacity, const float gm);
+   void destroy();
+
+   uint32_t add(const kepler_elements_t &elements, const float size);
+   uint32_t count() const { return m_count; }
+
+   // note: writes one xyzw per body, xyz position and w the size given to
+   //       add(), spread over the job system, 'output' may be mapped gpu memory
+   //       evaluate_range() needs 'begin' to be a multiple of orbit_kernels::max_lane_width
+   void evaluate(const double time, float *output) const;
+   void evaluate_range(const double time, const uint32_t begin, const uint32_t end, float *output) const;
+
+   float    m_gm = 1.0f;
+   uint32_t m_count = 0;
+   uint32_t m_capacity = 0;
+
+   std::vector<float> m_mean_motion;
+   std::vector<float> m_mean_anomaly;
+   std::vector<float> m_eccentricity;
+   std::vector<float> m_semi_major;
+   std::vector<float> m_semi_minor;
+   std::vector<float> m_px, m_py, m_pz;
+   std::vector<float> m_qx, m_qy, m_qz;
+   std::vector<float> m_size;
+};
+
+// note: dynamic bodies under the central mass plus their mutual gravity,
+//       direct o(n^2) summation with plummer softening, integrated with
+//       kick-drift-kick leapfrog which keeps orbits from spiraling over time
+struct nbody_system_t {
+   nbody_system_t() = default;
+
+   // note: 'softening' must be positive, the sum includes every body's pull on itself
+   bool create(const uint32_t capacity, const float central_gm, const float softening);
+   void destroy();
+
+   // note: 'gm' is the gravitational parameter of the body itself
+   uint32_t add(const float position[3], const float velocity[3], const float gm, const float size);
+   uint32_t count() const { return m_count; }
+
+   // note: one fixed step, spread over the job system
+   void step(const float dt);
+
+   // note: xyzw per body like kepler_orbits_t, positions extrapolated by 'offset' seconds
+   void write_instances(const float offset, float *output) const;
+
+   void compute_accelerations(const uint32_t begin, const uint32_t end);
+
+   float    m_central_gm = 1.0f;
+   float    m_softening_squared = 0.0f;
+   uint32_t m_count = 0;
+   uint32_t m_capacity = 0;
+   bool     m_accelerations_valid = false;
+
+   std::vector<float> m_x, m_y, m_z;
+   std::vector<float> m_vx, m_vy, m_vz;
+   std::vector<float> m_ax, m_ay, m_az;
+   std::vector<float> m_gm;
+   std::vector<float> m_size;
+};
@@ -0,0 +1,54 @@
+// orbits_kernels.hpp
+
+#pragma once
+
+#include <cstdint>
+
+// note: the orbit kernels are built twice, in orbits.cpp with the project's
+//       code generation and in orbits_avx2.cpp with /arch:AVX2 (-mavx2), the
+//       faster one the cpu supports is picked once at runtime
+//
+//       kernels only see raw arrays so the avx2 translation unit never emits
+//       an inline function (e.g. from std::vector) the linker could then pick
+//       over the copy every cpu can run
+namespace orbit_kernels
+{
+   // note: arrays are padded to the widest kernel so either can run over them
+   constexpr uint32_t max_lane_width = 8;
+
+   // note: newton iterations per body, enough for e < 0.5 at float precision
+   constexpr int solver_iterations = 4;
+
+   struct kepler_arrays_t {
+      const float *m_mean_motion;
+      const float *m_mean_anomaly;
+      const float *m_eccentricity;
+      const float *m_semi_major;
+      const float *m_semi_minor;
+      const float *m_px, *m_py, *m_pz;
+      const float *m_qx, *m_qy, *m_qz;
+      const float *m_size;
+   };
+
+   struct nbody_arrays_t {
+      const float *m_x, *m_y, *m_z;
+      const float *m_gm;
+      float       *m_ax, *m_ay, *m_az;
+      uint32_t     m_storage;
+      float        m_central_gm;
+      float        m_softening_squared;
+   };
+
+   struct kernels_t {
+      const char *m_name;
+      uint32_t    m_lane_width;
+      void      (*m_evaluate)(const kepler_arrays_t &orbits, const double time, const uint32_t begin, const uint32_t end, float *output);
+      void      (*m_accelerations)(const nbody_arrays_t &bodies, const uint32_t begin, const uint32_t end);
+   };
+
+   // note: 'avx2' has null kernels when orbits_avx2.cpp was built without the flags
+   extern const kernels_t baseline;
+   extern const kernels_t avx2;
+
+   const kernels_t &selected();
+}
@@ -0,0 +1,272 @@
+// orbits_lanes.hpp
+
+#pragma once
+
+#include "orbits_kernels.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <math.h>
+
+// note: only for orbits.cpp and orbits_avx2.cpp, everything in here has
+//       internal linkage and is compiled once per code generation, stick to
+//       the c math functions, the std overloads are inline and shared
+
+// note: the width follows the code generation of the including translation
+//       unit, avx2 with /arch:AVX2 (-mavx2), otherwise sse2 which every x64 target has
+#if defined(__AVX2__)
+#define KIWI_ORBITS_SIMD 2
+#include <immintrin.h>
+#elif defined(_M_X64) || defined(__SSE2__)
+#define KIWI_ORBITS_SIMD 1
+#include <emmintrin.h>
+#else
+#define KIWI_ORBITS_SIMD 0
+#endif
+
+namespace
+{
+   constexpr double two_pi = 6.283185307179586;
+
+   // note: thin wrappers so the kernels below are written once for every width,
+   //       named functions since gcc does not allow operators on vector types
+#if KIWI_ORBITS_SIMD == 2
+   using lane_t = __m256;
+   constexpr uint32_t lane_width = 8;
+   constexpr const char *lane_name = "avx2";
+
+   inline lane_t load(const float *source) { return _mm256_loadu_ps(source); }
+   inline lane_t set(const float value) { return _mm256_set1_ps(value); }
+   inline lane_t sub(const lane_t a, const lane_t b) { return _mm256_sub_ps(a, b); }
+   inline lane_t mul(const lane_t a, const lane_t b) { return _mm256_mul_ps(a, b); }
+   inline lane_t div(const lane_t a, const lane_t b) { return _mm256_div_ps(a, b); }
+   inline lane_t madd(const lane_t a, const lane_t b, const lane_t c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+   inline lane_t square_root(const lane_t a) { return _mm256_sqrt_ps(a); }
+
+   // note: quadrant reduction by pi/2 in three parts, then minimax polynomials on [-pi/4, pi/4]
+   inline void
+   sincos(const lane_t x, lane_t &sine, lane_t &cosine)
+   {
+      const __m256i quadrant = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(0.63661977236f)));
+      const lane_t q = _mm256_cvtepi32_ps(quadrant);
+      lane_t r = madd(q, set(-1.5703125f), x);
+      r = madd(q, set(-4.837512969970703125e-4f), r);
+      r = madd(q, set(-7.54978995489188216e-8f), r);
+
+      const lane_t r2 = mul(r, r);
+      const lane_t s = madd(mul(r, r2), madd(r2, madd(r2, set(-1.9515295891e-4f), set(8.3321608736e-3f)), set(-1.6666654611e-1f)), r);
+      const lane_t c = madd(mul(r2, r2), madd(r2, madd(r2, set(2.443315711809948e-5f), set(-1.388731625493765e-3f)), set(4.166664568298827e-2f)), madd(r2, set(-0.5f), set(1.0f)));
+
+      const lane_t swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quadrant, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+      const lane_t sine_sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(quadrant, _mm256_set1_epi32(2)), 30));
+      const lane_t cosine_sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(quadrant, _mm256_set1_epi32(1)), _mm256_set1_epi32(2)), 30));
+      sine = _mm256_xor_ps(_mm256_blendv_ps(s, c, swap), sine_sign);
+      cosine = _mm256_xor_ps(_mm256_blendv_ps(c, s, swap), cosine_sign);
+   }
+
+   inline float
+   horizontal_sum(const lane_t value)
+   {
+      const __m128 half = _mm_add_ps(_mm256_castps256_ps128(value), _mm256_extractf128_ps(value, 1));
+      const __m128 pair = _mm_add_ps(half, _mm_movehl_ps(half, half));
+      return _mm_cvtss_f32(_mm_add_ss(pair, _mm_shuffle_ps(pair, pair, 1)));
+   }
+
+   // note: four lanes at a time into xyzw rows
+   inline void
+   store_xyzw(float *destination, const lane_t x, const lane_t y, const lane_t z, const lane_t w)
+   {
+      for (int half = 0; half < 2; half++) {
+         __m128 rx = half ? _mm256_extractf128_ps(x, 1) : _mm256_castps256_ps128(x);
+         __m128 ry = half ? _mm256_extractf128_ps(y, 1) : _mm256_castps256_ps128(y);
+         __m128 rz = half ? _mm256_extractf128_ps(z, 1) : _mm256_castps256_ps128(z);
+         __m128 rw = half ? _mm256_extractf128_ps(w, 1) : _mm256_castps256_ps128(w);
+         _MM_TRANSPOSE4_PS(rx, ry, rz, rw);
+         _mm_storeu_ps(destination + half * 16 + 0, rx);
+         _mm_storeu_ps(destination + half * 16 + 4, ry);
+         _mm_storeu_ps(destination + half * 16 + 8, rz);
+         _mm_storeu_ps(destination + half * 16 + 12, rw);
+      }
+   }
+#elif KIWI_ORBITS_SIMD == 1
+   using lane_t = __m128;
+   constexpr uint32_t lane_width = 4;
+   constexpr const char *lane_name = "sse2";
+
+   inline lane_t load(const float *source) { return _mm_loadu_ps(source); }
+   inline lane_t set(const float value) { return _mm_set1_ps(value); }
+   inline lane_t sub(const lane_t a, const lane_t b) { return _mm_sub_ps(a, b); }
+   inline lane_t mul(const lane_t a, const lane_t b) { return _mm_mul_ps(a, b); }
+   inline lane_t div(const lane_t a, const lane_t b) { return _mm_div_ps(a, b); }
+   inline lane_t madd(const lane_t a, const lane_t b, const lane_t c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+   inline lane_t square_root(const lane_t a) { return _mm_sqrt_ps(a); }
+
+   inline lane_t
+   select(const lane_t mask, const lane_t a, const lane_t b)
+   {
+      return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+   }
+
+   // note: quadrant reduction by pi/2 in three parts, then minimax polynomials on [-pi/4, pi/4]
+   inline void
+   sincos(const lane_t x, lane_t &sine, lane_t &cosine)
+   {
+      const __m128i quadrant = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(0.63661977236f)));
+      const lane_t q = _mm_cvtepi32_ps(quadrant);
+      lane_t r = madd(q, set(-1.5703125f), x);
+      r = madd(q, set(-4.837512969970703125e-4f), r);
+      r = madd(q, set(-7.54978995489188216e-8f), r);
+
+      const lane_t r2 = mul(r, r);
+      const lane_t s = madd(mul(r, r2), madd(r2, madd(r2, set(-1.9515295891e-4f), set(8.3321608736e-3f)), set(-1.6666654611e-1f)), r);
+      const lane_t c = madd(mul(r2, r2), madd(r2, madd(r2, set(2.443315711809948e-5f), set(-1.388731625493765e-3f)), set(4.166664568298827e-2f)), madd(r2, set(-0.5f), set(1.0f)));
+
+      const lane_t swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+      const lane_t sine_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, _mm_set1_epi32(2)), 30));
+      const lane_t cosine_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(quadrant, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+      sine = _mm_xor_ps(select(swap, c, s), sine_sign);
+      cosine = _mm_xor_ps(select(swap, s, c), cosine_sign);
+   }
+
+   inline float
+   horizontal_sum(const lane_t value)
+   {
+      const __m128 pair = _mm_add_ps(value, _mm_movehl_ps(value, value));
+      return _mm_cvtss_f32(_mm_add_ss(pair, _mm_shuffle_ps(pair, pair, 1)));
+   }
+
+   inline void
+   store_xyzw(float *destination, lane_t x, lane_t y, lane_t z, lane_t w)
+   {
+      _MM_TRANSPOSE4_PS(x, y, z, w);
+      _mm_storeu_ps(destination + 0, x);
+      _mm_storeu_ps(destination + 4, y);
+      _mm_storeu_ps(destination + 8, z);
+      _mm_storeu_ps(destination + 12, w);
+   }
+#else
+   using lane_t = float;
+   constexpr uint32_t lane_width = 1;
+   constexpr const char *lane_name = "scalar";
+
+   inline lane_t load(const float *source) { return *source; }
+   inline lane_t set(const float value) { return value; }
+   inline lane_t sub(const lane_t a, const lane_t b) { return a - b; }
+   inline lane_t mul(const lane_t a, const lane_t b) { return a * b; }
+   inline lane_t div(const lane_t a, const lane_t b) { return a / b; }
+   inline lane_t madd(const lane_t a, const lane_t b, const lane_t c) { return a * b + c; }
+   inline lane_t square_root(const lane_t a) { return sqrtf(a); }
+
+   inline void
+   sincos(const lane_t x, lane_t &sine, lane_t &cosine)
+   {
+      sine = sinf(x);
+      cosine = cosf(x);
+   }
+
+   inline float
+   horizontal_sum(const lane_t value)
+   {
+      return value;
+   }
+
+   inline void
+   store_xyzw(float *destination, const lane_t x, const lane_t y, const lane_t z, const lane_t w)
+   {
+      destination[0] = x;
+      destination[1] = y;
+      destination[2] = z;
+      destination[3] = w;
+   }
+#endif
+
+   static_assert(orbit_kernels::max_lane_width % lane_width == 0, "lanes must divide the padding!");
+
+   void
+   evaluate_lanes(const orbit_kernels::kepler_arrays_t &orbits, const double time, const uint32_t begin, const uint32_t end, float *output)
+   {
+      assert((begin % lane_width) == 0 && "unaligned orbit range!");
+      for (uint32_t index = begin; index < end; index += lane_width) {
+         // note: phase in double, mean motion times a long running time loses
+         //       too many bits in float, everything after is relative to it
+         alignas(32) float phase[lane_width];
+         for (uint32_t lane = 0; lane < lane_width; lane++) {
+            const double angle = double(orbits.m_mean_anomaly[index + lane]) + double(orbits.m_mean_motion[index + lane]) * time;
+            phase[lane] = float(angle - floor(angle * (1.0 / two_pi)) * two_pi);
+         }
+
+         const lane_t mean_anomaly = load(phase);
+         const lane_t e = load(&orbits.m_eccentricity[index]);
+
+         // note: newton on f(E) = E - e sin E - M starting from E = M + e sin M
+         lane_t sine, cosine;
+         sincos(mean_anomaly, sine, cosine);
+         lane_t eccentric_anomaly = madd(e, sine, mean_anomaly);
+         lane_t delta = set(0.0f);
+         for (int iteration = 0; iteration < orbit_kernels::solver_iterations; iteration++) {
+            sincos(eccentric_anomaly, sine, cosine);
+            const lane_t f = sub(sub(eccentric_anomaly, mul(e, sine)), mean_anomaly);
+            const lane_t derivative = sub(set(1.0f), mul(e, cosine));
+            delta = div(f, derivative);
+            eccentric_anomaly = sub(eccentric_anomaly, delta);
+         }
+
+         // note: the last step is tiny, rotate sin/cos by it instead of another sincos
+         const lane_t corrected_sine = sub(sine, mul(cosine, delta));
+         const lane_t corrected_cosine = madd(sine, delta, cosine);
+
+         const lane_t x = mul(load(&orbits.m_semi_major[index]), sub(corrected_cosine, e));
+         const lane_t y = mul(load(&orbits.m_semi_minor[index]), corrected_sine);
+         const lane_t px = madd(x, load(&orbits.m_px[index]), mul(y, load(&orbits.m_qx[index])));
+         const lane_t py = madd(x, load(&orbits.m_py[index]), mul(y, load(&orbits.m_qy[index])));
+         const lane_t pz = madd(x, load(&orbits.m_pz[index]), mul(y, load(&orbits.m_qz[index])));
+
+         if (index + lane_width <= end) {
+            store_xyzw(output + size_t(index) * 4, px, py, pz, load(&orbits.m_size[index]));
+         }
+         else {
+            // note: the last group, padding lanes must not run past the output
+            alignas(32) float rows[lane_width * 4];
+            store_xyzw(rows, px, py, pz, load(&orbits.m_size[index]));
+            memcpy(output + size_t(index) * 4, rows, sizeof(float) * 4 * (end - index));
+         }
+      }
+   }
+
+   void
+   accelerations_lanes(const orbit_kernels::nbody_arrays_t &bodies, const uint32_t begin, const uint32_t end)
+   {
+      // note: the self term has a zero offset, with softening it adds nothing so
+      //       there is no need to skip it, without it would be 0 / 0
+      assert(bodies.m_softening_squared > 0.0f && "n-body softening must be positive!");
+      const lane_t softening = set(bodies.m_softening_squared);
+      for (uint32_t body = begin; body < end; body++) {
+         const lane_t x = set(bodies.m_x[body]);
+         const lane_t y = set(bodies.m_y[body]);
+         const lane_t z = set(bodies.m_z[body]);
+         lane_t ax = set(0.0f);
+         lane_t ay = set(0.0f);
+         lane_t az = set(0.0f);
+         for (uint32_t other = 0; other < bodies.m_storage; other += lane_width) {
+            const lane_t dx = sub(load(&bodies.m_x[other]), x);
+            const lane_t dy = sub(load(&bodies.m_y[other]), y);
+            const lane_t dz = sub(load(&bodies.m_z[other]), z);
+            const lane_t distance_squared = madd(dx, dx, madd(dy, dy, madd(dz, dz, softening)));
+            const lane_t strength = div(load(&bodies.m_gm[other]), mul(distance_squared, square_root(distance_squared)));
+            ax = madd(dx, strength, ax);
+            ay = madd(dy, strength, ay);
+            az = madd(dz, strength, az);
+         }
+
+         // note: the central mass sits at the origin
+         const float px = bodies.m_x[body];
+         const float py = bodies.m_y[body];
+         const float pz = bodies.m_z[body];
+         const float distance_squared = px * px + py * py + pz * pz + bodies.m_softening_squared;
+         const float central = bodies.m_central_gm / (distance_squared * sqrtf(distance_squared));
+         bodies.m_ax[body] = horizontal_sum(ax) - px * central;
+         bodies.m_ay[body] = horizontal_sum(ay) - py * central;
+         bodies.m_az[body] = horizontal_sum(az) - pz * central;
+      }
+   }
+} // !anonymous
@@ -0,0 +1,60 @@
+// pacing.hpp
+
+#pragma once
+
+#include "system.hpp"
+
+struct frame_stats_t {
+   float m_average_ms = 0.0f;
+   float m_jitter_ms = 0.0f;
+   float m_min_ms = 0.0f;
+   float m_max_ms = 0.0f;
+};
+
+// note: fixed timestep simulation with render interpolation, an optional
+//       sleep-then-spin frame limiter and present-to-present measurements
+struct frame_pacer_t {
+   static constexpr int history_size = 240;
+   static constexpr int max_steps_per_frame = 8;
+
+   frame_pacer_t() = default;
+   ~frame_pacer_t();
+
+   void set_fixed_timestep(const timespan_t &timestep);
+   void set_target_frame_rate(const float frames_per_second);
+
+   // note: call begin_frame once per frame, then step() until it returns false
+   void begin_frame(const timespan_t &now);
+   bool step();
+   float alpha() const;
+   const timespan_t &timestep() const;
+   const timespan_t &simulation_time() const;
+
+   // note: call limit right before presenting and on_present right after
+   void limit();
+   void on_present(const timespan_t &now);
+   frame_stats_t stats() const;
+
+private:
+   void precise_sleep_until(const timespan_t &deadline);
+
+public:
+   timespan_t m_timestep = timespan_t::from_seconds(1.0 / 120.0);
+   timespan_t m_simulation_time;
+   timespan_t m_accumulator;
+   timespan_t m_last_frame;
+   bool       m_first_frame = true;
+
+   timespan_t m_target_period;
+   timespan_t m_next_deadline;
+   bool       m_timer_resolution_raised = false;
+
+   // note: running estimate of how long a 1ms sleep really takes (welford)
+   double     m_sleep_mean_ms = 1.0;
+   double     m_sleep_m2 = 0.0;
+   int64      m_sleep_count = 1;
+
+   timespan_t m_last_present;
+   float      m_present_intervals[history_size] = {};
+   int        m_present_count = 0;
+};
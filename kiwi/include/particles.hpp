@@ -0,0 +1,66 @@
+// particles.hpp
+
+#pragma once
+
+#include "graphics.hpp"
+
+#include <glm/glm.hpp>
+
+struct shader_library_t;
+
+// note: particles emitted from a sphere around the origin that fly outwards
+//       against the pull of the central mass and respawn when their life runs out
+struct particle_emitter_t {
+   float m_radius = 2.0f;
+   float m_min_speed = 2.0f;
+   float m_max_speed = 6.0f;
+   float m_min_life = 2.0f;
+   float m_max_life = 6.0f;
+   float m_gm = 0.0f;
+   float m_size = 0.06f;
+};
+
+// note: simulated entirely on the gpu, the state lives in two vertex buffers
+//       and every update draws the current one as points through a vertex shader
+//       whose outputs are captured into the other one by transform feedback with
+//       the rasterizer off, then the roles swap, the particle count is fixed so
+//       nothing is ever read back to the cpu
+//
+//       state layout, interleaved per particle:
+//         position + age, velocity + life - two vec4s
+//
+//       drawn as camera facing quads, one instance per particle read straight
+//       from the current state buffer
+struct particle_system_t {
+   struct state_t {
+      glm::vec4 m_position_age;
+      glm::vec4 m_velocity_life;
+   };
+
+   particle_system_t() = default;
+
+   // note: the programs are requested from 'shaders' and compile in the background,
+   //       update() and draw() do nothing until they are ready
+   bool create(shader_library_t &shaders, const uint32_t count, const particle_emitter_t &emitter);
+   void destroy();
+
+   // note: 'time' is used to seed respawns, the step is clamped so a hitch does
+   //       not send every particle flying
+   void update(renderer_t &renderer, const float dt, const float time);
+
+   // note: blend, depth and rasterizer state are left to the caller
+   void draw(renderer_t &renderer, const glm::mat4 &projection, const glm::mat4 &view, const glm::mat4 &world);
+
+   uint32_t count() const { return m_count; }
+
+   particle_emitter_t m_emitter;
+   shader_program_t  *m_update_program = nullptr;
+   shader_program_t  *m_draw_program = nullptr;
+   vertex_buffer_t    m_state[2];
+   vertex_buffer_t    m_quad;
+   vertex_layout_t    m_update_layout;
+   vertex_layout_t    m_instance_layout;
+   vertex_layout_t    m_quad_layout;
+   uint32_t           m_current = 0;
+   uint32_t           m_count = 0;
+};
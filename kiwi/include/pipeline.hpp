@@ -0,0 +1,84 @@
+// pipeline.hpp
+
+#pragma once
+
+#include <mutex>
+#include <cstdint>
+#include <vector>
+#include <condition_variable>
+
+// note: fixed ring of frame slots handed from a producer (simulation) to a
+//       consumer (render) thread, the producer may run at most 'latency'
+//       frames ahead, slots are reused so their allocations survive
+template <typename T>
+struct frame_pipeline_t {
+   frame_pipeline_t() = default;
+
+   void create(const int latency)
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_slots.clear();
+      m_slots.resize(latency < 1 ? 2 : latency + 1);
+      m_written = 0;
+      m_read = 0;
+      m_closed = false;
+   }
+
+   // note: blocks while the consumer lags behind, returns nullptr once closed
+   T *begin_write()
+   {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_condition.wait(lock, [this] { return m_closed || m_written - m_read < m_slots.size(); });
+      if (m_closed) {
+         return nullptr;
+      }
+
+      return &m_slots[m_written % m_slots.size()];
+   }
+
+   void end_write()
+   {
+      {
+         std::lock_guard<std::mutex> lock(m_mutex);
+         m_written++;
+      }
+      m_condition.notify_all();
+   }
+
+   // note: blocks until a frame is published, returns nullptr once closed and drained
+   const T *begin_read()
+   {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_condition.wait(lock, [this] { return m_closed || m_read < m_written; });
+      if (m_read == m_written) {
+         return nullptr;
+      }
+
+      return &m_slots[m_read % m_slots.size()];
+   }
+
+   void end_read()
+   {
+      {
+         std::lock_guard<std::mutex> lock(m_mutex);
+         m_read++;
+      }
+      m_condition.notify_all();
+   }
+
+   void close()
+   {
+      {
+         std::lock_guard<std::mutex> lock(m_mutex);
+         m_closed = true;
+      }
+      m_condition.notify_all();
+   }
+
+   std::mutex              m_mutex;
+   std::condition_variable m_condition;
+   std::vector<T>          m_slots;
+   uint64_t                m_written = 0;
+   uint64_t                m_read = 0;
+   bool                    m_closed = false;
+};
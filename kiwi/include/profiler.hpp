@@ -0,0 +1,63 @@
+// profiler.hpp
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+// note: set to 0 to compile every profile_scope out
+#ifndef KIWI_PROFILER
+#define KIWI_PROFILER 1
+#endif
+
+namespace profiler
+{
+   // note: raw ticks, converted to microseconds when exported
+   inline uint64_t now()
+   {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+      return __rdtsc();
+#else
+      return uint64_t(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+   }
+
+   void record(const char *name, const uint64_t begin, const uint64_t end);
+   void set_thread_name(const char *name);
+
+   // note: drains the per-thread rings, call once per frame from one thread
+   void collect();
+   bool save_chrome_trace(const std::string_view &filename);
+} // !profiler
+
+struct profile_zone_t {
+   profile_zone_t(const char *name)
+      : m_name(name)
+      , m_begin(profiler::now())
+   {
+   }
+
+   ~profile_zone_t()
+   {
+      profiler::record(m_name, m_begin, profiler::now());
+   }
+
+   const char *m_name;
+   uint64_t    m_begin;
+};
+
+#if KIWI_PROFILER
+#define profile_concat_(a, b) a##b
+#define profile_concat(a, b) profile_concat_(a, b)
+#define profile_scope(name) profile_zone_t profile_concat(profile_zone_, __LINE__)(name)
+#else
+#define profile_scope(name)
+#endif
@@ -0,0 +1,282 @@
+// resources.hpp
+
+#pragma once
+
+#include "graphics.hpp"
+
+#include <cassert>
+#include <vector>
+
+// note: 32 bit generational handle, the low bits index a slot and the high bits
+//       hold the generation the slot had when the handle was handed out, a slot
+//       bumps its generation on release so stale handles stop matching,
+//       zero is never handed out and means no resource
+template <typename T>
+struct resource_handle_t {
+   static constexpr uint32_t index_bits = 20;
+   static constexpr uint32_t generation_bits = 32 - index_bits;
+   static constexpr uint32_t index_mask = (1u << index_bits) - 1;
+   static constexpr uint32_t generation_mask = (1u << generation_bits) - 1;
+
+   resource_handle_t() = default;
+   resource_handle_t(const uint32_t index, const uint32_t generation)
+      : m_value((generation << index_bits) | index)
+   {
+   }
+
+   bool valid() const { return m_value != 0; }
+   uint32_t index() const { return m_value & index_mask; }
+   uint32_t generation() const { return m_value >> index_bits; }
+
+   bool operator==(const resource_handle_t &rhs) const { return m_value == rhs.m_value; }
+   bool operator!=(const resource_handle_t &rhs) const { return m_value != rhs.m_value; }
+
+   uint32_t m_value = 0;
+};
+
+using texture_handle_t = resource_handle_t<texture_t>;
+using sampler_handle_t = resource_handle_t<sampler_state_t>;
+using vertex_buffer_handle_t = resource_handle_t<vertex_buffer_t>;
+
+// note: resources are kept packed in one array so iterating them walks contiguous
+//       memory, handles go through a slot table that follows the resource when a
+//       release moves the last one into the hole, the capacity is fixed at create()
+//       and allocate() returns an invalid handle when full rather than growing
+template <typename T>
+struct resource_pool_t {
+   using handle_t = resource_handle_t<T>;
+
+   resource_pool_t() = default;
+   ~resource_pool_t() { destroy(); }
+
+   resource_pool_t(const resource_pool_t &) = delete;
+   resource_pool_t &operator=(const resource_pool_t &) = delete;
+
+   bool create(const uint32_t capacity)
+   {
+      destroy();
+
+      if (capacity == 0 || capacity > handle_t::index_mask + 1) {
+         return false;
+      }
+
+      m_slots.resize(capacity);
+      m_dense.reserve(capacity);
+      m_dense_slots.reserve(capacity);
+      for (uint32_t index = 0; index < capacity; index++) {
+         m_slots[index].m_dense = index + 1;
+         m_slots[index].m_generation = 1;
+      }
+      m_free = 0;
+
+      return true;
+   }
+
+   // note: destroys every resource still alive
+   void destroy()
+   {
+      for (T &resource : m_dense) {
+         resource.destroy();
+      }
+
+      m_slots.clear();
+      m_dense.clear();
+      m_dense_slots.clear();
+      m_free = 0;
+   }
+
+   // note: the resource is default constructed, create() it through get()
+   handle_t allocate()
+   {
+      if (m_free >= m_slots.size()) {
+         return {};
+      }
+
+      const uint32_t index = m_free;
+      slot_t &slot = m_slots[index];
+      m_free = slot.m_dense;
+
+      slot.m_dense = uint32_t(m_dense.size());
+      m_dense.emplace_back();
+      m_dense_slots.push_back(index);
+
+      return handle_t(index, slot.m_generation);
+   }
+
+   // note: takes ownership of an already created resource
+   handle_t insert(const T &resource)
+   {
+      const handle_t handle = allocate();
+      if (handle.valid()) {
+         get(handle) = resource;
+      }
+
+      return handle;
+   }
+
+   // note: destroys the resource, the handle and every copy of it go stale
+   void release(const handle_t handle)
+   {
+      T resource;
+      if (remove(handle, resource)) {
+         resource.destroy();
+      }
+   }
+
+   // note: like release() but hands the resource over instead of destroying it
+   bool remove(const handle_t handle, T &resource)
+   {
+      if (!valid(handle)) {
+         assert(!handle.valid() && "stale resource handle released!");
+         return false;
+      }
+
+      const uint32_t index = handle.index();
+      slot_t &slot = m_slots[index];
+      resource = m_dense[slot.m_dense];
+
+      // note: keep the array packed, the last resource moves into the hole
+      const uint32_t last = uint32_t(m_dense.size()) - 1;
+      if (slot.m_dense != last) {
+         m_dense[slot.m_dense] = m_dense[last];
+         m_dense_slots[slot.m_dense] = m_dense_slots[last];
+         m_slots[m_dense_slots[last]].m_dense = slot.m_dense;
+      }
+      m_dense.pop_back();
+      m_dense_slots.pop_back();
+
+      // note: generation zero is skipped so a handle value is never zero
+      slot.m_generation = (slot.m_generation + 1) & handle_t::generation_mask;
+      slot.m_generation = slot.m_generation == 0 ? 1 : slot.m_generation;
+      slot.m_dense = m_free;
+      m_free = index;
+
+      return true;
+   }
+
+   bool valid(const handle_t handle) const
+   {
+      const uint32_t index = handle.index();
+      return handle.valid() &&
+             index < m_slots.size() &&
+             m_slots[index].m_generation == handle.generation() &&
+             m_slots[index].m_dense < m_dense.size() &&
+             m_dense_slots[m_slots[index].m_dense] == index;
+   }
+
+   // note: stale handles are only caught in debug builds
+   T &get(const handle_t handle)
+   {
+      assert(valid(handle) && "stale resource handle!");
+      return m_dense[m_slots[handle.index()].m_dense];
+   }
+
+   const T &get(const handle_t handle) const
+   {
+      assert(valid(handle) && "stale resource handle!");
+      return m_dense[m_slots[handle.index()].m_dense];
+   }
+
+   // note: in no particular order, the order changes on release
+   T *begin() { return m_dense.data(); }
+   T *end() { return m_dense.data() + m_dense.size(); }
+   const T *begin() const { return m_dense.data(); }
+   const T *end() const { return m_dense.data() + m_dense.size(); }
+
+   uint32_t count() const { return uint32_t(m_dense.size()); }
+   uint32_t capacity() const { return uint32_t(m_slots.size()); }
+
+private:
+   // note: 'm_dense' doubles as the next free slot while the slot is unused
+   struct slot_t {
+      uint32_t m_dense = 0;
+      uint32_t m_generation = 1;
+   };
+
+   std::vector<slot_t>   m_slots;
+   std::vector<T>        m_dense;
+   std::vector<uint32_t> m_dense_slots;
+   uint32_t              m_free = 0;
+};
+
+struct resource_stats_t {
+   uint32_t m_textures = 0;
+   uint32_t m_samplers = 0;
+   uint32_t m_vertex_buffers = 0;
+   uint64_t m_texels = 0;
+   uint32_t m_retired = 0;
+   uint32_t m_recycled = 0;
+   uint64_t m_reused = 0;
+   uint64_t m_destroyed = 0;
+};
+
+// note: owns the long lived gpu resources, everything still alive is destroyed
+//       with the manager, code that draws holds handles rather than the structs
+//
+//       released resources are not deleted right away, the gpu may still read
+//       them in frames it has not finished, they wait in a retire queue tagged
+//       with the frame they were released in until the renderer's frame fence
+//       for it has passed, then textures and vertex buffers go to a small
+//       recycle bin where create_*() picks up an exact match and refills it
+//       in place instead of asking the driver for new storage
+struct resource_manager_t {
+   struct desc_t {
+      uint32_t m_max_textures = 256;
+      uint32_t m_max_samplers = 32;
+      uint32_t m_max_vertex_buffers = 256;
+      uint32_t m_max_recycled = 16;
+   };
+
+   resource_manager_t() = default;
+
+   bool create(const desc_t &desc);
+   void destroy();
+
+   // note: 'frame' tags what is released from now on, anything released in
+   //       'completed_frame' or earlier is recycled or destroyed
+   void begin_frame(const int64_t frame, const int64_t completed_frame);
+
+   texture_handle_t create_texture(const int width,
+                                   const int height,
+                                   const void *data,
+                                   const texture_t::pixel_format_t format,
+                                   const bool mipmap = false);
+   texture_handle_t create_cube_texture(const int size,
+                                        const void *const faces[cubemap_image_t::face_count],
+                                        const texture_t::pixel_format_t format,
+                                        const bool mipmap = false);
+   vertex_buffer_handle_t create_vertex_buffer(const size_t size,
+                                               const void *data,
+                                               const vertex_buffer_t::usage_hint_t usage = vertex_buffer_t::usage_hint_t::immutable);
+
+   texture_t &get(const texture_handle_t handle) { return m_textures.get(handle); }
+   sampler_state_t &get(const sampler_handle_t handle) { return m_samplers.get(handle); }
+   vertex_buffer_t &get(const vertex_buffer_handle_t handle) { return m_vertex_buffers.get(handle); }
+
+   void release(const texture_handle_t handle);
+   void release(const sampler_handle_t handle);
+   void release(const vertex_buffer_handle_t handle);
+
+   resource_stats_t stats() const;
+
+   template <typename T>
+   struct retired_t {
+      T       m_resource;
+      int64_t m_frame = 0;
+   };
+
+   resource_pool_t<texture_t>       m_textures;
+   resource_pool_t<sampler_state_t> m_samplers;
+   resource_pool_t<vertex_buffer_t> m_vertex_buffers;
+
+   std::vector<retired_t<texture_t>>       m_retired_textures;
+   std::vector<retired_t<sampler_state_t>> m_retired_samplers;
+   std::vector<retired_t<vertex_buffer_t>> m_retired_vertex_buffers;
+   std::vector<texture_t>                  m_recycled_textures;
+   std::vector<vertex_buffer_t>            m_recycled_vertex_buffers;
+
+   uint32_t m_max_recycled = 0;
+   int64_t  m_frame = 0;
+   uint64_t m_reused = 0;
+   uint64_t m_destroyed = 0;
+};
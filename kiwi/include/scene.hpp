@@ -0,0 +1,54 @@
+// scene.hpp
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#pragma warning(push)
+#pragma warning(disable: 4201) // nonstandard extension used: nameless struct/union
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#pragma warning(pop)
+
+struct scene_graph_t {
+   static constexpr uint32_t invalid_node = ~0u;
+
+   scene_graph_t() = default;
+
+   void clear();
+   void reserve(const uint32_t capacity);
+   uint32_t add_node(const uint32_t parent = invalid_node);
+   uint32_t count() const;
+
+   void set_position(const uint32_t node, const glm::vec3 &position);
+   void set_rotation(const uint32_t node, const glm::quat &rotation);
+   void set_scale(const uint32_t node, const glm::vec3 &scale);
+   const glm::mat4 &world(const uint32_t node) const;
+
+   // note: recomputes world matrices of dirty subtrees only, optionally split
+   //       per level over the job system, returns the number of nodes updated
+   uint32_t update(const bool parallel = false);
+
+private:
+   bool update_node(const uint32_t node);
+   void build_levels();
+
+public:
+   // note: structure-of-arrays, sorted parent-before-child (m_parent[i] < i)
+   std::vector<uint32_t>  m_parent;
+   std::vector<uint32_t>  m_depth;
+   std::vector<uint8_t>   m_dirty;
+   std::vector<glm::vec3> m_position;
+   std::vector<glm::quat> m_rotation;
+   std::vector<glm::vec3> m_scale;
+   std::vector<glm::mat4> m_world;
+
+   // note: node indices bucketed per depth, used to split updates into jobs
+   std::vector<uint32_t>  m_level_order;
+   std::vector<uint32_t>  m_level_offsets;
+   bool                   m_levels_dirty = false;
+
+   // note: lowest dirty index, children come after their parents so nothing
+   //       before it can be dirty and updates start there, invalid when clean
+   uint32_t               m_first_dirty = invalid_node;
+};
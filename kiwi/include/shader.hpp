@@ -0,0 +1,58 @@
+// shader.hpp
+
+#pragma once
+
+#include "graphics.hpp"
+
+#include <span>
+#include <string>
+#include <memory>
+#include <utility>
+#include <initializer_list>
+
+// note: the #defines that make up one permutation, kept sorted by name so the
+//       permutation key does not depend on the order they were set in
+struct shader_defines_t {
+   shader_defines_t() = default;
+   shader_defines_t(std::initializer_list<std::string_view> names);
+
+   shader_defines_t &set(const std::string_view &name, const std::string_view &value = "1");
+   bool has(const std::string_view &name) const;
+   uint64_t key() const;
+   std::string to_string() const;
+
+   std::vector<std::pair<std::string, std::string>> m_defines;
+};
+
+// note: resolves #include "file" relative to the including file (each file once),
+//       injects the defines right after #version and emits #line directives so
+//       driver errors point at the right place, 'files' receives the source
+//       string numbers used by those #line directives
+bool preprocess_shader(const std::string_view &path,
+                       const shader_defines_t &defines,
+                       std::string &output,
+                       std::vector<std::string> *files = nullptr);
+
+// note: owns every compiled permutation, identical requests share one program,
+//       programs stay invalid until their background compile has finished
+struct shader_library_t {
+   shader_library_t() = default;
+
+   shader_program_t &request(const std::string_view &vertex_path,
+                             const std::string_view &fragment_path,
+                             const shader_defines_t &defines = {},
+                             const std::span<const char *const> feedback_varyings = {});
+   void update();
+   bool finish(shader_program_t &program);
+   int pending() const;
+   void destroy();
+
+   struct variant_t {
+      uint64_t                 m_key = 0;
+      std::string              m_name;
+      std::vector<std::string> m_files;
+      shader_program_t         m_program;
+   };
+
+   std::vector<std::unique_ptr<variant_t>> m_variants;
+};
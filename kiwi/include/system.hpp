@@ -4,58 +4,131 @@
 
 #include <string>
 #include <vector>
-#include <functional>
+#include <span>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <type_traits>
 #include <string_view>
 
 using int64 = signed long long;
 
+// note: 1 strips debug::info at compile time, 2 strips warnings too, 3 everything
+#ifndef KIWI_LOG_LEVEL
+#define KIWI_LOG_LEVEL 0
+#endif
+
 namespace debug 
 {
-   void info(const char *format, ...);
-   void warn(const char *format, ...);
-   void error(const char *format, ...);
-} // !debug
+   enum class log_level_t : uint8_t {
+      info,
+      warn,
+      error,
+   };
 
-struct mouse_moved_t     { int x, y; };
-struct key_pressed_t     { int keycode; };
-struct key_released_t    { int keycode; };
-struct button_pressed_t  { int button; };
-struct button_released_t { int button; };
+   // note: one captured printf argument, strings are copied when the record is
+   //       queued, anything that is not a number, pointer or string is rejected
+   struct log_argument_t {
+      enum class type_t : uint8_t {
+         none,
+         signed_,
+         unsigned_,
+         floating,
+         pointer,
+         string,
+      };
 
-class event_dispatcher_t {
-public:
-   event_dispatcher_t() = delete;
+      log_argument_t() = default;
 
-   template <typename T>
-   static void dispatch(const T &event)
+      template <typename T> requires std::is_integral_v<T>
+      log_argument_t(const T value) 
+      {
+         if constexpr (std::is_signed_v<T>) {
+            m_type = type_t::signed_;
+            m_value.m_signed = value;
+         }
+         else {
+            m_type = type_t::unsigned_;
+            m_value.m_unsigned = value;
+         }
+      }
+
+      log_argument_t(const double value)           : m_type(type_t::floating) { m_value.m_floating = value; }
+      log_argument_t(const char *value)            : m_type(type_t::string), m_length(value ? uint32_t(strlen(value)) : 0) { m_value.m_string = value; }
+      log_argument_t(const unsigned char *value)   : log_argument_t(reinterpret_cast<const char *>(value)) {}
+      log_argument_t(const std::string_view value) : m_type(type_t::string), m_length(uint32_t(value.size())) { m_value.m_string = value.data(); }
+      log_argument_t(const std::string &value)     : log_argument_t(std::string_view(value)) {}
+      log_argument_t(const void *value)            : m_type(type_t::pointer) { m_value.m_pointer = value; }
+
+      type_t   m_type = type_t::none;
+      uint32_t m_length = 0;
+      union {
+         int64       m_signed;
+         uint64_t    m_unsigned;
+         double      m_floating;
+         const void *m_pointer;
+         const char *m_string;
+      } m_value{};
+   };
+
+   // note: queues a record for the logging thread, formatting happens there,
+   //       before start_logging() and after stop_logging() it writes right away
+   void log(const log_level_t level, const char *format, const log_argument_t *arguments, const int count);
+
+   template <typename... Args>
+   void info(const char *format, const Args &...args)
    {
-      auto &listeners = get_listeners<T>();
-      for (auto &listener : listeners) {
-         listener(event);
+      if constexpr (KIWI_LOG_LEVEL < 1) {
+         const log_argument_t arguments[] = { log_argument_t(args)..., log_argument_t() };
+         log(log_level_t::info, format, arguments, int(sizeof...(Args)));
       }
    }
 
-   template <typename T, typename F>
-   static void add_listener(F &listener)
+   template <typename... Args>
+   void warn(const char *format, const Args &...args)
    {
-      auto &listeners = get_listeners<T>();
-      listeners.emplace_back([&](const T &event) { listener.on_event(event); });
+      if constexpr (KIWI_LOG_LEVEL < 2) {
+         const log_argument_t arguments[] = { log_argument_t(args)..., log_argument_t() };
+         log(log_level_t::warn, format, arguments, int(sizeof...(Args)));
+      }
    }
 
-private:
-   template <typename T>
-   static auto &get_listeners()
+   template <typename... Args>
+   void error(const char *format, const Args &...args)
    {
-      static std::vector<std::function<void(const T &)>> ms_listeners;
-      return ms_listeners;
+      if constexpr (KIWI_LOG_LEVEL < 3) {
+         const log_argument_t arguments[] = { log_argument_t(args)..., log_argument_t() };
+         log(log_level_t::error, format, arguments, int(sizeof...(Args)));
+      }
    }
-};
+
+   // note: 'binary_filename' also writes every record unformatted, call sites
+   //       once as format strings and then by index, for decode_binary_log()
+   bool start_logging(const char *filename = nullptr, const char *binary_filename = nullptr);
+   void stop_logging();
+
+   // note: blocks until everything queued so far has been written
+   void flush();
+   uint64_t dropped_logs();
+
+   // note: prints a --log-binary file as text with timestamps, false when it is
+   //       not one or cut short, works without the logging thread
+   bool decode_binary_log(const char *filename);
+} // !debug
+
+uint32_t fnv1a32(const void *data, const size_t size);
+uint64_t fnv1a64(const void *data, const size_t size, const uint64_t seed = 14695981039346656037ull);
+
+struct linear_arena_t;
 
 struct file_system_t {
    file_system_t() = delete;
 
    static bool load_content(const std::string_view &filename, std::string &content);
    static bool load_content(const std::string_view &filename, std::vector<uint8_t> &content);
+   // note: 'content' points into the arena, no zero-fill and no heap allocation once it is warm
+   static bool load_content(const std::string_view &filename, linear_arena_t &arena, std::span<uint8_t> &content);
+   static bool save_content(const std::string_view &filename, const std::string_view &content);
 };
 
 struct timespan_t {
@@ -92,3 +165,169 @@ struct watch_t {
 
    static timespan_t time_since_start();
 };
+
+// note: input events carry the time they were received (watch_t)
+struct mouse_moved_t     { int x, y; timespan_t time; };
+struct key_pressed_t     { int keycode; timespan_t time; };
+struct key_released_t    { int keycode; timespan_t time; };
+struct button_pressed_t  { int button; timespan_t time; };
+struct button_released_t { int button; timespan_t time; };
+
+// note: newest cursor sample, written by one thread and read lock-free by any
+//       other (sequence lock, readers retry when they raced with the writer)
+struct input_latch_t {
+   struct sample_t {
+      float      x = 0.0f;
+      float      y = 0.0f;
+      timespan_t time;
+   };
+
+   void store(const sample_t &sample);
+   sample_t load() const;
+
+   std::atomic<uint32_t> m_sequence = 0;
+   std::atomic<uint64_t> m_position = 0;
+   std::atomic<int64>    m_time = 0;
+};
+
+
+using listener_id_t = uint32_t;
+
+#pragma warning(push)
+#pragma warning(disable: 4324) // structure was padded due to alignment specifier
+// note: bounded multi-producer single-consumer ring of type-erased events, 
+//       posting never locks nor allocates, a full ring drops the event
+class event_queue_t {
+public:
+   static constexpr uint32_t capacity = 1024;
+   static constexpr uint32_t mask = capacity - 1;
+   static constexpr size_t   max_event_size = 48;
+   static constexpr size_t   max_event_alignment = 16;
+   using dispatch_proc_t = void (*)(const void *payload);
+
+   event_queue_t();
+
+   bool push(dispatch_proc_t dispatch, const void *payload, const size_t size);
+   uint32_t drain();
+   uint64_t dropped() const;
+
+private:
+   struct slot_t {
+      std::atomic<uint32_t> m_sequence;
+      dispatch_proc_t       m_dispatch;
+      alignas(max_event_alignment) uint8_t m_payload[max_event_size];
+   };
+
+   alignas(64) std::atomic<uint32_t> m_head;
+   alignas(64) uint32_t              m_tail;
+   std::atomic<uint64_t>             m_dropped;
+   slot_t                            m_slots[capacity];
+};
+#pragma warning(pop)
+
+// note: listeners are added, removed and invoked on the main thread only,
+//       post() is safe from any thread and is delivered by the next process()
+class event_dispatcher_t {
+public:
+   event_dispatcher_t() = delete;
+
+   template <typename T>
+   static void dispatch(const T &event)
+   {
+      auto &listeners = get_listeners<T>();
+      auto &depth = get_dispatch_depth<T>();
+
+      // note: listeners may be added or removed from within a callback, 
+      //       removed ones are only cleared here and compacted afterwards
+      depth++;
+      for (size_t index = 0; index < listeners.size(); index++) {
+         const auto listener = listeners[index];
+         if (listener.m_invoke) {
+            listener.m_invoke(listener.m_object, event);
+         }
+      }
+      depth--;
+
+      if (depth == 0) {
+         std::erase_if(listeners, [](const auto &listener) { return listener.m_invoke == nullptr; });
+      }
+   }
+
+   template <typename T>
+   static bool post(const T &event)
+   {
+      static_assert(std::is_trivially_copyable_v<T>, "posted events are copied bytewise");
+      static_assert(sizeof(T) <= event_queue_t::max_event_size, "event too large for the queue");
+      static_assert(alignof(T) <= event_queue_t::max_event_alignment, "event alignment too strict for the queue");
+
+      return queue().push([](const void *payload) { dispatch(*static_cast<const T *>(payload)); }, &event, sizeof(T));
+   }
+
+   // note: delivers everything posted so far, returns the number of events
+   static uint32_t process()
+   {
+      return queue().drain();
+   }
+
+   static uint64_t dropped()
+   {
+      return queue().dropped();
+   }
+
+   template <typename T, typename F>
+   static listener_id_t add_listener(F &listener)
+   {
+      const listener_id_t id = next_listener_id();
+      get_listeners<T>().push_back({ id, &listener, [](void *object, const T &event) {
+         static_cast<F *>(object)->on_event(event);
+      } });
+
+      return id;
+   }
+
+   template <typename T>
+   static void remove_listener(const listener_id_t id)
+   {
+      auto &listeners = get_listeners<T>();
+      for (auto &listener : listeners) {
+         if (listener.m_id == id) {
+            listener.m_object = nullptr;
+            listener.m_invoke = nullptr;
+         }
+      }
+
+      if (get_dispatch_depth<T>() == 0) {
+         std::erase_if(listeners, [](const auto &listener) { return listener.m_invoke == nullptr; });
+      }
+   }
+
+private:
+   template <typename T>
+   struct listener_t {
+      listener_id_t m_id;
+      void         *m_object;
+      void        (*m_invoke)(void *object, const T &event);
+   };
+
+   template <typename T>
+   static auto &get_listeners()
+   {
+      static std::vector<listener_t<T>> ms_listeners;
+      return ms_listeners;
+   }
+
+   template <typename T>
+   static int &get_dispatch_depth()
+   {
+      static int ms_depth = 0;
+      return ms_depth;
+   }
+
+   static listener_id_t next_listener_id()
+   {
+      static listener_id_t ms_next_id = 0;
+      return ++ms_next_id;
+   }
+
+   static event_queue_t &queue();
+};
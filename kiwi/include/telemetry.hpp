@@ -0,0 +1,101 @@
+// telemetry.hpp
+
+#pragma once
+
+#include "system.hpp"
+
+struct gpu_profiler_t;
+
+// note: log-linear histogram of microseconds in the spirit of hdr histogram,
+//       values below 'sub_bucket_count' get a bucket each, above that every
+//       power of two is split into half as many buckets, so any recorded value
+//       is known to within 1 / 64 of itself, fixed size and never allocates
+struct latency_histogram_t {
+   static constexpr uint32_t sub_bucket_bits = 7;
+   static constexpr uint32_t sub_bucket_count = 1u << sub_bucket_bits;
+   static constexpr uint32_t sub_bucket_half = sub_bucket_count / 2;
+   // note: values are clamped to about 67 seconds
+   static constexpr uint32_t max_value_bits = 26;
+   static constexpr uint64_t max_value = (uint64_t(1) << max_value_bits) - 1;
+   static constexpr uint32_t bucket_count = (max_value_bits - sub_bucket_bits + 2) * sub_bucket_half;
+
+   static uint32_t bucket_index(const uint64_t value);
+   static uint64_t bucket_lowest(const uint32_t index);
+   static uint64_t bucket_highest(const uint32_t index);
+
+   void clear();
+   void add(const uint64_t value);
+   void remove(const uint64_t value);
+
+   // note: interpolated inside the bucket the percentile falls into, as if its
+   //       values were spread evenly, so off by at most the bucket precision
+   uint64_t percentile(const double percent) const;
+   uint64_t highest() const;
+
+   uint64_t m_count = 0;
+   uint32_t m_counts[bucket_count] = {};
+};
+
+enum class frame_metric_t {
+   cpu,
+   gpu,
+   present,
+   count,
+};
+
+struct frame_percentiles_t {
+   uint64_t m_frames = 0;
+   uint64_t m_hitches = 0;
+   float    m_mean_ms = 0.0f;
+   float    m_p50_ms = 0.0f;
+   float    m_p95_ms = 0.0f;
+   float    m_p99_ms = 0.0f;
+   float    m_max_ms = 0.0f;
+};
+
+// note: per frame cpu time, gpu time and present interval, each kept in a
+//       histogram over the whole run and one over a sliding window of the last
+//       'window_size' frames, a frame is a hitch when it takes more than
+//       'hitch_ratio' times the median of the window before it
+//
+//       every metric must only be recorded from one thread, reading from
+//       another one is only safe once that thread is done
+struct frame_telemetry_t {
+   static constexpr uint32_t window_size = 600;
+   static constexpr uint32_t hitch_min_frames = 30;
+   static constexpr float    hitch_ratio = 1.5f;
+
+   struct metric_t {
+      latency_histogram_t m_total;
+      latency_histogram_t m_window;
+      uint64_t            m_total_us = 0;
+      uint64_t            m_window_us = 0;
+      uint64_t            m_min_us = 0;
+      uint64_t            m_max_us = 0;
+      uint64_t            m_hitches = 0;
+      uint32_t            m_window_hitches = 0;
+      uint32_t            m_samples[window_size] = {};
+      bool                m_hitch[window_size] = {};
+   };
+
+   frame_telemetry_t() = default;
+
+   static const char *metric_name(const frame_metric_t metric);
+
+   // note: forgets every recorded frame, e.g. once warm up is over
+   void reset();
+   void record(const frame_metric_t metric, const timespan_t &duration);
+
+   // note: gpu times resolve a few frames late, records every "frame" marker
+   //       the profiler resolved since the last call
+   void record_gpu(const gpu_profiler_t &profiler);
+
+   frame_percentiles_t total(const frame_metric_t metric) const;
+   frame_percentiles_t window(const frame_metric_t metric) const;
+
+   void log_summary() const;
+   bool save_json(const std::string_view &filename) const;
+
+   metric_t m_metrics[int(frame_metric_t::count)];
+   int64_t  m_gpu_recorded = 0;
+};
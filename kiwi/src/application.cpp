@@ -1,6 +1,8 @@
 // application.cpp
 
 #include "application.hpp"
+#include "profiler.hpp"
+#include "jobs.hpp"
 
 #include <GLFW/glfw3.h>
 
@@ -9,25 +11,48 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/matrix_access.hpp>
 #pragma warning(pop)
 
 #include <numbers> 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 
-application_t::application_t()
-   : m_position(0.0f)
-   , m_rotation(0.0f)
-   , m_world(1.0f)
+application_t::application_t(const uint32_t asteroid_count, const uint32_t particle_count)
+   : m_asteroid_count(asteroid_count)
+   , m_particle_count(particle_count)
 {
-   event_dispatcher_t::add_listener<mouse_moved_t>(*this);
-   event_dispatcher_t::add_listener<key_pressed_t>(*this);
-   event_dispatcher_t::add_listener<key_released_t>(*this);
-   event_dispatcher_t::add_listener<button_pressed_t>(*this);
-   event_dispatcher_t::add_listener<button_released_t>(*this);
+   m_listeners[0] = event_dispatcher_t::add_listener<mouse_moved_t>(*this);
+   m_listeners[1] = event_dispatcher_t::add_listener<key_pressed_t>(*this);
+   m_listeners[2] = event_dispatcher_t::add_listener<key_released_t>(*this);
+   m_listeners[3] = event_dispatcher_t::add_listener<button_pressed_t>(*this);
+   m_listeners[4] = event_dispatcher_t::add_listener<button_released_t>(*this);
+}
+
+application_t::~application_t()
+{
+   event_dispatcher_t::remove_listener<mouse_moved_t>(m_listeners[0]);
+   event_dispatcher_t::remove_listener<key_pressed_t>(m_listeners[1]);
+   event_dispatcher_t::remove_listener<key_released_t>(m_listeners[2]);
+   event_dispatcher_t::remove_listener<button_pressed_t>(m_listeners[3]);
+   event_dispatcher_t::remove_listener<button_released_t>(m_listeners[4]);
 }
 
 bool application_t::on_initialize()
 {
-   if (!m_program.create_from_file("assets/shader.vs.glsl", "assets/shader.fs.glsl")) {
+   // note: only the base permutation is needed for the first frame, the 
+   //       others compile in the background and are used once ready
+   m_program = &m_shaders.request("assets/shader.vs.glsl", "assets/shader.fs.glsl");
+   m_wireframe_program = &m_shaders.request("assets/shader.vs.glsl", "assets/shader.fs.glsl", { "DEBUG_WIREFRAME" });
+   m_depth_only_program = &m_shaders.request("assets/shader.vs.glsl", "assets/shader.fs.glsl", { "DEPTH_ONLY" });
+   m_skybox_program = &m_shaders.request("assets/skybox.vs.glsl", "assets/skybox.fs.glsl");
+   m_asteroid_program = &m_shaders.request("assets/asteroid.vs.glsl", "assets/asteroid.fs.glsl");
+   if (!m_shaders.finish(*m_program)) {
+      return false;
+   }
+
+   if (!m_resources.create(resource_manager_t::desc_t{})) {
       return false;
    }
 
@@ -35,7 +60,21 @@ bool application_t::on_initialize()
       return false;
    }
 
-   if (!m_sampler.create(sampler_state_t::filter_mode_t::linear)) {
+   m_sampler = m_resources.m_samplers.allocate();
+   if (!m_sampler.valid() || !m_resources.get(m_sampler).create(sampler_state_t::filter_mode_t::linear)) {
+      return false;
+   }
+
+   m_skybox_sampler = m_resources.m_samplers.allocate();
+   if (!m_skybox_sampler.valid() || !m_resources.get(m_skybox_sampler).create(sampler_state_t::filter_mode_t::linear)) {
+      return false;
+   }
+
+   if (!m_frame_arena.create(64 * 1024)) {
+      return false;
+   }
+
+   if (!m_light_clusters.create()) {
       return false;
    }
 
@@ -43,6 +82,59 @@ bool application_t::on_initialize()
       return false;
    }
 
+   makeScene();
+
+   if (!make_belt()) {
+      return false;
+   }
+
+   // note: launched off the sun's surface, most fall back, the fast ones escape
+   particle_emitter_t corona;
+   corona.m_radius = 2.0f;
+   corona.m_gm = 12.0f;
+   if (!m_corona.create(m_shaders, m_particle_count, corona)) {
+      return false;
+   }
+
+   for (auto &body : m_bodies) {
+      if (!body.m_query.create()) {
+         return false;
+      }
+   }
+
+   for (auto &counter : m_fragment_counters) {
+      if (!counter.create()) {
+         return false;
+      }
+   }
+
+   m_proxy_blend_state.m_enabled = false;
+   m_proxy_blend_state.m_color_write = false;
+   m_proxy_depth_stencil_state.m_write = false;
+
+   m_prepass_blend_state.m_enabled = false;
+   m_prepass_blend_state.m_color_write = false;
+   m_equal_depth_stencil_state.m_write = false;
+   m_equal_depth_stencil_state.m_func = depth_stencil_state_t::compare_func_t::equal;
+
+   m_particle_blend_state.m_color_src = blend_state_t::blend_factor_t::one;
+   m_particle_blend_state.m_color_dest = blend_state_t::blend_factor_t::one;
+   m_particle_depth_stencil_state.m_write = false;
+   m_particle_rasterizer_state.m_cull_mode = rasterizer_state_t::cull_mode_t::none;
+
+   // note: the camera is inside the skybox cube, so its inside faces are the front ones
+   m_skybox_depth_stencil_state.m_write = false;
+   m_skybox_depth_stencil_state.m_func = depth_stencil_state_t::compare_func_t::less_equal;
+   m_skybox_rasterizer_state.m_cull_mode = rasterizer_state_t::cull_mode_t::front;
+
+   const program_cache_stats_t &cache_stats = program_cache_t::stats();
+   debug::info("program cache - hits: %d misses: %d rejected: %d load: %2.3fms compile: %2.3fms",
+               cache_stats.m_hits,
+               cache_stats.m_misses,
+               cache_stats.m_rejected,
+               cache_stats.m_load_ms,
+               cache_stats.m_compile_ms);
+
    return true;
 }
 
@@ -62,103 +154,698 @@ bool application_t::makeObjects()
     return success;
 }
 
-bool application_t::setTextures()
+void application_t::makeScene()
 {
-    bool success = true;
-    success &= m_textureSun.create_from_file("assets/8k_sun.jpg");
-    success &= m_textureMercury.create_from_file("assets/8k_mercury.jpg");
-    success &= m_textureVenus.create_from_file("assets/8k_venus.jpg");
-    success &= m_textureEarth.create_from_file("assets/8k_earth.jpg");
-    success &= m_textureMoon.create_from_file("assets/8k_moon.jpg");
-    success &= m_textureMars.create_from_file("assets/8k_mars.jpg");
-    success &= m_textureJupiter.create_from_file("assets/8k_jupiter.jpg");
-    success &= m_textureSaturn.create_from_file("assets/8k_saturn.jpg");
-    success &= m_textureUranus.create_from_file("assets/2k_uranus.jpg");
-    success &= m_textureNeptune.create_from_file("assets/2k_neptune.jpg");
-    putTexturesInVector();
-    return success;
+   // note: one entry per texture, moons reference the body they orbit
+   struct body_desc_t {
+      int   parent;
+      float distance;
+      float size;
+      float orbit_speed;
+      float spin_speed;
+      float emissive;
+   };
+
+   constexpr body_desc_t descs[] =
+   {
+      { -1,  0.0f, 4.0f, 0.0f , 0.1f, 1.0f }, // sun
+      { -1,  4.0f, 0.4f, 1.6f , 0.4f, 0.0f }, // mercury
+      { -1,  5.5f, 0.7f, 1.2f , 0.3f, 0.0f }, // venus
+      { -1,  7.5f, 0.8f, 1.0f , 1.0f, 0.0f }, // earth
+      {  3,  1.2f, 0.25f, 3.0f, 0.5f, 0.0f }, // moon
+      { -1,  9.5f, 0.5f, 0.8f , 1.0f, 0.0f }, // mars
+      { -1, 13.0f, 2.0f, 0.4f , 2.0f, 0.0f }, // jupiter
+      { -1, 17.0f, 1.7f, 0.3f , 1.8f, 0.0f }, // saturn
+      { -1, 20.5f, 1.2f, 0.2f , 1.4f, 0.0f }, // uranus
+      { -1, 23.5f, 1.2f, 0.15f, 1.5f, 0.0f }, // neptune
+   };
+
+   // note: a ring of small colored lights circles every body that is not emissive
+   constexpr uint32_t lights_per_ring = 28;
+   constexpr glm::vec3 ring_colors[] =
+   {
+      { 1.0f, 0.35f, 0.2f },
+      { 0.3f, 0.6f, 1.0f },
+      { 0.4f, 1.0f, 0.5f },
+      { 1.0f, 0.9f, 0.4f },
+   };
+
+   m_scene.clear();
+   m_bodies.clear();
+   m_lights.clear();
+
+   constexpr float system_origin_z = -55.0f;
+   constexpr float system_tilt = 0.4f;
+   m_root_node = m_scene.add_node();
+   m_scene.set_position(m_root_node, glm::vec3(0.0f, 0.0f, system_origin_z));
+   m_scene.set_rotation(m_root_node, glm::angleAxis(system_tilt, glm::vec3(1.0f, 0.0f, 0.0f)));
+
+   // note: orbit pivots around the parent anchor, the anchor carries the orbit 
+   //       distance and the body node adds spin and size on top of that, so
+   //       moons follow their planet without inheriting its spin or scale
+   for (const auto &desc : descs) {
+      const uint32_t parent = desc.parent < 0 ? m_root_node : m_bodies[desc.parent].m_anchor_node;
+
+      body_t body;
+      body.m_orbit_node = m_scene.add_node(parent);
+      body.m_anchor_node = m_scene.add_node(body.m_orbit_node);
+      body.m_body_node = m_scene.add_node(body.m_anchor_node);
+      body.m_orbit_speed = desc.orbit_speed;
+      body.m_spin_speed = desc.spin_speed;
+      body.m_emissive = desc.emissive;
+
+      m_scene.set_position(body.m_anchor_node, glm::vec3(desc.distance, 0.0f, 0.0f));
+      m_scene.set_scale(body.m_body_node, glm::vec3(desc.size));
+
+      if (desc.emissive > 0.0f) {
+         light_t light;
+         light.m_node = body.m_body_node;
+         light.m_light.m_radius = 60.0f;
+         light.m_light.m_color = glm::vec3(1.0f, 0.95f, 0.85f);
+         light.m_light.m_intensity = 1.2f;
+         m_lights.push_back(light);
+      }
+      else {
+         body.m_light_ring_node = m_scene.add_node(body.m_anchor_node);
+         for (uint32_t index = 0; index < lights_per_ring; index++) {
+            const float angle = 2.0f * std::numbers::pi_v<float> * float(index) / float(lights_per_ring);
+            const float distance = desc.size * 1.1f;
+
+            light_t light;
+            light.m_node = m_scene.add_node(body.m_light_ring_node);
+            light.m_light.m_radius = desc.size * 1.2f;
+            light.m_light.m_color = ring_colors[index % std::size(ring_colors)];
+            light.m_light.m_intensity = 0.6f;
+            m_scene.set_position(light.m_node, glm::vec3(std::cos(angle) * distance, 0.0f, std::sin(angle) * distance));
+            m_lights.push_back(light);
+         }
+      }
+
+      m_bodies.push_back(body);
+   }
 }
 
-void application_t::putTexturesInVector()
+bool application_t::setTextures()
 {
-    m_textures.push_back(m_textureSun);
-    m_textures.push_back(m_textureMercury);
-    m_textures.push_back(m_textureVenus);
-    m_textures.push_back(m_textureEarth);
-    m_textures.push_back(m_textureMoon);
-    m_textures.push_back(m_textureMars);
-    m_textures.push_back(m_textureJupiter);
-    m_textures.push_back(m_textureSaturn);
-    m_textures.push_back(m_textureUranus);
-    m_textures.push_back(m_textureNeptune);
+    // note: decoding is most of the load time, spread it over the job system,
+    //       the uploads need the context and stay on this thread
+    constexpr int texture_count = 11;
+    const char *filenames[texture_count] =
+    {
+        "assets/8k_sun.jpg",
+        "assets/8k_mercury.jpg",
+        "assets/8k_venus.jpg",
+        "assets/8k_earth.jpg",
+        "assets/8k_moon.jpg",
+        "assets/8k_mars.jpg",
+        "assets/8k_jupiter.jpg",
+        "assets/8k_saturn.jpg",
+        "assets/2k_uranus.jpg",
+        "assets/2k_neptune.jpg",
+        "assets/8k_stars.jpg",
+    };
+    // note: one texture per body in body order, the starfield comes last
+    constexpr int skybox_index = texture_count - 1;
+
+    // note: the maps are equirectangular, as cubemaps the poles stop hogging 
+    //       texels and the shaders sample by direction instead of doing trig,
+    //       a quarter of the width keeps the equator's texel density, so an
+    //       8k map gets 2048 faces at about 3/4 of its texels
+
+    image_t images[texture_count];
+    job_system_t::parallel_for(texture_count, 1, [&](const uint32_t begin, const uint32_t end) {
+        for (uint32_t index = begin; index < end; index++) {
+            images[index].load_from_file(filenames[index]);
+        }
+    });
+
+    bool success = true;
+    for (int index = 0; index < texture_count; index++) {
+        const bool skybox = index == skybox_index;
+        const int face_size = images[index].m_width / 4;
+
+        texture_handle_t handle;
+        cubemap_image_t cubemap;
+        if (cubemap.create_from_equirect(images[index], face_size)) {
+            const void *faces[cubemap_image_t::face_count] = {};
+            for (int face = 0; face < cubemap_image_t::face_count; face++) {
+                faces[face] = cubemap.face(face);
+            }
+            handle = m_resources.create_cube_texture(cubemap.m_size, faces, texture_t::pixel_format_for(cubemap.m_components));
+        }
+        success &= handle.valid();
+        cubemap.destroy();
+        images[index].destroy();
+
+        if (skybox) {
+            m_textureStars = handle;
+        }
+        else {
+            m_textures.push_back(handle);
+        }
+    }
+
+    return success;
 }
 
 void application_t::on_shutdown()
 {
+   m_renderer.gpu_profiler().save_csv("gpu_timings.csv");
+
+   const char *latch_names[] = { "off", "on" };
+   for (int index = 0; index < 2; index++) {
+      const input_latency_t &latency = m_input_latency[index];
+      if (latency.m_frames > 0) {
+         debug::info("input to present (late latch %s) - frames: %d avg: %2.3fms max: %2.3fms",
+                     latch_names[index],
+                     latency.m_frames,
+                     latency.m_total_ms / latency.m_frames,
+                     latency.m_max_ms);
+      }
+   }
+
+   // note: averages over the frames each mode was active for, gpu time covers the pre-pass too
+   const char *prepass_names[] = { "off", "on" };
+   const char *opaque_passes[] = { "opaque", "opaque prepass" };
+   for (int index = 0; index < 2; index++) {
+      const fragment_counter_t &counter = m_fragment_counters[index];
+      const gpu_profiler_t::pass_t *pass = m_renderer.gpu_profiler().find(opaque_passes[index]);
+      if (counter.m_resolved > 0) {
+         debug::info("depth prepass %s - frames: %lld %s/frame: %llu gpu: %2.3fms",
+                     prepass_names[index],
+                     (long long)counter.m_resolved,
+                     m_renderer.fragment_invocations_supported() ? "fragment invocations" : "samples passed",
+                     (unsigned long long)(counter.m_total / uint64_t(counter.m_resolved)),
+                     pass ? pass->average() : 0.0f);
+      }
+   }
+
+   const light_cluster_stats_t &light_stats = m_light_clusters.stats();
+   debug::info("light clusters - lights: %u indices: %u max per cluster: %u overflowed: %u",
+               light_stats.m_lights,
+               light_stats.m_indices,
+               light_stats.m_max_per_cluster,
+               light_stats.m_overflowed);
+
+   for (auto &body : m_bodies) {
+      body.m_query.destroy();
+   }
+
+   for (auto &counter : m_fragment_counters) {
+      counter.destroy();
+   }
+
+   const resource_stats_t resource_stats = m_resources.stats();
+   debug::info("resources - textures: %u (%2.1f mtexels) samplers: %u vertex buffers: %u retired: %u recycled: %u reused: %llu destroyed: %llu",
+               resource_stats.m_textures,
+               double(resource_stats.m_texels) / 1000000.0,
+               resource_stats.m_samplers,
+               resource_stats.m_vertex_buffers,
+               resource_stats.m_retired,
+               resource_stats.m_recycled,
+               (unsigned long long)resource_stats.m_reused,
+               (unsigned long long)resource_stats.m_destroyed);
+
+   m_corona.destroy();
+   m_asteroids.destroy();
+   m_debris.destroy();
+   m_light_clusters.destroy();
+   m_resources.destroy();
+   m_shaders.destroy();
+   m_frame_arena.destroy();
 }
 
 bool application_t::on_update(const timespan_t &deltatime,
                               const timespan_t &apptime)
 {
-   constexpr float cube_origin_z = -12.0f;
-   m_position.z = cube_origin_z;
-   m_rotation.z += deltatime.elapsed_seconds();
+   profile_scope("application_t::on_update");
+
+   // note: deltatime is a fixed step, keep the previous state around for on_interpolate
+   const float dt = deltatime.elapsed_seconds();
+   for (auto &body : m_bodies) {
+      body.m_previous_orbit_angle = body.m_orbit_angle;
+      body.m_previous_spin_angle = body.m_spin_angle;
+      body.m_orbit_angle += body.m_orbit_speed * dt;
+      body.m_spin_angle += body.m_spin_speed * dt;
+   }
 
-   m_world = glm::translate(glm::mat4(1.0f), m_position) *
-      glm::rotate(glm::mat4(1.0f), m_rotation.x, glm::vec3(1.0f, 0.0f, 0.0f)) *
-      glm::rotate(glm::mat4(1.0f), m_rotation.y, glm::vec3(0.0f, 1.0f, 0.0f)) *
-      glm::rotate(glm::mat4(1.0f), m_rotation.z, glm::vec3(0.0f, 0.0f, 1.0f))
-      ;
+   m_step_seconds = dt;
+   m_previous_orbit_time = m_orbit_time;
+   m_orbit_time += double(dt);
+   m_debris.step(dt);
 
    return m_running;
 }
 
-void application_t::on_render(const viewport_t &viewport)
+void application_t::on_interpolate(const float alpha)
+{
+   profile_scope("application_t::on_interpolate");
+
+   // note: blend between the last two simulation steps so motion stays smooth
+   //       when the render rate does not match the simulation rate
+   const glm::vec3 up_axis(0.0f, 1.0f, 0.0f);
+   const glm::vec3 ring_axis = glm::normalize(glm::vec3(0.3f, 1.0f, 0.0f));
+   for (auto &body : m_bodies) {
+      const float orbit_angle = glm::mix(body.m_previous_orbit_angle, body.m_orbit_angle, alpha);
+      const float spin_angle = glm::mix(body.m_previous_spin_angle, body.m_spin_angle, alpha);
+
+      m_scene.set_rotation(body.m_orbit_node, glm::angleAxis(orbit_angle, up_axis));
+      m_scene.set_rotation(body.m_body_node, glm::angleAxis(spin_angle, up_axis));
+      if (body.m_light_ring_node != scene_graph_t::invalid_node) {
+         m_scene.set_rotation(body.m_light_ring_node, glm::angleAxis(-2.0f * orbit_angle, ring_axis));
+      }
+   }
+
+   m_scene.update(true);
+
+   // note: the debris only has its latest step, extrapolate back from it
+   m_interpolated_orbit_time = m_previous_orbit_time + (m_orbit_time - m_previous_orbit_time) * double(alpha);
+   m_debris_offset = (alpha - 1.0f) * m_step_seconds;
+}
+
+void application_t::on_snapshot(const viewport_t &viewport, render_snapshot_t &snapshot)
 {
+   profile_scope("application_t::on_snapshot");
+
+   snapshot.m_frame = m_frame++;
+   snapshot.m_viewport = viewport;
+   snapshot.m_occlusion_culling = m_occlusion_culling;
+   snapshot.m_wireframe = m_wireframe;
+   snapshot.m_depth_prepass = m_depth_prepass;
+   snapshot.m_msaa_samples = m_msaa_samples;
+   snapshot.m_late_latch = m_late_latch;
+   snapshot.m_input = m_input_latch.load();
+
    // todo: remove this later
-   glm::mat4 projection = glm::perspective(std::numbers::pi_v<float> * 0.25f,
-                                           float(viewport.width) / viewport.height,
-                                           1.0f,
-                                           100.0f);
+   constexpr float field_of_view = std::numbers::pi_v<float> * 0.25f;
+   const float aspect = viewport.height > 0 ? float(viewport.width) / viewport.height : 1.0f;
+   snapshot.m_projection = glm::perspective(field_of_view,
+                                            aspect,
+                                            1.0f,
+                                            100.0f);
+
+   // note: the view may still be late latched on the render side, anywhere
+   //       from one end of the cursor range to the other, so cull with each
+   //       half angle widened by the full yaw (pitch) range, exact for a turn
+   //       on one axis and close for both, the horizontal half angle stays
+   //       short of 90 degrees for very wide windows
+   const float cull_half_y = field_of_view * 0.5f + 2.0f * camera_max_pitch;
+   const float cull_half_x = glm::min(std::atan(std::tan(field_of_view * 0.5f) * aspect) + 2.0f * camera_max_yaw, 1.5f);
+   const glm::mat4 clip = glm::perspective(2.0f * cull_half_y, std::tan(cull_half_x) / std::tan(cull_half_y), 1.0f, 100.0f) *
+                          camera_view(snapshot.m_input, viewport);
+   glm::vec4 planes[6];
+   for (int axis = 0; axis < 3; axis++) {
+      planes[axis * 2 + 0] = glm::row(clip, 3) + glm::row(clip, axis);
+      planes[axis * 2 + 1] = glm::row(clip, 3) - glm::row(clip, axis);
+   }
+
+   // note: vectors are assigned, not rebuilt, so pipeline slots keep their capacity
+   snapshot.m_world.resize(m_bodies.size());
+   snapshot.m_visible.clear();
+   for (uint32_t index = 0; index < uint32_t(m_bodies.size()); index++) {
+      const glm::mat4 &world = m_scene.world(m_bodies[index].m_body_node);
+      snapshot.m_world[index] = world;
+
+      // note: bounding sphere of the unit cube, scale is uniform
+      const glm::vec4 center = world[3];
+      const float radius = glm::length(glm::vec3(world[0])) * 0.8660254f;
+
+      bool visible = true;
+      for (const auto &plane : planes) {
+         const float distance = glm::dot(glm::vec3(plane), glm::vec3(center)) + plane.w;
+         if (distance < -radius * glm::length(glm::vec3(plane))) {
+            visible = false;
+            break;
+         }
+      }
+
+      if (visible) {
+         snapshot.m_visible.push_back(index);
+      }
+   }
+
+   // note: the belt itself is evaluated on the render side from the time alone
+   snapshot.m_system_world = m_scene.world(m_root_node);
+   snapshot.m_orbit_time = m_interpolated_orbit_time;
+   snapshot.m_debris.resize(m_debris.count());
+   m_debris.write_instances(m_debris_offset, &snapshot.m_debris.data()->x);
+
+   // note: not culled here, lights outside the frustum can still reach visible bodies
+   snapshot.m_lights.resize(m_lights.size());
+   for (size_t index = 0; index < m_lights.size(); index++) {
+      point_light_t &light = snapshot.m_lights[index];
+      light = m_lights[index].m_light;
+      light.m_position = glm::vec3(m_scene.world(m_lights[index].m_node)[3]);
+   }
+}
+
+void application_t::on_render(const viewport_t &viewport)
+{
+   on_snapshot(viewport, m_snapshot);
+   on_render(m_snapshot);
+}
+
+void application_t::on_present(const timespan_t &present_time)
+{
+   // note: only frames that showed input not seen before, an idle mouse is no latency
+   if (m_frame_input_time == timespan_t{} || m_frame_input_time == m_last_input_time) {
+      return;
+   }
+
+   const float latency_ms = (present_time - m_frame_input_time).elapsed_milliseonds();
+   input_latency_t &latency = m_input_latency[m_frame_input_latched ? 1 : 0];
+   latency.m_frames++;
+   latency.m_total_ms += latency_ms;
+   latency.m_max_ms = latency_ms > latency.m_max_ms ? latency_ms : latency.m_max_ms;
+
+   m_last_input_time = m_frame_input_time;
+}
+
+const gpu_profiler_t &application_t::gpu_profiler() const
+{
+   return m_renderer.gpu_profiler();
+}
+
+glm::mat4 application_t::camera_view(const input_latch_t::sample_t &input, const viewport_t &viewport)
+{
+   // note: no input yet, look straight ahead
+   if (input.time == timespan_t{} || viewport.width <= 0 || viewport.height <= 0) {
+      return glm::mat4(1.0f);
+   }
+
+   // note: cursor position maps directly to a small look offset around the center
+   const float yaw = (input.x / viewport.width - 0.5f) * 2.0f * camera_max_yaw;
+   const float pitch = (input.y / viewport.height - 0.5f) * 2.0f * camera_max_pitch;
+
+   return glm::rotate(glm::mat4(1.0f), pitch, glm::vec3(1.0f, 0.0f, 0.0f)) *
+          glm::rotate(glm::mat4(1.0f), yaw, glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+void application_t::on_render(const render_snapshot_t &snapshot)
+{
+   profile_scope("application_t::on_render");
+
+   m_shaders.update();
+   m_frame_arena.reset();
+
+   const viewport_t &viewport = snapshot.m_viewport;
+   m_rasterizer_state.m_polygon_mode = snapshot.m_wireframe ? rasterizer_state_t::polygon_mode_t::wireframe 
+                                                            : rasterizer_state_t::polygon_mode_t::fill;
 
    // note: done once
-   m_renderer.clear(color_t{ 0.1f, 0.2f, 0.3f, 1.0f });
-   m_renderer.set_viewport(viewport);
-   
-   // note: done for each object we want to render
-   for (unsigned int i = 0; i < m_textures.size(); i++) {
-       renderObject(projection, i);
+   m_renderer.begin_frame();
+   m_resources.begin_frame(m_renderer.frame_index(), m_renderer.completed_frame());
+
+   // note: no draw depends on it this frame, the update only has to be queued before the particles are drawn
+   {
+      gpu_scope_t scope(m_renderer, "particles update");
+      const float step = m_corona_time < 0.0 ? 0.0f : float(snapshot.m_orbit_time - m_corona_time);
+      m_corona.update(m_renderer, step, float(snapshot.m_orbit_time));
+      m_corona_time = snapshot.m_orbit_time;
+   }
+
+   // note: optionally render into a pooled multisampled target that is resolved at the end
+   render_target_t *target = nullptr;
+   if (snapshot.m_msaa_samples > 1 && viewport.width > 0 && viewport.height > 0) {
+      render_target_t::desc_t desc;
+      desc.m_width = viewport.width;
+      desc.m_height = viewport.height;
+      desc.m_samples = snapshot.m_msaa_samples;
+      target = m_renderer.acquire_render_target(desc);
+      m_renderer.set_render_target(target);
+   }
+
+   {
+      gpu_scope_t scope(m_renderer, "clear");
+      m_renderer.clear(color_t{ 0.1f, 0.2f, 0.3f, 1.0f });
+      m_renderer.set_viewport(target ? viewport_t{ 0, 0, viewport.width, viewport.height } : viewport);
    }
    
+   // note: late latch, resample the cursor right before the view is submitted, 
+   //       with a render thread the simulation has polled input since the snapshot
+   input_latch_t::sample_t input = snapshot.m_input;
+   if (snapshot.m_late_latch) {
+      const input_latch_t::sample_t latest = m_input_latch.load();
+      input = latest.time > input.time ? latest : input;
+   }
+
+   m_view = camera_view(input, viewport);
+   m_frame_input_time = input.time;
+   m_frame_input_latched = snapshot.m_late_latch;
+
+   // note: needs the final view, the tables are filled from the frame arena
+   {
+      const viewport_t cluster_viewport = target ? viewport_t{ 0, 0, viewport.width, viewport.height } : viewport;
+      m_light_clusters.bin(snapshot.m_lights.data(),
+                           uint32_t(snapshot.m_lights.size()),
+                           m_view,
+                           snapshot.m_projection,
+                           cluster_viewport,
+                           m_frame_arena);
+      m_light_clusters.upload();
+   }
+
+   // note: record a packet for each object we want to render, then submit them in state order
+   {
+      shader_program_t &program = snapshot.m_wireframe && m_wireframe_program->valid() ? *m_wireframe_program : *m_program;
+
+      // note: the material texture stays on unit 0, the light tables follow it
+      m_renderer.set_shader_program(program);
+      m_renderer.set_uniform("u_diffuse", 0);
+      m_light_clusters.bind(m_renderer, 1);
+
+      const size_t packet_count = snapshot.m_visible.size();
+      draw_packet_t *packets = m_frame_arena.allocate_array<draw_packet_t>(packet_count);
+      for (size_t index = 0; index < packet_count; index++) {
+         const uint32_t body = snapshot.m_visible[index];
+         draw_packet_t &packet = packets[index];
+         packet.m_body = body;
+         packet.m_program = &program;
+         packet.m_texture = m_textures.at(body);
+         packet.m_sort_key = (uint64_t(program.m_id) << 32) | packet.m_texture.m_value;
+      }
+
+      std::sort(packets, packets + packet_count, [](const draw_packet_t &lhs, const draw_packet_t &rhs) {
+         return lhs.m_sort_key < rhs.m_sort_key;
+      });
+
+      // note: the pre-pass lays down depth, shading then only passes where it is equal
+      const bool prepass = snapshot.m_depth_prepass && m_depth_only_program->valid();
+      gpu_scope_t scope(m_renderer, prepass ? "opaque prepass" : "opaque");
+      if (prepass) {
+         gpu_scope_t prepass_scope(m_renderer, "depth prepass");
+         renderDepthPrepass(snapshot, packets, packet_count);
+      }
+
+      fragment_counter_t &counter = m_fragment_counters[prepass ? 1 : 0];
+      const bool counting = m_renderer.begin_fragment_count(counter);
+      {
+         gpu_scope_t bodies_scope(m_renderer, "bodies");
+         depth_stencil_state_t &depth_stencil_state = prepass ? m_equal_depth_stencil_state : m_depth_stencil_state;
+         for (size_t index = 0; index < packet_count; index++) {
+            renderObject(snapshot, packets[index], depth_stencil_state);
+         }
+      }
+      if (counting) {
+         m_renderer.end_fragment_count();
+      }
+   }
+
+   if (m_asteroid_program->valid()) {
+      gpu_scope_t scope(m_renderer, "asteroids");
+      render_asteroids(snapshot);
+   }
+
+   // note: after the opaque bodies so the depth test rejects every covered pixel
+   if (m_skybox_program->valid()) {
+      gpu_scope_t scope(m_renderer, "skybox");
+      renderSkybox(snapshot);
+   }
+
+   // note: additive, tested against the finished depth buffer but not written
+   {
+      gpu_scope_t scope(m_renderer, "particles");
+      m_renderer.set_blend_state(m_particle_blend_state);
+      m_renderer.set_depth_stencil_state(m_particle_depth_stencil_state);
+      m_renderer.set_rasterizer_state(m_particle_rasterizer_state);
+      m_corona.draw(m_renderer, snapshot.m_projection, m_view, snapshot.m_system_world);
+      m_renderer.set_blend_state(m_blend_state);
+      m_renderer.set_depth_stencil_state(m_depth_stencil_state);
+      m_renderer.set_rasterizer_state(m_rasterizer_state);
+   }
+
+   // note: test against the finished depth buffer, results are used next frame
+   if (snapshot.m_occlusion_culling) {
+      gpu_scope_t scope(m_renderer, "occlusion");
+      renderOcclusionProxies(snapshot);
+   }
+
+   // note: the multisampled contents are not needed after the resolve
+   if (target) {
+      gpu_scope_t scope(m_renderer, "resolve");
+      m_renderer.set_render_target(nullptr);
+      m_renderer.resolve_render_target(*target, nullptr, viewport);
+      m_renderer.invalidate_render_target(*target, true, true);
+      m_renderer.release_render_target(target);
+   }
+
+   m_renderer.end_frame();
 }
 
-void application_t::renderObject(glm::mat4& projection, unsigned int i)
+void application_t::renderObject(const render_snapshot_t &snapshot, const draw_packet_t &packet, depth_stencil_state_t &depth_stencil_state)
 {
-    m_renderer.set_shader_program(m_program);
-    m_renderer.set_uniform("u_projection", projection);
-    m_renderer.set_uniform("u_world", m_world);
-    m_renderer.set_texture(m_textures.at(i));
-    m_renderer.set_sampler_state(m_sampler);
+    const uint32_t i = packet.m_body;
+    m_renderer.set_shader_program(*packet.m_program);
+    m_renderer.set_uniform("u_projection", snapshot.m_projection);
+    m_renderer.set_uniform("u_view", m_view);
+    m_renderer.set_uniform("u_world", snapshot.m_world.at(i));
+    m_renderer.set_uniform("u_material", glm::vec4(m_bodies.at(i).m_emissive, 0.08f, 0.0f, 0.0f));
+    m_renderer.set_texture(m_resources.get(packet.m_texture));
+    m_renderer.set_sampler_state(m_resources.get(m_sampler));
     m_renderer.set_blend_state(m_blend_state);
-    m_renderer.set_depth_stencil_state(m_depth_stencil_state);
+    m_renderer.set_depth_stencil_state(depth_stencil_state);
     m_renderer.set_rasterizer_state(m_rasterizer_state);
-    m_renderer.set_vertex_buffer_and_layout(m_objects.at(i), m_layout);
+    m_renderer.set_vertex_buffer_and_layout(m_resources.get(m_objects.at(i)), m_layout);
+
+    if (snapshot.m_occlusion_culling) {
+       m_renderer.begin_conditional_render(m_bodies.at(i).m_query);
+    }
+
     m_renderer.draw(topology_t::triangle_list, 0, m_cube_primitive_count);
+    m_renderer.end_conditional_render();
+}
+
+void application_t::renderDepthPrepass(const render_snapshot_t &snapshot, const draw_packet_t *packets, const size_t count)
+{
+   // note: same vertex shader and transforms as the shading pass, position only
+   m_renderer.set_shader_program(*m_depth_only_program);
+   m_renderer.set_uniform("u_projection", snapshot.m_projection);
+   m_renderer.set_uniform("u_view", m_view);
+   m_renderer.set_blend_state(m_prepass_blend_state);
+   m_renderer.set_depth_stencil_state(m_prepass_depth_stencil_state);
+   m_renderer.set_rasterizer_state(m_rasterizer_state);
+
+   for (size_t index = 0; index < count; index++) {
+      const uint32_t i = packets[index].m_body;
+      m_renderer.set_uniform("u_world", snapshot.m_world[i]);
+      m_renderer.set_vertex_buffer_and_layout(m_resources.get(m_objects[i]), m_layout);
+
+      if (snapshot.m_occlusion_culling) {
+         m_renderer.begin_conditional_render(m_bodies[i].m_query);
+      }
+
+      m_renderer.draw(topology_t::triangle_list, 0, m_cube_primitive_count);
+      m_renderer.end_conditional_render();
+   }
+}
+
+void application_t::renderOcclusionProxies(const render_snapshot_t &snapshot)
+{
+   // note: the proxy is the body cube grown slightly so it never z-fights 
+   //       with the body itself when that was drawn
+   constexpr float proxy_scale = 1.05f;
+
+   m_renderer.set_shader_program(m_depth_only_program->valid() ? *m_depth_only_program : *m_program);
+   m_renderer.set_uniform("u_projection", snapshot.m_projection);
+   m_renderer.set_uniform("u_view", m_view);
+   m_renderer.set_blend_state(m_proxy_blend_state);
+   m_renderer.set_depth_stencil_state(m_proxy_depth_stencil_state);
+   m_renderer.set_rasterizer_state(m_proxy_rasterizer_state);
+   m_renderer.set_vertex_buffer_and_layout(m_resources.get(m_cube), m_layout);
+
+   // note: frustum culled bodies keep their last query result
+   for (const uint32_t i : snapshot.m_visible) {
+      const glm::mat4 proxy = glm::scale(snapshot.m_world[i], glm::vec3(proxy_scale));
+      m_renderer.set_uniform("u_world", proxy);
+
+      if (m_renderer.begin_occlusion_query(m_bodies[i].m_query)) {
+         m_renderer.draw(topology_t::triangle_list, 0, m_cube_primitive_count);
+         m_renderer.end_occlusion_query();
+      }
+   }
+
+   // note: restore the default write masks for whoever draws next
+   m_renderer.set_blend_state(m_blend_state);
+   m_renderer.set_depth_stencil_state(m_depth_stencil_state);
+   m_renderer.set_rasterizer_state(m_rasterizer_state);
+}
+
+void application_t::renderSkybox(const render_snapshot_t &snapshot)
+{
+   m_renderer.set_shader_program(*m_skybox_program);
+   m_renderer.set_uniform("u_projection", snapshot.m_projection);
+   m_renderer.set_uniform("u_view", m_view);
+   m_renderer.set_texture(m_resources.get(m_textureStars));
+   m_renderer.set_sampler_state(m_resources.get(m_skybox_sampler));
+   m_renderer.set_blend_state(m_blend_state);
+   m_renderer.set_depth_stencil_state(m_skybox_depth_stencil_state);
+   m_renderer.set_rasterizer_state(m_skybox_rasterizer_state);
+   m_renderer.set_vertex_buffer_and_layout(m_resources.get(m_cube), m_layout);
+   m_renderer.draw(topology_t::triangle_list, 0, m_cube_primitive_count);
+
+   m_renderer.set_depth_stencil_state(m_depth_stencil_state);
+   m_renderer.set_rasterizer_state(m_rasterizer_state);
+}
+
+void application_t::render_asteroids(const render_snapshot_t &snapshot)
+{
+   const uint32_t asteroid_count = m_asteroids.count();
+   const uint32_t debris_count = uint32_t(snapshot.m_debris.size());
+   const uint32_t instance_count = asteroid_count + debris_count;
+   if (instance_count == 0) {
+      return;
+   }
+
+   // note: the solver writes straight into the driver's memory, no staging copy
+   vertex_buffer_t &instances = m_resources.get(m_instances);
+   float *data = static_cast<float *>(instances.map(sizeof(glm::vec4) * instance_count));
+   if (data == nullptr) {
+      return;
+   }
+
+   m_asteroids.evaluate(snapshot.m_orbit_time, data);
+   memcpy(data + size_t(asteroid_count) * 4, snapshot.m_debris.data(), sizeof(glm::vec4) * debris_count);
+   instances.unmap();
+
+   m_renderer.set_shader_program(*m_asteroid_program);
+   m_renderer.set_uniform("u_projection", snapshot.m_projection);
+   m_renderer.set_uniform("u_view", m_view);
+   m_renderer.set_uniform("u_world", snapshot.m_system_world);
+   m_renderer.set_uniform("u_material", glm::vec4(0.0f, 0.08f, 0.0f, 0.0f));
+   m_light_clusters.bind(m_renderer, 1);
+   m_renderer.set_blend_state(m_blend_state);
+   m_renderer.set_depth_stencil_state(m_depth_stencil_state);
+   m_renderer.set_rasterizer_state(m_rasterizer_state);
+   m_renderer.set_vertex_buffer_and_layout(m_resources.get(m_cube), m_layout);
+   m_renderer.set_vertex_buffer_and_layout(instances, m_instance_layout);
+   m_renderer.draw_instanced(topology_t::triangle_list, 0, m_cube_primitive_count, int(instance_count));
 }
 
 void application_t::on_event(const mouse_moved_t &event)
 {
+   m_input_latch.store({ float(event.x), float(event.y), event.time });
 }
 
 void application_t::on_event(const key_pressed_t &event)
 {
+   if (event.keycode == GLFW_KEY_O) {
+      m_occlusion_culling = !m_occlusion_culling;
+   }
+
+   if (event.keycode == GLFW_KEY_L) {
+      m_late_latch = !m_late_latch;
+   }
+
+   if (event.keycode == GLFW_KEY_M) {
+      m_msaa_samples = m_msaa_samples > 1 ? 1 : 4;
+   }
+
+   if (event.keycode == GLFW_KEY_Z) {
+      m_depth_prepass = !m_depth_prepass;
+   }
+
    if (event.keycode == GLFW_KEY_SPACE) {
-      if (m_rasterizer_state.m_polygon_mode == rasterizer_state_t::polygon_mode_t::fill) {
-         m_rasterizer_state.m_polygon_mode = rasterizer_state_t::polygon_mode_t::wireframe;
-      }
-      else {
-         m_rasterizer_state.m_polygon_mode = rasterizer_state_t::polygon_mode_t::fill;
-      }
+      m_wireframe = !m_wireframe;
    }
 }
 
@@ -177,7 +864,7 @@ void application_t::on_event(const button_released_t &event)
 {
 }
 
-bool application_t::make_cube(vertex_buffer_t &buffer, vertex_layout_t &layout, int &primitive_count, float size)
+bool application_t::make_cube(vertex_buffer_handle_t &buffer, vertex_layout_t &layout, int &primitive_count, float size)
 {
    // todo: move this to a shared header!
    struct vertex3d_t {
@@ -277,9 +964,67 @@ bool application_t::make_cube(vertex_buffer_t &buffer, vertex_layout_t &layout,
       .add(attribute_type_t::float_, 4, false);
 
    primitive_count = sizeof(vertices) / sizeof(vertices[0]);
-   if (!buffer.create(sizeof(vertices), vertices)) {
+   buffer = m_resources.create_vertex_buffer(sizeof(vertices), vertices);
+   if (!buffer.valid()) {
       return false;
    }
    m_objects.push_back(buffer);
    return true;
 }
+
+bool application_t::make_belt()
+{
+   // note: matches the planets, earth at 7.5 units goes round at one radian per second
+   constexpr float central_gm = 420.0f;
+   constexpr uint32_t debris_count = 256;
+
+   // note: fixed seed, the belt looks the same every run
+   uint32_t state = 0x2545f491u;
+   auto random = [&state](const float min, const float max) {
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      return min + (max - min) * float(state >> 8) * (1.0f / 16777216.0f);
+   };
+
+   // note: between mars and jupiter
+   if (!m_asteroids.create(m_asteroid_count, central_gm)) {
+      return false;
+   }
+
+   constexpr float two_pi = 2.0f * std::numbers::pi_v<float>;
+   for (uint32_t index = 0; index < m_asteroid_count; index++) {
+      kepler_elements_t elements;
+      elements.m_semi_major_axis = random(10.6f, 11.9f);
+      elements.m_eccentricity = random(0.0f, 0.12f);
+      elements.m_inclination = random(0.0f, 0.08f);
+      elements.m_ascending_node = random(0.0f, two_pi);
+      elements.m_argument_of_periapsis = random(0.0f, two_pi);
+      elements.m_mean_anomaly = random(0.0f, two_pi);
+      m_asteroids.add(elements, random(0.03f, 0.09f));
+   }
+
+   // note: a loose swarm of fragments past jupiter that pull on each other
+   if (!m_debris.create(debris_count, central_gm, 0.05f)) {
+      return false;
+   }
+
+   for (uint32_t index = 0; index < debris_count; index++) {
+      const float position[3] = { 15.0f + random(-0.6f, 0.6f), random(-0.2f, 0.2f), random(-0.6f, 0.6f) };
+      const float speed = std::sqrt(central_gm / position[0]);
+      const float velocity[3] = { random(-0.05f, 0.05f), random(-0.05f, 0.05f), -speed + random(-0.05f, 0.05f) };
+      m_debris.add(position, velocity, 0.002f, random(0.05f, 0.1f));
+   }
+
+   debug::info("orbits: %u asteroids %u debris - %s kernels", m_asteroids.count(), m_debris.count(), orbit_kernels::selected().m_name);
+
+   m_instance_layout
+      .clear()
+      .per_instance(3)
+      .add(attribute_type_t::float_, 4, false);
+
+   m_instances = m_resources.create_vertex_buffer(sizeof(glm::vec4) * (m_asteroid_count + debris_count),
+                                                  nullptr,
+                                                  vertex_buffer_t::usage_hint_t::dynamic);
+   return m_instances.valid();
+}
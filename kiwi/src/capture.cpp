@@ -0,0 +1,1443 @@
+// capture.cpp
+
+#include "capture.hpp"
+#include "system.hpp"
+#include "profiler.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <cstddef>
+#pragma warning(push)
+#pragma warning(disable: 4201) // nonstandard extension used: nameless struct/union
+#include <glm/gtc/type_ptr.hpp>
+#pragma warning(pop)
+
+namespace
+{
+   enum class opcode_t : uint8_t {
+      begin_frame = 1,
+      end_frame,
+      clear,
+      set_viewport,
+      set_render_target,
+      resolve_render_target,
+      invalidate_render_target,
+      acquire_render_target,
+      release_render_target,
+      define_name,
+      create_program,
+      destroy_program,
+      set_shader_program,
+      set_uniform_int,
+      set_uniform_vec3,
+      set_uniform_vec4,
+      set_uniform_mat4,
+      create_texture,
+      create_texture_cube,
+      update_texture,
+      update_texture_cube,
+      destroy_texture,
+      set_texture,
+      create_sampler_state,
+      destroy_sampler_state,
+      set_sampler_state,
+      create_vertex_buffer,
+      update_vertex_buffer,
+      destroy_vertex_buffer,
+      set_vertex_buffer_and_layout,
+      create_texture_buffer,
+      update_texture_buffer,
+      destroy_texture_buffer,
+      set_texture_buffer,
+      set_blend_state,
+      set_depth_stencil_state,
+      set_rasterizer_state,
+      draw,
+      draw_instanced,
+      begin_transform_feedback,
+      end_transform_feedback,
+      create_occlusion_query,
+      destroy_occlusion_query,
+      begin_occlusion_query,
+      end_occlusion_query,
+      begin_conditional_render,
+      end_conditional_render,
+      create_fragment_counter,
+      destroy_fragment_counter,
+      begin_fragment_count,
+      end_fragment_count,
+      begin_gpu_marker,
+      end_gpu_marker,
+   };
+
+   struct header_t {
+      char     m_magic[4];
+      uint32_t m_version;
+      int32_t  m_width;
+      int32_t  m_height;
+      uint64_t m_frames;
+   };
+
+   constexpr char capture_magic[4] = { 'k', 'w', 'r', 'c' };
+   constexpr uint32_t max_feedback_varyings = 16;
+
+   render_capture_t *active_capture = nullptr;
+
+   // note: what glTexImage2D reads, rows are padded to 'alignment' except the last one
+   size_t
+   texture_data_size(const int width, const int height, const texture_t::pixel_format_t format, const size_t alignment)
+   {
+      constexpr size_t bytes_per_pixel[] = { 1, 2, 3, 4 };
+      static_assert(int(texture_t::pixel_format_t::count) == (sizeof(bytes_per_pixel) / sizeof(bytes_per_pixel[0])), "texture pixel_format mismatch!");
+      if (width <= 0 || height <= 0 || format >= texture_t::pixel_format_t::count) {
+         return 0;
+      }
+
+      const size_t row = size_t(width) * bytes_per_pixel[int(format)];
+      const size_t pitch = (row + alignment - 1) / alignment * alignment;
+      return pitch * size_t(height - 1) + row;
+   }
+
+   FILE *
+   open_capture_file(const std::string_view &filename, const char *mode)
+   {
+      const std::string path(filename);
+#if defined(_MSC_VER)
+      FILE *file = nullptr;
+      fopen_s(&file, path.c_str(), mode);
+      return file;
+#else
+      return fopen(path.c_str(), mode);
+#endif
+   }
+} // !anonymous
+
+render_capture_t *render_capture_t::active()
+{
+   return active_capture;
+}
+
+bool render_capture_t::begin(const std::string_view &filename, const int width, const int height)
+{
+   if (active_capture) {
+      debug::error("capture: another capture is already running!");
+      return false;
+   }
+
+   m_file = open_capture_file(filename, "wb");
+   if (m_file == nullptr) {
+      debug::error("capture: could not open '%s'!", filename);
+      return false;
+   }
+
+   m_filename = filename;
+   m_buffer.clear();
+   m_buffer.reserve(buffer_size);
+   m_failed = false;
+   m_name_count = 0;
+   m_name_bytes_used = 0;
+   m_commands = 0;
+   m_frames = 0;
+   m_bytes = 0;
+   for (auto &slot : m_names) {
+      slot = name_slot_t{};
+   }
+
+   header_t header = {};
+   memcpy(header.m_magic, capture_magic, sizeof(capture_magic));
+   header.m_version = version;
+   header.m_width = width;
+   header.m_height = height;
+   write(header);
+
+   active_capture = this;
+   debug::info("capture: recording to '%s' (%dx%d)", filename, width, height);
+
+   return true;
+}
+
+void render_capture_t::end()
+{
+   if (active_capture != this) {
+      return;
+   }
+
+   active_capture = nullptr;
+   flush();
+
+   // note: the frame count is only known now, patch it into the header
+   fseek(m_file, long(offsetof(header_t, m_frames)), SEEK_SET);
+   fwrite(&m_frames, sizeof(m_frames), 1, m_file);
+   fclose(m_file);
+   m_file = nullptr;
+
+   // note: an incomplete stream would replay wrong, rather have none
+   if (m_failed) {
+      remove(m_filename.c_str());
+      debug::error("capture: failed, '%s' was removed", m_filename);
+   }
+   else {
+      debug::info("capture: %llu frames %llu commands %2.3fmb",
+                  (unsigned long long)m_frames,
+                  (unsigned long long)m_commands,
+                  double(m_bytes) / (1024.0 * 1024.0));
+   }
+
+   m_buffer = {};
+   m_staging = {};
+   m_staging_size = 0;
+   m_staging_mapped = false;
+}
+
+void render_capture_t::command(const uint8_t opcode)
+{
+   m_commands++;
+   write(opcode);
+}
+
+template <typename... Args>
+void render_capture_t::fail(const char *format, const Args &...args)
+{
+   if (!m_failed) {
+      debug::error(format, args...);
+      m_failed = true;
+   }
+}
+
+void render_capture_t::write(const void *data, const size_t size)
+{
+   // note: a failed capture stays active until end() so mapped buffers still work
+   if (m_failed) {
+      return;
+   }
+
+   m_bytes += size;
+   if (m_buffer.size() + size > buffer_size) {
+      flush();
+   }
+
+   // note: texture and buffer contents go straight to the file
+   if (size > buffer_size) {
+      fwrite(data, 1, size, m_file);
+      return;
+   }
+
+   const uint8_t *bytes = static_cast<const uint8_t *>(data);
+   m_buffer.insert(m_buffer.end(), bytes, bytes + size);
+}
+
+void render_capture_t::write_string(const std::string_view &value)
+{
+   // note: zero terminated so the replay can hand it to gl as is
+   const char terminator = 0;
+   write(uint32_t(value.length()));
+   write(value.data(), value.length());
+   write(terminator);
+}
+
+uint16_t render_capture_t::name_index(const std::string_view &name)
+{
+   const uint32_t hash = fnv1a32(name.data(), name.length());
+   constexpr uint32_t slot_count = max_names * 2;
+
+   uint32_t slot = hash % slot_count;
+   while (m_names[slot].m_used) {
+      const name_slot_t &entry = m_names[slot];
+      if (entry.m_hash == hash && std::string_view(m_name_bytes + entry.m_offset, entry.m_length) == name) {
+         return entry.m_index;
+      }
+      slot = (slot + 1) % slot_count;
+   }
+
+   // note: an index always means one name, the replay hands them out as marker names
+   if (m_name_count >= max_names || m_name_bytes_used + name.length() > max_name_bytes) {
+      fail("capture: out of uniform and marker names at '%s'!", name);
+      return 0;
+   }
+
+   const uint16_t index = uint16_t(m_name_count++);
+   memcpy(m_name_bytes + m_name_bytes_used, name.data(), name.length());
+   m_names[slot] = name_slot_t{ hash, m_name_bytes_used, uint16_t(name.length()), index, true };
+   m_name_bytes_used += uint32_t(name.length());
+
+   command(uint8_t(opcode_t::define_name));
+   write(index);
+   write_string(name);
+
+   return index;
+}
+
+void render_capture_t::flush()
+{
+   if (m_file && !m_buffer.empty()) {
+      fwrite(m_buffer.data(), 1, m_buffer.size(), m_file);
+   }
+   m_buffer.clear();
+}
+
+void render_capture_t::begin_frame()
+{
+   command(uint8_t(opcode_t::begin_frame));
+}
+
+void render_capture_t::end_frame()
+{
+   command(uint8_t(opcode_t::end_frame));
+   m_frames++;
+}
+
+void render_capture_t::clear(const color_t &color, const float depth)
+{
+   command(uint8_t(opcode_t::clear));
+   write(color);
+   write(depth);
+}
+
+void render_capture_t::set_viewport(const viewport_t &viewport)
+{
+   command(uint8_t(opcode_t::set_viewport));
+   write(viewport);
+}
+
+void render_capture_t::set_render_target(const render_target_t *target)
+{
+   command(uint8_t(opcode_t::set_render_target));
+   write(target ? target->m_id : 0u);
+}
+
+void render_capture_t::resolve_render_target(const render_target_t &source, const render_target_t *destination, const viewport_t &viewport)
+{
+   command(uint8_t(opcode_t::resolve_render_target));
+   write(source.m_id);
+   write(destination ? destination->m_id : 0u);
+   write(viewport);
+}
+
+void render_capture_t::invalidate_render_target(const render_target_t &target, const bool color, const bool depth)
+{
+   command(uint8_t(opcode_t::invalidate_render_target));
+   write(target.m_id);
+   write(uint8_t((color ? 1 : 0) | (depth ? 2 : 0)));
+}
+
+void render_capture_t::acquire_render_target(const render_target_t::desc_t &desc, const render_target_t *target)
+{
+   command(uint8_t(opcode_t::acquire_render_target));
+   write(desc.m_width);
+   write(desc.m_height);
+   write(desc.m_samples);
+   write(uint8_t(desc.m_color_format));
+   write(uint8_t(desc.m_depth_format));
+   write(target ? target->m_id : 0u);
+   write(target ? target->m_color_texture.m_id : 0u);
+}
+
+void render_capture_t::release_render_target(const render_target_t &target)
+{
+   command(uint8_t(opcode_t::release_render_target));
+   write(target.m_id);
+}
+
+void render_capture_t::create_program(const uint32_t id,
+                                      const std::string_view &vertex_source,
+                                      const std::string_view &fragment_source,
+                                      const std::span<const char *const> feedback_varyings)
+{
+   command(uint8_t(opcode_t::create_program));
+   write(id);
+   write_string(vertex_source);
+   write_string(fragment_source);
+   write(uint8_t(feedback_varyings.size()));
+   for (const char *varying : feedback_varyings) {
+      write_string(varying);
+   }
+}
+
+void render_capture_t::destroy_program(const uint32_t id)
+{
+   command(uint8_t(opcode_t::destroy_program));
+   write(id);
+}
+
+void render_capture_t::set_shader_program(const shader_program_t &program)
+{
+   command(uint8_t(opcode_t::set_shader_program));
+   write(program.m_id);
+}
+
+void render_capture_t::set_uniform(const std::string_view &name, const int value)
+{
+   const uint16_t index = name_index(name);
+   command(uint8_t(opcode_t::set_uniform_int));
+   write(index);
+   write(int32_t(value));
+}
+
+void render_capture_t::set_uniform(const std::string_view &name, const glm::vec3 &value)
+{
+   const uint16_t index = name_index(name);
+   command(uint8_t(opcode_t::set_uniform_vec3));
+   write(index);
+   write(glm::value_ptr(value), sizeof(glm::vec3));
+}
+
+void render_capture_t::set_uniform(const std::string_view &name, const glm::vec4 &value)
+{
+   const uint16_t index = name_index(name);
+   command(uint8_t(opcode_t::set_uniform_vec4));
+   write(index);
+   write(glm::value_ptr(value), sizeof(glm::vec4));
+}
+
+void render_capture_t::set_uniform(const std::string_view &name, const glm::mat4 &value)
+{
+   const uint16_t index = name_index(name);
+   command(uint8_t(opcode_t::set_uniform_mat4));
+   write(index);
+   write(glm::value_ptr(value), sizeof(glm::mat4));
+}
+
+void render_capture_t::create_texture(const texture_t &texture, const void *data, const bool mipmap)
+{
+   const uint32_t size = data ? uint32_t(texture_data_size(texture.m_width, texture.m_height, texture.m_format, 4)) : 0;
+
+   command(uint8_t(opcode_t::create_texture));
+   write(texture.m_id);
+   write(texture.m_width);
+   write(texture.m_height);
+   write(uint8_t(texture.m_format));
+   write(uint8_t(mipmap ? 1 : 0));
+   write(size);
+   write(data, size);
+}
+
+void render_capture_t::create_texture_cube(const texture_t &texture, const void *const faces[cubemap_image_t::face_count], const bool mipmap)
+{
+   const uint32_t size = uint32_t(texture_data_size(texture.m_width, texture.m_height, texture.m_format, 1));
+
+   command(uint8_t(opcode_t::create_texture_cube));
+   write(texture.m_id);
+   write(texture.m_width);
+   write(uint8_t(texture.m_format));
+   write(uint8_t(mipmap ? 1 : 0));
+   write(size);
+   for (int face = 0; face < cubemap_image_t::face_count; face++) {
+      write(faces[face], size);
+   }
+}
+
+void render_capture_t::update_texture(const texture_t &texture, const void *data)
+{
+   const uint32_t size = uint32_t(texture_data_size(texture.m_width, texture.m_height, texture.m_format, 4));
+
+   command(uint8_t(opcode_t::update_texture));
+   write(texture.m_id);
+   write(size);
+   write(data, size);
+}
+
+void render_capture_t::update_texture_cube(const texture_t &texture, const void *const faces[cubemap_image_t::face_count])
+{
+   const uint32_t size = uint32_t(texture_data_size(texture.m_width, texture.m_height, texture.m_format, 1));
+
+   command(uint8_t(opcode_t::update_texture_cube));
+   write(texture.m_id);
+   write(size);
+   for (int face = 0; face < cubemap_image_t::face_count; face++) {
+      write(faces[face], size);
+   }
+}
+
+void render_capture_t::destroy_texture(const uint32_t id)
+{
+   command(uint8_t(opcode_t::destroy_texture));
+   write(id);
+}
+
+void render_capture_t::set_texture(const texture_t &texture, const int unit)
+{
+   command(uint8_t(opcode_t::set_texture));
+   write(texture.m_id);
+   write(uint8_t(unit));
+}
+
+void render_capture_t::create_sampler_state(const uint32_t id,
+                                            const sampler_state_t::filter_mode_t filter,
+                                            const sampler_state_t::address_mode_t address_u,
+                                            const sampler_state_t::address_mode_t address_v,
+                                            const sampler_state_t::address_mode_t address_w)
+{
+   command(uint8_t(opcode_t::create_sampler_state));
+   write(id);
+   write(uint8_t(filter));
+   write(uint8_t(address_u));
+   write(uint8_t(address_v));
+   write(uint8_t(address_w));
+}
+
+void render_capture_t::destroy_sampler_state(const uint32_t id)
+{
+   command(uint8_t(opcode_t::destroy_sampler_state));
+   write(id);
+}
+
+void render_capture_t::set_sampler_state(const sampler_state_t &sampler, const int unit)
+{
+   command(uint8_t(opcode_t::set_sampler_state));
+   write(sampler.m_id);
+   write(uint8_t(unit));
+}
+
+void render_capture_t::create_vertex_buffer(const vertex_buffer_t &buffer, const void *data)
+{
+   const uint64_t size = data ? uint64_t(buffer.m_size) : 0;
+
+   command(uint8_t(opcode_t::create_vertex_buffer));
+   write(buffer.m_id);
+   write(uint64_t(buffer.m_size));
+   write(uint8_t(buffer.m_usage));
+   write(size);
+   write(data, size_t(size));
+}
+
+void render_capture_t::update_vertex_buffer(const vertex_buffer_t &buffer, const void *data, const size_t size)
+{
+   command(uint8_t(opcode_t::update_vertex_buffer));
+   write(buffer.m_id);
+   write(uint64_t(size));
+   write(data, size);
+}
+
+void render_capture_t::destroy_vertex_buffer(const uint32_t id)
+{
+   command(uint8_t(opcode_t::destroy_vertex_buffer));
+   write(id);
+}
+
+void render_capture_t::set_vertex_buffer_and_layout(const vertex_buffer_t &buffer, const vertex_layout_t &layout)
+{
+   command(uint8_t(opcode_t::set_vertex_buffer_and_layout));
+   write(buffer.m_id);
+   write(layout.m_stride);
+   write(uint8_t(layout.m_count));
+   write(uint8_t(layout.m_first_index));
+   write(layout.m_divisor);
+   for (uint32_t index = 0; index < layout.m_count; index++) {
+      write(layout.m_attributes[index]);
+   }
+}
+
+void *render_capture_t::map_staging(const size_t size)
+{
+   assert(!m_staging_mapped);
+
+   if (m_staging.size() < size) {
+      m_staging.resize(size);
+   }
+
+   m_staging_size = size;
+   m_staging_mapped = true;
+
+   return m_staging.data();
+}
+
+const void *render_capture_t::staging() const
+{
+   return m_staging.data();
+}
+
+size_t render_capture_t::unmap_staging()
+{
+   if (!m_staging_mapped) {
+      return 0;
+   }
+
+   m_staging_mapped = false;
+   return m_staging_size;
+}
+
+void render_capture_t::create_texture_buffer(const texture_buffer_t &buffer, const texture_buffer_t::format_t format)
+{
+   command(uint8_t(opcode_t::create_texture_buffer));
+   write(buffer.m_texture_id);
+   write(uint64_t(buffer.m_capacity));
+   write(uint8_t(format));
+}
+
+void render_capture_t::update_texture_buffer(const texture_buffer_t &buffer, const void *data, const size_t size)
+{
+   command(uint8_t(opcode_t::update_texture_buffer));
+   write(buffer.m_texture_id);
+   write(uint64_t(size));
+   write(data, size);
+}
+
+void render_capture_t::destroy_texture_buffer(const uint32_t id)
+{
+   command(uint8_t(opcode_t::destroy_texture_buffer));
+   write(id);
+}
+
+void render_capture_t::set_texture_buffer(const texture_buffer_t &buffer, const int unit)
+{
+   command(uint8_t(opcode_t::set_texture_buffer));
+   write(buffer.m_texture_id);
+   write(uint8_t(unit));
+}
+
+void render_capture_t::set_blend_state(const blend_state_t &state)
+{
+   command(uint8_t(opcode_t::set_blend_state));
+   write(uint8_t((state.m_enabled ? 1 : 0) | (state.m_color_write ? 2 : 0)));
+   write(uint8_t(state.m_color_eq));
+   write(uint8_t(state.m_color_src));
+   write(uint8_t(state.m_color_dest));
+   write(uint8_t(state.m_alpha_eq));
+   write(uint8_t(state.m_alpha_src));
+   write(uint8_t(state.m_alpha_dest));
+}
+
+void render_capture_t::set_depth_stencil_state(const depth_stencil_state_t &state)
+{
+   command(uint8_t(opcode_t::set_depth_stencil_state));
+   write(uint8_t((state.m_read ? 1 : 0) | (state.m_write ? 2 : 0)));
+   write(uint8_t(state.m_func));
+   write(state.m_znear);
+   write(state.m_zfar);
+}
+
+void render_capture_t::set_rasterizer_state(const rasterizer_state_t &state)
+{
+   command(uint8_t(opcode_t::set_rasterizer_state));
+   write(uint8_t(state.m_cull_mode));
+   write(uint8_t(state.m_front_face));
+   write(uint8_t(state.m_polygon_mode));
+}
+
+void render_capture_t::draw(const topology_t topology, const int start, const int count)
+{
+   command(uint8_t(opcode_t::draw));
+   write(uint8_t(topology));
+   write(int32_t(start));
+   write(int32_t(count));
+}
+
+void render_capture_t::draw_instanced(const topology_t topology, const int start, const int count, const int instances)
+{
+   command(uint8_t(opcode_t::draw_instanced));
+   write(uint8_t(topology));
+   write(int32_t(start));
+   write(int32_t(count));
+   write(int32_t(instances));
+}
+
+void render_capture_t::begin_transform_feedback(const vertex_buffer_t &buffer, const topology_t topology)
+{
+   command(uint8_t(opcode_t::begin_transform_feedback));
+   write(buffer.m_id);
+   write(uint8_t(topology));
+}
+
+void render_capture_t::end_transform_feedback()
+{
+   command(uint8_t(opcode_t::end_transform_feedback));
+}
+
+void render_capture_t::create_occlusion_query(const uint32_t id)
+{
+   command(uint8_t(opcode_t::create_occlusion_query));
+   write(id);
+}
+
+void render_capture_t::destroy_occlusion_query(const uint32_t id)
+{
+   command(uint8_t(opcode_t::destroy_occlusion_query));
+   write(id);
+}
+
+void render_capture_t::begin_occlusion_query(const occlusion_query_t &query)
+{
+   command(uint8_t(opcode_t::begin_occlusion_query));
+   write(query.m_ids[0]);
+}
+
+void render_capture_t::end_occlusion_query()
+{
+   command(uint8_t(opcode_t::end_occlusion_query));
+}
+
+void render_capture_t::begin_conditional_render(const occlusion_query_t &query)
+{
+   command(uint8_t(opcode_t::begin_conditional_render));
+   write(query.m_ids[0]);
+}
+
+void render_capture_t::end_conditional_render()
+{
+   command(uint8_t(opcode_t::end_conditional_render));
+}
+
+void render_capture_t::create_fragment_counter(const uint32_t id)
+{
+   command(uint8_t(opcode_t::create_fragment_counter));
+   write(id);
+}
+
+void render_capture_t::destroy_fragment_counter(const uint32_t id)
+{
+   command(uint8_t(opcode_t::destroy_fragment_counter));
+   write(id);
+}
+
+void render_capture_t::begin_fragment_count(const fragment_counter_t &counter)
+{
+   command(uint8_t(opcode_t::begin_fragment_count));
+   write(counter.m_ids[0]);
+}
+
+void render_capture_t::end_fragment_count()
+{
+   command(uint8_t(opcode_t::end_fragment_count));
+}
+
+void render_capture_t::begin_gpu_marker(const char *name)
+{
+   const uint16_t index = name_index(name);
+   command(uint8_t(opcode_t::begin_gpu_marker));
+   write(index);
+}
+
+void render_capture_t::end_gpu_marker()
+{
+   command(uint8_t(opcode_t::end_gpu_marker));
+}
+
+bool render_replay_t::load(const std::string_view &filename)
+{
+   destroy();
+
+   if (!file_system_t::load_content(filename, m_stream)) {
+      return false;
+   }
+
+   header_t header = {};
+   if (!read(header) || memcmp(header.m_magic, capture_magic, sizeof(capture_magic)) != 0) {
+      debug::error("replay: '%s' is not a capture!", filename);
+      m_stream = {};
+      return false;
+   }
+
+   if (header.m_version != render_capture_t::version) {
+      debug::error("replay: '%s' is version %d, expected %d!", filename, int(header.m_version), int(render_capture_t::version));
+      m_stream = {};
+      return false;
+   }
+
+   m_width = header.m_width;
+   m_height = header.m_height;
+   m_frame_count = header.m_frames;
+   m_names.reserve(render_capture_t::max_names);
+
+   debug::info("replay: '%s' - %dx%d frames: %llu size: %2.3fmb",
+               filename,
+               m_width,
+               m_height,
+               (unsigned long long)m_frame_count,
+               double(m_stream.size()) / (1024.0 * 1024.0));
+
+   return true;
+}
+
+void render_replay_t::destroy()
+{
+   for (auto &program : m_programs) {
+      if (program) {
+         program->destroy();
+      }
+   }
+
+   for (auto &texture : m_textures) {
+      if (texture) {
+         texture->destroy();
+      }
+   }
+
+   for (auto &sampler : m_samplers) {
+      if (sampler) {
+         sampler->destroy();
+      }
+   }
+
+   for (auto &buffer : m_vertex_buffers) {
+      if (buffer) {
+         buffer->destroy();
+      }
+   }
+
+   for (auto &buffer : m_texture_buffers) {
+      if (buffer) {
+         buffer->destroy();
+      }
+   }
+
+   for (auto &query : m_occlusion_queries) {
+      if (query) {
+         query->destroy();
+      }
+   }
+
+   for (auto &counter : m_fragment_counters) {
+      if (counter) {
+         counter->destroy();
+      }
+   }
+
+   m_programs.clear();
+   m_textures.clear();
+   m_samplers.clear();
+   m_vertex_buffers.clear();
+   m_texture_buffers.clear();
+   m_occlusion_queries.clear();
+   m_fragment_counters.clear();
+   m_render_targets.clear();
+   m_target_textures.clear();
+   m_names.clear();
+   m_stream = {};
+   m_cursor = 0;
+   m_first_frame = 0;
+   m_failed = false;
+   m_frame_count = 0;
+   m_commands = 0;
+   m_draws = 0;
+}
+
+bool render_replay_t::prepare(renderer_t &renderer)
+{
+   profile_scope("render_replay_t::prepare");
+
+   m_cursor = sizeof(header_t);
+   while (m_cursor < m_stream.size()) {
+      if (m_stream[m_cursor] == uint8_t(opcode_t::begin_frame)) {
+         m_first_frame = m_cursor;
+         return true;
+      }
+
+      uint8_t opcode = 0;
+      if (!read(opcode) || !execute(renderer, opcode)) {
+         return false;
+      }
+   }
+
+   debug::error("replay: capture has no frames!");
+   return false;
+}
+
+bool render_replay_t::play_frame(renderer_t &renderer)
+{
+   profile_scope("render_replay_t::play_frame");
+
+   while (!m_failed && m_cursor < m_stream.size()) {
+      uint8_t opcode = 0;
+      if (!read(opcode) || !execute(renderer, opcode)) {
+         return false;
+      }
+
+      if (opcode == uint8_t(opcode_t::end_frame)) {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+void render_replay_t::rewind()
+{
+   m_cursor = m_first_frame;
+}
+
+bool render_replay_t::read(void *data, const size_t size)
+{
+   if (m_failed || m_stream.size() - m_cursor < size) {
+      if (!m_failed) {
+         debug::error("replay: capture is truncated at %llu!", (unsigned long long)m_cursor);
+      }
+      m_failed = true;
+      return false;
+   }
+
+   memcpy(data, m_stream.data() + m_cursor, size);
+   m_cursor += size;
+
+   return true;
+}
+
+bool render_replay_t::read_view(const uint8_t *&data, const size_t size)
+{
+   if (m_failed || m_stream.size() - m_cursor < size) {
+      if (!m_failed) {
+         debug::error("replay: capture is truncated at %llu!", (unsigned long long)m_cursor);
+      }
+      m_failed = true;
+      return false;
+   }
+
+   data = m_stream.data() + m_cursor;
+   m_cursor += size;
+
+   return true;
+}
+
+bool render_replay_t::read_string(std::string_view &value)
+{
+   uint32_t length = 0;
+   const uint8_t *data = nullptr;
+   if (!read(length) || !read_view(data, size_t(length) + 1)) {
+      return false;
+   }
+
+   value = std::string_view(reinterpret_cast<const char *>(data), length);
+   return true;
+}
+
+template <typename T>
+T *render_replay_t::find(std::vector<std::unique_ptr<T>> &objects, const uint32_t id)
+{
+   return id < objects.size() ? objects[id].get() : nullptr;
+}
+
+template <typename T>
+T &render_replay_t::emplace(std::vector<std::unique_ptr<T>> &objects, const uint32_t id)
+{
+   if (id >= objects.size()) {
+      objects.resize(size_t(id) + 1);
+   }
+
+   // note: gl names are reused, whatever had this one before is gone
+   if (objects[id]) {
+      objects[id]->destroy();
+   }
+
+   objects[id] = std::make_unique<T>();
+   return *objects[id];
+}
+
+bool render_replay_t::execute(renderer_t &renderer, const uint8_t opcode)
+{
+   m_commands++;
+
+   uint32_t id = 0;
+   switch (opcode_t(opcode)) {
+      case opcode_t::begin_frame: {
+         renderer.begin_frame();
+      } break;
+
+      case opcode_t::end_frame: {
+         renderer.end_frame();
+      } break;
+
+      case opcode_t::clear: {
+         color_t color;
+         float depth = 1.0f;
+         if (read(color) && read(depth)) {
+            renderer.clear(color, depth);
+         }
+      } break;
+
+      case opcode_t::set_viewport: {
+         viewport_t viewport;
+         if (read(viewport)) {
+            renderer.set_viewport(viewport);
+         }
+      } break;
+
+      case opcode_t::set_render_target: {
+         if (read(id)) {
+            render_target_t *target = id < m_render_targets.size() ? m_render_targets[id] : nullptr;
+            if (id == 0 || target) {
+               renderer.set_render_target(target);
+            }
+         }
+      } break;
+
+      case opcode_t::resolve_render_target: {
+         uint32_t destination_id = 0;
+         viewport_t viewport;
+         if (read(id) && read(destination_id) && read(viewport)) {
+            render_target_t *source = id < m_render_targets.size() ? m_render_targets[id] : nullptr;
+            render_target_t *destination = destination_id < m_render_targets.size() ? m_render_targets[destination_id] : nullptr;
+            if (source && (destination_id == 0 || destination)) {
+               renderer.resolve_render_target(*source, destination, viewport);
+            }
+         }
+      } break;
+
+      case opcode_t::invalidate_render_target: {
+         uint8_t flags = 0;
+         if (read(id) && read(flags)) {
+            render_target_t *target = id < m_render_targets.size() ? m_render_targets[id] : nullptr;
+            if (target) {
+               renderer.invalidate_render_target(*target, (flags & 1) != 0, (flags & 2) != 0);
+            }
+         }
+      } break;
+
+      case opcode_t::acquire_render_target: {
+         render_target_t::desc_t desc;
+         uint8_t color_format = 0, depth_format = 0;
+         uint32_t color_texture_id = 0;
+         if (read(desc.m_width) && read(desc.m_height) && read(desc.m_samples) &&
+             read(color_format) && read(depth_format) && read(id) && read(color_texture_id)) {
+            desc.m_color_format = render_target_t::color_format_t(color_format);
+            desc.m_depth_format = render_target_t::depth_format_t(depth_format);
+
+            render_target_t *target = renderer.acquire_render_target(desc);
+            if (id != 0) {
+               if (id >= m_render_targets.size()) {
+                  m_render_targets.resize(size_t(id) + 1);
+               }
+               m_render_targets[id] = target;
+            }
+
+            if (color_texture_id != 0) {
+               if (color_texture_id >= m_target_textures.size()) {
+                  m_target_textures.resize(size_t(color_texture_id) + 1);
+               }
+               m_target_textures[color_texture_id] = target ? &target->m_color_texture : nullptr;
+            }
+         }
+      } break;
+
+      case opcode_t::release_render_target: {
+         if (read(id) && id < m_render_targets.size()) {
+            renderer.release_render_target(m_render_targets[id]);
+            m_render_targets[id] = nullptr;
+         }
+      } break;
+
+      case opcode_t::define_name: {
+         uint16_t index = 0;
+         std::string_view name;
+         if (read(index) && read_string(name) && index < render_capture_t::max_names) {
+            // note: reserved up front, marker names have to stay put, passes
+            //       after the first see the same definitions again
+            if (index >= m_names.size()) {
+               m_names.resize(size_t(index) + 1);
+            }
+
+            if (m_names[index].empty()) {
+               m_names[index] = name;
+            }
+            else if (m_names[index] != name) {
+               debug::error("replay: name %d redefined from '%s' to '%s'!", int(index), m_names[index], name);
+               m_failed = true;
+            }
+         }
+      } break;
+
+      case opcode_t::create_program: {
+         std::string_view vertex_source, fragment_source;
+         uint8_t varying_count = 0;
+         if (!read(id) || !read_string(vertex_source) || !read_string(fragment_source) || !read(varying_count)) {
+            break;
+         }
+
+         const char *varyings[max_feedback_varyings] = {};
+         for (uint32_t index = 0; index < varying_count; index++) {
+            std::string_view varying;
+            if (!read_string(varying)) {
+               break;
+            }
+            if (index < max_feedback_varyings) {
+               varyings[index] = varying.data();
+            }
+         }
+
+         const uint32_t count = varying_count < max_feedback_varyings ? varying_count : max_feedback_varyings;
+         emplace(m_programs, id).create(vertex_source, fragment_source, std::span<const char *const>(varyings, count));
+      } break;
+
+      case opcode_t::destroy_program: {
+         if (read(id) && find(m_programs, id)) {
+            m_programs[id]->destroy();
+            m_programs[id].reset();
+         }
+      } break;
+
+      case opcode_t::set_shader_program: {
+         if (read(id)) {
+            shader_program_t *program = find(m_programs, id);
+            if (program && program->valid()) {
+               renderer.set_shader_program(*program);
+            }
+         }
+      } break;
+
+      case opcode_t::set_uniform_int: {
+         uint16_t index = 0;
+         int32_t value = 0;
+         if (read(index) && read(value) && index < m_names.size()) {
+            renderer.set_uniform(m_names[index], int(value));
+         }
+      } break;
+
+      case opcode_t::set_uniform_vec3: {
+         uint16_t index = 0;
+         glm::vec3 value;
+         if (read(index) && read(glm::value_ptr(value), sizeof(value)) && index < m_names.size()) {
+            renderer.set_uniform(m_names[index], value);
+         }
+      } break;
+
+      case opcode_t::set_uniform_vec4: {
+         uint16_t index = 0;
+         glm::vec4 value;
+         if (read(index) && read(glm::value_ptr(value), sizeof(value)) && index < m_names.size()) {
+            renderer.set_uniform(m_names[index], value);
+         }
+      } break;
+
+      case opcode_t::set_uniform_mat4: {
+         uint16_t index = 0;
+         glm::mat4 value;
+         if (read(index) && read(glm::value_ptr(value), sizeof(value)) && index < m_names.size()) {
+            renderer.set_uniform(m_names[index], value);
+         }
+      } break;
+
+      case opcode_t::create_texture: {
+         int32_t width = 0, height = 0;
+         uint8_t format = 0, mipmap = 0;
+         uint32_t size = 0;
+         const uint8_t *data = nullptr;
+         if (read(id) && read(width) && read(height) && read(format) && read(mipmap) && read(size) && read_view(data, size)) {
+            emplace(m_textures, id).create(width, height, size ? data : nullptr, texture_t::pixel_format_t(format), mipmap != 0);
+         }
+      } break;
+
+      case opcode_t::create_texture_cube: {
+         int32_t face_size = 0;
+         uint8_t format = 0, mipmap = 0;
+         uint32_t size = 0;
+         if (!read(id) || !read(face_size) || !read(format) || !read(mipmap) || !read(size)) {
+            break;
+         }
+
+         const void *faces[cubemap_image_t::face_count] = {};
+         for (auto &face : faces) {
+            const uint8_t *data = nullptr;
+            if (!read_view(data, size)) {
+               return false;
+            }
+            face = data;
+         }
+
+         emplace(m_textures, id).create_cube(face_size, faces, texture_t::pixel_format_t(format), mipmap != 0);
+      } break;
+
+      case opcode_t::update_texture: {
+         uint32_t size = 0;
+         const uint8_t *data = nullptr;
+         if (read(id) && read(size) && read_view(data, size)) {
+            if (texture_t *texture = find(m_textures, id)) {
+               texture->update(data);
+            }
+         }
+      } break;
+
+      case opcode_t::update_texture_cube: {
+         uint32_t size = 0;
+         if (!read(id) || !read(size)) {
+            break;
+         }
+
+         const void *faces[cubemap_image_t::face_count] = {};
+         for (auto &face : faces) {
+            const uint8_t *data = nullptr;
+            if (!read_view(data, size)) {
+               return false;
+            }
+            face = data;
+         }
+
+         if (texture_t *texture = find(m_textures, id)) {
+            texture->update_cube(faces);
+         }
+      } break;
+
+      case opcode_t::destroy_texture: {
+         if (read(id) && find(m_textures, id)) {
+            m_textures[id]->destroy();
+            m_textures[id].reset();
+         }
+      } break;
+
+      case opcode_t::set_texture: {
+         uint8_t unit = 0;
+         if (read(id) && read(unit)) {
+            texture_t *texture = find(m_textures, id);
+            if (texture == nullptr && id < m_target_textures.size()) {
+               texture = m_target_textures[id];
+            }
+
+            if (texture) {
+               renderer.set_texture(*texture, unit);
+            }
+         }
+      } break;
+
+      case opcode_t::create_sampler_state: {
+         uint8_t filter = 0, address_u = 0, address_v = 0, address_w = 0;
+         if (read(id) && read(filter) && read(address_u) && read(address_v) && read(address_w)) {
+            emplace(m_samplers, id).create(sampler_state_t::filter_mode_t(filter),
+                                           sampler_state_t::address_mode_t(address_u),
+                                           sampler_state_t::address_mode_t(address_v),
+                                           sampler_state_t::address_mode_t(address_w));
+         }
+      } break;
+
+      case opcode_t::destroy_sampler_state: {
+         if (read(id) && find(m_samplers, id)) {
+            m_samplers[id]->destroy();
+            m_samplers[id].reset();
+         }
+      } break;
+
+      case opcode_t::set_sampler_state: {
+         uint8_t unit = 0;
+         if (read(id) && read(unit)) {
+            if (sampler_state_t *sampler = find(m_samplers, id)) {
+               renderer.set_sampler_state(*sampler, unit);
+            }
+         }
+      } break;
+
+      case opcode_t::create_vertex_buffer: {
+         uint64_t capacity = 0, size = 0;
+         uint8_t usage = 0;
+         const uint8_t *data = nullptr;
+         if (read(id) && read(capacity) && read(usage) && read(size) && read_view(data, size_t(size))) {
+            emplace(m_vertex_buffers, id).create(size_t(capacity), size ? data : nullptr, vertex_buffer_t::usage_hint_t(usage));
+         }
+      } break;
+
+      case opcode_t::update_vertex_buffer: {
+         uint64_t size = 0;
+         const uint8_t *data = nullptr;
+         if (read(id) && read(size) && read_view(data, size_t(size))) {
+            if (vertex_buffer_t *buffer = find(m_vertex_buffers, id)) {
+               buffer->update(data, size_t(size));
+            }
+         }
+      } break;
+
+      case opcode_t::destroy_vertex_buffer: {
+         if (read(id) && find(m_vertex_buffers, id)) {
+            m_vertex_buffers[id]->destroy();
+            m_vertex_buffers[id].reset();
+         }
+      } break;
+
+      case opcode_t::set_vertex_buffer_and_layout: {
+         uint8_t count = 0, first_index = 0;
+         if (!read(id) || !read(m_layout.m_stride) || !read(count) || !read(first_index) || !read(m_layout.m_divisor)) {
+            break;
+         }
+
+         m_layout.m_count = count < vertex_layout_t::max_vertex_attributes ? count : vertex_layout_t::max_vertex_attributes;
+         m_layout.m_first_index = first_index;
+         for (uint32_t index = 0; index < count; index++) {
+            vertex_layout_t::attribute_t attribute;
+            if (!read(attribute)) {
+               return false;
+            }
+            if (index < m_layout.m_count) {
+               m_layout.m_attributes[index] = attribute;
+            }
+         }
+
+         if (vertex_buffer_t *buffer = find(m_vertex_buffers, id)) {
+            renderer.set_vertex_buffer_and_layout(*buffer, m_layout);
+         }
+      } break;
+
+      case opcode_t::create_texture_buffer: {
+         uint64_t capacity = 0;
+         uint8_t format = 0;
+         if (read(id) && read(capacity) && read(format)) {
+            emplace(m_texture_buffers, id).create(size_t(capacity), texture_buffer_t::format_t(format));
+         }
+      } break;
+
+      case opcode_t::update_texture_buffer: {
+         uint64_t size = 0;
+         const uint8_t *data = nullptr;
+         if (read(id) && read(size) && read_view(data, size_t(size))) {
+            if (texture_buffer_t *buffer = find(m_texture_buffers, id)) {
+               buffer->update(data, size_t(size));
+            }
+         }
+      } break;
+
+      case opcode_t::destroy_texture_buffer: {
+         if (read(id) && find(m_texture_buffers, id)) {
+            m_texture_buffers[id]->destroy();
+            m_texture_buffers[id].reset();
+         }
+      } break;
+
+      case opcode_t::set_texture_buffer: {
+         uint8_t unit = 0;
+         if (read(id) && read(unit)) {
+            if (texture_buffer_t *buffer = find(m_texture_buffers, id)) {
+               renderer.set_texture_buffer(*buffer, unit);
+            }
+         }
+      } break;
+
+      case opcode_t::set_blend_state: {
+         uint8_t values[7] = {};
+         if (read(values, sizeof(values))) {
+            m_blend_state.m_enabled = (values[0] & 1) != 0;
+            m_blend_state.m_color_write = (values[0] & 2) != 0;
+            m_blend_state.m_color_eq = blend_state_t::blend_equation_t(values[1]);
+            m_blend_state.m_color_src = blend_state_t::blend_factor_t(values[2]);
+            m_blend_state.m_color_dest = blend_state_t::blend_factor_t(values[3]);
+            m_blend_state.m_alpha_eq = blend_state_t::blend_equation_t(values[4]);
+            m_blend_state.m_alpha_src = blend_state_t::blend_factor_t(values[5]);
+            m_blend_state.m_alpha_dest = blend_state_t::blend_factor_t(values[6]);
+            renderer.set_blend_state(m_blend_state);
+         }
+      } break;
+
+      case opcode_t::set_depth_stencil_state: {
+         uint8_t flags = 0, func = 0;
+         if (read(flags) && read(func) && read(m_depth_stencil_state.m_znear) && read(m_depth_stencil_state.m_zfar)) {
+            m_depth_stencil_state.m_read = (flags & 1) != 0;
+            m_depth_stencil_state.m_write = (flags & 2) != 0;
+            m_depth_stencil_state.m_func = depth_stencil_state_t::compare_func_t(func);
+            renderer.set_depth_stencil_state(m_depth_stencil_state);
+         }
+      } break;
+
+      case opcode_t::set_rasterizer_state: {
+         uint8_t values[3] = {};
+         if (read(values, sizeof(values))) {
+            m_rasterizer_state.m_cull_mode = rasterizer_state_t::cull_mode_t(values[0]);
+            m_rasterizer_state.m_front_face = rasterizer_state_t::front_face_t(values[1]);
+            m_rasterizer_state.m_polygon_mode = rasterizer_state_t::polygon_mode_t(values[2]);
+            renderer.set_rasterizer_state(m_rasterizer_state);
+         }
+      } break;
+
+      case opcode_t::draw: {
+         uint8_t topology = 0;
+         int32_t start = 0, count = 0;
+         if (read(topology) && read(start) && read(count)) {
+            renderer.draw(topology_t(topology), start, count);
+            m_draws++;
+         }
+      } break;
+
+      case opcode_t::draw_instanced: {
+         uint8_t topology = 0;
+         int32_t start = 0, count = 0, instances = 0;
+         if (read(topology) && read(start) && read(count) && read(instances)) {
+            renderer.draw_instanced(topology_t(topology), start, count, instances);
+            m_draws++;
+         }
+      } break;
+
+      case opcode_t::begin_transform_feedback: {
+         uint8_t topology = 0;
+         if (read(id) && read(topology)) {
+            if (vertex_buffer_t *buffer = find(m_vertex_buffers, id)) {
+               renderer.begin_transform_feedback(*buffer, topology_t(topology));
+            }
+         }
+      } break;
+
+      case opcode_t::end_transform_feedback: {
+         renderer.end_transform_feedback();
+      } break;
+
+      case opcode_t::create_occlusion_query: {
+         if (read(id)) {
+            emplace(m_occlusion_queries, id).create();
+         }
+      } break;
+
+      case opcode_t::destroy_occlusion_query: {
+         if (read(id) && find(m_occlusion_queries, id)) {
+            m_occlusion_queries[id]->destroy();
+            m_occlusion_queries[id].reset();
+         }
+      } break;
+
+      case opcode_t::begin_occlusion_query: {
+         if (read(id)) {
+            if (occlusion_query_t *query = find(m_occlusion_queries, id)) {
+               renderer.begin_occlusion_query(*query);
+            }
+         }
+      } break;
+
+      case opcode_t::end_occlusion_query: {
+         renderer.end_occlusion_query();
+      } break;
+
+      case opcode_t::begin_conditional_render: {
+         if (read(id)) {
+            if (occlusion_query_t *query = find(m_occlusion_queries, id)) {
+               renderer.begin_conditional_render(*query);
+            }
+         }
+      } break;
+
+      case opcode_t::end_conditional_render: {
+         renderer.end_conditional_render();
+      } break;
+
+      case opcode_t::create_fragment_counter: {
+         if (read(id)) {
+            emplace(m_fragment_counters, id).create();
+         }
+      } break;
+
+      case opcode_t::destroy_fragment_counter: {
+         if (read(id) && find(m_fragment_counters, id)) {
+            m_fragment_counters[id]->destroy();
+            m_fragment_counters[id].reset();
+         }
+      } break;
+
+      case opcode_t::begin_fragment_count: {
+         if (read(id)) {
+            if (fragment_counter_t *counter = find(m_fragment_counters, id)) {
+               renderer.begin_fragment_count(*counter);
+            }
+         }
+      } break;
+
+      case opcode_t::end_fragment_count: {
+         renderer.end_fragment_count();
+      } break;
+
+      case opcode_t::begin_gpu_marker: {
+         uint16_t index = 0;
+         if (read(index) && index < m_names.size()) {
+            renderer.begin_gpu_marker(m_names[index].c_str());
+         }
+      } break;
+
+      case opcode_t::end_gpu_marker: {
+         renderer.end_gpu_marker();
+      } break;
+
+      default: {
+         debug::error("replay: unknown opcode %d at %llu!", int(opcode), (unsigned long long)(m_cursor - 1));
+         m_failed = true;
+      } break;
+   }
+
+   return !m_failed;
+}
@@ -1,9 +1,19 @@
 // graphics.cpp
 
 #include "graphics.hpp"
+#include "capture.hpp"
 #include "system.hpp"
+#include "profiler.hpp"
+#include "memory.hpp"
+#include "jobs.hpp"
 
+#include <cmath>
+#include <cstdio>
 #include <cassert>
+#include <cstring>
+#include <string>
+#include <filesystem>
+#include <bit>
 #include <glad/glad.h>
 #pragma warning(push)
 #pragma warning(disable: 4201) // nonstandard extension used: nameless struct/union
@@ -11,12 +21,22 @@
 #pragma warning(pop)
 #include <stb_image.h>
 
+#if defined(_M_X64) || defined(__SSE2__)
+#define KIWI_CUBEMAP_SSE 1
+#include <emmintrin.h>
+#else
+#define KIWI_CUBEMAP_SSE 0
+#endif
+
 static void 
 opengl_check_errors_(const char *file, const int line)
 {
    GLenum error = glGetError();
    if (error != GL_NO_ERROR) {
       debug::error("0x%X (%d) in %s (%d)", error, error, file, line);
+
+      // note: the assert below would take the queued message down with it
+      debug::flush();
    }
    assert(error == GL_NO_ERROR);
 }
@@ -27,17 +47,272 @@ opengl_check_errors_(const char *file, const int line)
 #define opengl_check_errors() 
 #endif
 
-static uint32_t 
-fnv1a32(const void *data, const size_t size) {
-   const uint8_t *at = (uint8_t *)data;
+// note: entry points beyond opengl v3.3 core, null when not supported
+typedef void (APIENTRYP gl_invalidate_framebuffer_proc)(GLenum target, GLsizei count, const GLenum *attachments);
+typedef void (APIENTRYP gl_get_program_binary_proc)(GLuint program, GLsizei size, GLsizei *length, GLenum *format, void *binary);
+typedef void (APIENTRYP gl_program_binary_proc)(GLuint program, GLenum format, const void *binary, GLsizei length);
+typedef void (APIENTRYP gl_program_parameteri_proc)(GLuint program, GLenum name, GLint value);
+typedef void (APIENTRYP gl_max_shader_compiler_threads_proc)(GLuint count);
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH           0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS      0x87FE
+#endif
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR           0x91B1
+#endif
+
+#ifndef GL_FRAGMENT_SHADER_INVOCATIONS
+#define GL_FRAGMENT_SHADER_INVOCATIONS     0x82F4
+#endif
+
+struct opengl_extensions_t {
+   gl_invalidate_framebuffer_proc invalidate_framebuffer = nullptr;
+   gl_get_program_binary_proc     get_program_binary = nullptr;
+   gl_program_binary_proc         program_binary = nullptr;
+   gl_program_parameteri_proc     program_parameteri = nullptr;
+   bool                           parallel_shader_compile = false;
+   bool                           pipeline_statistics = false;
+};
+
+static opengl_extensions_t gl_extensions;
+
+static bool
+opengl_has_extension(const char *name)
+{
+   GLint extension_count = 0;
+   glGetIntegerv(GL_NUM_EXTENSIONS, &extension_count);
+   for (GLint index = 0; index < extension_count; index++) {
+      const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, index);
+      if (extension && strcmp(extension, name) == 0) {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+static bool
+opengl_has_version(const int major, const int minor)
+{
+   GLint context_major = 0, context_minor = 0;
+   glGetIntegerv(GL_MAJOR_VERSION, &context_major);
+   glGetIntegerv(GL_MINOR_VERSION, &context_minor);
+   return context_major > major || (context_major == major && context_minor >= minor);
+}
+
+void load_opengl_extensions(opengl_loader_t loader)
+{
+   gl_extensions = {};
+
+   if (opengl_has_version(4, 3) || opengl_has_extension("GL_ARB_invalidate_subdata")) {
+      gl_extensions.invalidate_framebuffer = (gl_invalidate_framebuffer_proc)loader("glInvalidateFramebuffer");
+   }
+
+   // note: a driver may expose the entry points but zero binary formats, that means no cache
+   if (opengl_has_version(4, 1) || opengl_has_extension("GL_ARB_get_program_binary")) {
+      GLint format_count = 0;
+      glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+      if (format_count > 0) {
+         gl_extensions.get_program_binary = (gl_get_program_binary_proc)loader("glGetProgramBinary");
+         gl_extensions.program_binary = (gl_program_binary_proc)loader("glProgramBinary");
+         gl_extensions.program_parameteri = (gl_program_parameteri_proc)loader("glProgramParameteri");
+      }
+   }
+
+   // note: the khr and arb variants share the completion status enum
+   const char *parallel_compile_entry = nullptr;
+   if (opengl_has_extension("GL_KHR_parallel_shader_compile")) {
+      parallel_compile_entry = "glMaxShaderCompilerThreadsKHR";
+   }
+   else if (opengl_has_extension("GL_ARB_parallel_shader_compile")) {
+      parallel_compile_entry = "glMaxShaderCompilerThreadsARB";
+   }
+
+   if (parallel_compile_entry) {
+      auto max_shader_compiler_threads = (gl_max_shader_compiler_threads_proc)loader(parallel_compile_entry);
+      if (max_shader_compiler_threads) {
+         max_shader_compiler_threads(0xffffffffu);
+         gl_extensions.parallel_shader_compile = true;
+      }
+   }
+
+   // note: query targets only, no entry points beyond the v3.3 query api
+   gl_extensions.pipeline_statistics = opengl_has_version(4, 6) || opengl_has_extension("GL_ARB_pipeline_statistics_query");
+
+   debug::info("opengl extensions - invalidate_framebuffer: %s program_binary: %s parallel_shader_compile: %s pipeline_statistics: %s", 
+               gl_extensions.invalidate_framebuffer ? "yes" : "no",
+               program_cache_t::enabled() ? "yes" : "no",
+               gl_extensions.parallel_shader_compile ? "yes" : "no",
+               gl_extensions.pipeline_statistics ? "yes" : "no");
+}
+
+namespace
+{
+   struct program_cache_header_t {
+      static constexpr uint32_t magic = 0x4342504b; // 'KPBC'
+      static constexpr uint32_t version = 1;
+
+      uint32_t m_magic = magic;
+      uint32_t m_version = version;
+      uint64_t m_key = 0;
+      uint32_t m_format = 0;
+      uint32_t m_length = 0;
+   };
+
+   std::string program_cache_directory = "shader_cache";
+
+   std::string program_cache_path(const uint64_t key)
+   {
+      char filename[32];
+      snprintf(filename, sizeof(filename), "%016llx.bin", (unsigned long long)key);
+      return program_cache_directory + "/" + filename;
+   }
+} // !anonymous
+
+void program_cache_t::set_directory(const std::string_view &path)
+{
+   program_cache_directory = path;
+}
+
+bool program_cache_t::enabled()
+{
+   return !program_cache_directory.empty() &&
+      gl_extensions.get_program_binary &&
+      gl_extensions.program_binary &&
+      gl_extensions.program_parameteri;
+}
+
+uint64_t program_cache_t::make_key(const std::string_view &vertex_source,
+                                   const std::string_view &fragment_source,
+                                   const std::span<const char *const> feedback_varyings)
+{
+   // note: binaries are only valid for the exact driver that produced them
+   const char *driver_strings[] =
+   {
+      (const char *)glGetString(GL_VENDOR),
+      (const char *)glGetString(GL_RENDERER),
+      (const char *)glGetString(GL_VERSION),
+   };
+
+   const uint32_t version = program_cache_header_t::version;
+   uint64_t key = fnv1a64(&version, sizeof(version));
+   key = fnv1a64(vertex_source.data(), vertex_source.size(), key);
+   key = fnv1a64("\0", 1, key);
+   key = fnv1a64(fragment_source.data(), fragment_source.size(), key);
+   for (const char *varying : feedback_varyings) {
+      key = fnv1a64(varying, strlen(varying) + 1, key);
+   }
+   for (const char *driver_string : driver_strings) {
+      if (driver_string) {
+         key = fnv1a64(driver_string, strlen(driver_string) + 1, key);
+      }
+   }
+
+   return key;
+}
+
+uint32_t program_cache_t::load(const uint64_t key)
+{
+   const std::string path = program_cache_path(key);
+   std::error_code error;
+   if (!std::filesystem::exists(path, error)) {
+      return 0;
+   }
+
+   scratch_scope_t scratch;
+   std::span<uint8_t> content;
+   if (!file_system_t::load_content(path, scratch.arena(), content)) {
+      return 0;
+   }
+
+   program_cache_header_t header;
+   if (content.size() < sizeof(header)) {
+      discard(key);
+      return 0;
+   }
+
+   memcpy(&header, content.data(), sizeof(header));
+   if (header.m_magic != program_cache_header_t::magic ||
+       header.m_version != program_cache_header_t::version ||
+       header.m_key != key ||
+       header.m_length != content.size() - sizeof(header)) 
+   {
+      discard(key);
+      return 0;
+   }
+
+   GLuint program_id = glCreateProgram();
+   gl_extensions.program_binary(program_id, header.m_format, content.data() + sizeof(header), GLsizei(header.m_length));
+
+   // note: the driver may reject a binary at any time (updates, different gpu), 
+   //       clear the error it raised and fall back to compiling from source
+   GLint link_status = GL_FALSE;
+   glGetProgramiv(program_id, GL_LINK_STATUS, &link_status);
+   if (link_status == GL_FALSE) {
+      while (glGetError() != GL_NO_ERROR) {}
+      glDeleteProgram(program_id);
+
+      stats().m_rejected++;
+      discard(key);
+      return 0;
+   }
+
+   return program_id;
+}
+
+void program_cache_t::save(const uint64_t key, const uint32_t program)
+{
+   GLint length = 0;
+   glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+   if (length <= 0) {
+      return;
+   }
 
-   uint32_t result = 2166136261;
-   for (size_t index = 0; index < size; index++) {
-      result ^= uint32_t(at[index]);
-      result *= 16777619;
+   program_cache_header_t header;
+   header.m_key = key;
+
+   std::string content(sizeof(header) + length, '\0');
+   GLsizei written = 0;
+   GLenum format = GL_NONE;
+   gl_extensions.get_program_binary(program, length, &written, &format, content.data() + sizeof(header));
+   if (written <= 0) {
+      return;
+   }
+
+   header.m_format = format;
+   header.m_length = uint32_t(written);
+   memcpy(content.data(), &header, sizeof(header));
+   content.resize(sizeof(header) + written);
+
+   // note: write aside and rename, a crash mid-write must not leave a torn binary
+   std::error_code error;
+   std::filesystem::create_directories(program_cache_directory, error);
+
+   const std::string path = program_cache_path(key);
+   const std::string temporary_path = path + ".tmp";
+   if (!file_system_t::save_content(temporary_path, content)) {
+      return;
+   }
+
+   std::filesystem::rename(temporary_path, path, error);
+   if (error) {
+      std::filesystem::remove(temporary_path, error);
    }
+}
 
-   return result;
+void program_cache_t::discard(const uint64_t key)
+{
+   std::error_code error;
+   std::filesystem::remove(program_cache_path(key), error);
+}
+
+program_cache_stats_t &program_cache_t::stats()
+{
+   static program_cache_stats_t ms_stats;
+   return ms_stats;
 }
 
 bool shader_program_t::valid() const
@@ -45,20 +320,45 @@ bool shader_program_t::valid() const
    return m_id != 0;
 }
 
+static bool
+gl_uniform_is_sampler(const GLenum type)
+{
+   switch (type) {
+   case GL_SAMPLER_2D:
+   case GL_SAMPLER_CUBE:
+   case GL_SAMPLER_BUFFER:
+   case GL_INT_SAMPLER_BUFFER:
+   case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+      return true;
+   }
+   return false;
+}
+
 static const char *
 gl_uniform_type_string(const GLenum type)
 {
    switch (type) {
+   case GL_INT: return "int";
    case GL_FLOAT_VEC2: return "vec2";
    case GL_FLOAT_VEC3: return "vec3";
    case GL_FLOAT_VEC4: return "vec4";
    case GL_FLOAT_MAT4: return "mat4";
+   case GL_SAMPLER_2D: return "sampler2d";
+   case GL_SAMPLER_CUBE: return "samplercube";
+   case GL_SAMPLER_BUFFER: return "samplerbuffer";
+   case GL_INT_SAMPLER_BUFFER: return "isamplerbuffer";
+   case GL_UNSIGNED_INT_SAMPLER_BUFFER: return "usamplerbuffer";
    }
    return "unknown";
 }
 
-bool shader_program_t::create(const std::string_view &vertex_source,
-                              const std::string_view &fragment_source)
+// note: only issues the work, link status is checked in finalize so a driver
+//       with parallel compilation can keep working in the background
+static GLuint
+compile_and_link_program(const std::string_view &vertex_source,
+                         const std::string_view &fragment_source,
+                         const std::span<const char *const> feedback_varyings,
+                         const bool retrievable)
 {
    const char *glsl_vertex_source = vertex_source.data();
    const GLint glsl_vertex_length = GLint(vertex_source.length());
@@ -73,17 +373,116 @@ bool shader_program_t::create(const std::string_view &vertex_source,
    glCompileShader(fragment_shader_id);
 
    GLuint shader_program_id = glCreateProgram();
+   if (retrievable) {
+      gl_extensions.program_parameteri(shader_program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+   }
+
+   if (!feedback_varyings.empty()) {
+      glTransformFeedbackVaryings(shader_program_id, GLsizei(feedback_varyings.size()), feedback_varyings.data(), GL_INTERLEAVED_ATTRIBS);
+   }
+
    glAttachShader(shader_program_id, vertex_shader_id);
    glAttachShader(shader_program_id, fragment_shader_id);
    glLinkProgram(shader_program_id);
 
    // note: we don't need the vertex and fragment shaders anymore, 
-   //       they are (hopefully) linked into a shader program
+   //       they are (hopefully) linked into a shader program, 
+   //       deletion is deferred by the driver until the link is done
    glDetachShader(shader_program_id, vertex_shader_id);
    glDetachShader(shader_program_id, fragment_shader_id);
    glDeleteShader(vertex_shader_id);
    glDeleteShader(fragment_shader_id);
 
+   return shader_program_id;
+}
+
+bool shader_program_t::create(const std::string_view &vertex_source,
+                              const std::string_view &fragment_source,
+                              const std::span<const char *const> feedback_varyings)
+{
+   profile_scope("shader_program_t::create");
+
+   if (!create_async(vertex_source, fragment_source, feedback_varyings)) {
+      return false;
+   }
+
+   return wait();
+}
+
+bool shader_program_t::create_async(const std::string_view &vertex_source,
+                                    const std::string_view &fragment_source,
+                                    const std::span<const char *const> feedback_varyings)
+{
+   // note: recreating replaces the program, finalize() would otherwise leak it
+   destroy();
+
+   m_pending_start = watch_t::time_since_start().m_duration;
+
+   // note: try the binary cache first, compile from source on a miss or a rejected binary
+   const bool cache_enabled = program_cache_t::enabled();
+   m_cache_key = cache_enabled ? program_cache_t::make_key(vertex_source, fragment_source, feedback_varyings) : 0;
+   m_pending_id = cache_enabled ? program_cache_t::load(m_cache_key) : 0;
+   m_cache_hit = m_pending_id != 0;
+   if (!m_cache_hit) {
+      m_pending_id = compile_and_link_program(vertex_source, fragment_source, feedback_varyings, cache_enabled);
+   }
+
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->create_program(m_pending_id, vertex_source, fragment_source, feedback_varyings);
+   }
+
+   m_issue_duration = watch_t::time_since_start().m_duration - m_pending_start;
+
+   // note: a cached binary is already linked, nothing to wait for
+   if (m_cache_hit) {
+      return finalize();
+   }
+
+   return m_pending_id != 0;
+}
+
+bool shader_program_t::pending() const
+{
+   return m_pending_id != 0;
+}
+
+bool shader_program_t::poll()
+{
+   if (!pending()) {
+      return true;
+   }
+
+   // note: without parallel compilation any status query blocks until the link is done
+   if (gl_extensions.parallel_shader_compile) {
+      GLint completed = GL_FALSE;
+      glGetProgramiv(m_pending_id, GL_COMPLETION_STATUS_KHR, &completed);
+      if (completed == GL_FALSE) {
+         return false;
+      }
+   }
+
+   finalize();
+   return true;
+}
+
+bool shader_program_t::wait()
+{
+   if (!pending()) {
+      return valid();
+   }
+
+   return finalize();
+}
+
+bool shader_program_t::finalize()
+{
+   const GLuint shader_program_id = m_pending_id;
+   m_pending_id = 0;
+
+   // note: blocking is the time this thread spent in the driver, latency is
+   //       how long it took until the program was usable
+   const timespan_t finalize_start = watch_t::time_since_start();
+
    // note: verify shader program linkage status
    GLint link_status = GL_TRUE;
    glGetProgramiv(shader_program_id, GL_LINK_STATUS, &link_status);
@@ -96,15 +495,21 @@ bool shader_program_t::create(const std::string_view &vertex_source,
       return false;
    }
 
+   const bool cache_enabled = m_cache_key != 0;
+   if (cache_enabled && !m_cache_hit) {
+      program_cache_t::save(m_cache_key, shader_program_id);
+   }
+
    m_id = shader_program_id;
+   m_uniforms.clear();
 
    // note: introspection
    glUseProgram(m_id);
    GLint sampler_count = 0;
    GLint active_uniform_count = 0;
    glGetProgramiv(m_id, GL_ACTIVE_UNIFORMS, &active_uniform_count);
-   debug::info("shader_program_t: %d - uniforms: %d", m_id, active_uniform_count);
 
+   m_uniforms.reserve(active_uniform_count);
    for (int index = 0; index < active_uniform_count; index++) {
       GLint uniform_ = 0;
       GLenum uniform_type = GL_NONE;
@@ -119,11 +524,16 @@ bool shader_program_t::create(const std::string_view &vertex_source,
                          uniform_name);
 
       GLint location = glGetUniformLocation(m_id, uniform_name);
-      if (uniform_type == GL_SAMPLER_2D) {
-         debug::info(" + %s - location: %d type: sampler2d", 
+      // note: samplers get consecutive units up front, set_uniform(name, unit) can rebind them
+      if (gl_uniform_is_sampler(uniform_type)) {
+         debug::info(" + %s - location: %d type: %s", 
                      uniform_name,
-                     sampler_count);
+                     sampler_count,
+                     gl_uniform_type_string(uniform_type));
          glUniform1i(location, sampler_count);
+
+         uint32_t uniform_name_hash = fnv1a32(uniform_name, uniform_name_length);
+         m_uniforms.emplace_back(location, uniform_name_hash, uniform_type, fnv1a32(&sampler_count, sizeof(sampler_count)));
          sampler_count++;
          continue;
       }
@@ -145,9 +555,30 @@ bool shader_program_t::create(const std::string_view &vertex_source,
       m_uniforms.clear();
 
       debug::error("could not create shader program!");
+      return false;
    }
 
-   return valid();
+   const timespan_t finalize_end = watch_t::time_since_start();
+   const float blocking_ms = (timespan_t{ m_issue_duration } + (finalize_end - finalize_start)).elapsed_milliseonds();
+   const float latency_ms = (finalize_end - timespan_t{ m_pending_start }).elapsed_milliseonds();
+   program_cache_stats_t &cache_stats = program_cache_t::stats();
+   if (m_cache_hit) {
+      cache_stats.m_hits++;
+      cache_stats.m_load_ms += blocking_ms;
+   }
+   else {
+      cache_stats.m_misses += cache_enabled ? 1 : 0;
+      cache_stats.m_compile_ms += blocking_ms;
+   }
+
+   debug::info("shader_program_t: %d - uniforms: %d %s - blocking: %2.3fms latency: %2.3fms", 
+               m_id, 
+               active_uniform_count,
+               m_cache_hit ? "cache hit" : (cache_enabled ? "cache miss" : "compiled"),
+               blocking_ms,
+               latency_ms);
+
+   return true;
 }
 
 bool shader_program_t::create_from_file(const std::string_view &vertex_path,
@@ -168,11 +599,467 @@ bool shader_program_t::create_from_file(const std::string_view &vertex_path,
 
 void shader_program_t::destroy()
 {
+   render_capture_t *capture = render_capture_t::active();
+   if (capture && (valid() || pending())) {
+      capture->destroy_program(valid() ? m_id : m_pending_id);
+   }
+
    if (valid()) {
       glDeleteProgram(m_id);
    }
 
+   if (pending()) {
+      glDeleteProgram(m_pending_id);
+   }
+
    m_id = 0;
+   m_pending_id = 0;
+}
+
+bool image_t::valid() const
+{
+   return m_pixels != nullptr;
+}
+
+bool image_t::load_from_file(const std::string_view &filename)
+{
+   scratch_scope_t scratch;
+   std::span<uint8_t> content;
+   if (!file_system_t::load_content(filename, scratch.arena(), content)) {
+      return false;
+   }
+
+   {
+      profile_scope("image_t::decode");
+      m_pixels = stbi_load_from_memory(content.data(),
+                                       int(content.size()),
+                                       &m_width,
+                                       &m_height,
+                                       &m_components,
+                                       STBI_default);
+   }
+   if (m_pixels == nullptr) {
+      debug::warn("could not load image data: '%s'!", filename);
+      return false;
+   }
+
+   return valid();
+}
+
+void image_t::destroy()
+{
+   if (valid()) {
+      stbi_image_free(m_pixels);
+   }
+
+   m_pixels = nullptr;
+   m_width = 0;
+   m_height = 0;
+   m_components = 0;
+}
+
+bool cubemap_image_t::valid() const
+{
+   return m_pixels != nullptr;
+}
+
+namespace
+{
+   constexpr float pi = 3.14159265358979f;
+
+   // note: rows of the equirect image processed per job, and rows of cube faces
+   constexpr uint32_t min_rows_per_batch = 16;
+
+   // note: equirect texels are box filtered down until a face texel covers about
+   //       one of them at the equator, the rest is done by the supersampling
+   int
+   box_filter_factor(const image_t &image, const int face_size)
+   {
+      int factor = 1;
+      while (factor < 16 && image.m_width / (factor * 2) >= face_size * 4) {
+         factor *= 2;
+      }
+      return factor;
+   }
+
+   // note: averages 'factor' x 'factor' blocks, rows are summed sixteen bytes at a 
+   //       time regardless of the component count, columns are summed per texel
+   void
+   box_filter_rows(const image_t &image, const int factor, uint8_t *destination, const uint32_t begin, const uint32_t end)
+   {
+      const int components = image.m_components;
+      const size_t source_pitch = size_t(image.m_width) * components;
+      const int width = image.m_width / factor;
+      const size_t pitch = size_t(width) * components;
+      const uint32_t scale = uint32_t(factor * factor);
+
+      scratch_scope_t scratch;
+      uint16_t *sums = scratch.arena().allocate_array<uint16_t>(source_pitch + 16);
+
+      for (uint32_t row = begin; row < end; row++) {
+         const uint8_t *source = image.m_pixels + size_t(row) * factor * source_pitch;
+
+         size_t index = 0;
+#if KIWI_CUBEMAP_SSE
+         // note: at most 16 rows of 255, the sum fits in 16 bits
+         const __m128i zero = _mm_setzero_si128();
+         for (; index + 16 <= source_pitch; index += 16) {
+            __m128i low = _mm_setzero_si128();
+            __m128i high = _mm_setzero_si128();
+            for (int y = 0; y < factor; y++) {
+               const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + y * source_pitch + index));
+               low = _mm_add_epi16(low, _mm_unpacklo_epi8(bytes, zero));
+               high = _mm_add_epi16(high, _mm_unpackhi_epi8(bytes, zero));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(sums + index), low);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(sums + index + 8), high);
+         }
+#endif
+         for (; index < source_pitch; index++) {
+            uint16_t sum = 0;
+            for (int y = 0; y < factor; y++) {
+               sum = uint16_t(sum + source[y * source_pitch + index]);
+            }
+            sums[index] = sum;
+         }
+
+         uint8_t *target = destination + size_t(row) * pitch;
+         for (int x = 0; x < width; x++) {
+            for (int c = 0; c < components; c++) {
+               uint32_t sum = 0;
+               for (int s = 0; s < factor; s++) {
+                  sum += sums[(size_t(x) * factor + s) * components + c];
+               }
+               target[size_t(x) * components + c] = uint8_t((sum + scale / 2) / scale);
+            }
+         }
+      }
+   }
+
+   struct equirect_source_t {
+      const uint8_t *m_pixels;
+      int            m_width;
+      int            m_height;
+      int            m_components;
+   };
+
+   struct bilinear_tap_t {
+      const uint8_t *m_texels[4];
+      float          m_ax;
+      float          m_ay;
+   };
+
+#if KIWI_CUBEMAP_SSE
+   template <int components>
+   inline __m128
+   load_texel(const uint8_t *texel)
+   {
+      // note: assembled in a register, a partial memcpy would stall on store forwarding
+      uint32_t bits = texel[0];
+      if constexpr (components > 1) bits |= uint32_t(texel[1]) << 8;
+      if constexpr (components > 2) bits |= uint32_t(texel[2]) << 16;
+      if constexpr (components > 3) bits |= uint32_t(texel[3]) << 24;
+
+      const __m128i zero = _mm_setzero_si128();
+      __m128i value = _mm_cvtsi32_si128(int(bits));
+      value = _mm_unpacklo_epi8(value, zero);
+      value = _mm_unpacklo_epi16(value, zero);
+      return _mm_cvtepi32_ps(value);
+   }
+
+   // note: all channels of the texel are blended at once
+   template <int components>
+   inline __m128
+   sample_bilinear(const bilinear_tap_t &tap)
+   {
+      const __m128 ax = _mm_set1_ps(tap.m_ax);
+      const __m128 ay = _mm_set1_ps(tap.m_ay);
+      const __m128 t00 = load_texel<components>(tap.m_texels[0]);
+      const __m128 t10 = load_texel<components>(tap.m_texels[1]);
+      const __m128 t01 = load_texel<components>(tap.m_texels[2]);
+      const __m128 t11 = load_texel<components>(tap.m_texels[3]);
+
+      const __m128 top = _mm_add_ps(t00, _mm_mul_ps(_mm_sub_ps(t10, t00), ax));
+      const __m128 bottom = _mm_add_ps(t01, _mm_mul_ps(_mm_sub_ps(t11, t01), ax));
+      return _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), ay));
+   }
+
+   // note: four taps at once, u and v are within [0, 1] so truncating from one
+   //       up is a floor, longitude wraps around and latitude clamps at the poles
+   inline void
+   bilinear_taps(const equirect_source_t &source, const __m128 u, const __m128 v, bilinear_tap_t taps[4])
+   {
+      const __m128i one = _mm_set1_epi32(1);
+      const __m128i width = _mm_set1_epi32(source.m_width);
+      const __m128i last_row = _mm_set1_epi32(source.m_height - 1);
+
+      const __m128 fx = _mm_sub_ps(_mm_mul_ps(u, _mm_set1_ps(float(source.m_width))), _mm_set1_ps(0.5f));
+      const __m128 fy = _mm_sub_ps(_mm_mul_ps(v, _mm_set1_ps(float(source.m_height))), _mm_set1_ps(0.5f));
+      const __m128i xi = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(fx, _mm_set1_ps(1.0f))), one);
+      const __m128i yi = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(fy, _mm_set1_ps(1.0f))), one);
+      const __m128 ax = _mm_sub_ps(fx, _mm_cvtepi32_ps(xi));
+      const __m128 ay = _mm_sub_ps(fy, _mm_cvtepi32_ps(yi));
+
+      __m128i x0 = _mm_add_epi32(xi, _mm_and_si128(_mm_cmplt_epi32(xi, _mm_setzero_si128()), width));
+      x0 = _mm_sub_epi32(x0, _mm_andnot_si128(_mm_cmplt_epi32(x0, width), width));
+      __m128i x1 = _mm_add_epi32(x0, one);
+      x1 = _mm_sub_epi32(x1, _mm_andnot_si128(_mm_cmplt_epi32(x1, width), width));
+      const __m128i y0 = _mm_andnot_si128(_mm_cmplt_epi32(yi, _mm_setzero_si128()), yi);
+      __m128i y1 = _mm_add_epi32(yi, one);
+      const __m128i overflow = _mm_cmpgt_epi32(y1, last_row);
+      y1 = _mm_or_si128(_mm_and_si128(overflow, last_row), _mm_andnot_si128(overflow, y1));
+
+      alignas(16) int32_t x0s[4], x1s[4], y0s[4], y1s[4];
+      alignas(16) float axs[4], ays[4];
+      _mm_store_si128(reinterpret_cast<__m128i *>(x0s), x0);
+      _mm_store_si128(reinterpret_cast<__m128i *>(x1s), x1);
+      _mm_store_si128(reinterpret_cast<__m128i *>(y0s), y0);
+      _mm_store_si128(reinterpret_cast<__m128i *>(y1s), y1);
+      _mm_store_ps(axs, ax);
+      _mm_store_ps(ays, ay);
+
+      const int components = source.m_components;
+      const size_t pitch = size_t(source.m_width) * components;
+      for (int index = 0; index < 4; index++) {
+         const uint8_t *row0 = source.m_pixels + y0s[index] * pitch;
+         const uint8_t *row1 = source.m_pixels + y1s[index] * pitch;
+         taps[index] = { { row0 + x0s[index] * components, row0 + x1s[index] * components, row1 + x0s[index] * components, row1 + x1s[index] * components },
+                         axs[index],
+                         ays[index] };
+      }
+   }
+
+   // note: minimax polynomial, about 1e-5 radians off, a hundredth of a texel 
+   //       on the largest maps and four lanes for the price of one libm call
+   inline __m128
+   atan2_ps(const __m128 y, const __m128 x)
+   {
+      const __m128 sign_mask = _mm_set1_ps(-0.0f);
+      const __m128 ax = _mm_andnot_ps(sign_mask, x);
+      const __m128 ay = _mm_andnot_ps(sign_mask, y);
+      const __m128 swap = _mm_cmpgt_ps(ay, ax);
+      const __m128 numerator = _mm_min_ps(ax, ay);
+      const __m128 denominator = _mm_max_ps(_mm_max_ps(ax, ay), _mm_set1_ps(1e-30f));
+      const __m128 a = _mm_div_ps(numerator, denominator);
+      const __m128 a2 = _mm_mul_ps(a, a);
+
+      __m128 r = _mm_set1_ps(-0.0117212f);
+      r = _mm_add_ps(_mm_mul_ps(r, a2), _mm_set1_ps(0.05265332f));
+      r = _mm_add_ps(_mm_mul_ps(r, a2), _mm_set1_ps(-0.11643287f));
+      r = _mm_add_ps(_mm_mul_ps(r, a2), _mm_set1_ps(0.19354346f));
+      r = _mm_add_ps(_mm_mul_ps(r, a2), _mm_set1_ps(-0.33262347f));
+      r = _mm_add_ps(_mm_mul_ps(r, a2), _mm_set1_ps(0.99997726f));
+      r = _mm_mul_ps(r, a);
+
+      // note: fold back into the octant, then the quadrant, then the sign
+      const __m128 half_pi = _mm_set1_ps(0.5f * pi);
+      r = _mm_or_ps(_mm_and_ps(swap, _mm_sub_ps(half_pi, r)), _mm_andnot_ps(swap, r));
+      const __m128 negative_x = _mm_cmplt_ps(x, _mm_setzero_ps());
+      r = _mm_or_ps(_mm_and_ps(negative_x, _mm_sub_ps(_mm_set1_ps(pi), r)), _mm_andnot_ps(negative_x, r));
+      return _mm_or_ps(r, _mm_and_ps(sign_mask, y));
+   }
+
+   // note: the 2x2 supersamples of a face texel fill the four lanes, the
+   //       component count is a constant so texel loads are fixed size
+   template <int components>
+   void
+   project_rows(const equirect_source_t &source, const int size, uint8_t *destination, const uint32_t begin, const uint32_t end)
+   {
+      const float texel = 2.0f / size;
+      const __m128 offset_s = _mm_setr_ps(0.25f * texel, 0.75f * texel, 0.25f * texel, 0.75f * texel);
+      const __m128 offset_t = _mm_setr_ps(0.25f * texel, 0.25f * texel, 0.75f * texel, 0.75f * texel);
+      const __m128 one = _mm_set1_ps(1.0f);
+      const __m128 half = _mm_set1_ps(0.5f);
+      const __m128 sign_mask = _mm_set1_ps(-0.0f);
+
+      for (uint32_t row = begin; row < end; row++) {
+         const int face = int(row) / size;
+         const int y = int(row) % size;
+         uint8_t *target = destination + size_t(row) * size * components;
+
+         const __m128 t = _mm_add_ps(_mm_set1_ps(y * texel - 1.0f), offset_t);
+         for (int x = 0; x < size; x++) {
+            const __m128 s = _mm_add_ps(_mm_set1_ps(x * texel - 1.0f), offset_s);
+            const __m128 neg_s = _mm_xor_ps(s, sign_mask);
+            const __m128 neg_t = _mm_xor_ps(t, sign_mask);
+
+            // note: opengl cube face layout, direction for face coordinates in [-1, 1]
+            __m128 dx, dy, dz;
+            switch (face) {
+            case 0: dx = one;                         dy = neg_t;                       dz = neg_s; break;
+            case 1: dx = _mm_xor_ps(one, sign_mask);  dy = neg_t;                       dz = s;     break;
+            case 2: dx = s;                           dy = one;                         dz = t;     break;
+            case 3: dx = s;                           dy = _mm_xor_ps(one, sign_mask);  dz = neg_t; break;
+            case 4: dx = s;                           dy = neg_t;                       dz = one;   break;
+            default: dx = neg_s;                      dy = neg_t;                       dz = _mm_xor_ps(one, sign_mask); break;
+            }
+
+            // note: -z is the center of the map, +y the top row
+            const __m128 horizontal = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz)));
+            const __m128 u = _mm_add_ps(half, _mm_mul_ps(atan2_ps(dx, _mm_xor_ps(dz, sign_mask)), _mm_set1_ps(0.5f / pi)));
+            const __m128 v = _mm_sub_ps(half, _mm_mul_ps(atan2_ps(dy, horizontal), _mm_set1_ps(1.0f / pi)));
+
+            bilinear_tap_t taps[4];
+            bilinear_taps(source, u, v, taps);
+
+            __m128 sum = _mm_setzero_ps();
+            for (int sample = 0; sample < 4; sample++) {
+               sum = _mm_add_ps(sum, sample_bilinear<components>(taps[sample]));
+            }
+
+            // note: average, round, then narrow with saturation down to bytes
+            __m128i value = _mm_cvtps_epi32(_mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+            value = _mm_packs_epi32(value, value);
+            value = _mm_packus_epi16(value, value);
+            const uint32_t bits = uint32_t(_mm_cvtsi128_si32(value));
+            memcpy(target + size_t(x) * components, &bits, components);
+         }
+      }
+   }
+#else
+   // note: longitude wraps around, latitude clamps at the poles
+   inline bilinear_tap_t
+   bilinear_tap(const equirect_source_t &source, const float u, const float v)
+   {
+      const float fx = u * source.m_width - 0.5f;
+      const float fy = v * source.m_height - 0.5f;
+      const float x0f = std::floor(fx);
+      const float y0f = std::floor(fy);
+
+      // note: u is within [0, 1] so the texel is at most one width off
+      int x0 = int(x0f);
+      x0 = x0 < 0 ? x0 + source.m_width : x0 >= source.m_width ? x0 - source.m_width : x0;
+      const int x1 = x0 + 1 < source.m_width ? x0 + 1 : 0;
+      int y0 = int(y0f);
+      int y1 = y0 + 1;
+      y0 = y0 < 0 ? 0 : y0 >= source.m_height ? source.m_height - 1 : y0;
+      y1 = y1 < 0 ? 0 : y1 >= source.m_height ? source.m_height - 1 : y1;
+
+      const int components = source.m_components;
+      const size_t pitch = size_t(source.m_width) * components;
+      const uint8_t *row0 = source.m_pixels + y0 * pitch;
+      const uint8_t *row1 = source.m_pixels + y1 * pitch;
+
+      return { { row0 + x0 * components, row0 + x1 * components, row1 + x0 * components, row1 + x1 * components },
+               fx - x0f,
+               fy - y0f };
+   }
+
+   // note: opengl cube face layout, direction for face coordinates in [-1, 1]
+   void
+   cube_face_direction(const int face, const float s, const float t, float &x, float &y, float &z)
+   {
+      switch (face) {
+      case 0: x =  1.0f; y = -t;    z = -s;    break;
+      case 1: x = -1.0f; y = -t;    z =  s;    break;
+      case 2: x =  s;    y =  1.0f; z =  t;    break;
+      case 3: x =  s;    y = -1.0f; z = -t;    break;
+      case 4: x =  s;    y = -t;    z =  1.0f; break;
+      default: x = -s;   y = -t;    z = -1.0f; break;
+      }
+   }
+
+   // note: 2x2 supersampled, every sample is a bilinear tap at the direction
+   //       of that point on the face, converted to longitude and latitude
+   template <int components>
+   void
+   project_rows(const equirect_source_t &source, const int size, uint8_t *destination, const uint32_t begin, const uint32_t end)
+   {
+      const float texel = 2.0f / size;
+
+      for (uint32_t row = begin; row < end; row++) {
+         const int face = int(row) / size;
+         const int y = int(row) % size;
+         uint8_t *target = destination + size_t(row) * size * components;
+
+         for (int x = 0; x < size; x++) {
+            float sum[4] = {};
+            for (int sample = 0; sample < 4; sample++) {
+               const float s = (x + 0.25f + 0.5f * (sample & 1)) * texel - 1.0f;
+               const float t = (y + 0.25f + 0.5f * (sample >> 1)) * texel - 1.0f;
+
+               float dx, dy, dz;
+               cube_face_direction(face, s, t, dx, dy, dz);
+
+               // note: -z is the center of the map, +y the top row
+               const float u = 0.5f + std::atan2(dx, -dz) * (0.5f / pi);
+               const float v = 0.5f - std::atan2(dy, std::sqrt(dx * dx + dz * dz)) * (1.0f / pi);
+
+               const bilinear_tap_t tap = bilinear_tap(source, u, v);
+               for (int c = 0; c < components; c++) {
+                  const float top = tap.m_texels[0][c] + (tap.m_texels[1][c] - tap.m_texels[0][c]) * tap.m_ax;
+                  const float bottom = tap.m_texels[2][c] + (tap.m_texels[3][c] - tap.m_texels[2][c]) * tap.m_ax;
+                  sum[c] += top + (bottom - top) * tap.m_ay;
+               }
+            }
+
+            for (int c = 0; c < components; c++) {
+               target[size_t(x) * components + c] = uint8_t(sum[c] * 0.25f + 0.5f);
+            }
+         }
+      }
+   }
+#endif
+} // !anonymous
+
+bool cubemap_image_t::create_from_equirect(const image_t &image, const int face_size)
+{
+   profile_scope("cubemap_image_t::create_from_equirect");
+
+   destroy();
+
+   if (!image.valid() || face_size <= 0 || image.m_components < 1 || image.m_components > 4) {
+      debug::error("could not create cubemap, invalid source image!");
+      return false;
+   }
+
+   scratch_scope_t scratch;
+
+   equirect_source_t source{ image.m_pixels, image.m_width, image.m_height, image.m_components };
+   const int factor = box_filter_factor(image, face_size);
+   if (factor > 1) {
+      source.m_width = image.m_width / factor;
+      source.m_height = image.m_height / factor;
+
+      const size_t size = size_t(source.m_width) * source.m_height * source.m_components;
+      uint8_t *filtered = scratch.arena().allocate_array<uint8_t>(size);
+      job_system_t::parallel_for(uint32_t(source.m_height), min_rows_per_batch, [&](const uint32_t begin, const uint32_t end) {
+         box_filter_rows(image, factor, filtered, begin, end);
+      });
+      source.m_pixels = filtered;
+   }
+
+   const size_t face_bytes = size_t(face_size) * face_size * image.m_components;
+   m_pixels = new uint8_t[face_bytes * face_count];
+   m_size = face_size;
+   m_components = image.m_components;
+
+   const uint32_t rows = uint32_t(face_size) * face_count;
+   job_system_t::parallel_for(rows, min_rows_per_batch, [&](const uint32_t begin, const uint32_t end) {
+      switch (source.m_components) {
+      case 1: project_rows<1>(source, face_size, m_pixels, begin, end); break;
+      case 2: project_rows<2>(source, face_size, m_pixels, begin, end); break;
+      case 3: project_rows<3>(source, face_size, m_pixels, begin, end); break;
+      default: project_rows<4>(source, face_size, m_pixels, begin, end); break;
+      }
+   });
+
+   return valid();
+}
+
+void cubemap_image_t::destroy()
+{
+   delete[] m_pixels;
+
+   m_pixels = nullptr;
+   m_size = 0;
+   m_components = 0;
+}
+
+const uint8_t *cubemap_image_t::face(const int index) const
+{
+   assert(index >= 0 && index < face_count);
+   return m_pixels + size_t(m_size) * m_size * m_components * index;
 }
 
 bool texture_t::valid() const
@@ -195,8 +1082,8 @@ static pixel_format_desc gl_pixel_formats[] =
 };
 static_assert(int(texture_t::pixel_format_t::count) == (sizeof(gl_pixel_formats) / sizeof(gl_pixel_formats[0])), "texture pixel_format mismatch!");
 
-static texture_t::pixel_format_t
-determine_pixel_format(int components) {
+texture_t::pixel_format_t texture_t::pixel_format_for(const int components)
+{
    switch (components) {
    case 1: return texture_t::pixel_format_t::r8;
    case 2: return texture_t::pixel_format_t::rg8;
@@ -249,46 +1136,210 @@ bool texture_t::create(const int width,
    m_id = texture_id;
    m_width = width;
    m_height = height;
+   m_levels = levels;
+   m_type = type_t::texture_2d;
+   m_format = format;
+
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->create_texture(*this, data, mipmap);
+   }
 
    debug::info("texture_t: %d - size: %dx%d levels: %d", m_id, width, height, levels);
 
    return valid();
 }
 
-bool texture_t::create_from_file(const std::string_view &filename, const bool mipmap)
+bool texture_t::create_cube(const int size,
+                            const void *const faces[cubemap_image_t::face_count],
+                            const pixel_format_t format,
+                            const bool mipmap)
 {
-   std::vector<uint8_t> content;
-   if (!file_system_t::load_content(filename, content)) {
-      return false;
+   const pixel_format_desc &desc = gl_pixel_formats[int(format)];
+
+   GLuint texture_id = 0;
+   glGenTextures(1, &texture_id);
+   glBindTexture(GL_TEXTURE_CUBE_MAP, texture_id);
+
+   // note: rows of three component faces are not 4 byte aligned for every size
+   glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+   for (int face = 0; face < cubemap_image_t::face_count; face++) {
+      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face,
+                   0,
+                   desc.internal_format,
+                   size,
+                   size,
+                   0,
+                   desc.provided_format,
+                   desc.pixel_element_type,
+                   faces[face]);
    }
+   glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
-   int width = 0, height = 0, components = 0;
-   stbi_uc *bitmap = stbi_load_from_memory(content.data(),
-                                           int(content.size()),
-                                           &width,
-                                           &height,
-                                           &components,
-                                           STBI_default);
-   if (bitmap == nullptr) {
-      debug::warn("could not load image data: '%s'!", filename);
+   int levels = 1;
+   if (mipmap) {
+      glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+      opengl_check_errors();
+
+      int value = size;
+      while (value > 1) {
+         value >>= 1;
+         levels++;
+      }
+   }
+
+   glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+   if (glGetError() != GL_NO_ERROR) {
+      glDeleteTextures(1, &texture_id);
+      debug::error("could not create cube texture!");
       return false;
    }
 
-   create(width, height, bitmap, determine_pixel_format(components), mipmap);
-   stbi_image_free(bitmap);
+   m_id = texture_id;
+   m_width = size;
+   m_height = size;
+   m_levels = levels;
+   m_type = type_t::cube;
+   m_format = format;
+
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->create_texture_cube(*this, faces, mipmap);
+   }
+
+   debug::info("texture_t: %d - cube size: %dx%d levels: %d", m_id, size, size, levels);
 
    return valid();
 }
 
-void texture_t::destroy()
+bool texture_t::create_from_image(const image_t &image, const bool mipmap)
+{
+   if (!image.valid()) {
+      return false;
+   }
+
+   create(image.m_width, image.m_height, image.m_pixels, pixel_format_for(image.m_components), mipmap);
+
+   return valid();
+}
+
+bool texture_t::create_from_cubemap(const cubemap_image_t &image, const bool mipmap)
+{
+   if (!image.valid()) {
+      return false;
+   }
+
+   const void *faces[cubemap_image_t::face_count] = {};
+   for (int face = 0; face < cubemap_image_t::face_count; face++) {
+      faces[face] = image.face(face);
+   }
+
+   create_cube(image.m_size, faces, pixel_format_for(image.m_components), mipmap);
+
+   return valid();
+}
+
+bool texture_t::create_from_file(const std::string_view &filename, const bool mipmap)
+{
+   image_t image;
+   if (!image.load_from_file(filename)) {
+      return false;
+   }
+
+   create_from_image(image, mipmap);
+   image.destroy();
+
+   return valid();
+}
+
+void texture_t::destroy()
 {
    if (valid()) {
       glDeleteTextures(1, &m_id);
+
+      if (render_capture_t *capture = render_capture_t::active()) {
+         capture->destroy_texture(m_id);
+      }
    }
 
    m_id = 0;
    m_width = 0;
    m_height = 0;
+   m_levels = 0;
+   m_type = type_t::texture_2d;
+   m_format = pixel_format_t::unknown;
+}
+
+bool texture_t::update(const void *data)
+{
+   if (!valid() || m_type != type_t::texture_2d) {
+      return false;
+   }
+
+   const pixel_format_desc &desc = gl_pixel_formats[int(m_format)];
+
+   glBindTexture(GL_TEXTURE_2D, m_id);
+   glTexSubImage2D(GL_TEXTURE_2D,
+                   0,
+                   0,
+                   0,
+                   m_width,
+                   m_height,
+                   desc.provided_format,
+                   desc.pixel_element_type,
+                   data);
+   if (m_levels > 1) {
+      glGenerateMipmap(GL_TEXTURE_2D);
+   }
+   glBindTexture(GL_TEXTURE_2D, 0);
+
+   if (glGetError() != GL_NO_ERROR) {
+      debug::error("could not update texture!");
+      return false;
+   }
+
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->update_texture(*this, data);
+   }
+
+   return true;
+}
+
+bool texture_t::update_cube(const void *const faces[cubemap_image_t::face_count])
+{
+   if (!valid() || m_type != type_t::cube) {
+      return false;
+   }
+
+   const pixel_format_desc &desc = gl_pixel_formats[int(m_format)];
+
+   glBindTexture(GL_TEXTURE_CUBE_MAP, m_id);
+   glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+   for (int face = 0; face < cubemap_image_t::face_count; face++) {
+      glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face,
+                      0,
+                      0,
+                      0,
+                      m_width,
+                      m_height,
+                      desc.provided_format,
+                      desc.pixel_element_type,
+                      faces[face]);
+   }
+   glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+   if (m_levels > 1) {
+      glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+   }
+   glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+   if (glGetError() != GL_NO_ERROR) {
+      debug::error("could not update cube texture!");
+      return false;
+   }
+
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->update_texture_cube(*this, faces);
+   }
+
+   return true;
 }
 
 bool sampler_state_t::valid() const
@@ -316,7 +1367,8 @@ static const GLenum gl_address_modes[] =
 
 bool sampler_state_t::create(const filter_mode_t filter,
                              const address_mode_t address_u,
-                             const address_mode_t address_v)
+                             const address_mode_t address_v,
+                             const address_mode_t address_w)
 {
    GLuint sampler_state_id = 0;
    glGenSamplers(1, &sampler_state_id);
@@ -324,6 +1376,7 @@ bool sampler_state_t::create(const filter_mode_t filter,
    glSamplerParameteri(sampler_state_id, GL_TEXTURE_MAG_FILTER, filter == filter_mode_t::nearest ? GL_NEAREST : GL_LINEAR);
    glSamplerParameteri(sampler_state_id, GL_TEXTURE_WRAP_S, gl_address_modes[int(address_u)]);
    glSamplerParameteri(sampler_state_id, GL_TEXTURE_WRAP_T, gl_address_modes[int(address_v)]);
+   glSamplerParameteri(sampler_state_id, GL_TEXTURE_WRAP_R, gl_address_modes[int(address_w)]);
    if (glGetError() != GL_NO_ERROR) {
       glDeleteSamplers(1, &sampler_state_id);
       debug::error("could not create sampler state!");
@@ -332,6 +1385,10 @@ bool sampler_state_t::create(const filter_mode_t filter,
 
    m_id = sampler_state_id;
 
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->create_sampler_state(m_id, filter, address_u, address_v, address_w);
+   }
+
    return valid();
 }
 
@@ -339,6 +1396,10 @@ void sampler_state_t::destroy()
 {
    if (valid()) {
       glDeleteSamplers(1, &m_id);
+
+      if (render_capture_t *capture = render_capture_t::active()) {
+         capture->destroy_sampler_state(m_id);
+      }
    }
 
    m_id = 0;
@@ -349,6 +1410,13 @@ bool vertex_buffer_t::valid() const
    return m_id != 0;
 }
 
+static const GLenum gl_buffer_usages[] =
+{
+   GL_STATIC_DRAW,
+   GL_DYNAMIC_DRAW,
+   GL_DYNAMIC_COPY,
+};
+
 bool vertex_buffer_t::create(const size_t size,
                              const void *data,
                              const usage_hint_t usage)
@@ -356,7 +1424,7 @@ bool vertex_buffer_t::create(const size_t size,
    GLuint vertex_buffer_id = 0;
    glGenBuffers(1, &vertex_buffer_id);
    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_id);
-   glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
+   glBufferData(GL_ARRAY_BUFFER, size, data, gl_buffer_usages[int(usage)]);
    glBindBuffer(GL_ARRAY_BUFFER, 0);
    if (glGetError() != GL_NO_ERROR) {
       glDeleteBuffers(1, &vertex_buffer_id);
@@ -365,17 +1433,170 @@ bool vertex_buffer_t::create(const size_t size,
    }
 
    m_id = vertex_buffer_id;
+   m_size = size;
+   m_usage = usage;
+
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->create_vertex_buffer(*this, data);
+   }
 
    return valid();
 }
 
+bool vertex_buffer_t::update(const void *data, const size_t size)
+{
+   if (!valid() || size > m_size) {
+      return false;
+   }
+
+   glBindBuffer(GL_ARRAY_BUFFER, m_id);
+   glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+   opengl_check_errors();
+
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->update_vertex_buffer(*this, data, size);
+   }
+
+   return true;
+}
+
 void vertex_buffer_t::destroy()
 {
    if (valid()) {
       glDeleteBuffers(1, &m_id);
+
+      if (render_capture_t *capture = render_capture_t::active()) {
+         capture->destroy_vertex_buffer(m_id);
+      }
    }
 
    m_id = 0;
+   m_size = 0;
+   m_usage = usage_hint_t::immutable;
+}
+
+void *vertex_buffer_t::map(const size_t size)
+{
+   if (!valid() || size > m_size) {
+      return nullptr;
+   }
+
+   // note: while capturing the caller writes into a staging copy instead, so the
+   //       contents can be recorded on unmap without reading back mapped memory
+   if (render_capture_t *capture = render_capture_t::active()) {
+      return capture->map_staging(size);
+   }
+
+   glBindBuffer(GL_ARRAY_BUFFER, m_id);
+   void *data = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+   if (data == nullptr) {
+      debug::error("could not map vertex buffer!");
+   }
+
+   return data;
+}
+
+void vertex_buffer_t::unmap()
+{
+   render_capture_t *capture = render_capture_t::active();
+   if (capture && capture->m_staging_mapped) {
+      const size_t size = capture->unmap_staging();
+      update(capture->staging(), size);
+      return;
+   }
+
+   glBindBuffer(GL_ARRAY_BUFFER, m_id);
+   if (glUnmapBuffer(GL_ARRAY_BUFFER) == GL_FALSE) {
+      // note: the contents were lost, e.g. on a mode switch, they are rewritten next frame
+      debug::warn("vertex buffer contents lost while mapped!");
+   }
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+   opengl_check_errors();
+}
+
+bool texture_buffer_t::valid() const
+{
+   return m_buffer_id != 0 && m_texture_id != 0;
+}
+
+static const GLenum gl_texture_buffer_formats[] =
+{
+   GL_R16UI,
+   GL_R32UI,
+   GL_RG32UI,
+   GL_RGBA32F,
+};
+static_assert(int(texture_buffer_t::format_t::count) == (sizeof(gl_texture_buffer_formats) / sizeof(gl_texture_buffer_formats[0])), "texture buffer format mismatch!");
+
+bool texture_buffer_t::create(const size_t capacity, const format_t format)
+{
+   GLuint buffer_id = 0;
+   glGenBuffers(1, &buffer_id);
+   glBindBuffer(GL_TEXTURE_BUFFER, buffer_id);
+   glBufferData(GL_TEXTURE_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+   glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+   GLuint texture_id = 0;
+   glGenTextures(1, &texture_id);
+   glBindTexture(GL_TEXTURE_BUFFER, texture_id);
+   glTexBuffer(GL_TEXTURE_BUFFER, gl_texture_buffer_formats[int(format)], buffer_id);
+   glBindTexture(GL_TEXTURE_BUFFER, 0);
+   if (glGetError() != GL_NO_ERROR) {
+      glDeleteTextures(1, &texture_id);
+      glDeleteBuffers(1, &buffer_id);
+      debug::error("could not create texture buffer!");
+      return false;
+   }
+
+   m_buffer_id = buffer_id;
+   m_texture_id = texture_id;
+   m_capacity = capacity;
+
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->create_texture_buffer(*this, format);
+   }
+
+   return valid();
+}
+
+bool texture_buffer_t::update(const void *data, const size_t size)
+{
+   assert(size <= m_capacity);
+
+   // note: orphan first so the driver hands out fresh storage instead of 
+   //       waiting for draws of the previous frame that still read the old
+   glBindBuffer(GL_TEXTURE_BUFFER, m_buffer_id);
+   glBufferData(GL_TEXTURE_BUFFER, m_capacity, nullptr, GL_STREAM_DRAW);
+   glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+   glBindBuffer(GL_TEXTURE_BUFFER, 0);
+   opengl_check_errors();
+
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->update_texture_buffer(*this, data, size);
+   }
+
+   return true;
+}
+
+void texture_buffer_t::destroy()
+{
+   if (m_texture_id) {
+      glDeleteTextures(1, &m_texture_id);
+
+      if (render_capture_t *capture = render_capture_t::active()) {
+         capture->destroy_texture_buffer(m_texture_id);
+      }
+   }
+
+   if (m_buffer_id) {
+      glDeleteBuffers(1, &m_buffer_id);
+   }
+
+   m_buffer_id = 0;
+   m_texture_id = 0;
+   m_capacity = 0;
 }
 
 struct vertex_attrib_desc {
@@ -389,72 +1610,814 @@ static const vertex_attrib_desc gl_attrib_desc[] =
    { GL_UNSIGNED_BYTE, sizeof(uint8_t) },
 };
 
-vertex_layout_t &vertex_layout_t::clear()
+vertex_layout_t &vertex_layout_t::clear()
+{
+   m_count = 0;
+   m_stride = 0;
+   m_first_index = 0;
+   m_divisor = 0;
+
+   return *this;
+}
+
+vertex_layout_t &vertex_layout_t::add(const attribute_type_t type,
+                                      const uint32_t count,
+                                      const bool normalized)
+{
+   assert(m_count < max_vertex_attributes);
+   assert(count <= 4);
+
+   m_attributes[m_count].index = m_first_index + m_count;
+   m_attributes[m_count].type  = gl_attrib_desc[int(type)].type;
+   m_attributes[m_count].size  = gl_attrib_desc[int(type)].size;
+   m_attributes[m_count].count = count;
+   m_attributes[m_count].normalized = normalized ? GL_TRUE : GL_FALSE;
+   m_count++;
+
+   m_stride += gl_attrib_desc[int(type)].size * count;
+
+   return *this;
+}
+
+vertex_layout_t &vertex_layout_t::per_instance(const uint32_t first_index)
+{
+   assert(m_count == 0);
+
+   m_first_index = first_index;
+   m_divisor = 1;
+
+   return *this;
+}
+
+bool render_target_t::valid() const
+{
+   return m_id != 0;
+}
+
+static const GLenum gl_color_formats[] =
+{
+   GL_NONE,
+   GL_RGBA8,
+   GL_RGBA16F,
+};
+
+static const GLenum gl_depth_formats[] =
+{
+   GL_NONE,
+   GL_DEPTH24_STENCIL8,
+   GL_DEPTH_COMPONENT32F,
+};
+
+bool render_target_t::create(const desc_t &desc)
+{
+   assert(desc.m_width > 0 && desc.m_height > 0 && desc.m_samples > 0);
+
+   const bool multisampled = desc.m_samples > 1;
+   const GLenum color_format = gl_color_formats[int(desc.m_color_format)];
+   const GLenum depth_format = gl_depth_formats[int(desc.m_depth_format)];
+
+   GLuint framebuffer_id = 0;
+   glGenFramebuffers(1, &framebuffer_id);
+   glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_id);
+
+   GLuint color_renderbuffer_id = 0;
+   GLuint color_texture_id = 0;
+   if (color_format != GL_NONE) {
+      if (multisampled) {
+         glGenRenderbuffers(1, &color_renderbuffer_id);
+         glBindRenderbuffer(GL_RENDERBUFFER, color_renderbuffer_id);
+         glRenderbufferStorageMultisample(GL_RENDERBUFFER, desc.m_samples, color_format, desc.m_width, desc.m_height);
+         glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_renderbuffer_id);
+      }
+      else {
+         const GLenum pixel_type = desc.m_color_format == color_format_t::rgba16f ? GL_HALF_FLOAT : GL_UNSIGNED_BYTE;
+         glGenTextures(1, &color_texture_id);
+         glBindTexture(GL_TEXTURE_2D, color_texture_id);
+         glTexImage2D(GL_TEXTURE_2D, 0, color_format, desc.m_width, desc.m_height, 0, GL_RGBA, pixel_type, nullptr);
+         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+         glBindTexture(GL_TEXTURE_2D, 0);
+         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color_texture_id, 0);
+      }
+   }
+   else {
+      glDrawBuffer(GL_NONE);
+      glReadBuffer(GL_NONE);
+   }
+
+   GLuint depth_renderbuffer_id = 0;
+   if (depth_format != GL_NONE) {
+      const GLenum attachment = desc.m_depth_format == depth_format_t::depth24_stencil8 ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+      glGenRenderbuffers(1, &depth_renderbuffer_id);
+      glBindRenderbuffer(GL_RENDERBUFFER, depth_renderbuffer_id);
+      glRenderbufferStorageMultisample(GL_RENDERBUFFER, multisampled ? desc.m_samples : 0, depth_format, desc.m_width, desc.m_height);
+      glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachment, GL_RENDERBUFFER, depth_renderbuffer_id);
+   }
+
+   glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+   const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+   glBindFramebuffer(GL_FRAMEBUFFER, 0);
+   if (status != GL_FRAMEBUFFER_COMPLETE || glGetError() != GL_NO_ERROR) {
+      glDeleteFramebuffers(1, &framebuffer_id);
+      glDeleteRenderbuffers(1, &color_renderbuffer_id);
+      glDeleteRenderbuffers(1, &depth_renderbuffer_id);
+      glDeleteTextures(1, &color_texture_id);
+      debug::error("could not create render target! (status: 0x%X)", status);
+      return false;
+   }
+
+   m_id = framebuffer_id;
+   m_color_renderbuffer = color_renderbuffer_id;
+   m_depth_renderbuffer = depth_renderbuffer_id;
+   m_color_texture.m_id = color_texture_id;
+   m_color_texture.m_width = color_texture_id ? desc.m_width : 0;
+   m_color_texture.m_height = color_texture_id ? desc.m_height : 0;
+   m_desc = desc;
+
+   debug::info("render_target_t: %d - size: %dx%d samples: %d", m_id, desc.m_width, desc.m_height, desc.m_samples);
+
+   return valid();
+}
+
+void render_target_t::destroy()
+{
+   if (valid()) {
+      glDeleteFramebuffers(1, &m_id);
+      glDeleteRenderbuffers(1, &m_color_renderbuffer);
+      glDeleteRenderbuffers(1, &m_depth_renderbuffer);
+      m_color_texture.destroy();
+   }
+
+   m_id = 0;
+   m_color_renderbuffer = 0;
+   m_depth_renderbuffer = 0;
+   m_desc = {};
+}
+
+render_target_t *render_target_pool_t::acquire(const render_target_t::desc_t &desc, const int64_t frame_index)
+{
+   for (auto &entry : m_entries) {
+      if (!entry->m_in_use && entry->m_target.m_desc == desc) {
+         entry->m_in_use = true;
+         entry->m_last_used = frame_index;
+         return &entry->m_target;
+      }
+   }
+
+   if (m_pool.capacity() == 0) {
+      m_pool.create(max_targets);
+      m_entries.reserve(max_targets);
+   }
+
+   entry_t *entry = m_pool.allocate();
+   if (entry == nullptr) {
+      debug::error("render target pool exhausted!");
+      return nullptr;
+   }
+
+   if (!entry->m_target.create(desc)) {
+      m_pool.release(entry);
+      return nullptr;
+   }
+
+   entry->m_in_use = true;
+   entry->m_last_used = frame_index;
+   m_entries.push_back(entry);
+
+   return &entry->m_target;
+}
+
+void render_target_pool_t::release(render_target_t *target)
+{
+   for (auto &entry : m_entries) {
+      if (&entry->m_target == target) {
+         entry->m_in_use = false;
+         return;
+      }
+   }
+
+   assert(!"render target is not pooled!");
+}
+
+void render_target_pool_t::trim(const int64_t frame_index)
+{
+   for (size_t index = 0; index < m_entries.size();) {
+      auto &entry = m_entries[index];
+      if (!entry->m_in_use && frame_index - entry->m_last_used > max_idle_frames) {
+         entry->m_target.destroy();
+         m_pool.release(entry);
+         m_entries[index] = m_entries.back();
+         m_entries.pop_back();
+         continue;
+      }
+
+      index++;
+   }
+}
+
+void render_target_pool_t::destroy()
+{
+   for (auto &entry : m_entries) {
+      entry->m_target.destroy();
+      m_pool.release(entry);
+   }
+
+   m_entries.clear();
+   m_pool.destroy();
+}
+
+bool occlusion_query_t::valid() const
+{
+   return m_ids[0] != 0;
+}
+
+bool occlusion_query_t::create()
+{
+   GLuint query_ids[latency] = {};
+   glGenQueries(latency, query_ids);
+   if (glGetError() != GL_NO_ERROR) {
+      glDeleteQueries(latency, query_ids);
+      debug::error("could not create occlusion query!");
+      return false;
+   }
+
+   for (int slot = 0; slot < latency; slot++) {
+      m_ids[slot] = query_ids[slot];
+      m_issued_frame[slot] = -1;
+   }
+
+   m_resolved_frame = -1;
+   m_polled_frame = -1;
+   m_latest_slot = -1;
+   m_visible = true;
+
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->create_occlusion_query(m_ids[0]);
+   }
+
+   return valid();
+}
+
+void occlusion_query_t::destroy()
+{
+   if (valid()) {
+      glDeleteQueries(latency, m_ids);
+
+      if (render_capture_t *capture = render_capture_t::active()) {
+         capture->destroy_occlusion_query(m_ids[0]);
+      }
+   }
+
+   for (int slot = 0; slot < latency; slot++) {
+      m_ids[slot] = 0;
+   }
+}
+
+bool fragment_counter_t::valid() const
+{
+   return m_ids[0] != 0;
+}
+
+bool fragment_counter_t::create()
+{
+   GLuint query_ids[latency] = {};
+   glGenQueries(latency, query_ids);
+   if (glGetError() != GL_NO_ERROR) {
+      glDeleteQueries(latency, query_ids);
+      debug::error("could not create fragment counter!");
+      return false;
+   }
+
+   for (int slot = 0; slot < latency; slot++) {
+      m_ids[slot] = query_ids[slot];
+      m_issued_frame[slot] = -1;
+   }
+
+   m_polled_frame = -1;
+   m_latest = 0;
+   m_total = 0;
+   m_resolved = 0;
+
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->create_fragment_counter(m_ids[0]);
+   }
+
+   return valid();
+}
+
+void fragment_counter_t::destroy()
+{
+   if (valid()) {
+      glDeleteQueries(latency, m_ids);
+
+      if (render_capture_t *capture = render_capture_t::active()) {
+         capture->destroy_fragment_counter(m_ids[0]);
+      }
+   }
+
+   for (int slot = 0; slot < latency; slot++) {
+      m_ids[slot] = 0;
+   }
+}
+
+float gpu_profiler_t::pass_t::latest() const
+{
+   if (m_count == 0) {
+      return 0.0f;
+   }
+
+   return m_milliseconds[(m_count - 1) % history_size];
+}
+
+float gpu_profiler_t::pass_t::average() const
+{
+   const int count = m_count < history_size ? m_count : history_size;
+   if (count == 0) {
+      return 0.0f;
+   }
+
+   float sum = 0.0f;
+   for (int index = 0; index < count; index++) {
+      sum += m_milliseconds[index];
+   }
+
+   return sum / count;
+}
+
+bool gpu_profiler_t::valid() const
+{
+   return m_frames[0].m_query_ids[0] != 0;
+}
+
+bool gpu_profiler_t::create()
+{
+   for (auto &frame : m_frames) {
+      glGenQueries(max_markers * 2, frame.m_query_ids);
+      frame.m_marker_count = 0;
+      frame.m_frame_index = -1;
+      frame.m_complete = false;
+   }
+
+   if (glGetError() != GL_NO_ERROR) {
+      destroy();
+      debug::error("could not create gpu profiler!");
+      return false;
+   }
+
+   m_passes.reserve(max_passes);
+
+   return valid();
+}
+
+void gpu_profiler_t::destroy()
+{
+   for (auto &frame : m_frames) {
+      if (frame.m_query_ids[0] != 0) {
+         glDeleteQueries(max_markers * 2, frame.m_query_ids);
+      }
+
+      frame = {};
+   }
+
+   m_current = nullptr;
+   m_open_count = 0;
+   m_passes.clear();
+}
+
+void gpu_profiler_t::collect()
+{
+   // note: a frame is resolved once the last timestamp written in it is available,
+   //       timestamps complete in submission order so the rest are available too
+   for (auto &frame : m_frames) {
+      if (frame.m_frame_index < 0 || !frame.m_complete) {
+         continue;
+      }
+
+      if (frame.m_last_query < 0) {
+         frame.m_frame_index = -1;
+         frame.m_complete = false;
+         continue;
+      }
+
+      GLuint available = GL_FALSE;
+      glGetQueryObjectuiv(frame.m_query_ids[frame.m_last_query], GL_QUERY_RESULT_AVAILABLE, &available);
+      if (available == GL_FALSE) {
+         continue;
+      }
+
+      for (int index = 0; index < frame.m_marker_count; index++) {
+         const marker_t &marker = frame.m_markers[index];
+         if (!marker.m_ended) {
+            continue;
+         }
+
+         GLuint64 begin = 0, end = 0;
+         glGetQueryObjectui64v(frame.m_query_ids[index * 2 + 0], GL_QUERY_RESULT, &begin);
+         glGetQueryObjectui64v(frame.m_query_ids[index * 2 + 1], GL_QUERY_RESULT, &end);
+         record(marker, frame.m_frame_index, float((end - begin) / 1000000.0));
+      }
+
+      frame.m_frame_index = -1;
+      frame.m_complete = false;
+   }
+   opengl_check_errors();
+}
+
+void gpu_profiler_t::record(const marker_t &marker, const int64_t frame_index, const float milliseconds)
+{
+   const uint32_t name_hash = fnv1a32(marker.m_name, strlen(marker.m_name));
+
+   pass_t *pass = nullptr;
+   for (auto &candidate : m_passes) {
+      if (candidate.m_name_hash == name_hash) {
+         pass = &candidate;
+         break;
+      }
+   }
+
+   if (pass == nullptr) {
+      if (m_passes.size() >= max_passes) {
+         return;
+      }
+
+      pass = &m_passes.emplace_back();
+      pass->m_name = marker.m_name;
+      pass->m_name_hash = name_hash;
+      pass->m_depth = marker.m_depth;
+   }
+
+   const int slot = pass->m_count % history_size;
+   pass->m_frames[slot] = frame_index;
+   pass->m_milliseconds[slot] = milliseconds;
+   pass->m_count++;
+}
+
+void gpu_profiler_t::begin_frame(const int64_t frame_index)
+{
+   collect();
+
+   // note: results that did not arrive within 'latency' frames are dropped, not waited for
+   frame_t &frame = m_frames[frame_index % latency];
+   if (frame.m_frame_index >= 0) {
+      m_dropped_frames++;
+   }
+
+   frame.m_frame_index = frame_index;
+   frame.m_marker_count = 0;
+   frame.m_last_query = -1;
+   frame.m_complete = false;
+
+   m_current = &frame;
+   m_open_count = 0;
+}
+
+void gpu_profiler_t::end_frame()
+{
+   if (m_current) {
+      m_current->m_complete = true;
+      m_current = nullptr;
+   }
+}
+
+void gpu_profiler_t::begin(const char *name)
+{
+   assert(m_open_count < max_markers);
+
+   if (m_current == nullptr || m_current->m_marker_count >= max_markers) {
+      m_open[m_open_count++] = -1;
+      return;
+   }
+
+   const int index = m_current->m_marker_count++;
+   m_current->m_markers[index] = marker_t{ name, m_open_count, false };
+   m_open[m_open_count++] = index;
+
+   glQueryCounter(m_current->m_query_ids[index * 2 + 0], GL_TIMESTAMP);
+   opengl_check_errors();
+}
+
+void gpu_profiler_t::end()
+{
+   assert(m_open_count > 0);
+
+   const int index = m_open[--m_open_count];
+   if (m_current == nullptr || index < 0) {
+      return;
+   }
+
+   m_current->m_markers[index].m_ended = true;
+   m_current->m_last_query = index * 2 + 1;
+
+   glQueryCounter(m_current->m_query_ids[index * 2 + 1], GL_TIMESTAMP);
+   opengl_check_errors();
+}
+
+const gpu_profiler_t::pass_t *gpu_profiler_t::find(const std::string_view &name) const
+{
+   const uint32_t name_hash = fnv1a32(name.data(), name.length());
+   for (auto &pass : m_passes) {
+      if (pass.m_name_hash == name_hash) {
+         return &pass;
+      }
+   }
+
+   return nullptr;
+}
+
+bool gpu_profiler_t::save_csv(const std::string_view &filename) const
+{
+   std::string content = "frame,pass,depth,milliseconds\n";
+   for (auto &pass : m_passes) {
+      const int count = pass.m_count < history_size ? pass.m_count : history_size;
+      const int first = pass.m_count - count;
+      for (int index = first; index < pass.m_count; index++) {
+         const int slot = index % history_size;
+
+         char line[256];
+         snprintf(line, sizeof(line), "%lld,%s,%d,%.4f\n",
+                  (long long)pass.m_frames[slot],
+                  pass.m_name,
+                  pass.m_depth,
+                  pass.m_milliseconds[slot]);
+         content += line;
+      }
+   }
+
+   return file_system_t::save_content(filename, content);
+}
+
+static GLuint gl_vertex_array_object_id = 0;
+
+renderer_t::renderer_t()
+{
+   assert(gl_vertex_array_object_id == 0);
+   glGenVertexArrays(1, &gl_vertex_array_object_id);
+   glBindVertexArray(gl_vertex_array_object_id);
+   debug::info("created gl_vertex_array_object_id: %d", gl_vertex_array_object_id);
+
+   // note: filter across cube face edges instead of clamping at each face
+   glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+   m_gpu_profiler.create();
+}
+
+renderer_t::~renderer_t()
+{
+   for (auto &fence : m_frame_fences) {
+      if (fence) {
+         glDeleteSync(static_cast<GLsync>(fence));
+         fence = nullptr;
+      }
+   }
+
+   m_render_target_pool.destroy();
+   m_gpu_profiler.destroy();
+   glDeleteVertexArrays(1, &gl_vertex_array_object_id);
+}
+
+void renderer_t::begin_frame()
+{
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->begin_frame();
+   }
+
+   m_frame_index++;
+   m_occlusion_stats = {};
+
+   // note: whatever is bound now (backbuffer or an offscreen target owned 
+   //       by the caller) is what set_render_target(nullptr) returns to
+   GLint framebuffer_id = 0;
+   glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer_id);
+   m_default_framebuffer = uint32_t(framebuffer_id);
+   m_render_target = nullptr;
+   m_render_target_pool.trim(m_frame_index);
+
+   if (m_gpu_profiler.valid()) {
+      m_gpu_profiler.begin_frame(m_frame_index);
+      m_gpu_profiler.begin("frame");
+   }
+}
+
+void renderer_t::end_frame()
+{
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->end_frame();
+   }
+
+   if (m_gpu_profiler.valid()) {
+      m_gpu_profiler.end();
+      m_gpu_profiler.end_frame();
+   }
+
+   // note: the ring slot of this frame is only still taken when the gpu is
+   //       'max_frames_in_flight' frames behind, then and only then we wait
+   poll_frame_fences(m_frame_index - max_frames_in_flight);
+   m_frame_fences[m_frame_index % max_frames_in_flight] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+   opengl_check_errors();
+}
+
+int64_t renderer_t::frame_index() const
+{
+   return m_frame_index;
+}
+
+int64_t renderer_t::completed_frame() const
+{
+   return m_completed_frame;
+}
+
+void renderer_t::poll_frame_fences(const int64_t wait_for_frame)
+{
+   // note: fences signal in submission order, stop at the first one still pending
+   for (int64_t frame = m_completed_frame + 1; frame < m_frame_index; frame++) {
+      void *&fence = m_frame_fences[frame % max_frames_in_flight];
+      if (fence) {
+         const bool wait = frame <= wait_for_frame;
+         const GLenum result = glClientWaitSync(static_cast<GLsync>(fence),
+                                                wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                                                wait ? GL_TIMEOUT_IGNORED : 0);
+         if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) {
+            break;
+         }
+
+         glDeleteSync(static_cast<GLsync>(fence));
+         fence = nullptr;
+      }
+
+      m_completed_frame = frame;
+   }
+}
+
+void renderer_t::clear(const color_t &color, const float depth)
+{
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->clear(color, depth);
+   }
+
+   GLbitfield mask = GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT;
+   if (m_render_target) {
+      mask = 0;
+      if (m_render_target->m_desc.m_color_format != render_target_t::color_format_t::none) {
+         mask |= GL_COLOR_BUFFER_BIT;
+      }
+
+      if (m_render_target->m_desc.m_depth_format != render_target_t::depth_format_t::none) {
+         mask |= GL_DEPTH_BUFFER_BIT;
+      }
+
+      if (m_render_target->m_desc.m_depth_format == render_target_t::depth_format_t::depth24_stencil8) {
+         mask |= GL_STENCIL_BUFFER_BIT;
+      }
+   }
+
+   glClearDepth(depth);
+   glClearColor(color.r, color.g, color.b, color.a);
+   glClear(mask);
+   opengl_check_errors();
+}
+
+void renderer_t::set_viewport(const viewport_t &viewport)
+{
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->set_viewport(viewport);
+   }
+
+   glViewport(viewport.x, viewport.y, viewport.width, viewport.height);
+   opengl_check_errors();
+}
+
+void renderer_t::set_render_target(render_target_t *target)
 {
-   m_count = 0;
-   m_stride = 0;
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->set_render_target(target);
+   }
 
-   return *this;
+   m_render_target = target;
+
+   glBindFramebuffer(GL_FRAMEBUFFER, target ? target->m_id : m_default_framebuffer);
+   if (target) {
+      glViewport(0, 0, target->m_desc.m_width, target->m_desc.m_height);
+   }
+   opengl_check_errors();
 }
 
-vertex_layout_t &vertex_layout_t::add(const attribute_type_t type,
-                                      const uint32_t count,
-                                      const bool normalized)
+void renderer_t::resolve_render_target(render_target_t &source, render_target_t *destination, const viewport_t &viewport)
 {
-   assert(m_count < max_vertex_attributes);
-   assert(count <= 4);
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->resolve_render_target(source, destination, viewport);
+   }
 
-   m_attributes[m_count].index = m_count;
-   m_attributes[m_count].type  = gl_attrib_desc[int(type)].type;
-   m_attributes[m_count].size  = gl_attrib_desc[int(type)].size;
-   m_attributes[m_count].count = count;
-   m_attributes[m_count].normalized = normalized ? GL_TRUE : GL_FALSE;
-   m_count++;
+   // note: multisampled sources can only be resolved 1:1, scaled blits are filtered
+   const bool same_size = source.m_desc.m_width == viewport.width && source.m_desc.m_height == viewport.height;
+   assert(source.m_desc.m_samples == 1 || same_size);
 
-   m_stride += gl_attrib_desc[int(type)].size * count;
+   glBindFramebuffer(GL_READ_FRAMEBUFFER, source.m_id);
+   glBindFramebuffer(GL_DRAW_FRAMEBUFFER, destination ? destination->m_id : m_default_framebuffer);
+   glBlitFramebuffer(0, 0, source.m_desc.m_width, source.m_desc.m_height,
+                     viewport.x, viewport.y, viewport.x + viewport.width, viewport.y + viewport.height,
+                     GL_COLOR_BUFFER_BIT,
+                     same_size ? GL_NEAREST : GL_LINEAR);
 
-   return *this;
+   glBindFramebuffer(GL_FRAMEBUFFER, m_render_target ? m_render_target->m_id : m_default_framebuffer);
+   opengl_check_errors();
 }
 
-static GLuint gl_vertex_array_object_id = 0;
-
-renderer_t::renderer_t()
+void renderer_t::invalidate_render_target(render_target_t &target, const bool color, const bool depth)
 {
-   assert(gl_vertex_array_object_id == 0);
-   glGenVertexArrays(1, &gl_vertex_array_object_id);
-   glBindVertexArray(gl_vertex_array_object_id);
-   debug::info("created gl_vertex_array_object_id: %d", gl_vertex_array_object_id);
-}
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->invalidate_render_target(target, color, depth);
+   }
 
-renderer_t::~renderer_t()
-{
-   glDeleteVertexArrays(1, &gl_vertex_array_object_id);
+   if (gl_extensions.invalidate_framebuffer == nullptr) {
+      return;
+   }
+
+   GLenum attachments[2] = {};
+   GLsizei attachment_count = 0;
+   if (color && target.m_desc.m_color_format != render_target_t::color_format_t::none) {
+      attachments[attachment_count++] = GL_COLOR_ATTACHMENT0;
+   }
+
+   if (depth && target.m_desc.m_depth_format != render_target_t::depth_format_t::none) {
+      attachments[attachment_count++] = target.m_desc.m_depth_format == render_target_t::depth_format_t::depth24_stencil8 ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+   }
+
+   if (attachment_count == 0) {
+      return;
+   }
+
+   glBindFramebuffer(GL_FRAMEBUFFER, target.m_id);
+   gl_extensions.invalidate_framebuffer(GL_FRAMEBUFFER, attachment_count, attachments);
+   glBindFramebuffer(GL_FRAMEBUFFER, m_render_target ? m_render_target->m_id : m_default_framebuffer);
+   opengl_check_errors();
 }
 
-void renderer_t::clear(const color_t &color, const float depth)
+render_target_t *renderer_t::acquire_render_target(const render_target_t::desc_t &desc)
 {
-   glClearDepth(depth);
-   glClearColor(color.r, color.g, color.b, color.a);
-   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-   opengl_check_errors();
+   render_target_t *target = m_render_target_pool.acquire(desc, m_frame_index);
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->acquire_render_target(desc, target);
+   }
+
+   return target;
 }
 
-void renderer_t::set_viewport(const viewport_t &viewport)
+void renderer_t::release_render_target(render_target_t *target)
 {
-   glViewport(viewport.x, viewport.y, viewport.width, viewport.height);
-   opengl_check_errors();
+   if (target) {
+      if (render_capture_t *capture = render_capture_t::active()) {
+         capture->release_render_target(*target);
+      }
+
+      m_render_target_pool.release(target);
+   }
 }
 
 void renderer_t::set_shader_program(shader_program_t &program)
 {
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->set_shader_program(program);
+   }
+
    m_program = &program;
 
    glUseProgram(program.m_id);
    opengl_check_errors();
 }
 
+void renderer_t::set_uniform(const std::string_view &name, const int value)
+{
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->set_uniform(name, value);
+   }
+
+   assert(m_program);
+
+   const uint32_t name_hash = fnv1a32(name.data(), name.length());
+
+   auto &uniforms = m_program->m_uniforms;
+   for (auto &uniform : uniforms) {
+      if (uniform.m_name_hash == name_hash) {
+         assert(uniform.m_value_type == GL_INT || gl_uniform_is_sampler(uniform.m_value_type));
+
+         const uint32_t value_hash = fnv1a32(&value, sizeof(value));
+         if (uniform.m_value_hash != value_hash) {
+            uniform.m_value_hash = value_hash;
+
+            glUniform1i(uniform.m_location, value);
+         }
+
+         break;
+      }
+   }
+}
+
 void renderer_t::set_uniform(const std::string_view &name, const glm::vec3 &value)
 {
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->set_uniform(name, value);
+   }
+
    assert(m_program);
 
    const uint32_t name_hash = fnv1a32(name.data(), name.length());
@@ -478,6 +2441,10 @@ void renderer_t::set_uniform(const std::string_view &name, const glm::vec3 &valu
 
 void renderer_t::set_uniform(const std::string_view &name, const glm::vec4 &value)
 {
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->set_uniform(name, value);
+   }
+
    assert(m_program);
 
    const uint32_t name_hash = fnv1a32(name.data(), name.length());
@@ -501,6 +2468,10 @@ void renderer_t::set_uniform(const std::string_view &name, const glm::vec4 &valu
 
 void renderer_t::set_uniform(const std::string_view &name, const glm::mat4 &value)
 {
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->set_uniform(name, value);
+   }
+
    assert(m_program);
 
    const uint32_t name_hash = fnv1a32(name.data(), name.length());
@@ -522,19 +2493,44 @@ void renderer_t::set_uniform(const std::string_view &name, const glm::mat4 &valu
    }
 }
 
+static const GLenum gl_texture_types[] =
+{
+   GL_TEXTURE_2D,
+   GL_TEXTURE_CUBE_MAP,
+};
+
 void renderer_t::set_texture(texture_t &texture, const int unit)
 {
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->set_texture(texture, unit);
+   }
+
    glActiveTexture(GL_TEXTURE0 + unit);
-   glBindTexture(GL_TEXTURE_2D, texture.m_id);
+   glBindTexture(gl_texture_types[int(texture.m_type)], texture.m_id);
    opengl_check_errors();
 }
 
 void renderer_t::set_sampler_state(sampler_state_t &sampler, const int unit)
 {
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->set_sampler_state(sampler, unit);
+   }
+
    glBindSampler(unit, sampler.m_id);
    opengl_check_errors();
 }
 
+void renderer_t::set_texture_buffer(texture_buffer_t &buffer, const int unit)
+{
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->set_texture_buffer(buffer, unit);
+   }
+
+   glActiveTexture(GL_TEXTURE0 + unit);
+   glBindTexture(GL_TEXTURE_BUFFER, buffer.m_texture_id);
+   opengl_check_errors();
+}
+
 static const GLenum gl_blend_equations[] =
 {
    GL_FUNC_ADD,
@@ -565,6 +2561,13 @@ static const GLenum gl_blend_factors[] =
 
 void renderer_t::set_blend_state(blend_state_t &state)
 {
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->set_blend_state(state);
+   }
+
+   const GLboolean color_write = state.m_color_write ? GL_TRUE : GL_FALSE;
+   glColorMask(color_write, color_write, color_write, color_write);
+
    if (state.m_enabled) {
       glEnable(GL_BLEND);
       glBlendFuncSeparate(gl_blend_factors[int(state.m_color_src)],
@@ -595,6 +2598,10 @@ static const GLenum gl_compare_funcs[] =
 
 void renderer_t::set_depth_stencil_state(depth_stencil_state_t &state)
 {
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->set_depth_stencil_state(state);
+   }
+
    if (state.m_read) {
       glEnable(GL_DEPTH_TEST);
       glDepthFunc(gl_compare_funcs[int(state.m_func)]);
@@ -630,6 +2637,10 @@ static const GLenum gl_front_faces[] =
 
 void renderer_t::set_rasterizer_state(rasterizer_state_t &state)
 {
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->set_rasterizer_state(state);
+   }
+
    if (state.m_cull_mode != rasterizer_state_t::cull_mode_t::none) {
       glEnable(GL_CULL_FACE);
       glCullFace(gl_cull_modes[int(state.m_cull_mode)]);
@@ -645,9 +2656,30 @@ void renderer_t::set_rasterizer_state(rasterizer_state_t &state)
 
 void renderer_t::set_vertex_buffer_and_layout(vertex_buffer_t &buffer, vertex_layout_t &layout)
 {
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->set_vertex_buffer_and_layout(buffer, layout);
+   }
+
    glBindBuffer(GL_ARRAY_BUFFER, buffer.m_id);
    opengl_check_errors();
 
+   // note: an earlier per-instance layout leaves its locations enabled with a
+   //       divisor, a later draw with a narrower layout would still fetch them
+   uint32_t layout_attributes = 0;
+   for (uint32_t index = 0; index < layout.m_count; index++) {
+      layout_attributes |= 1u << layout.m_attributes[index].index;
+   }
+
+   if (layout.m_divisor == 0) {
+      for (uint32_t stale = m_enabled_attributes & ~layout_attributes; stale != 0; stale &= stale - 1) {
+         const uint32_t location = uint32_t(std::countr_zero(stale));
+         glDisableVertexAttribArray(location);
+         glVertexAttribDivisor(location, 0);
+      }
+      m_enabled_attributes = 0;
+   }
+   m_enabled_attributes |= layout_attributes;
+
    uint8_t *offset = nullptr;
    for (uint32_t index = 0; index < layout.m_count; index++) {
       auto &attrib = layout.m_attributes[index];
@@ -659,6 +2691,7 @@ void renderer_t::set_vertex_buffer_and_layout(vertex_buffer_t &buffer, vertex_la
                             (GLboolean)attrib.normalized,
                             layout.m_stride,
                             offset);
+      glVertexAttribDivisor(attrib.index, layout.m_divisor);
 
       offset += attrib.count * attrib.size;
       opengl_check_errors();
@@ -674,6 +2707,288 @@ static const GLenum gl_topology_types[] =
 
 void renderer_t::draw(const topology_t topology, const int start, const int count)
 {
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->draw(topology, start, count);
+   }
+
    glDrawArrays(gl_topology_types[int(topology)], start, count);
    opengl_check_errors();
 }
+
+void renderer_t::draw_instanced(const topology_t topology, const int start, const int count, const int instances)
+{
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->draw_instanced(topology, start, count, instances);
+   }
+
+   glDrawArraysInstanced(gl_topology_types[int(topology)], start, count, instances);
+   opengl_check_errors();
+}
+
+void renderer_t::begin_transform_feedback(vertex_buffer_t &buffer, const topology_t topology)
+{
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->begin_transform_feedback(buffer, topology);
+   }
+
+   assert(!m_transform_feedback_active);
+
+   // note: nothing reaches the rasterizer, the vertex shader outputs are the result
+   glEnable(GL_RASTERIZER_DISCARD);
+   glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffer.m_id);
+   glBeginTransformFeedback(gl_topology_types[int(topology)]);
+   opengl_check_errors();
+
+   m_transform_feedback_active = true;
+}
+
+void renderer_t::end_transform_feedback()
+{
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->end_transform_feedback();
+   }
+
+   if (!m_transform_feedback_active) {
+      return;
+   }
+
+   glEndTransformFeedback();
+   glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+   glDisable(GL_RASTERIZER_DISCARD);
+   opengl_check_errors();
+
+   m_transform_feedback_active = false;
+}
+
+void renderer_t::poll_occlusion_query(occlusion_query_t &query)
+{
+   if (query.m_polled_frame == m_frame_index) {
+      return;
+   }
+
+   query.m_polled_frame = m_frame_index;
+
+   // note: only ask for results that are already available, never stall the pipeline
+   bool resolved = false;
+   bool pending = false;
+   for (int slot = 0; slot < occlusion_query_t::latency; slot++) {
+      const int64_t issued_frame = query.m_issued_frame[slot];
+      if (issued_frame < 0) {
+         continue;
+      }
+
+      GLuint available = GL_FALSE;
+      glGetQueryObjectuiv(query.m_ids[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+      if (available == GL_FALSE) {
+         pending = true;
+         continue;
+      }
+
+      GLuint any_samples_passed = GL_FALSE;
+      glGetQueryObjectuiv(query.m_ids[slot], GL_QUERY_RESULT, &any_samples_passed);
+      query.m_issued_frame[slot] = -1;
+
+      if (issued_frame > query.m_resolved_frame) {
+         query.m_resolved_frame = issued_frame;
+         query.m_visible = any_samples_passed != GL_FALSE;
+         resolved = true;
+      }
+   }
+   opengl_check_errors();
+
+   if (resolved) {
+      m_occlusion_stats.m_resolved++;
+      if (!query.m_visible) {
+         m_occlusion_stats.m_occluded++;
+      }
+   }
+
+   if (pending) {
+      m_occlusion_stats.m_pending++;
+   }
+}
+
+bool renderer_t::begin_occlusion_query(occlusion_query_t &query)
+{
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->begin_occlusion_query(query);
+   }
+
+   assert(!m_occlusion_query_active && !m_fragment_count_active);
+   poll_occlusion_query(query);
+
+   // note: the gpu is more than 'latency' frames behind, skip this test
+   //       instead of waiting for the slot to become available
+   const int slot = int(m_frame_index % occlusion_query_t::latency);
+   if (query.m_issued_frame[slot] >= 0) {
+      return false;
+   }
+
+   glBeginQuery(GL_ANY_SAMPLES_PASSED, query.m_ids[slot]);
+   opengl_check_errors();
+
+   query.m_issued_frame[slot] = m_frame_index;
+   query.m_latest_slot = slot;
+   m_occlusion_query_active = true;
+   m_occlusion_stats.m_tested++;
+
+   return true;
+}
+
+void renderer_t::end_occlusion_query()
+{
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->end_occlusion_query();
+   }
+
+   if (m_occlusion_query_active) {
+      glEndQuery(GL_ANY_SAMPLES_PASSED);
+      opengl_check_errors();
+
+      m_occlusion_query_active = false;
+   }
+}
+
+void renderer_t::begin_conditional_render(occlusion_query_t &query)
+{
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->begin_conditional_render(query);
+   }
+
+   assert(!m_conditional_render_active);
+   poll_occlusion_query(query);
+
+   // note: nothing tested yet, draw unconditionally
+   if (query.m_latest_slot < 0) {
+      return;
+   }
+
+   glBeginConditionalRender(query.m_ids[query.m_latest_slot], GL_QUERY_NO_WAIT);
+   opengl_check_errors();
+
+   m_conditional_render_active = true;
+}
+
+void renderer_t::end_conditional_render()
+{
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->end_conditional_render();
+   }
+
+   if (m_conditional_render_active) {
+      glEndConditionalRender();
+      opengl_check_errors();
+
+      m_conditional_render_active = false;
+   }
+}
+
+static GLenum
+gl_fragment_count_target()
+{
+   return gl_extensions.pipeline_statistics ? GL_FRAGMENT_SHADER_INVOCATIONS : GL_SAMPLES_PASSED;
+}
+
+void renderer_t::poll_fragment_counter(fragment_counter_t &counter)
+{
+   if (counter.m_polled_frame == m_frame_index) {
+      return;
+   }
+
+   counter.m_polled_frame = m_frame_index;
+
+   // note: same as occlusion queries, only collect what is already available
+   for (int slot = 0; slot < fragment_counter_t::latency; slot++) {
+      if (counter.m_issued_frame[slot] < 0) {
+         continue;
+      }
+
+      GLuint available = GL_FALSE;
+      glGetQueryObjectuiv(counter.m_ids[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+      if (available == GL_FALSE) {
+         continue;
+      }
+
+      GLuint64 count = 0;
+      glGetQueryObjectui64v(counter.m_ids[slot], GL_QUERY_RESULT, &count);
+      counter.m_issued_frame[slot] = -1;
+      counter.m_latest = count;
+      counter.m_total += count;
+      counter.m_resolved++;
+   }
+   opengl_check_errors();
+}
+
+bool renderer_t::begin_fragment_count(fragment_counter_t &counter)
+{
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->begin_fragment_count(counter);
+   }
+
+   assert(!m_fragment_count_active && !m_occlusion_query_active);
+   poll_fragment_counter(counter);
+
+   const int slot = int(m_frame_index % fragment_counter_t::latency);
+   if (counter.m_issued_frame[slot] >= 0) {
+      return false;
+   }
+
+   glBeginQuery(gl_fragment_count_target(), counter.m_ids[slot]);
+   opengl_check_errors();
+
+   counter.m_issued_frame[slot] = m_frame_index;
+   m_fragment_count_active = true;
+
+   return true;
+}
+
+void renderer_t::end_fragment_count()
+{
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->end_fragment_count();
+   }
+
+   if (m_fragment_count_active) {
+      glEndQuery(gl_fragment_count_target());
+      opengl_check_errors();
+
+      m_fragment_count_active = false;
+   }
+}
+
+bool renderer_t::fragment_invocations_supported() const
+{
+   return gl_extensions.pipeline_statistics;
+}
+
+const occlusion_stats_t &renderer_t::occlusion_stats() const
+{
+   return m_occlusion_stats;
+}
+
+void renderer_t::begin_gpu_marker(const char *name)
+{
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->begin_gpu_marker(name);
+   }
+
+   if (m_gpu_profiler.valid()) {
+      m_gpu_profiler.begin(name);
+   }
+}
+
+void renderer_t::end_gpu_marker()
+{
+   if (render_capture_t *capture = render_capture_t::active()) {
+      capture->end_gpu_marker();
+   }
+
+   if (m_gpu_profiler.valid()) {
+      m_gpu_profiler.end();
+   }
+}
+
+const gpu_profiler_t &renderer_t::gpu_profiler() const
+{
+   return m_gpu_profiler;
+}
@@ -0,0 +1,216 @@
+// headless.cpp
+
+#include "headless.hpp"
+#include "system.hpp"
+
+#include <glad/glad.h>
+
+#if defined(__linux__)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <cstring>
+#else
+#include <GLFW/glfw3.h>
+#endif
+
+#if defined(__linux__)
+static EGLDisplay
+egl_open_display()
+{
+   // note: prefer the mesa surfaceless platform, it needs neither a display server nor a gpu
+   const char *client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+   if (client_extensions && strstr(client_extensions, "EGL_MESA_platform_surfaceless")) {
+      auto get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+      if (get_platform_display) {
+         EGLDisplay display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+         if (display != EGL_NO_DISPLAY) {
+            return display;
+         }
+      }
+   }
+
+   return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+static bool
+create_render_context(headless_context_t &headless)
+{
+   EGLDisplay display = egl_open_display();
+   EGLint major = 0, minor = 0;
+   if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+      debug::error("could not initialize egl!");
+      return false;
+   }
+
+   headless.m_display = display;
+   if (!eglBindAPI(EGL_OPENGL_API)) {
+      debug::error("egl does not support desktop opengl!");
+      return false;
+   }
+
+   const char *display_extensions = eglQueryString(display, EGL_EXTENSIONS);
+   const bool surfaceless = display_extensions && strstr(display_extensions, "EGL_KHR_surfaceless_context");
+
+   const EGLint config_attributes[] =
+   {
+      EGL_SURFACE_TYPE, surfaceless ? EGL_DONT_CARE : EGL_PBUFFER_BIT,
+      EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+      EGL_RED_SIZE, 8,
+      EGL_GREEN_SIZE, 8,
+      EGL_BLUE_SIZE, 8,
+      EGL_NONE,
+   };
+
+   EGLConfig config = nullptr;
+   EGLint config_count = 0;
+   if (!eglChooseConfig(display, config_attributes, &config, 1, &config_count) || config_count == 0) {
+      debug::error("could not find a matching egl config!");
+      return false;
+   }
+
+   const EGLint context_attributes[] =
+   {
+      EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+      EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+      EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+      EGL_NONE,
+   };
+
+   EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attributes);
+   if (context == EGL_NO_CONTEXT) {
+      debug::error("could not create opengl v3.3 core context!");
+      return false;
+   }
+
+   headless.m_context = context;
+
+   // note: we never present, a pbuffer is only needed when surfaceless contexts are unsupported
+   EGLSurface surface = EGL_NO_SURFACE;
+   if (!surfaceless) {
+      const EGLint surface_attributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+      surface = eglCreatePbufferSurface(display, config, surface_attributes);
+      if (surface == EGL_NO_SURFACE) {
+         debug::error("could not create egl pbuffer surface!");
+         return false;
+      }
+
+      headless.m_surface = surface;
+   }
+
+   if (!eglMakeCurrent(display, surface, surface, context)) {
+      debug::error("could not make egl context current!");
+      return false;
+   }
+
+   debug::info("egl %d.%d - %s", major, minor, surfaceless ? "surfaceless" : "pbuffer");
+
+   if (gladLoadGLLoader((GLADloadproc)eglGetProcAddress) == 0) {
+      return false;
+   }
+
+   load_opengl_extensions((opengl_loader_t)eglGetProcAddress);
+   return true;
+}
+
+static void
+destroy_render_context(headless_context_t &headless)
+{
+   EGLDisplay display = headless.m_display;
+   if (display == nullptr) {
+      return;
+   }
+
+   eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+   if (headless.m_surface) {
+      eglDestroySurface(display, headless.m_surface);
+   }
+
+   if (headless.m_context) {
+      eglDestroyContext(display, headless.m_context);
+   }
+
+   eglTerminate(display);
+}
+#else
+static bool
+create_render_context(headless_context_t &headless)
+{
+   if (!glfwInit()) {
+      debug::error("could not initialize glfw!");
+      return false;
+   }
+
+   glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+   GLFWwindow *window = glfwCreateWindow(64, 64, "kiwi", nullptr, nullptr);
+   if (window == nullptr) {
+      debug::error("could not create hidden window!");
+      return false;
+   }
+
+   headless.m_window = window;
+
+   glfwMakeContextCurrent(window);
+   if (gladLoadGLLoader((GLADloadproc)glfwGetProcAddress) == 0) {
+      return false;
+   }
+
+   load_opengl_extensions((opengl_loader_t)glfwGetProcAddress);
+   return true;
+}
+
+static void
+destroy_render_context(headless_context_t &headless)
+{
+   if (headless.m_window) {
+      glfwDestroyWindow((GLFWwindow *)headless.m_window);
+   }
+
+   glfwTerminate();
+}
+#endif
+
+bool headless_context_t::valid() const
+{
+   return m_target.valid();
+}
+
+bool headless_context_t::create(const int width, const int height)
+{
+   if (!create_render_context(*this)) {
+      destroy();
+      return false;
+   }
+
+   debug::info("headless: %s - %s", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+
+   render_target_t::desc_t desc;
+   desc.m_width = width;
+   desc.m_height = height;
+   if (!m_target.create(desc)) {
+      destroy();
+      return false;
+   }
+
+   // note: the target stays bound, everything rendered from now on ends up in it
+   glBindFramebuffer(GL_FRAMEBUFFER, m_target.m_id);
+
+   return valid();
+}
+
+void headless_context_t::destroy()
+{
+   if (m_target.valid()) {
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+      m_target.destroy();
+   }
+
+   destroy_render_context(*this);
+
+   m_display = nullptr;
+   m_context = nullptr;
+   m_surface = nullptr;
+   m_window = nullptr;
+}
@@ -0,0 +1,423 @@
+// jobs.cpp
+
+#include "jobs.hpp"
+#include "system.hpp"
+#include "profiler.hpp"
+
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <cassert>
+#include <cstdio>
+#include <condition_variable>
+
+bool job_deque_t::push(job_t *job)
+{
+   const int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+   const int64_t top = m_top.load(std::memory_order_acquire);
+   if (bottom - top >= capacity) {
+      return false;
+   }
+
+   m_jobs[bottom & mask].store(job, std::memory_order_relaxed);
+   m_bottom.store(bottom + 1, std::memory_order_release);
+
+   return true;
+}
+
+job_t *job_deque_t::pop()
+{
+   // note: claim the bottom slot first, then check whether a thief got there too
+   const int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+   m_bottom.store(bottom, std::memory_order_seq_cst);
+   int64_t top = m_top.load(std::memory_order_seq_cst);
+   if (top > bottom) {
+      m_bottom.store(bottom + 1, std::memory_order_relaxed);
+      return nullptr;
+   }
+
+   job_t *job = m_jobs[bottom & mask].load(std::memory_order_relaxed);
+   if (top == bottom) {
+      // note: last job, race the thieves for it
+      if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+         job = nullptr;
+      }
+      m_bottom.store(bottom + 1, std::memory_order_relaxed);
+   }
+
+   return job;
+}
+
+job_t *job_deque_t::steal()
+{
+   int64_t top = m_top.load(std::memory_order_seq_cst);
+   const int64_t bottom = m_bottom.load(std::memory_order_seq_cst);
+   if (top >= bottom) {
+      return nullptr;
+   }
+
+   // note: losing the race means someone else took the job, not that there is none
+   job_t *job = m_jobs[top & mask].load(std::memory_order_relaxed);
+   if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+      return nullptr;
+   }
+
+   return job;
+}
+
+namespace
+{
+#pragma warning(push)
+#pragma warning(disable: 4324) // structure was padded due to alignment specifier
+   struct worker_t {
+      job_deque_t           m_deque;
+      std::thread           m_thread;
+      std::atomic<uint64_t> m_executed = 0;
+      std::atomic<uint64_t> m_stolen = 0;
+      std::atomic<uint64_t> m_busy_ticks = 0;
+   };
+#pragma warning(pop)
+
+   // note: jobs run() from threads that are not workers, e.g. the render
+   //       thread, they have no deque of their own, rarely used so a lock will do
+   struct injected_queue_t {
+      static constexpr uint32_t capacity = 1024;
+
+      std::mutex            m_mutex;
+      std::atomic<uint32_t> m_count = 0;
+      uint32_t              m_head = 0;
+      job_t                *m_jobs[capacity] = {};
+   };
+
+   struct job_state_t {
+      std::unique_ptr<worker_t[]> m_workers;
+      int                         m_worker_count = 0;
+      std::atomic<bool>           m_running = false;
+      std::atomic<uint32_t>       m_epoch = 0;
+      std::atomic<int>            m_sleeping = 0;
+      std::atomic<uint64_t>       m_window_start = 0;
+      std::mutex                  m_mutex;
+      std::condition_variable     m_condition;
+      injected_queue_t            m_injected;
+   };
+
+   job_state_t &state()
+   {
+      static job_state_t ms_state;
+      return ms_state;
+   }
+
+   // note: spins before a worker goes to sleep, waking one costs far more
+   constexpr int idle_spin_count = 64;
+
+   thread_local int      tls_worker = -1;
+   thread_local int      tls_depth = 0;
+   thread_local uint32_t tls_random = 0x9e3779b9u;
+
+   thread_local std::unique_ptr<job_t[]> tls_jobs;
+   thread_local uint32_t                 tls_next_job = 0;
+
+   uint32_t next_random()
+   {
+      // note: xorshift32, only used to spread thieves over victims
+      tls_random ^= tls_random << 13;
+      tls_random ^= tls_random >> 17;
+      tls_random ^= tls_random << 5;
+      return tls_random;
+   }
+
+   bool inject(job_t *job)
+   {
+      injected_queue_t &queue = state().m_injected;
+      std::lock_guard<std::mutex> lock(queue.m_mutex);
+      const uint32_t count = queue.m_count.load(std::memory_order_relaxed);
+      if (count == injected_queue_t::capacity) {
+         return false;
+      }
+
+      queue.m_jobs[(queue.m_head + count) % injected_queue_t::capacity] = job;
+      queue.m_count.store(count + 1, std::memory_order_release);
+      return true;
+   }
+
+   job_t *take_injected()
+   {
+      injected_queue_t &queue = state().m_injected;
+      if (queue.m_count.load(std::memory_order_acquire) == 0) {
+         return nullptr;
+      }
+
+      std::lock_guard<std::mutex> lock(queue.m_mutex);
+      const uint32_t count = queue.m_count.load(std::memory_order_relaxed);
+      if (count == 0) {
+         return nullptr;
+      }
+
+      job_t *job = queue.m_jobs[queue.m_head];
+      queue.m_head = (queue.m_head + 1) % injected_queue_t::capacity;
+      queue.m_count.store(count - 1, std::memory_order_release);
+      return job;
+   }
+
+   job_t *next_job()
+   {
+      auto &jobs = state();
+      if (tls_worker >= 0) {
+         if (job_t *job = jobs.m_workers[tls_worker].m_deque.pop()) {
+            return job;
+         }
+      }
+
+      if (job_t *job = take_injected()) {
+         return job;
+      }
+
+      const int count = jobs.m_worker_count;
+      if (count == 0) {
+         return nullptr;
+      }
+
+      const int first = int(next_random() % uint32_t(count));
+      for (int offset = 0; offset < count; offset++) {
+         const int victim = (first + offset) % count;
+         if (victim == tls_worker) {
+            continue;
+         }
+
+         if (job_t *job = jobs.m_workers[victim].m_deque.steal()) {
+            if (tls_worker >= 0) {
+               jobs.m_workers[tls_worker].m_stolen.fetch_add(1, std::memory_order_relaxed);
+            }
+            return job;
+         }
+      }
+
+      return nullptr;
+   }
+
+   void finish(job_t &job)
+   {
+      // note: the last child to finish completes its parent, and so on up the chain
+      job_t *current = &job;
+      while (current && current->m_unfinished.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+         current = current->m_parent;
+      }
+   }
+
+   void execute(job_t &job)
+   {
+      // note: jobs run from within wait() are already part of the outer job's busy time
+      const bool outermost = tls_depth++ == 0;
+      const uint64_t begin = outermost ? profiler::now() : 0;
+
+      job.m_function(job);
+      finish(job);
+
+      tls_depth--;
+      if (tls_worker >= 0) {
+         worker_t &worker = state().m_workers[tls_worker];
+         worker.m_executed.fetch_add(1, std::memory_order_relaxed);
+         if (outermost) {
+            worker.m_busy_ticks.fetch_add(profiler::now() - begin, std::memory_order_relaxed);
+         }
+      }
+   }
+
+   void worker_main(const int index)
+   {
+      char name[32];
+      snprintf(name, sizeof(name), "worker %d", index);
+      profiler::set_thread_name(name);
+
+      tls_worker = index;
+      tls_random += uint32_t(index) * 0x85ebca6bu;
+
+      auto &jobs = state();
+      int idle = 0;
+      while (jobs.m_running.load(std::memory_order_acquire)) {
+         const uint32_t epoch = jobs.m_epoch.load();
+         if (job_t *job = next_job()) {
+            execute(*job);
+            idle = 0;
+            continue;
+         }
+
+         if (++idle < idle_spin_count) {
+            std::this_thread::yield();
+            continue;
+         }
+
+         // note: run() bumps the epoch before it looks for sleepers, so either
+         //       we see the new epoch here or it sees us sleeping and wakes us
+         std::unique_lock<std::mutex> lock(jobs.m_mutex);
+         jobs.m_sleeping++;
+         jobs.m_condition.wait(lock, [&] { return !jobs.m_running.load() || jobs.m_epoch.load() != epoch; });
+         jobs.m_sleeping--;
+         idle = 0;
+      }
+
+      tls_worker = -1;
+   }
+} // !anonymous
+
+bool job_system_t::initialize(const int worker_count)
+{
+   auto &jobs = state();
+   if (jobs.m_running) {
+      debug::error("job system already initialized!");
+      return false;
+   }
+
+   int count = worker_count > 0 ? worker_count : int(std::thread::hardware_concurrency());
+   count = count < 1 ? 1 : count > max_workers ? max_workers : count;
+
+   jobs.m_workers = std::make_unique<worker_t[]>(count);
+   jobs.m_worker_count = count;
+   jobs.m_running = true;
+   jobs.m_window_start = profiler::now();
+
+   tls_worker = 0;
+   for (int index = 1; index < count; index++) {
+      jobs.m_workers[index].m_thread = std::thread(worker_main, index);
+   }
+
+   debug::info("job_system_t: %d worker(s)", count);
+
+   return true;
+}
+
+void job_system_t::shutdown()
+{
+   auto &jobs = state();
+   if (!jobs.m_running) {
+      return;
+   }
+
+   for (int index = 0; index < jobs.m_worker_count; index++) {
+      const job_worker_stats_t worker = stats(index);
+      debug::info("job_system_t: worker %d - executed: %llu stolen: %llu utilization: %2.1f%%",
+                  index,
+                  (unsigned long long)worker.m_executed,
+                  (unsigned long long)worker.m_stolen,
+                  worker.m_utilization * 100.0f);
+   }
+
+   {
+      std::lock_guard<std::mutex> lock(jobs.m_mutex);
+      jobs.m_running = false;
+   }
+   jobs.m_condition.notify_all();
+
+   for (int index = 1; index < jobs.m_worker_count; index++) {
+      jobs.m_workers[index].m_thread.join();
+   }
+
+   tls_worker = -1;
+   jobs.m_worker_count = 0;
+   jobs.m_workers.reset();
+}
+
+int job_system_t::worker_count()
+{
+   return state().m_worker_count;
+}
+
+void job_system_t::run(job_handle_t job)
+{
+   auto &jobs = state();
+   const bool queued = tls_worker >= 0 ? jobs.m_workers[tls_worker].m_deque.push(job)
+                                       : jobs.m_running.load(std::memory_order_acquire) && inject(job);
+   if (!queued) {
+      execute(*job);
+      return;
+   }
+
+   jobs.m_epoch.fetch_add(1);
+   if (jobs.m_sleeping.load() > 0) {
+      std::lock_guard<std::mutex> lock(jobs.m_mutex);
+      jobs.m_condition.notify_one();
+   }
+}
+
+bool job_system_t::finished(const job_handle_t job)
+{
+   return job->m_unfinished.load(std::memory_order_acquire) == 0;
+}
+
+void job_system_t::wait(job_handle_t job)
+{
+   while (!finished(job)) {
+      if (job_t *next = next_job()) {
+         execute(*next);
+      }
+      else {
+         std::this_thread::yield();
+      }
+   }
+}
+
+job_worker_stats_t job_system_t::stats(const int worker)
+{
+   job_worker_stats_t result;
+
+   auto &jobs = state();
+   if (worker < 0 || worker >= jobs.m_worker_count) {
+      return result;
+   }
+
+   const worker_t &source = jobs.m_workers[worker];
+   const uint64_t elapsed = profiler::now() - jobs.m_window_start.load();
+   result.m_executed = source.m_executed.load(std::memory_order_relaxed);
+   result.m_stolen = source.m_stolen.load(std::memory_order_relaxed);
+   result.m_utilization = elapsed > 0 ? float(double(source.m_busy_ticks.load(std::memory_order_relaxed)) / double(elapsed)) : 0.0f;
+
+   return result;
+}
+
+void job_system_t::reset_stats()
+{
+   auto &jobs = state();
+   for (int index = 0; index < jobs.m_worker_count; index++) {
+      jobs.m_workers[index].m_executed = 0;
+      jobs.m_workers[index].m_stolen = 0;
+      jobs.m_workers[index].m_busy_ticks = 0;
+   }
+
+   jobs.m_window_start = profiler::now();
+}
+
+job_t *job_system_t::allocate(job_handle_t parent)
+{
+   // note: per-thread ring, a slot is reused once the thread has created
+   //       'max_jobs_per_thread' more jobs, by then it has long finished
+   if (!tls_jobs) {
+      tls_jobs = std::make_unique<job_t[]>(max_jobs_per_thread);
+   }
+
+   job_t *job = &tls_jobs[tls_next_job++ & (max_jobs_per_thread - 1)];
+   assert(job->m_unfinished.load(std::memory_order_relaxed) == 0 && "job ring wrapped onto an unfinished job");
+
+   job->m_parent = parent;
+   job->m_unfinished.store(1, std::memory_order_relaxed);
+   if (parent) {
+      parent->m_unfinished.fetch_add(1, std::memory_order_relaxed);
+   }
+
+   return job;
+}
+
+uint32_t job_system_t::batch_count(const uint32_t count, const uint32_t batch_size)
+{
+   // note: a few batches per worker so stealing can even out uneven batches,
+   //       other threads split too, their batches go to the shared queue
+   const int workers = state().m_worker_count;
+   if (workers <= 1) {
+      return 1;
+   }
+
+   const uint32_t size = batch_size > 0 ? batch_size : 1;
+   const uint32_t batches = (count + size - 1) / size;
+   const uint32_t max_batches = uint32_t(workers) * 4;
+
+   return batches < max_batches ? batches : max_batches;
+}
@@ -0,0 +1,316 @@
+// lighting.cpp
+
+#include "lighting.hpp"
+#include "system.hpp"
+#include "profiler.hpp"
+#include "memory.hpp"
+#include "jobs.hpp"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define KIWI_LIGHTING_SSE 1
+#include <emmintrin.h>
+#else
+#define KIWI_LIGHTING_SSE 0
+#endif
+
+static_assert(sizeof(point_light_t) == sizeof(float) * 8, "point_light_t is uploaded as two vec4s!");
+static_assert(light_clusters_t::max_lights <= 65536, "light indices are 16 bit!");
+
+namespace
+{
+   // note: view space light spheres as structure of arrays, padded to a multiple
+   //       of four with lights that never overlap a slice
+   struct light_spheres_t {
+      float   *m_x;
+      float   *m_y;
+      float   *m_depth;
+      float   *m_radius;
+      uint32_t m_count;
+      uint32_t m_padded_count;
+   };
+
+   struct tile_bounds_t {
+      int32_t m_x0[4];
+      int32_t m_x1[4];
+      int32_t m_y0[4];
+      int32_t m_y1[4];
+   };
+
+   struct bin_state_t {
+      light_spheres_t m_spheres;
+      const float    *m_boundaries;
+      float           m_scale_x;
+      float           m_scale_y;
+      uint32_t       *m_counts;
+      uint16_t       *m_slots;
+      uint32_t       *m_overflowed;
+   };
+
+   void
+   append(const bin_state_t &state, const uint32_t slice, const uint16_t light, const tile_bounds_t &bounds, const int lane)
+   {
+      const uint32_t base = slice * light_clusters_t::tiles_x * light_clusters_t::tiles_y;
+      for (int32_t y = bounds.m_y0[lane]; y <= bounds.m_y1[lane]; y++) {
+         for (int32_t x = bounds.m_x0[lane]; x <= bounds.m_x1[lane]; x++) {
+            const uint32_t cluster = base + uint32_t(y) * light_clusters_t::tiles_x + uint32_t(x);
+            uint32_t &count = state.m_counts[cluster];
+            if (count < light_clusters_t::max_lights_per_cluster) {
+               state.m_slots[cluster * light_clusters_t::max_lights_per_cluster + count] = light;
+               count++;
+            }
+            else {
+               state.m_overflowed[slice]++;
+            }
+         }
+      }
+   }
+
+#if KIWI_LIGHTING_SSE
+   // note: the part of the sphere inside the slice lies within a view space box,
+   //       its corners bound the projection since x/z is monotonic on the box
+   void
+   bin_slice(const bin_state_t &state, const uint32_t slice)
+   {
+      const light_spheres_t &spheres = state.m_spheres;
+      const __m128 near_depth = _mm_set1_ps(state.m_boundaries[slice]);
+      const __m128 far_depth = _mm_set1_ps(state.m_boundaries[slice + 1]);
+      const __m128 scale_x = _mm_set1_ps(state.m_scale_x * 0.5f * float(light_clusters_t::tiles_x));
+      const __m128 scale_y = _mm_set1_ps(state.m_scale_y * 0.5f * float(light_clusters_t::tiles_y));
+      const __m128 center_x = _mm_set1_ps(0.5f * float(light_clusters_t::tiles_x));
+      const __m128 center_y = _mm_set1_ps(0.5f * float(light_clusters_t::tiles_y));
+      const __m128 last_x = _mm_set1_ps(float(light_clusters_t::tiles_x - 1));
+      const __m128 last_y = _mm_set1_ps(float(light_clusters_t::tiles_y - 1));
+      const __m128 zero = _mm_setzero_ps();
+
+      for (uint32_t first = 0; first < spheres.m_padded_count; first += 4) {
+         const __m128 depth = _mm_loadu_ps(spheres.m_depth + first);
+         const __m128 radius = _mm_loadu_ps(spheres.m_radius + first);
+         const __m128 front = _mm_sub_ps(depth, radius);
+         const __m128 back = _mm_add_ps(depth, radius);
+         const int overlap = _mm_movemask_ps(_mm_and_ps(_mm_cmplt_ps(front, far_depth), _mm_cmpgt_ps(back, near_depth)));
+         if (overlap == 0) {
+            continue;
+         }
+
+         const __m128 inv_zmin = _mm_div_ps(_mm_set1_ps(1.0f), _mm_max_ps(front, near_depth));
+         const __m128 inv_zmax = _mm_div_ps(_mm_set1_ps(1.0f), _mm_min_ps(back, far_depth));
+         const __m128 x = _mm_loadu_ps(spheres.m_x + first);
+         const __m128 y = _mm_loadu_ps(spheres.m_y + first);
+         const __m128 left = _mm_sub_ps(x, radius);
+         const __m128 right = _mm_add_ps(x, radius);
+         const __m128 bottom = _mm_sub_ps(y, radius);
+         const __m128 top = _mm_add_ps(y, radius);
+
+         // note: ndc scaled straight into tile units, then clamped to the grid
+         __m128 x0 = _mm_min_ps(_mm_mul_ps(left, inv_zmin), _mm_mul_ps(left, inv_zmax));
+         __m128 x1 = _mm_max_ps(_mm_mul_ps(right, inv_zmin), _mm_mul_ps(right, inv_zmax));
+         __m128 y0 = _mm_min_ps(_mm_mul_ps(bottom, inv_zmin), _mm_mul_ps(bottom, inv_zmax));
+         __m128 y1 = _mm_max_ps(_mm_mul_ps(top, inv_zmin), _mm_mul_ps(top, inv_zmax));
+         x0 = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(x0, scale_x), center_x), zero), last_x);
+         x1 = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(x1, scale_x), center_x), zero), last_x);
+         y0 = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(y0, scale_y), center_y), zero), last_y);
+         y1 = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(y1, scale_y), center_y), zero), last_y);
+
+         tile_bounds_t bounds;
+         _mm_storeu_si128(reinterpret_cast<__m128i *>(bounds.m_x0), _mm_cvttps_epi32(x0));
+         _mm_storeu_si128(reinterpret_cast<__m128i *>(bounds.m_x1), _mm_cvttps_epi32(x1));
+         _mm_storeu_si128(reinterpret_cast<__m128i *>(bounds.m_y0), _mm_cvttps_epi32(y0));
+         _mm_storeu_si128(reinterpret_cast<__m128i *>(bounds.m_y1), _mm_cvttps_epi32(y1));
+
+         for (int lane = 0; lane < 4; lane++) {
+            if (overlap & (1 << lane)) {
+               append(state, slice, uint16_t(first + lane), bounds, lane);
+            }
+         }
+      }
+   }
+#else
+   void
+   bin_slice(const bin_state_t &state, const uint32_t slice)
+   {
+      const light_spheres_t &spheres = state.m_spheres;
+      const float near_depth = state.m_boundaries[slice];
+      const float far_depth = state.m_boundaries[slice + 1];
+      const float scale_x = state.m_scale_x * 0.5f * light_clusters_t::tiles_x;
+      const float scale_y = state.m_scale_y * 0.5f * light_clusters_t::tiles_y;
+
+      auto to_tile = [](const float value, const float scale, const uint32_t tiles) {
+         const float tile = value * scale + 0.5f * float(tiles);
+         return int32_t(tile < 0.0f ? 0.0f : tile > float(tiles - 1) ? float(tiles - 1) : tile);
+      };
+
+      for (uint32_t light = 0; light < spheres.m_count; light++) {
+         const float front = spheres.m_depth[light] - spheres.m_radius[light];
+         const float back = spheres.m_depth[light] + spheres.m_radius[light];
+         if (!(front < far_depth && back > near_depth)) {
+            continue;
+         }
+
+         const float inv_zmin = 1.0f / (front > near_depth ? front : near_depth);
+         const float inv_zmax = 1.0f / (back < far_depth ? back : far_depth);
+         const float left = spheres.m_x[light] - spheres.m_radius[light];
+         const float right = spheres.m_x[light] + spheres.m_radius[light];
+         const float bottom = spheres.m_y[light] - spheres.m_radius[light];
+         const float top = spheres.m_y[light] + spheres.m_radius[light];
+
+         tile_bounds_t bounds;
+         bounds.m_x0[0] = to_tile(std::fmin(left * inv_zmin, left * inv_zmax), scale_x, light_clusters_t::tiles_x);
+         bounds.m_x1[0] = to_tile(std::fmax(right * inv_zmin, right * inv_zmax), scale_x, light_clusters_t::tiles_x);
+         bounds.m_y0[0] = to_tile(std::fmin(bottom * inv_zmin, bottom * inv_zmax), scale_y, light_clusters_t::tiles_y);
+         bounds.m_y1[0] = to_tile(std::fmax(top * inv_zmin, top * inv_zmax), scale_y, light_clusters_t::tiles_y);
+         append(state, slice, uint16_t(light), bounds, 0);
+      }
+   }
+#endif
+} // !anonymous
+
+bool light_clusters_t::create()
+{
+   bool success = true;
+   success &= m_light_buffer.create(sizeof(point_light_t) * max_lights, texture_buffer_t::format_t::rgba32f);
+   success &= m_grid_buffer.create(sizeof(uint32_t) * 2 * cluster_count, texture_buffer_t::format_t::rg32ui);
+   success &= m_index_buffer.create(sizeof(uint16_t) * max_lights_per_cluster * cluster_count, texture_buffer_t::format_t::r16ui);
+   if (!success) {
+      destroy();
+      return false;
+   }
+
+   return true;
+}
+
+void light_clusters_t::destroy()
+{
+   m_light_buffer.destroy();
+   m_grid_buffer.destroy();
+   m_index_buffer.destroy();
+
+   m_lights = nullptr;
+   m_grid = nullptr;
+   m_indices = nullptr;
+   m_stats = {};
+}
+
+void light_clusters_t::bin(const point_light_t *lights,
+                           const uint32_t count,
+                           const glm::mat4 &view,
+                           const glm::mat4 &projection,
+                           const viewport_t &viewport,
+                           linear_arena_t &arena)
+{
+   profile_scope("light_clusters_t::bin");
+
+   const uint32_t light_count = count < max_lights ? count : max_lights;
+
+   // note: perspective projection, near and far are recovered from the depth terms
+   m_znear = projection[3][2] / (projection[2][2] - 1.0f);
+   m_zfar = projection[3][2] / (projection[2][2] + 1.0f);
+   m_viewport = viewport;
+   m_lights = lights;
+
+   bin_state_t state;
+   state.m_scale_x = projection[0][0];
+   state.m_scale_y = projection[1][1];
+
+   light_spheres_t &spheres = state.m_spheres;
+   spheres.m_count = light_count;
+   spheres.m_padded_count = (light_count + 3) & ~3u;
+   spheres.m_x = arena.allocate_array<float>(spheres.m_padded_count);
+   spheres.m_y = arena.allocate_array<float>(spheres.m_padded_count);
+   spheres.m_depth = arena.allocate_array<float>(spheres.m_padded_count);
+   spheres.m_radius = arena.allocate_array<float>(spheres.m_padded_count);
+   for (uint32_t index = 0; index < light_count; index++) {
+      const glm::vec4 position = view * glm::vec4(lights[index].m_position, 1.0f);
+      spheres.m_x[index] = position.x;
+      spheres.m_y[index] = position.y;
+      spheres.m_depth[index] = -position.z;
+      spheres.m_radius[index] = lights[index].m_radius;
+   }
+   for (uint32_t index = light_count; index < spheres.m_padded_count; index++) {
+      spheres.m_x[index] = 0.0f;
+      spheres.m_y[index] = 0.0f;
+      spheres.m_depth[index] = -1.0f;
+      spheres.m_radius[index] = 0.0f;
+   }
+
+   // note: exponential slices, thin near the camera where clusters are small on screen
+   float *boundaries = arena.allocate_array<float>(slices + 1);
+   for (uint32_t slice = 0; slice <= slices; slice++) {
+      boundaries[slice] = m_znear * std::pow(m_zfar / m_znear, float(slice) / float(slices));
+   }
+   state.m_boundaries = boundaries;
+
+   state.m_counts = arena.allocate_array<uint32_t>(cluster_count);
+   state.m_slots = arena.allocate_array<uint16_t>(size_t(cluster_count) * max_lights_per_cluster);
+   state.m_overflowed = arena.allocate_array<uint32_t>(slices);
+   memset(state.m_counts, 0, sizeof(uint32_t) * cluster_count);
+   memset(state.m_overflowed, 0, sizeof(uint32_t) * slices);
+
+   // note: every slice owns its clusters, jobs never write to the same memory
+   job_system_t::parallel_for(slices, 1, [&state](const uint32_t begin, const uint32_t end) {
+      for (uint32_t slice = begin; slice < end; slice++) {
+         bin_slice(state, slice);
+      }
+   });
+
+   // note: compact the fixed size cluster lists into one index table
+   uint32_t total = 0;
+   uint32_t max_per_cluster = 0;
+   for (uint32_t cluster = 0; cluster < cluster_count; cluster++) {
+      total += state.m_counts[cluster];
+      max_per_cluster = state.m_counts[cluster] > max_per_cluster ? state.m_counts[cluster] : max_per_cluster;
+   }
+
+   uint32_t *grid = arena.allocate_array<uint32_t>(size_t(cluster_count) * 2);
+   uint16_t *indices = arena.allocate_array<uint16_t>(total > 0 ? total : 1);
+   uint32_t offset = 0;
+   for (uint32_t cluster = 0; cluster < cluster_count; cluster++) {
+      const uint32_t cluster_lights = state.m_counts[cluster];
+      grid[cluster * 2 + 0] = offset;
+      grid[cluster * 2 + 1] = cluster_lights;
+      memcpy(indices + offset, state.m_slots + size_t(cluster) * max_lights_per_cluster, sizeof(uint16_t) * cluster_lights);
+      offset += cluster_lights;
+   }
+
+   m_grid = grid;
+   m_indices = indices;
+
+   m_stats.m_lights = light_count;
+   m_stats.m_indices = total;
+   m_stats.m_max_per_cluster = max_per_cluster;
+   m_stats.m_overflowed = 0;
+   for (uint32_t slice = 0; slice < slices; slice++) {
+      m_stats.m_overflowed += state.m_overflowed[slice];
+   }
+}
+
+void light_clusters_t::upload()
+{
+   profile_scope("light_clusters_t::upload");
+
+   m_light_buffer.update(m_lights, sizeof(point_light_t) * (m_stats.m_lights > 0 ? m_stats.m_lights : 1));
+   m_grid_buffer.update(m_grid, sizeof(uint32_t) * 2 * cluster_count);
+   m_index_buffer.update(m_indices, sizeof(uint16_t) * (m_stats.m_indices > 0 ? m_stats.m_indices : 1));
+}
+
+void light_clusters_t::bind(renderer_t &renderer, const int first_unit)
+{
+   renderer.set_texture_buffer(m_light_buffer, first_unit + 0);
+   renderer.set_texture_buffer(m_grid_buffer, first_unit + 1);
+   renderer.set_texture_buffer(m_index_buffer, first_unit + 2);
+   renderer.set_uniform("u_lights", first_unit + 0);
+   renderer.set_uniform("u_light_grid", first_unit + 1);
+   renderer.set_uniform("u_light_indices", first_unit + 2);
+
+   // note: slice = log(depth) * scale + bias, matches the boundaries used in bin()
+   const float depth_scale = float(slices) / std::log(m_zfar / m_znear);
+   const float depth_bias = -depth_scale * std::log(m_znear);
+   renderer.set_uniform("u_cluster_tile", glm::vec4(float(m_viewport.width) / float(tiles_x),
+                                                    float(m_viewport.height) / float(tiles_y),
+                                                    float(m_viewport.x),
+                                                    float(m_viewport.y)));
+   renderer.set_uniform("u_cluster_count", glm::vec4(float(tiles_x), float(tiles_y), float(slices), 0.0f));
+   renderer.set_uniform("u_cluster_depth", glm::vec4(depth_scale, depth_bias, 0.0f, 0.0f));
+}
@@ -0,0 +1,823 @@
+// log.cpp
+
+#include "system.hpp"
+#include "profiler.hpp"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+
+namespace
+{
+   using debug::log_level_t;
+   using debug::log_argument_t;
+
+   // note: a printf call captured as format pointer plus typed arguments,
+   //       string arguments are copied into the record itself
+   struct log_record_t {
+      static constexpr int    max_arguments = 16;
+      static constexpr size_t max_string_bytes = 320;
+
+      const char     *m_format;
+      int64           m_time;
+      log_level_t     m_level;
+      uint8_t         m_count;
+      uint16_t        m_string_bytes;
+      log_argument_t  m_arguments[max_arguments];
+      char            m_strings[max_string_bytes];
+   };
+
+   struct log_slot_t {
+      std::atomic<uint32_t> m_sequence;
+      log_record_t          m_record;
+   };
+
+   // note: repeats of the same call site beyond this many per second are
+   //       counted instead of written
+   constexpr int      rate_limit_entries = 64;
+   constexpr uint32_t rate_limit_per_second = 32;
+
+   struct rate_limit_entry_t {
+      const char *m_format = nullptr;
+      log_level_t m_level = log_level_t::info;
+      int64       m_window_start = 0;
+      uint32_t    m_count = 0;
+      uint32_t    m_suppressed = 0;
+   };
+
+   // note: --log-binary layout, native endianness:
+   //         header - magic, version
+   //         format - tag, id, length, characters, once per call site
+   //         record - tag, time in microseconds, level, format id, argument
+   //                  count, per argument type, length and raw value, then
+   //                  the copied string bytes the string offsets point into
+   //       call sites are told apart by their format pointer, a full table
+   //       writes the format inline with 'inline_format' as the id instead
+   constexpr uint32_t binary_log_magic = 0x676c776b; // 'kwlg'
+   constexpr uint32_t binary_log_version = 1;
+   constexpr uint32_t binary_formats = 4096;
+   constexpr uint32_t inline_format = ~0u;
+
+   enum class binary_tag_t : uint8_t {
+      format = 1,
+      record = 2,
+   };
+
+   struct binary_format_t {
+      const char *m_format = nullptr;
+      uint32_t    m_id = 0;
+   };
+
+#pragma warning(push)
+#pragma warning(disable: 4324) // structure was padded due to alignment specifier
+   // note: bounded multi-producer single-consumer ring, same scheme as event_queue_t
+   struct log_state_t {
+      static constexpr uint32_t capacity = 1024;
+      static constexpr uint32_t mask = capacity - 1;
+
+      log_state_t()
+      {
+         for (uint32_t index = 0; index < capacity; index++) {
+            m_slots[index].m_sequence.store(index, std::memory_order_relaxed);
+         }
+      }
+
+      alignas(64) std::atomic<uint32_t> m_head = 0;
+      alignas(64) uint32_t              m_tail = 0;
+      std::atomic<uint32_t>             m_written = 0;
+      std::atomic<uint64_t>             m_dropped = 0;
+      uint64_t                          m_reported_dropped = 0;
+      std::atomic<bool>                 m_running = false;
+      std::thread                       m_thread;
+      std::mutex                        m_mutex;
+      FILE                             *m_file = nullptr;
+      FILE                             *m_binary = nullptr;
+      uint32_t                          m_binary_format_count = 0;
+      binary_format_t                   m_binary_formats[binary_formats];
+      rate_limit_entry_t                m_rate_limits[rate_limit_entries];
+      log_slot_t                        m_slots[capacity];
+   };
+#pragma warning(pop)
+
+   const char *level_prefix(const log_level_t level)
+   {
+      switch (level) {
+         case log_level_t::info:  return "NFO: ";
+         case log_level_t::warn:  return "WRN: ";
+         case log_level_t::error: return "ERR: ";
+      }
+
+      return "";
+   }
+
+   void capture(log_record_t &record,
+                const log_level_t level,
+                const char *format,
+                const log_argument_t *arguments,
+                const int count)
+   {
+      record.m_format = format;
+      record.m_time = watch_t::time_since_start().m_duration;
+      record.m_level = level;
+      record.m_count = uint8_t(count < log_record_t::max_arguments ? count : log_record_t::max_arguments);
+      record.m_string_bytes = 0;
+
+      for (int index = 0; index < record.m_count; index++) {
+         log_argument_t &argument = record.m_arguments[index];
+         argument = arguments[index];
+         if (argument.m_type != log_argument_t::type_t::string) {
+            continue;
+         }
+
+         // note: strings become offsets into the record, truncated when it is full
+         const char *text = argument.m_value.m_string ? argument.m_value.m_string : "(null)";
+         const size_t length = argument.m_value.m_string ? argument.m_length : 6;
+         const size_t available = log_record_t::max_string_bytes - record.m_string_bytes;
+         const size_t copied = length < available ? length : available;
+         memcpy(record.m_strings + record.m_string_bytes, text, copied);
+
+         argument.m_value.m_unsigned = record.m_string_bytes;
+         argument.m_length = uint32_t(copied);
+         record.m_string_bytes = uint16_t(record.m_string_bytes + copied);
+      }
+   }
+
+   struct output_t {
+      void append(const char *text, const size_t length)
+      {
+         const size_t available = sizeof(m_buffer) - 1 - m_length;
+         const size_t copied = length < available ? length : available;
+         memcpy(m_buffer + m_length, text, copied);
+         m_length += copied;
+         m_buffer[m_length] = '\0';
+      }
+
+      template <typename T>
+      void append_formatted(const char *spec, const T value)
+      {
+         const size_t available = sizeof(m_buffer) - m_length;
+         const int written = snprintf(m_buffer + m_length, available, spec, value);
+         if (written > 0) {
+            m_length += size_t(written) < available ? size_t(written) : available - 1;
+         }
+      }
+
+      char   m_buffer[2048] = {};
+      size_t m_length = 0;
+   };
+
+   int64 as_signed(const log_argument_t &argument)
+   {
+      switch (argument.m_type) {
+         case log_argument_t::type_t::unsigned_: return int64(argument.m_value.m_unsigned);
+         case log_argument_t::type_t::floating:  return int64(argument.m_value.m_floating);
+         case log_argument_t::type_t::signed_:   return argument.m_value.m_signed;
+         default:                                return 0;
+      }
+   }
+
+   double as_floating(const log_argument_t &argument)
+   {
+      switch (argument.m_type) {
+         case log_argument_t::type_t::unsigned_: return double(argument.m_value.m_unsigned);
+         case log_argument_t::type_t::signed_:   return double(argument.m_value.m_signed);
+         case log_argument_t::type_t::floating:  return argument.m_value.m_floating;
+         default:                                return 0.0;
+      }
+   }
+
+   // note: walks the printf format and formats one conversion at a time with the
+   //       captured argument, length modifiers are replaced to match the capture
+   void format_record(const log_record_t &record, output_t &output)
+   {
+      int next = 0;
+      auto next_argument = [&]() -> const log_argument_t * {
+         return next < record.m_count ? &record.m_arguments[next++] : nullptr;
+      };
+
+      const char *at = record.m_format;
+      while (*at) {
+         const char *literal = at;
+         while (*at && *at != '%') {
+            at++;
+         }
+         output.append(literal, size_t(at - literal));
+         if (*at == '\0') {
+            break;
+         }
+
+         if (at[1] == '%') {
+            output.append("%", 1);
+            at += 2;
+            continue;
+         }
+
+         // note: %[flags][width][.precision][length]conversion
+         char spec[32] = "%";
+         size_t spec_length = 1;
+         auto push = [&](const char c) {
+            if (spec_length + 1 < sizeof(spec)) {
+               spec[spec_length++] = c;
+               spec[spec_length] = '\0';
+            }
+         };
+         auto push_number = [&](const int64 value) {
+            char digits[24];
+            snprintf(digits, sizeof(digits), "%lld", value);
+            for (const char *digit = digits; *digit; digit++) {
+               push(*digit);
+            }
+         };
+
+         at++;
+         while (*at == '-' || *at == '+' || *at == ' ' || *at == '#' || *at == '0') {
+            push(*at++);
+         }
+
+         if (*at == '*') {
+            const log_argument_t *width = next_argument();
+            push_number(width ? as_signed(*width) : 0);
+            at++;
+         }
+         while (*at >= '0' && *at <= '9') {
+            push(*at++);
+         }
+
+         int64 precision = -1;
+         if (*at == '.') {
+            at++;
+            precision = 0;
+            if (*at == '*') {
+               const log_argument_t *value = next_argument();
+               precision = value ? as_signed(*value) : 0;
+               at++;
+            }
+            while (*at >= '0' && *at <= '9') {
+               precision = precision * 10 + (*at++ - '0');
+            }
+         }
+
+         while (*at == 'h' || *at == 'l' || *at == 'L' || *at == 'z' || *at == 'j' || *at == 't' || *at == 'q') {
+            at++;
+         }
+
+         const char conversion = *at;
+         if (conversion == '\0') {
+            break;
+         }
+         at++;
+
+         const log_argument_t *argument = next_argument();
+         if (argument == nullptr) {
+            output.append("<missing>", 9);
+            continue;
+         }
+
+         if (conversion != 's' && precision >= 0) {
+            push('.');
+            push_number(precision);
+         }
+
+         switch (conversion) {
+            case 'd':
+            case 'i':
+               push('l'); push('l'); push(conversion);
+               output.append_formatted(spec, (long long)as_signed(*argument));
+               break;
+
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+               push('l'); push('l'); push(conversion);
+               output.append_formatted(spec, (unsigned long long)as_signed(*argument));
+               break;
+
+            case 'c':
+               push('c');
+               output.append_formatted(spec, int(as_signed(*argument)));
+               break;
+
+            case 'f': case 'F':
+            case 'e': case 'E':
+            case 'g': case 'G':
+            case 'a': case 'A':
+               push(conversion);
+               output.append_formatted(spec, as_floating(*argument));
+               break;
+
+            case 'p':
+               push('p');
+               output.append_formatted(spec, argument->m_type == log_argument_t::type_t::pointer ? argument->m_value.m_pointer : nullptr);
+               break;
+
+            case 's':
+            default:
+               if (argument->m_type == log_argument_t::type_t::string) {
+                  // note: captured strings are not terminated, always bound them
+                  const int64 length = precision >= 0 && precision < argument->m_length ? precision : argument->m_length;
+                  push('.'); push('*'); push('s');
+                  const size_t available = sizeof(output.m_buffer) - output.m_length;
+                  const int written = snprintf(output.m_buffer + output.m_length,
+                                               available,
+                                               spec,
+                                               int(length),
+                                               record.m_strings + argument->m_value.m_unsigned);
+                  if (written > 0) {
+                     output.m_length += size_t(written) < available ? size_t(written) : available - 1;
+                  }
+               }
+               else {
+                  output.append("<?>", 3);
+               }
+               break;
+         }
+      }
+   }
+
+   void write_line(log_state_t &state, const log_level_t level, const char *text, const size_t length)
+   {
+      const char *prefix = level_prefix(level);
+      fputs(prefix, stdout);
+      fwrite(text, 1, length, stdout);
+      fputc('\n', stdout);
+
+      if (state.m_file) {
+         fputs(prefix, state.m_file);
+         fwrite(text, 1, length, state.m_file);
+         fputc('\n', state.m_file);
+      }
+   }
+
+   void report_suppressed(log_state_t &state, rate_limit_entry_t &entry)
+   {
+      if (entry.m_suppressed == 0) {
+         return;
+      }
+
+      output_t output;
+      output.append_formatted("previous message repeated %u more time(s): ", entry.m_suppressed);
+      output.append(entry.m_format, strlen(entry.m_format));
+      write_line(state, entry.m_level, output.m_buffer, output.m_length);
+
+      entry.m_suppressed = 0;
+   }
+
+   bool rate_limit_allows(log_state_t &state, const log_record_t &record)
+   {
+      const int64 now = watch_t::time_since_start().m_duration;
+      const size_t index = (uintptr_t(record.m_format) >> 3) % rate_limit_entries;
+
+      rate_limit_entry_t &entry = state.m_rate_limits[index];
+      if (entry.m_format != record.m_format) {
+         if (entry.m_format) {
+            report_suppressed(state, entry);
+         }
+
+         entry.m_format = record.m_format;
+         entry.m_level = record.m_level;
+         entry.m_window_start = now;
+         entry.m_count = 0;
+      }
+
+      if (now - entry.m_window_start >= 1000000) {
+         report_suppressed(state, entry);
+         entry.m_window_start = now;
+         entry.m_count = 0;
+      }
+
+      if (++entry.m_count > rate_limit_per_second) {
+         entry.m_suppressed++;
+         return false;
+      }
+
+      return true;
+   }
+
+   template <typename T>
+   void write_binary(FILE *file, const T &value)
+   {
+      fwrite(&value, sizeof(T), 1, file);
+   }
+
+   void write_binary_format(FILE *file, const uint32_t id, const char *format)
+   {
+      const uint32_t length = uint32_t(strlen(format));
+      write_binary(file, binary_tag_t::format);
+      write_binary(file, id);
+      write_binary(file, length);
+      fwrite(format, 1, length, file);
+   }
+
+   // note: open addressing on the format pointer, nothing allocates here
+   uint32_t binary_format_id(log_state_t &state, const char *format)
+   {
+      uint32_t index = uint32_t((uintptr_t(format) >> 3) % binary_formats);
+      for (uint32_t probe = 0; probe < binary_formats; probe++) {
+         binary_format_t &entry = state.m_binary_formats[index];
+         if (entry.m_format == format) {
+            return entry.m_id;
+         }
+
+         if (entry.m_format == nullptr) {
+            if (state.m_binary_format_count + 1 >= binary_formats) {
+               break;
+            }
+
+            entry.m_format = format;
+            entry.m_id = state.m_binary_format_count++;
+            write_binary_format(state.m_binary, entry.m_id, format);
+            return entry.m_id;
+         }
+
+         index = (index + 1) % binary_formats;
+      }
+
+      write_binary_format(state.m_binary, inline_format, format);
+      return inline_format;
+   }
+
+   // note: every record, before rate limiting, the binary log stays complete
+   void write_binary_record(log_state_t &state, const log_record_t &record)
+   {
+      FILE *file = state.m_binary;
+      const uint32_t format = binary_format_id(state, record.m_format);
+
+      write_binary(file, binary_tag_t::record);
+      write_binary(file, record.m_time);
+      write_binary(file, record.m_level);
+      write_binary(file, format);
+      write_binary(file, record.m_count);
+      for (int index = 0; index < record.m_count; index++) {
+         const log_argument_t &argument = record.m_arguments[index];
+         write_binary(file, argument.m_type);
+         write_binary(file, argument.m_length);
+         write_binary(file, argument.m_value);
+      }
+      write_binary(file, record.m_string_bytes);
+      fwrite(record.m_strings, 1, record.m_string_bytes, file);
+   }
+
+   // note: callers hold the state mutex
+   void write_record(log_state_t &state, const log_record_t &record)
+   {
+      if (state.m_binary) {
+         write_binary_record(state, record);
+      }
+
+      if (!rate_limit_allows(state, record)) {
+         return;
+      }
+
+      output_t output;
+      format_record(record, output);
+      write_line(state, record.m_level, output.m_buffer, output.m_length);
+   }
+
+   void report_dropped(log_state_t &state)
+   {
+      const uint64_t dropped = state.m_dropped.load(std::memory_order_relaxed);
+      if (dropped != state.m_reported_dropped) {
+         output_t output;
+         output.append_formatted("log: %llu message(s) dropped, ring was full", (unsigned long long)(dropped - state.m_reported_dropped));
+         write_line(state, log_level_t::warn, output.m_buffer, output.m_length);
+         state.m_reported_dropped = dropped;
+      }
+   }
+
+   uint32_t drain(log_state_t &state)
+   {
+      const uint32_t end = state.m_head.load(std::memory_order_acquire);
+
+      std::lock_guard<std::mutex> lock(state.m_mutex);
+      uint32_t count = 0;
+      while (state.m_tail != end) {
+         log_slot_t &slot = state.m_slots[state.m_tail & log_state_t::mask];
+         if (slot.m_sequence.load(std::memory_order_acquire) != state.m_tail + 1) {
+            break; // note: claimed but not yet written, pick it up next time
+         }
+
+         write_record(state, slot.m_record);
+         slot.m_sequence.store(state.m_tail + log_state_t::capacity, std::memory_order_release);
+         state.m_tail++;
+         count++;
+      }
+
+      if (count > 0) {
+         report_dropped(state);
+         fflush(stdout);
+         if (state.m_file) {
+            fflush(state.m_file);
+         }
+         if (state.m_binary) {
+            fflush(state.m_binary);
+         }
+         state.m_written.store(state.m_tail, std::memory_order_release);
+      }
+
+      return count;
+   }
+
+   void log_thread_main(log_state_t &state)
+   {
+      profiler::set_thread_name("log");
+
+      // note: batches whatever arrived, idles in short sleeps so producers never signal
+      while (true) {
+         const bool running = state.m_running.load(std::memory_order_acquire);
+         if (drain(state) > 0) {
+            continue;
+         }
+
+         if (!running && state.m_tail == state.m_head.load(std::memory_order_acquire)) {
+            break;
+         }
+
+         std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+   }
+
+   void stop(log_state_t &state)
+   {
+      if (!state.m_thread.joinable()) {
+         return;
+      }
+
+      state.m_running.store(false, std::memory_order_release);
+      state.m_thread.join();
+
+      std::lock_guard<std::mutex> lock(state.m_mutex);
+      for (auto &entry : state.m_rate_limits) {
+         if (entry.m_format) {
+            report_suppressed(state, entry);
+         }
+      }
+      report_dropped(state);
+      fflush(stdout);
+
+      if (state.m_file) {
+         fclose(state.m_file);
+         state.m_file = nullptr;
+      }
+
+      if (state.m_binary) {
+         fclose(state.m_binary);
+         state.m_binary = nullptr;
+      }
+   }
+
+   FILE *open_file(const char *filename, const char *mode)
+   {
+      FILE *file = nullptr;
+#if defined(_MSC_VER)
+      fopen_s(&file, filename, mode);
+#else
+      file = fopen(filename, mode);
+#endif
+      return file;
+   }
+
+   struct binary_reader_t {
+      template <typename T>
+      bool read(T &value)
+      {
+         return read(&value, sizeof(T));
+      }
+
+      bool read(void *data, const size_t size)
+      {
+         if (m_cursor + size > m_content.size()) {
+            return false;
+         }
+
+         memcpy(data, m_content.data() + m_cursor, size);
+         m_cursor += size;
+         return true;
+      }
+
+      std::vector<uint8_t> m_content;
+      size_t               m_cursor = 0;
+   };
+
+   struct log_owner_t {
+      ~log_owner_t() { stop(m_state); }
+      log_state_t m_state;
+   };
+
+   log_state_t &state()
+   {
+      static log_owner_t ms_owner;
+      return ms_owner.m_state;
+   }
+} // !anonymous
+
+namespace debug
+{
+   void log(const log_level_t level, const char *format, const log_argument_t *arguments, const int count)
+   {
+      auto &log = state();
+      if (!log.m_running.load(std::memory_order_acquire)) {
+         std::lock_guard<std::mutex> lock(log.m_mutex);
+         log_record_t record;
+         capture(record, level, format, arguments, count);
+         write_record(log, record);
+         fflush(stdout);
+         return;
+      }
+
+      // note: claim a slot, a full ring drops the message rather than wait
+      uint32_t position = log.m_head.load(std::memory_order_relaxed);
+      log_slot_t *slot = nullptr;
+      while (true) {
+         slot = &log.m_slots[position & log_state_t::mask];
+         const uint32_t sequence = slot->m_sequence.load(std::memory_order_acquire);
+         const int32_t difference = int32_t(sequence - position);
+         if (difference == 0) {
+            if (log.m_head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+               break;
+            }
+         }
+         else if (difference < 0) {
+            log.m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+         }
+         else {
+            position = log.m_head.load(std::memory_order_relaxed);
+         }
+      }
+
+      capture(slot->m_record, level, format, arguments, count);
+      slot->m_sequence.store(position + 1, std::memory_order_release);
+   }
+
+   bool start_logging(const char *filename, const char *binary_filename)
+   {
+      auto &log = state();
+      if (log.m_thread.joinable()) {
+         return true;
+      }
+
+      if (filename) {
+         log.m_file = open_file(filename, "w");
+         if (log.m_file == nullptr) {
+            warn("could not open log file '%s'", filename);
+         }
+      }
+
+      if (binary_filename) {
+         log.m_binary = open_file(binary_filename, "wb");
+         if (log.m_binary == nullptr) {
+            warn("could not open binary log file '%s'", binary_filename);
+         }
+         else {
+            write_binary(log.m_binary, binary_log_magic);
+            write_binary(log.m_binary, binary_log_version);
+         }
+      }
+
+      log.m_running.store(true, std::memory_order_release);
+      log.m_thread = std::thread(log_thread_main, std::ref(log));
+
+      return true;
+   }
+
+   void stop_logging()
+   {
+      stop(state());
+   }
+
+   void flush()
+   {
+      auto &log = state();
+      if (!log.m_running.load(std::memory_order_acquire)) {
+         fflush(stdout);
+         return;
+      }
+
+      const uint32_t target = log.m_head.load(std::memory_order_acquire);
+      while (int32_t(log.m_written.load(std::memory_order_acquire) - target) < 0 &&
+             log.m_running.load(std::memory_order_acquire))
+      {
+         std::this_thread::yield();
+      }
+   }
+
+   uint64_t dropped_logs()
+   {
+      return state().m_dropped.load(std::memory_order_relaxed);
+   }
+
+   bool decode_binary_log(const char *filename)
+   {
+      binary_reader_t reader;
+      if (!file_system_t::load_content(filename, reader.m_content)) {
+         error("could not open binary log '%s'", filename);
+         return false;
+      }
+
+      uint32_t magic = 0, version = 0;
+      if (!reader.read(magic) || !reader.read(version) || magic != binary_log_magic || version != binary_log_version) {
+         error("'%s' is not a binary log!", filename);
+         return false;
+      }
+
+      std::vector<std::string> formats;
+      std::string inline_text;
+      uint64_t records = 0;
+      while (reader.m_cursor < reader.m_content.size()) {
+         binary_tag_t tag{};
+         if (!reader.read(tag)) {
+            break;
+         }
+
+         if (tag == binary_tag_t::format) {
+            uint32_t id = 0, length = 0;
+            if (!reader.read(id) || !reader.read(length) || reader.m_cursor + length > reader.m_content.size()) {
+               break;
+            }
+
+            std::string text(reinterpret_cast<const char *>(reader.m_content.data() + reader.m_cursor), length);
+            reader.m_cursor += length;
+            if (id == inline_format) {
+               inline_text = std::move(text);
+            }
+            else if (id == formats.size()) {
+               formats.push_back(std::move(text));
+            }
+            else {
+               break;
+            }
+            continue;
+         }
+
+         if (tag != binary_tag_t::record) {
+            break;
+         }
+
+         // note: rebuilt into a record so the text comes out of the same formatter
+         log_record_t record{};
+         uint32_t format = 0;
+         if (!reader.read(record.m_time) ||
+             !reader.read(record.m_level) ||
+             !reader.read(format) ||
+             !reader.read(record.m_count) ||
+             record.m_count > log_record_t::max_arguments ||
+             record.m_level > log_level_t::error)
+         {
+            break;
+         }
+
+         bool valid = true;
+         for (int index = 0; index < record.m_count && valid; index++) {
+            log_argument_t &argument = record.m_arguments[index];
+            valid = reader.read(argument.m_type) &&
+                    reader.read(argument.m_length) &&
+                    reader.read(argument.m_value) &&
+                    argument.m_type <= log_argument_t::type_t::string;
+         }
+
+         if (!valid ||
+             !reader.read(record.m_string_bytes) ||
+             record.m_string_bytes > log_record_t::max_string_bytes ||
+             !reader.read(record.m_strings, record.m_string_bytes))
+         {
+            break;
+         }
+
+         // note: pointers are only ever printed, strings must stay inside the record
+         for (int index = 0; index < record.m_count; index++) {
+            const log_argument_t &argument = record.m_arguments[index];
+            if (argument.m_type == log_argument_t::type_t::string &&
+                argument.m_value.m_unsigned + argument.m_length > record.m_string_bytes)
+            {
+               valid = false;
+            }
+         }
+
+         if (!valid || (format != inline_format && format >= formats.size())) {
+            break;
+         }
+
+         record.m_format = format == inline_format ? inline_text.c_str() : formats[format].c_str();
+
+         output_t output;
+         format_record(record, output);
+         printf("%12.6f %s%s\n", double(record.m_time) * 0.000001, level_prefix(record.m_level), output.m_buffer);
+         records++;
+      }
+
+      if (reader.m_cursor < reader.m_content.size()) {
+         error("binary log '%s' is corrupt at %llu after %llu record(s)!",
+               filename,
+               (unsigned long long)reader.m_cursor,
+               (unsigned long long)records);
+         return false;
+      }
+
+      fflush(stdout);
+      return true;
+   }
+} // !debug
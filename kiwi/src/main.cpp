@@ -1,11 +1,343 @@
 // main.cpp
 
 #include "application.hpp"
+#include "capture.hpp"
+#include "headless.hpp"
+#include "profiler.hpp"
+#include "pacing.hpp"
+#include "pipeline.hpp"
+#include "jobs.hpp"
+#include "memory.hpp"
+#include "telemetry.hpp"
 
 #include <glad/glad.h>
-#include <glfw/glfw3.h>
+#include <GLFW/glfw3.h>
 
-int main(int argc, char **argv)
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <thread>
+
+struct options_t {
+   bool headless = false;
+   bool synthetic_input = false;
+   bool check_allocations = false;
+   bool compare_prepass = false;
+   int  frames = 600;
+   int  width = 1280;
+   int  height = 720;
+   int  tick_rate = 120;
+   int  frame_rate_limit = 0;
+   int  render_latency = 0;
+   int  worker_count = 0;
+   int  asteroid_count = int(application_t::default_asteroid_count);
+   int  particle_count = int(application_t::default_particle_count);
+   float max_p99_ms = 0.0f;
+   const char *log_filename = nullptr;
+   const char *binary_log_filename = nullptr;
+   const char *decode_log_filename = nullptr;
+   const char *telemetry_filename = "frame_telemetry.json";
+   const char *capture_filename = nullptr;
+};
+
+static options_t
+parse_options(int argc, char **argv)
+{
+   options_t options;
+   for (int index = 1; index < argc; index++) {
+      const char *argument = argv[index];
+      if (strcmp(argument, "--headless") == 0) {
+         options.headless = true;
+      }
+      else if (strcmp(argument, "--input") == 0) {
+         options.synthetic_input = true;
+      }
+      else if (strcmp(argument, "--check-allocations") == 0) {
+         options.check_allocations = true;
+      }
+      else if (strcmp(argument, "--compare-prepass") == 0) {
+         options.compare_prepass = true;
+      }
+      else if (strncmp(argument, "--frames=", 9) == 0) {
+         options.frames = std::max(1, atoi(argument + 9));
+      }
+      else if (strncmp(argument, "--tick=", 7) == 0) {
+         options.tick_rate = std::max(1, atoi(argument + 7));
+      }
+      else if (strncmp(argument, "--fps=", 6) == 0) {
+         options.frame_rate_limit = std::max(0, atoi(argument + 6));
+      }
+      else if (strcmp(argument, "--render-thread") == 0) {
+         options.render_latency = 1;
+      }
+      else if (strncmp(argument, "--render-thread=", 16) == 0) {
+         options.render_latency = std::clamp(atoi(argument + 16), 1, 3);
+      }
+      else if (strncmp(argument, "--workers=", 10) == 0) {
+         options.worker_count = std::clamp(atoi(argument + 10), 1, job_system_t::max_workers);
+      }
+      else if (strncmp(argument, "--asteroids=", 12) == 0) {
+         options.asteroid_count = std::clamp(atoi(argument + 12), 0, 1 << 20);
+      }
+      else if (strncmp(argument, "--particles=", 12) == 0) {
+         options.particle_count = std::clamp(atoi(argument + 12), 0, 1 << 22);
+      }
+      else if (strncmp(argument, "--telemetry=", 12) == 0) {
+         options.telemetry_filename = argument + 12;
+      }
+      else if (strncmp(argument, "--max-p99=", 10) == 0) {
+         options.max_p99_ms = std::max(0.0f, float(atof(argument + 10)));
+      }
+      else if (strncmp(argument, "--capture=", 10) == 0) {
+         options.capture_filename = argument + 10;
+      }
+      else if (strncmp(argument, "--log=", 6) == 0) {
+         options.log_filename = argument + 6;
+      }
+      else if (strncmp(argument, "--log-binary=", 13) == 0) {
+         options.binary_log_filename = argument + 13;
+      }
+      else if (strncmp(argument, "--decode-log=", 13) == 0) {
+         options.decode_log_filename = argument + 13;
+      }
+      else if (strncmp(argument, "--size=", 7) == 0) {
+         int width = 0, height = 0;
+         if (sscanf(argument + 7, "%dx%d", &width, &height) == 2 && width > 0 && height > 0) {
+            options.width = width;
+            options.height = height;
+         }
+      }
+      else {
+         debug::warn("unknown argument '%s'", argument);
+      }
+   }
+
+   return options;
+}
+
+// note: --capture records every renderer call into a file for the replay tool
+static render_capture_t *
+begin_capture(const options_t &options)
+{
+   if (options.capture_filename == nullptr) {
+      return nullptr;
+   }
+
+   render_capture_t *capture = new render_capture_t;
+   if (!capture->begin(options.capture_filename, options.width, options.height)) {
+      delete capture;
+      return nullptr;
+   }
+
+   return capture;
+}
+
+static void
+end_capture(render_capture_t *capture)
+{
+   if (capture) {
+      capture->end();
+      delete capture;
+   }
+}
+
+// note: renders a fixed number of frames with a fixed timestep into an offscreen
+//       framebuffer and reports timings, returns non-zero on failure for ci,
+//       which includes a steady state p99 frame time over the --max-p99 budget
+static int 
+run_headless(const options_t &options)
+{
+   headless_context_t context;
+   if (!context.create(options.width, options.height)) {
+      return 1;
+   }
+
+   job_system_t::initialize(options.worker_count);
+
+   // note: recorded from before the first resource is created up to the last frame
+   render_capture_t *capture = begin_capture(options);
+
+   application_t *app = new application_t(uint32_t(options.asteroid_count), uint32_t(options.particle_count));
+   if (!app->on_initialize()) {
+      end_capture(capture);
+      delete app;
+      job_system_t::shutdown();
+      context.destroy();
+      return 1;
+   }
+
+   const timespan_t fixed_timestep = timespan_t::from_seconds(1.0 / 60.0);
+   const viewport_t viewport{ 0, 0, options.width, options.height };
+
+   // note: the first frames warm up pools, arenas and driver state, 
+   //       every frame after that is expected to leave the heap alone
+   //       and is the only one that counts towards the telemetry
+   constexpr int warmup_frames = 10;
+   memory::heap_stats_t steady_heap;
+   frame_telemetry_t *telemetry = new frame_telemetry_t;
+   int rendered_frames = 0;
+
+   timespan_t apptime;
+   const timespan_t start_time = watch_t::time_since_start();
+   for (int frame = 0; frame < options.frames; frame++) {
+      if (frame == warmup_frames) {
+         steady_heap = memory::heap_stats();
+         telemetry->reset();
+      }
+
+      profile_scope("frame");
+      const timespan_t frame_start = watch_t::time_since_start();
+
+      // note: sweep the cursor in a circle to exercise the input path
+      if (options.synthetic_input) {
+         const float angle = frame * 0.05f;
+         const int x = int(options.width * (0.5f + 0.4f * std::cos(angle)));
+         const int y = int(options.height * (0.5f + 0.4f * std::sin(angle)));
+         event_dispatcher_t::post(mouse_moved_t{ x, y, watch_t::time_since_start() });
+      }
+
+      // note: render the second half with the depth pre-pass, both halves are reported on exit
+      if (options.compare_prepass && frame == options.frames / 2) {
+         event_dispatcher_t::post(key_pressed_t{ GLFW_KEY_Z, watch_t::time_since_start() });
+      }
+      event_dispatcher_t::process();
+
+      apptime += fixed_timestep;
+      if (!app->on_update(fixed_timestep, apptime)) {
+         break;
+      }
+
+      app->on_interpolate(1.0f);
+      app->on_render(viewport);
+
+      // note: no present to pace us, wait for the gpu so each frame is measured in full
+      glFinish();
+      app->on_present(watch_t::time_since_start());
+
+      telemetry->record(frame_metric_t::cpu, watch_t::time_since_start() - frame_start);
+      telemetry->record_gpu(app->gpu_profiler());
+      rendered_frames++;
+      profiler::collect();
+   }
+   const timespan_t total_time = watch_t::time_since_start() - start_time;
+   const int steady_frames = rendered_frames - warmup_frames;
+   const uint64_t steady_allocations = steady_frames > 0 ? memory::heap_stats().m_allocations - steady_heap.m_allocations : 0;
+
+   end_capture(capture);
+
+   app->on_shutdown();
+   delete app;
+   job_system_t::shutdown();
+   context.destroy();
+
+   if (rendered_frames == 0) {
+      debug::error("headless: no frames rendered!");
+      delete telemetry;
+      return 1;
+   }
+
+   debug::info("headless: %d frames %dx%d in %2.3fs - avg: %2.3fms fps: %2.3f",
+               rendered_frames,
+               options.width,
+               options.height,
+               total_time.elapsed_seconds(),
+               total_time.elapsed_milliseonds() / rendered_frames,
+               rendered_frames / total_time.elapsed_seconds());
+
+   // note: steady state only, 'cpu' is the whole frame here since we wait for the gpu
+   telemetry->log_summary();
+   telemetry->save_json(options.telemetry_filename);
+   const frame_percentiles_t frame_times = telemetry->total(frame_metric_t::cpu);
+   delete telemetry;
+
+   if (steady_frames > 0) {
+      debug::info("headless: %llu heap allocation(s) in %d steady state frames",
+                  (unsigned long long)steady_allocations,
+                  steady_frames);
+   }
+
+   profiler::save_chrome_trace("kiwi_trace.json");
+
+   if (options.check_allocations && steady_allocations > 0) {
+      debug::error("headless: steady state frames allocated from the heap!");
+      return 1;
+   }
+
+   if (options.max_p99_ms > 0.0f && frame_times.m_p99_ms > options.max_p99_ms) {
+      debug::error("headless: p99 frame time %2.3fms is over the %2.3fms budget!", frame_times.m_p99_ms, options.max_p99_ms);
+      return 1;
+   }
+
+   return 0;
+}
+
+// note: KIWI_HEADLESS_ONLY leaves the window out so nothing links against
+//       glfw, the header is still used for its key codes
+#if !defined(KIWI_HEADLESS_ONLY)
+// note: owns the gl context while running, consumes snapshots published by
+//       the simulation thread and presents them
+struct render_thread_t {
+   GLFWwindow                          *m_window = nullptr;
+   application_t                       *m_app = nullptr;
+   int                                  m_frame_rate_limit = 0;
+   frame_pipeline_t<render_snapshot_t>  m_pipeline;
+   std::thread                          m_thread;
+   std::mutex                           m_stats_mutex;
+   frame_stats_t                        m_stats;
+   frame_telemetry_t                   *m_telemetry = nullptr;
+};
+
+static void
+render_thread_main(render_thread_t &render)
+{
+   profiler::set_thread_name("render");
+   glfwMakeContextCurrent(render.m_window);
+
+   frame_pacer_t pacer;
+   pacer.set_target_frame_rate(float(render.m_frame_rate_limit));
+   timespan_t last_present;
+
+   while (const render_snapshot_t *snapshot = render.m_pipeline.begin_read()) {
+      profile_scope("render frame");
+      const timespan_t frame_start = watch_t::time_since_start();
+
+      render.m_app->on_render(*snapshot);
+
+      // note: the snapshot is no longer needed, let the simulation reuse the slot
+      render.m_pipeline.end_read();
+      render.m_telemetry->record(frame_metric_t::cpu, watch_t::time_since_start() - frame_start);
+
+      {
+         profile_scope("frame_pacer_t::limit");
+         pacer.limit();
+      }
+
+      {
+         profile_scope("glfwSwapBuffers");
+         glfwSwapBuffers(render.m_window);
+      }
+
+      const timespan_t present_time = watch_t::time_since_start();
+      pacer.on_present(present_time);
+      render.m_app->on_present(present_time);
+      if (last_present != timespan_t{}) {
+         render.m_telemetry->record(frame_metric_t::present, present_time - last_present);
+      }
+      render.m_telemetry->record_gpu(render.m_app->gpu_profiler());
+      last_present = present_time;
+
+      std::lock_guard<std::mutex> lock(render.m_stats_mutex);
+      render.m_stats = pacer.stats();
+   }
+
+   glfwMakeContextCurrent(nullptr);
+}
+
+// note: the interactive app in a glfw window, runs until the window is closed
+static int
+run_windowed(const options_t &options)
 {
    // note: initialize glfw
    if (!glfwInit()) {
@@ -18,7 +350,7 @@ int main(int argc, char **argv)
    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-   GLFWwindow *window = glfwCreateWindow(1280, 720, "kiwi", nullptr, nullptr);
+   GLFWwindow *window = glfwCreateWindow(options.width, options.height, "kiwi", nullptr, nullptr);
    if (window == nullptr) {
       debug::error("could not create window!");
       return 0;
@@ -31,97 +363,196 @@ int main(int argc, char **argv)
       return 0;
    }
 
-   // note: request vsync on
-   glfwSwapInterval(1);
+   load_opengl_extensions((opengl_loader_t)glfwGetProcAddress);
+
+   // note: request vsync on, unless we pace ourselves
+   glfwSwapInterval(options.frame_rate_limit > 0 ? 0 : 1);
    
+   // note: the calling thread becomes worker 0 and helps out whenever it waits
+   job_system_t::initialize(options.worker_count);
+
+   // note: recorded from before the first resource is created until the window closes
+   render_capture_t *capture = begin_capture(options);
+
    // note: instanciate app
-   application_t *app_ = new application_t;
+   application_t *app_ = new application_t(uint32_t(options.asteroid_count), uint32_t(options.particle_count));
    application_t &app = *app_;
    if (!app.on_initialize()) {
+      end_capture(capture);
+      job_system_t::shutdown();
       return 0;
    }
 
-   // note: set up event callbacks
+   // note: set up event callbacks, events are queued and delivered in one batch per frame
    glfwSetCursorPosCallback(window, [](GLFWwindow *window, double xpos, double ypos) {
-      event_dispatcher_t::dispatch(mouse_moved_t{ int(xpos), int(ypos) });
+      event_dispatcher_t::post(mouse_moved_t{ int(xpos), int(ypos), watch_t::time_since_start() });
    });
 
    glfwSetMouseButtonCallback(window, [](GLFWwindow *window, int button, int action, int mods) {
       if (action == GLFW_PRESS) {
-         event_dispatcher_t::dispatch(button_pressed_t{ button });
+         event_dispatcher_t::post(button_pressed_t{ button, watch_t::time_since_start() });
       }
       else if (action == GLFW_RELEASE) {
-         event_dispatcher_t::dispatch(button_released_t{ button });
+         event_dispatcher_t::post(button_released_t{ button, watch_t::time_since_start() });
       } 
    });
 
    glfwSetKeyCallback(window, [](GLFWwindow *window, int key, int scancode, int action, int mods) {
       if (action == GLFW_PRESS) {
-         event_dispatcher_t::dispatch(key_pressed_t{ key });
+         event_dispatcher_t::post(key_pressed_t{ key, watch_t::time_since_start() });
       }
       else if (action == GLFW_RELEASE) {
-         event_dispatcher_t::dispatch(key_released_t{ key});
+         event_dispatcher_t::post(key_released_t{ key, watch_t::time_since_start() });
       }
    });
 
-   // note: get monitor refresh rate
-   GLFWmonitor *monitor = glfwGetPrimaryMonitor();
-   const GLFWvidmode *videomode = glfwGetVideoMode(monitor);
-   const float monitor_refresh_rate = float(videomode->refreshRate);
+   // note: simulation runs at a fixed rate, rendering interpolates between steps
+   frame_pacer_t pacer;
+   pacer.set_fixed_timestep(timespan_t::from_seconds(1.0 / options.tick_rate));
+
+   // note: recorded by whichever thread renders, with a render thread the cpu
+   //       time is that of the render thread alone, the simulation runs ahead of it
+   frame_telemetry_t *telemetry = new frame_telemetry_t;
+   timespan_t last_present;
 
-   // note: time-dependent updates, here we go! superstar dj!
-   float frames_per_second = monitor_refresh_rate;
-   timespan_t time_last_frame;
-   timespan_t average_frame_duration = timespan_t::from_seconds(1.0f / frames_per_second);
+   // note: optionally hand the context over to a render thread, the main thread
+   //       keeps polling events and simulating up to 'latency' frames ahead
+   const bool threaded = options.render_latency > 0;
+   render_thread_t render;
+   if (threaded) {
+      render.m_window = window;
+      render.m_app = &app;
+      render.m_telemetry = telemetry;
+      render.m_frame_rate_limit = options.frame_rate_limit;
+      render.m_pipeline.create(options.render_latency);
+
+      glfwMakeContextCurrent(nullptr);
+      render.m_thread = std::thread(render_thread_main, std::ref(render));
+      debug::info("render thread: latency %d frame(s)", options.render_latency);
+   }
+   else {
+      pacer.set_target_frame_rate(float(options.frame_rate_limit));
+   }
+
+   frame_stats_t stats;
 
    // note: mainloop as long as the window is open
    while (!glfwWindowShouldClose(window)) {
-      // note: calculate frame duration and frames per second ...
-      const timespan_t current_time = watch_t::time_since_start();
-      const timespan_t current_frame_duration = current_time - time_last_frame;
-      const float current_frames_per_second = 1.0f / current_frame_duration.elapsed_seconds();
-      time_last_frame = current_time;
-
-      // note: ... and averages using leaky integration
-      constexpr float leaky_factor_from = 0.98f; 
-      constexpr float leaky_factor_to   = 1.0f - leaky_factor_from;
-      frames_per_second = frames_per_second * leaky_factor_from + current_frames_per_second * leaky_factor_to;
-      average_frame_duration = average_frame_duration * leaky_factor_from + current_frame_duration * leaky_factor_to;
-
-      // note: poll all queued events since last frame
+      profiler::collect();
+      profile_scope("frame");
+
+      const timespan_t frame_start = watch_t::time_since_start();
+      pacer.begin_frame(frame_start);
+
+      // note: poll all queued events since last frame and deliver them, 
+      //       together with whatever other threads posted
       glfwPollEvents();
+      event_dispatcher_t::process();
 
       // note: since we have a resizable window (by default in glfw)
       //       get the current dimensions
       int width = 0, height = 0;
       glfwGetWindowSize(window, &width, &height);
 
-      // note: let the application update logic
-      if (!app.on_update(current_frame_duration, current_time)) {
-         glfwSetWindowShouldClose(window, GLFW_TRUE);
+      // note: let the application update logic in fixed steps ...
+      while (pacer.step()) {
+         if (!app.on_update(pacer.timestep(), pacer.simulation_time())) {
+            glfwSetWindowShouldClose(window, GLFW_TRUE);
+         }
+      }
+
+      // note: ... and then render the state in between the last two steps
+      app.on_interpolate(pacer.alpha());
+      const viewport_t viewport{ 0, 0, width, height };
+
+      if (threaded) {
+         // note: blocks while the render thread is 'latency' frames behind
+         render_snapshot_t *snapshot = nullptr;
+         {
+            profile_scope("frame_pipeline_t::begin_write");
+            snapshot = render.m_pipeline.begin_write();
+         }
+
+         if (snapshot) {
+            app.on_snapshot(viewport, *snapshot);
+            render.m_pipeline.end_write();
+         }
+
+         std::lock_guard<std::mutex> lock(render.m_stats_mutex);
+         stats = render.m_stats;
       }
+      else {
+         app.on_render(viewport);
+         telemetry->record(frame_metric_t::cpu, watch_t::time_since_start() - frame_start);
+
+         // note: sleep off the rest of the frame before presenting, not after,
+         //       so the frame we just built is shown as soon as possible
+         {
+            profile_scope("frame_pacer_t::limit");
+            pacer.limit();
+         }
 
-      // note: ... and then render
-      app.on_render(viewport_t{ 0, 0, width, height });
+         // note: we are done with this frame, swap backbuffer
+         {
+            profile_scope("glfwSwapBuffers");
+            glfwSwapBuffers(window);
+         }
 
-      // note: we are done with this frame, swap backbuffer
-      glfwSwapBuffers(window);
+         const timespan_t present_time = watch_t::time_since_start();
+         pacer.on_present(present_time);
+         app.on_present(present_time);
+         if (last_present != timespan_t{}) {
+            telemetry->record(frame_metric_t::present, present_time - last_present);
+         }
+         telemetry->record_gpu(app.gpu_profiler());
+         last_present = present_time;
+         stats = pacer.stats();
+      }
 
       { // note: whats cooler than being cool?
          char title[256];
-         sprintf_s(title, 
-                   "kiwi - window: %dx%d fps: %2.3f frame: %2.3fms", 
-                   width, 
-                   height, 
-                   frames_per_second, 
-                   average_frame_duration.elapsed_milliseonds());
+         snprintf(title, 
+                  sizeof(title),
+                  "kiwi - window: %dx%d fps: %2.3f frame: %2.3fms jitter: %2.3fms max: %2.3fms", 
+                  width, 
+                  height, 
+                  stats.m_average_ms > 0.0f ? 1000.0f / stats.m_average_ms : 0.0f, 
+                  stats.m_average_ms,
+                  stats.m_jitter_ms,
+                  stats.m_max_ms);
          glfwSetWindowTitle(window, title);
       }
    } 
 
+   // note: let the render thread drain and take the context back for shutdown
+   if (threaded) {
+      render.m_pipeline.close();
+      render.m_thread.join();
+      glfwMakeContextCurrent(window);
+   }
+
+   end_capture(capture);
+
+   { // note: present-to-present summary of the last few seconds
+      debug::info("pacing: avg: %2.3fms jitter: %2.3fms min: %2.3fms max: %2.3fms",
+                  stats.m_average_ms,
+                  stats.m_jitter_ms,
+                  stats.m_min_ms,
+                  stats.m_max_ms);
+   }
+
+   // note: the render thread is gone, the telemetry is ours to read
+   telemetry->log_summary();
+   telemetry->save_json(options.telemetry_filename);
+   delete telemetry;
+
    // note: clean up cr3w!
    app.on_shutdown();
    delete app_;
+   job_system_t::shutdown();
+
+   // note: open in chrome://tracing or ui.perfetto.dev
+   profiler::save_chrome_trace("kiwi_trace.json");
 
    // note: destroy the Windows (tm)
    glfwDestroyWindow(window);
@@ -131,3 +562,31 @@ int main(int argc, char **argv)
 
    return 0;
 }
+#else
+static int
+run_windowed([[maybe_unused]] const options_t &options)
+{
+   debug::error("built with KIWI_HEADLESS_ONLY, run with --headless");
+   return 1;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+   profiler::set_thread_name("main");
+
+   const options_t options = parse_options(argc, argv);
+
+   // note: prints a --log-binary file and exits
+   if (options.decode_log_filename) {
+      return debug::decode_binary_log(options.decode_log_filename) ? 0 : 1;
+   }
+
+   // note: from here on messages are formatted and written on the logging thread
+   debug::start_logging(options.log_filename, options.binary_log_filename);
+
+   const int result = options.headless ? run_headless(options) : run_windowed(options);
+   debug::stop_logging();
+
+   return result;
+}
@@ -0,0 +1,238 @@
+// memory.cpp
+
+#include "memory.hpp"
+
+#include <atomic>
+#include <cstdlib>
+
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+namespace
+{
+   std::atomic<uint64_t> g_allocations = 0;
+   std::atomic<uint64_t> g_frees = 0;
+   std::atomic<uint64_t> g_allocated_bytes = 0;
+
+   void *counted_allocate(const size_t size, const size_t alignment)
+   {
+      g_allocations.fetch_add(1, std::memory_order_relaxed);
+      g_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+
+      const size_t bytes = size > 0 ? size : 1;
+      void *memory = nullptr;
+      if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+         memory = std::malloc(bytes);
+      }
+      else {
+#if defined(_MSC_VER)
+         memory = _aligned_malloc(bytes, alignment);
+#else
+         memory = std::aligned_alloc(alignment, (bytes + alignment - 1) & ~(alignment - 1));
+#endif
+      }
+
+      if (memory == nullptr) {
+         throw std::bad_alloc();
+      }
+
+      return memory;
+   }
+
+   void counted_free(void *memory, const size_t alignment)
+   {
+      if (memory == nullptr) {
+         return;
+      }
+
+      g_frees.fetch_add(1, std::memory_order_relaxed);
+
+#if defined(_MSC_VER)
+      if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+         _aligned_free(memory);
+         return;
+      }
+#endif
+      (void)alignment;
+      std::free(memory);
+   }
+
+   constexpr size_t default_block_size = 64 * 1024;
+
+   linear_arena_t::block_t *
+   allocate_block(linear_arena_t::block_t *previous, const size_t size)
+   {
+      auto *block = static_cast<linear_arena_t::block_t *>(::operator new(sizeof(linear_arena_t::block_t) + size));
+      block->m_previous = previous;
+      block->m_size = size;
+      block->m_used = 0;
+      return block;
+   }
+
+   uint8_t *block_data(linear_arena_t::block_t *block)
+   {
+      return reinterpret_cast<uint8_t *>(block + 1);
+   }
+
+   thread_local linear_arena_t tls_scratch;
+   thread_local int            tls_scratch_depth = 0;
+} // !anonymous
+
+// note: replacing the plain and aligned forms is enough, the array and
+//       nothrow forms forward to these by default
+void *operator new(size_t size)                                   { return counted_allocate(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void *operator new(size_t size, std::align_val_t alignment)       { return counted_allocate(size, size_t(alignment)); }
+void operator delete(void *memory) noexcept                       { counted_free(memory, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void operator delete(void *memory, size_t) noexcept               { counted_free(memory, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void operator delete(void *memory, std::align_val_t alignment) noexcept         { counted_free(memory, size_t(alignment)); }
+void operator delete(void *memory, size_t, std::align_val_t alignment) noexcept { counted_free(memory, size_t(alignment)); }
+
+namespace memory
+{
+   heap_stats_t heap_stats()
+   {
+      heap_stats_t stats;
+      stats.m_allocations = g_allocations.load(std::memory_order_relaxed);
+      stats.m_frees = g_frees.load(std::memory_order_relaxed);
+      stats.m_allocated_bytes = g_allocated_bytes.load(std::memory_order_relaxed);
+      return stats;
+   }
+} // !memory
+
+linear_arena_t::~linear_arena_t()
+{
+   destroy();
+}
+
+bool linear_arena_t::create(const size_t block_size)
+{
+   destroy();
+
+   m_block_size = block_size > 0 ? block_size : default_block_size;
+   m_current = allocate_block(nullptr, m_block_size);
+
+   return m_current != nullptr;
+}
+
+void linear_arena_t::destroy()
+{
+   while (m_current) {
+      block_t *previous = m_current->m_previous;
+      ::operator delete(m_current);
+      m_current = previous;
+   }
+
+   m_used = 0;
+   m_peak = 0;
+}
+
+void *linear_arena_t::allocate(const size_t size, const size_t alignment)
+{
+   // note: alignment has to be a power of two
+   if (m_current) {
+      const uintptr_t base = uintptr_t(block_data(m_current));
+      const uintptr_t aligned = (base + m_current->m_used + alignment - 1) & ~uintptr_t(alignment - 1);
+      const size_t end = size_t(aligned - base) + size;
+      if (end <= m_current->m_size) {
+         m_used += end - m_current->m_used;
+         m_peak = m_used > m_peak ? m_used : m_peak;
+         m_current->m_used = end;
+         return reinterpret_cast<void *>(aligned);
+      }
+   }
+
+   // note: does not fit, chain a new block big enough for this request
+   const size_t block_size = m_block_size > 0 ? m_block_size : default_block_size;
+   const size_t needed = size + alignment;
+   m_current = allocate_block(m_current, needed > block_size ? needed : block_size);
+
+   return allocate(size, alignment);
+}
+
+void linear_arena_t::reset()
+{
+   if (m_current == nullptr) {
+      return;
+   }
+
+   // note: fold the chain into one block that holds everything the last cycle needed
+   if (m_current->m_previous) {
+      size_t total = 0;
+      while (m_current) {
+         block_t *previous = m_current->m_previous;
+         total += m_current->m_size;
+         ::operator delete(m_current);
+         m_current = previous;
+      }
+
+      m_current = allocate_block(nullptr, total);
+   }
+
+   m_current->m_used = 0;
+   m_used = 0;
+}
+
+linear_arena_t::marker_t linear_arena_t::mark() const
+{
+   return { m_current, m_current ? m_current->m_used : 0 };
+}
+
+void linear_arena_t::rewind(const marker_t &marker)
+{
+   while (m_current && m_current != marker.m_block) {
+      block_t *previous = m_current->m_previous;
+      m_used -= m_current->m_used;
+      ::operator delete(m_current);
+      m_current = previous;
+   }
+
+   if (m_current) {
+      m_used -= m_current->m_used - marker.m_used;
+      m_current->m_used = marker.m_used;
+   }
+}
+
+size_t linear_arena_t::used() const
+{
+   return m_used;
+}
+
+size_t linear_arena_t::peak() const
+{
+   return m_peak;
+}
+
+size_t linear_arena_t::capacity() const
+{
+   size_t total = 0;
+   for (const block_t *block = m_current; block; block = block->m_previous) {
+      total += block->m_size;
+   }
+
+   return total;
+}
+
+scratch_scope_t::scratch_scope_t()
+   : m_arena(tls_scratch)
+   , m_marker(tls_scratch.mark())
+{
+   tls_scratch_depth++;
+}
+
+scratch_scope_t::~scratch_scope_t()
+{
+   // note: the outermost scope folds the arena so the next load fits in one block,
+   //       unless that block would pin a one-off peak for the thread's lifetime
+   if (--tls_scratch_depth == 0) {
+      if (m_arena.capacity() > retained_size) {
+         m_arena.destroy();
+      }
+      else {
+         m_arena.reset();
+      }
+   }
+   else {
+      m_arena.rewind(m_marker);
+   }
+}
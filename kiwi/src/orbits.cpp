@@ -0,0 +1,285 @@
+// orbits.cpp
+
+#include "orbits.hpp"
+#include "orbits_lanes.hpp"
+#include "profiler.hpp"
+#include "jobs.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+   // note: cpuid leaf 7 for avx2, and xgetbv so the os saves the ymm registers
+   bool
+   cpu_supports_avx2()
+   {
+#if defined(_MSC_VER) && defined(_M_X64)
+      int info[4] = {};
+      __cpuid(info, 0);
+      if (info[0] < 7) {
+         return false;
+      }
+
+      __cpuid(info, 1);
+      const bool osxsave = (info[2] & (1 << 27)) != 0;
+      const bool avx = (info[2] & (1 << 28)) != 0;
+      if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+         return false;
+      }
+
+      __cpuidex(info, 7, 0);
+      return (info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+      return __builtin_cpu_supports("avx2");
+#else
+      return false;
+#endif
+   }
+
+   uint32_t
+   padded(const uint32_t count)
+   {
+      return (count + orbit_kernels::max_lane_width - 1) & ~(orbit_kernels::max_lane_width - 1);
+   }
+
+   constexpr uint32_t min_orbits_per_batch = 1024;
+   constexpr uint32_t min_nbody_rows_per_batch = 16;
+} // !anonymous
+
+const orbit_kernels::kernels_t orbit_kernels::baseline = { lane_name, lane_width, &evaluate_lanes, &accelerations_lanes };
+
+const orbit_kernels::kernels_t &orbit_kernels::selected()
+{
+   // note: decided once, the first caller pays for cpuid
+   static const kernels_t &kernels = avx2.m_evaluate && cpu_supports_avx2() ? avx2 : baseline;
+   return kernels;
+}
+
+bool kepler_orbits_t::create(const uint32_t capacity, const float gm)
+{
+   destroy();
+
+   // note: padding bodies have zero size and sit at the origin
+   const uint32_t storage = padded(capacity);
+   for (auto *array : { &m_mean_motion, &m_mean_anomaly, &m_eccentricity, &m_semi_major, &m_semi_minor,
+                        &m_px, &m_py, &m_pz, &m_qx, &m_qy, &m_qz, &m_size }) {
+      array->assign(storage, 0.0f);
+   }
+
+   m_gm = gm;
+   m_capacity = capacity;
+   m_count = 0;
+
+   return true;
+}
+
+void kepler_orbits_t::destroy()
+{
+   for (auto *array : { &m_mean_motion, &m_mean_anomaly, &m_eccentricity, &m_semi_major, &m_semi_minor,
+                        &m_px, &m_py, &m_pz, &m_qx, &m_qy, &m_qz, &m_size }) {
+      array->clear();
+      array->shrink_to_fit();
+   }
+
+   m_count = 0;
+   m_capacity = 0;
+}
+
+uint32_t kepler_orbits_t::add(const kepler_elements_t &elements, const float size)
+{
+   if (m_count >= m_capacity) {
+      return ~0u;
+   }
+
+   const float a = elements.m_semi_major_axis;
+   const float e = elements.m_eccentricity;
+   const float cos_node = std::cos(elements.m_ascending_node);
+   const float sin_node = std::sin(elements.m_ascending_node);
+   const float cos_periapsis = std::cos(elements.m_argument_of_periapsis);
+   const float sin_periapsis = std::sin(elements.m_argument_of_periapsis);
+   const float cos_inclination = std::cos(elements.m_inclination);
+   const float sin_inclination = std::sin(elements.m_inclination);
+
+   // note: perifocal axes in the textbook frame (reference plane xy, z up),
+   //       mapped to the scene as (x, z, -y) so orbits turn like the planets
+   const float p[3] =
+   {
+      cos_node * cos_periapsis - sin_node * sin_periapsis * cos_inclination,
+      sin_node * cos_periapsis + cos_node * sin_periapsis * cos_inclination,
+      sin_periapsis * sin_inclination,
+   };
+   const float q[3] =
+   {
+      -cos_node * sin_periapsis - sin_node * cos_periapsis * cos_inclination,
+      -sin_node * sin_periapsis + cos_node * cos_periapsis * cos_inclination,
+      cos_periapsis * sin_inclination,
+   };
+
+   const uint32_t index = m_count++;
+   m_mean_motion[index] = std::sqrt(m_gm / (a * a * a));
+   m_mean_anomaly[index] = elements.m_mean_anomaly;
+   m_eccentricity[index] = e;
+   m_semi_major[index] = a;
+   m_semi_minor[index] = a * std::sqrt(1.0f - e * e);
+   m_px[index] = p[0];
+   m_py[index] = p[2];
+   m_pz[index] = -p[1];
+   m_qx[index] = q[0];
+   m_qy[index] = q[2];
+   m_qz[index] = -q[1];
+   m_size[index] = size;
+
+   return index;
+}
+
+void kepler_orbits_t::evaluate(const double time, float *output) const
+{
+   profile_scope("kepler_orbits_t::evaluate");
+
+   // note: split on whole lane groups so no two jobs write the same rows
+   constexpr uint32_t group_width = orbit_kernels::max_lane_width;
+   const uint32_t groups = padded(m_count) / group_width;
+   job_system_t::parallel_for(groups, min_orbits_per_batch / group_width, [&](const uint32_t begin, const uint32_t end) {
+      evaluate_range(time, begin * group_width, std::min(end * group_width, m_count), output);
+   });
+}
+
+void kepler_orbits_t::evaluate_range(const double time, const uint32_t begin, const uint32_t end, float *output) const
+{
+   const orbit_kernels::kepler_arrays_t arrays =
+   {
+      m_mean_motion.data(),
+      m_mean_anomaly.data(),
+      m_eccentricity.data(),
+      m_semi_major.data(),
+      m_semi_minor.data(),
+      m_px.data(), m_py.data(), m_pz.data(),
+      m_qx.data(), m_qy.data(), m_qz.data(),
+      m_size.data(),
+   };
+
+   orbit_kernels::selected().m_evaluate(arrays, time, begin, end, output);
+}
+
+bool nbody_system_t::create(const uint32_t capacity, const float central_gm, const float softening)
+{
+   destroy();
+
+   // note: the self term is 0 / 0 without softening
+   assert(softening > 0.0f && "n-body softening must be positive!");
+   if (!(softening > 0.0f)) {
+      return false;
+   }
+
+   // note: padding bodies have no mass so they pull on nothing
+   const uint32_t storage = padded(capacity);
+   for (auto *array : { &m_x, &m_y, &m_z, &m_vx, &m_vy, &m_vz, &m_ax, &m_ay, &m_az, &m_gm, &m_size }) {
+      array->assign(storage, 0.0f);
+   }
+
+   m_central_gm = central_gm;
+   m_softening_squared = softening * softening;
+   m_capacity = capacity;
+   m_count = 0;
+   m_accelerations_valid = false;
+
+   return true;
+}
+
+void nbody_system_t::destroy()
+{
+   for (auto *array : { &m_x, &m_y, &m_z, &m_vx, &m_vy, &m_vz, &m_ax, &m_ay, &m_az, &m_gm, &m_size }) {
+      array->clear();
+      array->shrink_to_fit();
+   }
+
+   m_count = 0;
+   m_capacity = 0;
+   m_accelerations_valid = false;
+}
+
+uint32_t nbody_system_t::add(const float position[3], const float velocity[3], const float gm, const float size)
+{
+   if (m_count >= m_capacity) {
+      return ~0u;
+   }
+
+   const uint32_t index = m_count++;
+   m_x[index] = position[0];
+   m_y[index] = position[1];
+   m_z[index] = position[2];
+   m_vx[index] = velocity[0];
+   m_vy[index] = velocity[1];
+   m_vz[index] = velocity[2];
+   m_gm[index] = gm;
+   m_size[index] = size;
+   m_accelerations_valid = false;
+
+   return index;
+}
+
+void nbody_system_t::compute_accelerations(const uint32_t begin, const uint32_t end)
+{
+   const orbit_kernels::nbody_arrays_t arrays =
+   {
+      m_x.data(), m_y.data(), m_z.data(),
+      m_gm.data(),
+      m_ax.data(), m_ay.data(), m_az.data(),
+      padded(m_count),
+      m_central_gm,
+      m_softening_squared,
+   };
+
+   orbit_kernels::selected().m_accelerations(arrays, begin, end);
+}
+
+void nbody_system_t::step(const float dt)
+{
+   profile_scope("nbody_system_t::step");
+
+   auto accelerate = [this] {
+      job_system_t::parallel_for(m_count, min_nbody_rows_per_batch, [this](const uint32_t begin, const uint32_t end) {
+         compute_accelerations(begin, end);
+      });
+   };
+
+   // note: the accelerations of the last step are those at the current positions
+   if (!m_accelerations_valid) {
+      accelerate();
+      m_accelerations_valid = true;
+   }
+
+   const float half_dt = dt * 0.5f;
+   for (uint32_t body = 0; body < m_count; body++) {
+      m_vx[body] += m_ax[body] * half_dt;
+      m_vy[body] += m_ay[body] * half_dt;
+      m_vz[body] += m_az[body] * half_dt;
+      m_x[body] += m_vx[body] * dt;
+      m_y[body] += m_vy[body] * dt;
+      m_z[body] += m_vz[body] * dt;
+   }
+
+   accelerate();
+
+   for (uint32_t body = 0; body < m_count; body++) {
+      m_vx[body] += m_ax[body] * half_dt;
+      m_vy[body] += m_ay[body] * half_dt;
+      m_vz[body] += m_az[body] * half_dt;
+   }
+}
+
+void nbody_system_t::write_instances(const float offset, float *output) const
+{
+   for (uint32_t body = 0; body < m_count; body++) {
+      output[body * 4 + 0] = m_x[body] + m_vx[body] * offset;
+      output[body * 4 + 1] = m_y[body] + m_vy[body] * offset;
+      output[body * 4 + 2] = m_z[body] + m_vz[body] * offset;
+      output[body * 4 + 3] = m_size[body];
+   }
+}
@@ -0,0 +1,13 @@
+// orbits_avx2.cpp
+
+// note: built with /arch:AVX2 (-mavx2) and only ever called once cpuid said
+//       so, without the flags the kernels are left out and the baseline runs
+#include "orbits_kernels.hpp"
+
+#if defined(__AVX2__)
+#include "orbits_lanes.hpp"
+
+const orbit_kernels::kernels_t orbit_kernels::avx2 = { lane_name, lane_width, &evaluate_lanes, &accelerations_lanes };
+#else
+const orbit_kernels::kernels_t orbit_kernels::avx2 = { "avx2", 8, nullptr, nullptr };
+#endif
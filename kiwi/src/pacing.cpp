@@ -0,0 +1,187 @@
+// pacing.cpp
+
+#include "pacing.hpp"
+
+#include <cmath>
+#include <thread>
+#include <chrono>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+// note: frame deltas above this are treated as a hitch (debugger, window drag) and clamped
+static const timespan_t max_frame_delta = timespan_t::from_milliseconds(250.0);
+
+frame_pacer_t::~frame_pacer_t()
+{
+#if defined(_WIN32)
+   if (m_timer_resolution_raised) {
+      timeEndPeriod(1);
+   }
+#endif
+}
+
+void frame_pacer_t::set_fixed_timestep(const timespan_t &timestep)
+{
+   m_timestep = timestep;
+}
+
+void frame_pacer_t::set_target_frame_rate(const float frames_per_second)
+{
+   m_target_period = frames_per_second > 0.0f ? timespan_t::from_seconds(1.0 / frames_per_second) : timespan_t{};
+   m_next_deadline = timespan_t{};
+
+#if defined(_WIN32)
+   // note: default scheduler granularity is ~15.6ms, far too coarse for a limiter
+   if (frames_per_second > 0.0f && !m_timer_resolution_raised) {
+      m_timer_resolution_raised = timeBeginPeriod(1) == TIMERR_NOERROR;
+   }
+#endif
+}
+
+void frame_pacer_t::begin_frame(const timespan_t &now)
+{
+   if (m_first_frame) {
+      m_first_frame = false;
+      m_last_frame = now;
+      m_accumulator = m_timestep;
+      return;
+   }
+
+   timespan_t delta = now - m_last_frame;
+   m_last_frame = now;
+   if (delta > max_frame_delta) {
+      delta = max_frame_delta;
+   }
+
+   m_accumulator += delta;
+}
+
+bool frame_pacer_t::step()
+{
+   if (m_accumulator < m_timestep) {
+      return false;
+   }
+
+   // note: spiral of death, drop simulation time we can not catch up with
+   if (m_accumulator > m_timestep * float(max_steps_per_frame)) {
+      m_accumulator = m_timestep * float(max_steps_per_frame);
+   }
+
+   m_accumulator -= m_timestep;
+   m_simulation_time += m_timestep;
+
+   return true;
+}
+
+float frame_pacer_t::alpha() const
+{
+   const float value = float(double(m_accumulator.m_duration) / double(m_timestep.m_duration));
+   return value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+}
+
+const timespan_t &frame_pacer_t::timestep() const
+{
+   return m_timestep;
+}
+
+const timespan_t &frame_pacer_t::simulation_time() const
+{
+   return m_simulation_time;
+}
+
+void frame_pacer_t::precise_sleep_until(const timespan_t &deadline)
+{
+   // note: sleep in 1ms slices while the remaining time comfortably exceeds the
+   //       pessimistic sleep estimate (mean + stddev), then spin the rest
+   for (;;) {
+      const timespan_t now = watch_t::time_since_start();
+      const double remaining_ms = (deadline - now).elapsed_milliseonds();
+      const double stddev = std::sqrt(m_sleep_m2 / double(m_sleep_count > 1 ? m_sleep_count - 1 : 1));
+      if (remaining_ms <= m_sleep_mean_ms + stddev) {
+         break;
+      }
+
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+      const double observed_ms = (watch_t::time_since_start() - now).elapsed_milliseonds();
+      m_sleep_count++;
+      const double delta = observed_ms - m_sleep_mean_ms;
+      m_sleep_mean_ms += delta / double(m_sleep_count);
+      m_sleep_m2 += delta * (observed_ms - m_sleep_mean_ms);
+
+      // note: forget old samples slowly so the estimate follows system load
+      if (m_sleep_count > 1000) {
+         m_sleep_count = 500;
+         m_sleep_m2 *= 0.5;
+      }
+   }
+
+   while (watch_t::time_since_start() < deadline) {
+      std::this_thread::yield();
+   }
+}
+
+void frame_pacer_t::limit()
+{
+   if (m_target_period == timespan_t{}) {
+      return;
+   }
+
+   // note: deadlines advance by whole periods so the error does not accumulate,
+   //       resync when we fell behind by more than a frame
+   const timespan_t now = watch_t::time_since_start();
+   if (m_next_deadline == timespan_t{} || now - m_next_deadline > m_target_period) {
+      m_next_deadline = now;
+   }
+
+   precise_sleep_until(m_next_deadline);
+   m_next_deadline += m_target_period;
+}
+
+void frame_pacer_t::on_present(const timespan_t &now)
+{
+   if (m_last_present != timespan_t{}) {
+      m_present_intervals[m_present_count % history_size] = (now - m_last_present).elapsed_milliseonds();
+      m_present_count++;
+   }
+
+   m_last_present = now;
+}
+
+frame_stats_t frame_pacer_t::stats() const
+{
+   frame_stats_t stats;
+
+   const int count = m_present_count < history_size ? m_present_count : history_size;
+   if (count == 0) {
+      return stats;
+   }
+
+   double sum = 0.0;
+   stats.m_min_ms = m_present_intervals[0];
+   stats.m_max_ms = m_present_intervals[0];
+   for (int index = 0; index < count; index++) {
+      const float interval = m_present_intervals[index];
+      sum += interval;
+      stats.m_min_ms = interval < stats.m_min_ms ? interval : stats.m_min_ms;
+      stats.m_max_ms = interval > stats.m_max_ms ? interval : stats.m_max_ms;
+   }
+
+   const double mean = sum / count;
+   double variance = 0.0;
+   for (int index = 0; index < count; index++) {
+      const double difference = m_present_intervals[index] - mean;
+      variance += difference * difference;
+   }
+
+   stats.m_average_ms = float(mean);
+   stats.m_jitter_ms = float(std::sqrt(variance / count));
+
+   return stats;
+}
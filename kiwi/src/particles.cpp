@@ -0,0 +1,128 @@
+// particles.cpp
+
+#include "particles.hpp"
+#include "shader.hpp"
+#include "system.hpp"
+#include "profiler.hpp"
+
+#include <vector>
+
+static_assert(sizeof(particle_system_t::state_t) == sizeof(float) * 8, "particle state is captured as two vec4s!");
+
+namespace
+{
+   // note: must match the outputs of the update pass in particles.vs.glsl
+   constexpr const char *feedback_varyings[] =
+   {
+      "v_position_age",
+      "v_velocity_life",
+   };
+
+   constexpr float max_step = 0.1f;
+} // !anonymous
+
+bool particle_system_t::create(shader_library_t &shaders, const uint32_t count, const particle_emitter_t &emitter)
+{
+   destroy();
+
+   m_update_program = &shaders.request("assets/particles.vs.glsl", "assets/particles.fs.glsl", { "UPDATE" }, feedback_varyings);
+   m_draw_program = &shaders.request("assets/particles.vs.glsl", "assets/particles.fs.glsl");
+   m_emitter = emitter;
+   if (count == 0) {
+      return true;
+   }
+
+   // note: zero life means never alive, the first update spawns every particle
+   //       part way through a life so they do not all start out as one shell
+   const std::vector<state_t> initial(count, state_t{ glm::vec4(0.0f), glm::vec4(0.0f) });
+   const size_t size = sizeof(state_t) * count;
+   for (auto &state : m_state) {
+      if (!state.create(size, initial.data(), vertex_buffer_t::usage_hint_t::gpu_written)) {
+         destroy();
+         return false;
+      }
+   }
+
+   // note: two triangles, corners in [-1, 1]
+   const glm::vec2 corners[] =
+   {
+      { -1.0f, -1.0f }, {  1.0f, -1.0f }, {  1.0f,  1.0f },
+      {  1.0f,  1.0f }, { -1.0f,  1.0f }, { -1.0f, -1.0f },
+   };
+
+   if (!m_quad.create(sizeof(corners), corners)) {
+      destroy();
+      return false;
+   }
+
+   m_update_layout
+      .clear()
+      .add(attribute_type_t::float_, 4, false)
+      .add(attribute_type_t::float_, 4, false);
+
+   m_instance_layout
+      .clear()
+      .per_instance(1)
+      .add(attribute_type_t::float_, 4, false)
+      .add(attribute_type_t::float_, 4, false);
+
+   m_quad_layout
+      .clear()
+      .add(attribute_type_t::float_, 2, false);
+
+   m_count = count;
+   m_current = 0;
+
+   return true;
+}
+
+void particle_system_t::destroy()
+{
+   for (auto &state : m_state) {
+      state.destroy();
+   }
+
+   m_quad.destroy();
+   m_update_program = nullptr;
+   m_draw_program = nullptr;
+   m_count = 0;
+   m_current = 0;
+}
+
+void particle_system_t::update(renderer_t &renderer, const float dt, const float time)
+{
+   profile_scope("particle_system_t::update");
+
+   if (m_count == 0 || !m_update_program || !m_update_program->valid()) {
+      return;
+   }
+
+   const float step = dt < 0.0f ? 0.0f : (dt > max_step ? max_step : dt);
+   const uint32_t next = m_current ^ 1;
+
+   renderer.set_shader_program(*m_update_program);
+   renderer.set_uniform("u_simulation", glm::vec4(step, time, m_emitter.m_gm, m_emitter.m_radius));
+   renderer.set_uniform("u_emitter", glm::vec4(m_emitter.m_min_speed, m_emitter.m_max_speed, m_emitter.m_min_life, m_emitter.m_max_life));
+   renderer.set_vertex_buffer_and_layout(m_state[m_current], m_update_layout);
+   renderer.begin_transform_feedback(m_state[next], topology_t::point_list);
+   renderer.draw(topology_t::point_list, 0, int(m_count));
+   renderer.end_transform_feedback();
+
+   m_current = next;
+}
+
+void particle_system_t::draw(renderer_t &renderer, const glm::mat4 &projection, const glm::mat4 &view, const glm::mat4 &world)
+{
+   if (m_count == 0 || !m_draw_program || !m_draw_program->valid()) {
+      return;
+   }
+
+   renderer.set_shader_program(*m_draw_program);
+   renderer.set_uniform("u_projection", projection);
+   renderer.set_uniform("u_view", view);
+   renderer.set_uniform("u_world", world);
+   renderer.set_uniform("u_sprite", glm::vec4(m_emitter.m_size, 0.0f, 0.0f, 0.0f));
+   renderer.set_vertex_buffer_and_layout(m_quad, m_quad_layout);
+   renderer.set_vertex_buffer_and_layout(m_state[m_current], m_instance_layout);
+   renderer.draw_instanced(topology_t::triangle_list, 0, 6, int(m_count));
+}
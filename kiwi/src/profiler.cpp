@@ -0,0 +1,196 @@
+// profiler.cpp
+
+#include "profiler.hpp"
+#include "system.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdio>
+
+namespace
+{
+   struct profile_event_t {
+      const char *m_name;
+      uint64_t    m_begin;
+      uint64_t    m_end;
+   };
+
+   struct collected_event_t {
+      profile_event_t m_event;
+      uint32_t        m_thread_id;
+   };
+
+   // note: single producer (owning thread), single consumer (collect)
+   struct profile_buffer_t {
+      static constexpr uint32_t capacity = 1 << 14;
+      static constexpr uint32_t mask = capacity - 1;
+
+      std::atomic<uint32_t> m_head = 0;
+      std::atomic<uint32_t> m_tail = 0;
+      std::atomic<uint32_t> m_dropped = 0;
+      uint32_t              m_cached_tail = 0;
+      uint32_t              m_thread_id = 0;
+      char                  m_thread_name[64] = {};
+      profile_event_t       m_events[capacity];
+   };
+
+   // note: caps memory when the application runs for a long time
+   constexpr size_t max_collected_events = 1 << 20;
+
+   struct profiler_state_t {
+      std::mutex                                     m_mutex;
+      std::vector<std::unique_ptr<profile_buffer_t>> m_buffers;
+      std::vector<collected_event_t>                 m_events;
+      uint64_t                                       m_dropped = 0;
+      uint64_t                                       m_start_ticks = profiler::now();
+      std::chrono::steady_clock::time_point          m_start_time = std::chrono::steady_clock::now();
+   };
+
+   profiler_state_t &state()
+   {
+      static profiler_state_t ms_state;
+      return ms_state;
+   }
+
+   thread_local profile_buffer_t *tls_buffer = nullptr;
+
+   profile_buffer_t *register_thread()
+   {
+      auto &profiler = state();
+      std::lock_guard<std::mutex> lock(profiler.m_mutex);
+
+      auto buffer = std::make_unique<profile_buffer_t>();
+      buffer->m_thread_id = uint32_t(profiler.m_buffers.size() + 1);
+      snprintf(buffer->m_thread_name, sizeof(buffer->m_thread_name), "thread %u", buffer->m_thread_id);
+
+      tls_buffer = buffer.get();
+      profiler.m_buffers.push_back(std::move(buffer));
+
+      return tls_buffer;
+   }
+
+   void append_escaped(std::string &content, const char *text)
+   {
+      for (const char *at = text; *at; at++) {
+         if (*at == '"' || *at == '\\') {
+            content += '\\';
+         }
+         content += *at;
+      }
+   }
+} // !anonymous
+
+namespace profiler
+{
+   void record(const char *name, const uint64_t begin, const uint64_t end)
+   {
+      profile_buffer_t *buffer = tls_buffer ? tls_buffer : register_thread();
+
+      // note: only look at the consumer side when the ring appears full
+      const uint32_t head = buffer->m_head.load(std::memory_order_relaxed);
+      if (head - buffer->m_cached_tail >= profile_buffer_t::capacity) {
+         buffer->m_cached_tail = buffer->m_tail.load(std::memory_order_acquire);
+         if (head - buffer->m_cached_tail >= profile_buffer_t::capacity) {
+            buffer->m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+         }
+      }
+
+      buffer->m_events[head & profile_buffer_t::mask] = profile_event_t{ name, begin, end };
+      buffer->m_head.store(head + 1, std::memory_order_release);
+   }
+
+   void set_thread_name(const char *name)
+   {
+      profile_buffer_t *buffer = tls_buffer ? tls_buffer : register_thread();
+
+      std::lock_guard<std::mutex> lock(state().m_mutex);
+      snprintf(buffer->m_thread_name, sizeof(buffer->m_thread_name), "%s", name);
+   }
+
+   void collect()
+   {
+      auto &profiler = state();
+      std::lock_guard<std::mutex> lock(profiler.m_mutex);
+
+      // note: reserved once up front so collecting never reallocates mid-run,
+      //       untouched pages of the reservation are never committed
+      if (profiler.m_events.capacity() == 0) {
+         profiler.m_events.reserve(max_collected_events);
+      }
+
+      for (auto &buffer : profiler.m_buffers) {
+         const uint32_t head = buffer->m_head.load(std::memory_order_acquire);
+         uint32_t tail = buffer->m_tail.load(std::memory_order_relaxed);
+         for (; tail != head; tail++) {
+            if (profiler.m_events.size() >= max_collected_events) {
+               profiler.m_dropped++;
+               continue;
+            }
+
+            profiler.m_events.push_back({ buffer->m_events[tail & profile_buffer_t::mask], buffer->m_thread_id });
+         }
+
+         buffer->m_tail.store(tail, std::memory_order_release);
+         profiler.m_dropped += buffer->m_dropped.exchange(0, std::memory_order_relaxed);
+      }
+   }
+
+   bool save_chrome_trace(const std::string_view &filename)
+   {
+      collect();
+
+      auto &profiler = state();
+      std::lock_guard<std::mutex> lock(profiler.m_mutex);
+
+      // note: calibrate ticks against the steady clock over the whole run
+      const uint64_t ticks = now() - profiler.m_start_ticks;
+      const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - profiler.m_start_time).count();
+      const double ticks_per_microsecond = seconds > 0.0 ? (ticks / seconds) / 1000000.0 : 1.0;
+
+      std::string content;
+      content.reserve(profiler.m_events.size() * 96 + 1024);
+      content += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+      char line[256];
+      bool first = true;
+      for (auto &buffer : profiler.m_buffers) {
+         snprintf(line, sizeof(line), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"",
+                  first ? "" : ",\n",
+                  buffer->m_thread_id);
+         content += line;
+         append_escaped(content, buffer->m_thread_name);
+         content += "\"}}";
+         first = false;
+      }
+
+      for (auto &collected : profiler.m_events) {
+         const profile_event_t &event = collected.m_event;
+         const double timestamp = double(int64_t(event.m_begin - profiler.m_start_ticks)) / ticks_per_microsecond;
+         const double duration = double(event.m_end - event.m_begin) / ticks_per_microsecond;
+
+         content += first ? "{\"name\":\"" : ",\n{\"name\":\"";
+         append_escaped(content, event.m_name);
+         snprintf(line, sizeof(line), "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                  collected.m_thread_id,
+                  timestamp,
+                  duration);
+         content += line;
+         first = false;
+      }
+
+      content += "\n]}\n";
+
+      if (profiler.m_dropped > 0) {
+         debug::warn("profiler dropped %llu events", (unsigned long long)profiler.m_dropped);
+      }
+
+      debug::info("profiler: %zu events written to '%s'", profiler.m_events.size(), filename);
+
+      return file_system_t::save_content(filename, content);
+   }
+} // !profiler
@@ -0,0 +1,261 @@
+// resources.cpp
+
+#include "resources.hpp"
+#include "system.hpp"
+
+namespace
+{
+   // note: releases are appended in frame order, the queue is retired from the front
+   template <typename T>
+   void
+   collect_retired(std::vector<resource_manager_t::retired_t<T>> &retired,
+                   const int64_t completed_frame,
+                   std::vector<T> *recycled,
+                   const uint32_t max_recycled,
+                   uint64_t &destroyed)
+   {
+      size_t count = 0;
+      while (count < retired.size() && retired[count].m_frame <= completed_frame) {
+         T &resource = retired[count].m_resource;
+         if (recycled && recycled->size() < max_recycled) {
+            recycled->push_back(resource);
+         }
+         else {
+            resource.destroy();
+            destroyed++;
+         }
+         count++;
+      }
+
+      retired.erase(retired.begin(), retired.begin() + count);
+   }
+
+   template <typename T>
+   void
+   destroy_all(std::vector<T> &resources)
+   {
+      for (T &resource : resources) {
+         resource.destroy();
+      }
+      resources.clear();
+   }
+
+   template <typename T>
+   void
+   destroy_all(std::vector<resource_manager_t::retired_t<T>> &retired)
+   {
+      for (auto &entry : retired) {
+         entry.m_resource.destroy();
+      }
+      retired.clear();
+   }
+} // !anonymous
+
+bool resource_manager_t::create(const desc_t &desc)
+{
+   bool success = true;
+   success &= m_textures.create(desc.m_max_textures);
+   success &= m_samplers.create(desc.m_max_samplers);
+   success &= m_vertex_buffers.create(desc.m_max_vertex_buffers);
+   if (!success) {
+      debug::error("resource_manager_t: invalid capacity - textures: %u samplers: %u vertex buffers: %u",
+                   desc.m_max_textures,
+                   desc.m_max_samplers,
+                   desc.m_max_vertex_buffers);
+      destroy();
+      return false;
+   }
+
+   // note: sized for one release per pool slot in flight, the queues are not
+   //       bounded though, a released slot is reused right away so heavy churn
+   //       within the fence latency grows them past this (and allocates)
+   m_retired_textures.reserve(desc.m_max_textures);
+   m_retired_samplers.reserve(desc.m_max_samplers);
+   m_retired_vertex_buffers.reserve(desc.m_max_vertex_buffers);
+   m_recycled_textures.reserve(desc.m_max_recycled);
+   m_recycled_vertex_buffers.reserve(desc.m_max_recycled);
+   m_max_recycled = desc.m_max_recycled;
+
+   return true;
+}
+
+void resource_manager_t::destroy()
+{
+   // note: only on shutdown, after the last frame, nothing waits for the gpu here
+   destroy_all(m_retired_textures);
+   destroy_all(m_retired_samplers);
+   destroy_all(m_retired_vertex_buffers);
+   destroy_all(m_recycled_textures);
+   destroy_all(m_recycled_vertex_buffers);
+
+   m_textures.destroy();
+   m_samplers.destroy();
+   m_vertex_buffers.destroy();
+}
+
+void resource_manager_t::begin_frame(const int64_t frame, const int64_t completed_frame)
+{
+   m_frame = frame;
+
+   collect_retired(m_retired_textures, completed_frame, &m_recycled_textures, m_max_recycled, m_destroyed);
+   collect_retired<sampler_state_t>(m_retired_samplers, completed_frame, nullptr, 0, m_destroyed);
+   collect_retired(m_retired_vertex_buffers, completed_frame, &m_recycled_vertex_buffers, m_max_recycled, m_destroyed);
+}
+
+texture_handle_t resource_manager_t::create_texture(const int width,
+                                                    const int height,
+                                                    const void *data,
+                                                    const texture_t::pixel_format_t format,
+                                                    const bool mipmap)
+{
+   for (size_t index = 0; index < m_recycled_textures.size(); index++) {
+      texture_t texture = m_recycled_textures[index];
+      if (texture.m_type != texture_t::type_t::texture_2d ||
+          texture.m_width != width ||
+          texture.m_height != height ||
+          texture.m_format != format ||
+          (texture.m_levels > 1) != mipmap) {
+         continue;
+      }
+
+      m_recycled_textures[index] = m_recycled_textures.back();
+      m_recycled_textures.pop_back();
+
+      // note: without data the contents are undefined, same as a fresh texture
+      const bool updated = data == nullptr || texture.update(data);
+      const texture_handle_t handle = updated ? m_textures.insert(texture) : texture_handle_t{};
+      if (!handle.valid()) {
+         texture.destroy();
+         m_destroyed++;
+         return {};
+      }
+
+      m_reused++;
+      return handle;
+   }
+
+   const texture_handle_t handle = m_textures.allocate();
+   if (!handle.valid() || !get(handle).create(width, height, data, format, mipmap)) {
+      m_textures.release(handle);
+      return {};
+   }
+
+   return handle;
+}
+
+texture_handle_t resource_manager_t::create_cube_texture(const int size,
+                                                         const void *const faces[cubemap_image_t::face_count],
+                                                         const texture_t::pixel_format_t format,
+                                                         const bool mipmap)
+{
+   for (size_t index = 0; index < m_recycled_textures.size(); index++) {
+      texture_t texture = m_recycled_textures[index];
+      if (texture.m_type != texture_t::type_t::cube ||
+          texture.m_width != size ||
+          texture.m_format != format ||
+          (texture.m_levels > 1) != mipmap) {
+         continue;
+      }
+
+      m_recycled_textures[index] = m_recycled_textures.back();
+      m_recycled_textures.pop_back();
+
+      const texture_handle_t handle = texture.update_cube(faces) ? m_textures.insert(texture) : texture_handle_t{};
+      if (!handle.valid()) {
+         texture.destroy();
+         m_destroyed++;
+         return {};
+      }
+
+      m_reused++;
+      return handle;
+   }
+
+   const texture_handle_t handle = m_textures.allocate();
+   if (!handle.valid() || !get(handle).create_cube(size, faces, format, mipmap)) {
+      m_textures.release(handle);
+      return {};
+   }
+
+   return handle;
+}
+
+vertex_buffer_handle_t resource_manager_t::create_vertex_buffer(const size_t size,
+                                                                const void *data,
+                                                                const vertex_buffer_t::usage_hint_t usage)
+{
+   for (size_t index = 0; index < m_recycled_vertex_buffers.size(); index++) {
+      vertex_buffer_t buffer = m_recycled_vertex_buffers[index];
+      if (buffer.m_size != size || buffer.m_usage != usage) {
+         continue;
+      }
+
+      m_recycled_vertex_buffers[index] = m_recycled_vertex_buffers.back();
+      m_recycled_vertex_buffers.pop_back();
+
+      const bool updated = data == nullptr || buffer.update(data, size);
+      const vertex_buffer_handle_t handle = updated ? m_vertex_buffers.insert(buffer) : vertex_buffer_handle_t{};
+      if (!handle.valid()) {
+         buffer.destroy();
+         m_destroyed++;
+         return {};
+      }
+
+      m_reused++;
+      return handle;
+   }
+
+   const vertex_buffer_handle_t handle = m_vertex_buffers.allocate();
+   if (!handle.valid() || !get(handle).create(size, data, usage)) {
+      m_vertex_buffers.release(handle);
+      return {};
+   }
+
+   return handle;
+}
+
+void resource_manager_t::release(const texture_handle_t handle)
+{
+   retired_t<texture_t> entry;
+   if (m_textures.remove(handle, entry.m_resource)) {
+      entry.m_frame = m_frame;
+      m_retired_textures.push_back(entry);
+   }
+}
+
+void resource_manager_t::release(const sampler_handle_t handle)
+{
+   retired_t<sampler_state_t> entry;
+   if (m_samplers.remove(handle, entry.m_resource)) {
+      entry.m_frame = m_frame;
+      m_retired_samplers.push_back(entry);
+   }
+}
+
+void resource_manager_t::release(const vertex_buffer_handle_t handle)
+{
+   retired_t<vertex_buffer_t> entry;
+   if (m_vertex_buffers.remove(handle, entry.m_resource)) {
+      entry.m_frame = m_frame;
+      m_retired_vertex_buffers.push_back(entry);
+   }
+}
+
+resource_stats_t resource_manager_t::stats() const
+{
+   resource_stats_t stats;
+   stats.m_textures = m_textures.count();
+   stats.m_samplers = m_samplers.count();
+   stats.m_vertex_buffers = m_vertex_buffers.count();
+   stats.m_retired = uint32_t(m_retired_textures.size() + m_retired_samplers.size() + m_retired_vertex_buffers.size());
+   stats.m_recycled = uint32_t(m_recycled_textures.size() + m_recycled_vertex_buffers.size());
+   stats.m_reused = m_reused;
+   stats.m_destroyed = m_destroyed;
+
+   for (const texture_t &texture : m_textures) {
+      const uint64_t faces = texture.m_type == texture_t::type_t::cube ? cubemap_image_t::face_count : 1;
+      stats.m_texels += uint64_t(texture.m_width) * uint64_t(texture.m_height) * faces;
+   }
+
+   return stats;
+}
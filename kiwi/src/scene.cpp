@@ -0,0 +1,226 @@
+// scene.cpp
+
+#include "scene.hpp"
+#include "jobs.hpp"
+
+#include <atomic>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define KIWI_SCENE_SSE 1
+#include <xmmintrin.h>
+#else
+#define KIWI_SCENE_SSE 0
+#endif
+
+static void
+multiply_matrix(const glm::mat4 &lhs, const glm::mat4 &rhs, glm::mat4 &result)
+{
+#if KIWI_SCENE_SSE
+   // note: column-major, each result column is a linear combination of the lhs columns
+   const float *a = &lhs[0][0];
+   const __m128 a0 = _mm_loadu_ps(a + 0);
+   const __m128 a1 = _mm_loadu_ps(a + 4);
+   const __m128 a2 = _mm_loadu_ps(a + 8);
+   const __m128 a3 = _mm_loadu_ps(a + 12);
+
+   for (int column = 0; column < 4; column++) {
+      const float *b = &rhs[column][0];
+      __m128 r = _mm_mul_ps(a0, _mm_set1_ps(b[0]));
+      r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(b[1])));
+      r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(b[2])));
+      r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(b[3])));
+      _mm_storeu_ps(&result[column][0], r);
+   }
+#else
+   result = lhs * rhs;
+#endif
+}
+
+static glm::mat4
+compose_matrix(const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale)
+{
+   // note: translation * rotation * scale without going through three full matrix multiplies
+   const glm::mat3 basis = glm::mat3_cast(rotation);
+
+   glm::mat4 result;
+   result[0] = glm::vec4(basis[0] * scale.x, 0.0f);
+   result[1] = glm::vec4(basis[1] * scale.y, 0.0f);
+   result[2] = glm::vec4(basis[2] * scale.z, 0.0f);
+   result[3] = glm::vec4(position, 1.0f);
+   return result;
+}
+
+void scene_graph_t::clear()
+{
+   m_parent.clear();
+   m_depth.clear();
+   m_dirty.clear();
+   m_position.clear();
+   m_rotation.clear();
+   m_scale.clear();
+   m_world.clear();
+   m_level_order.clear();
+   m_level_offsets.clear();
+   m_levels_dirty = false;
+   m_first_dirty = invalid_node;
+}
+
+void scene_graph_t::reserve(const uint32_t capacity)
+{
+   m_parent.reserve(capacity);
+   m_depth.reserve(capacity);
+   m_dirty.reserve(capacity);
+   m_position.reserve(capacity);
+   m_rotation.reserve(capacity);
+   m_scale.reserve(capacity);
+   m_world.reserve(capacity);
+   m_level_order.reserve(capacity);
+}
+
+uint32_t scene_graph_t::add_node(const uint32_t parent)
+{
+   const uint32_t node = count();
+   assert(parent == invalid_node || parent < node);
+
+   m_parent.push_back(parent);
+   m_depth.push_back(parent == invalid_node ? 0 : m_depth[parent] + 1);
+   m_dirty.push_back(1);
+   m_position.emplace_back(0.0f);
+   m_rotation.emplace_back(1.0f, 0.0f, 0.0f, 0.0f);
+   m_scale.emplace_back(1.0f);
+   m_world.emplace_back(1.0f);
+
+   m_levels_dirty = true;
+   m_first_dirty = node < m_first_dirty ? node : m_first_dirty;
+
+   return node;
+}
+
+uint32_t scene_graph_t::count() const
+{
+   return uint32_t(m_parent.size());
+}
+
+void scene_graph_t::set_position(const uint32_t node, const glm::vec3 &position)
+{
+   m_position[node] = position;
+   m_dirty[node] = 1;
+   m_first_dirty = node < m_first_dirty ? node : m_first_dirty;
+}
+
+void scene_graph_t::set_rotation(const uint32_t node, const glm::quat &rotation)
+{
+   m_rotation[node] = rotation;
+   m_dirty[node] = 1;
+   m_first_dirty = node < m_first_dirty ? node : m_first_dirty;
+}
+
+void scene_graph_t::set_scale(const uint32_t node, const glm::vec3 &scale)
+{
+   m_scale[node] = scale;
+   m_dirty[node] = 1;
+   m_first_dirty = node < m_first_dirty ? node : m_first_dirty;
+}
+
+const glm::mat4 &scene_graph_t::world(const uint32_t node) const
+{
+   return m_world[node];
+}
+
+bool scene_graph_t::update_node(const uint32_t node)
+{
+   // note: parents are always processed before their children,
+   //       so a dirty parent has already marked its subtree by now
+   const uint32_t parent = m_parent[node];
+   if (parent != invalid_node && m_dirty[parent]) {
+      m_dirty[node] = 1;
+   }
+
+   if (!m_dirty[node]) {
+      return false;
+   }
+
+   const glm::mat4 local = compose_matrix(m_position[node], m_rotation[node], m_scale[node]);
+   if (parent == invalid_node) {
+      m_world[node] = local;
+   }
+   else {
+      multiply_matrix(m_world[parent], local, m_world[node]);
+   }
+
+   return true;
+}
+
+void scene_graph_t::build_levels()
+{
+   // note: counting sort by depth, keeps index order within each level
+   uint32_t level_count = 0;
+   for (const uint32_t depth : m_depth) {
+      level_count = depth + 1 > level_count ? depth + 1 : level_count;
+   }
+
+   m_level_offsets.assign(level_count + 1, 0);
+   for (const uint32_t depth : m_depth) {
+      m_level_offsets[depth + 1]++;
+   }
+
+   for (uint32_t level = 0; level < level_count; level++) {
+      m_level_offsets[level + 1] += m_level_offsets[level];
+   }
+
+   std::vector<uint32_t> cursor(m_level_offsets.begin(), m_level_offsets.end() - 1);
+   m_level_order.resize(m_depth.size());
+   for (uint32_t node = 0; node < count(); node++) {
+      m_level_order[cursor[m_depth[node]]++] = node;
+   }
+
+   m_levels_dirty = false;
+}
+
+uint32_t scene_graph_t::update(const bool parallel)
+{
+   if (m_first_dirty == invalid_node) {
+      return 0;
+   }
+
+   uint32_t updated = 0;
+   if (!parallel) {
+      for (uint32_t node = m_first_dirty; node < count(); node++) {
+         updated += update_node(node) ? 1 : 0;
+      }
+   }
+   else {
+      if (m_levels_dirty) {
+         build_levels();
+      }
+
+      // note: nodes within one level never depend on each other,
+      //       small levels are not worth splitting into jobs, each level
+      //       is in index order so the clean nodes up front are skipped
+      constexpr uint32_t min_nodes_per_batch = 1024;
+      std::atomic<uint32_t> counter = 0;
+      for (size_t level = 0; level + 1 < m_level_offsets.size(); level++) {
+         const auto level_end = m_level_order.begin() + m_level_offsets[level + 1];
+         const auto first = std::lower_bound(m_level_order.begin() + m_level_offsets[level], level_end, m_first_dirty);
+         const uint32_t offset = uint32_t(first - m_level_order.begin());
+         const uint32_t level_size = uint32_t(level_end - first);
+         job_system_t::parallel_for(level_size, min_nodes_per_batch, [&](const uint32_t begin, const uint32_t end) {
+            uint32_t local_updated = 0;
+            for (uint32_t index = begin; index < end; index++) {
+               local_updated += update_node(m_level_order[offset + index]) ? 1 : 0;
+            }
+            counter += local_updated;
+         });
+      }
+
+      updated = counter;
+   }
+
+   std::memset(m_dirty.data() + m_first_dirty, 0, m_dirty.size() - m_first_dirty);
+   m_first_dirty = invalid_node;
+
+   return updated;
+}
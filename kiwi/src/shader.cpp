@@ -0,0 +1,301 @@
+// shader.cpp
+
+#include "shader.hpp"
+#include "system.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+shader_defines_t::shader_defines_t(std::initializer_list<std::string_view> names)
+{
+   for (const auto &name : names) {
+      set(name);
+   }
+}
+
+shader_defines_t &shader_defines_t::set(const std::string_view &name, const std::string_view &value)
+{
+   auto it = std::lower_bound(m_defines.begin(), m_defines.end(), name, [](const auto &define, const std::string_view &rhs) {
+      return define.first < rhs;
+   });
+
+   if (it != m_defines.end() && it->first == name) {
+      it->second = value;
+   }
+   else {
+      m_defines.emplace(it, std::string(name), std::string(value));
+   }
+
+   return *this;
+}
+
+bool shader_defines_t::has(const std::string_view &name) const
+{
+   for (const auto &define : m_defines) {
+      if (define.first == name) {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+uint64_t shader_defines_t::key() const
+{
+   uint64_t key = fnv1a64(nullptr, 0);
+   for (const auto &[name, value] : m_defines) {
+      key = fnv1a64(name.c_str(), name.size() + 1, key);
+      key = fnv1a64(value.c_str(), value.size() + 1, key);
+   }
+
+   return key;
+}
+
+std::string shader_defines_t::to_string() const
+{
+   std::string result;
+   for (const auto &[name, value] : m_defines) {
+      result += "#define ";
+      result += name;
+      result += " ";
+      result += value;
+      result += "\n";
+   }
+
+   return result;
+}
+
+namespace
+{
+   constexpr int max_include_depth = 16;
+
+   struct preprocess_state_t {
+      const shader_defines_t   &m_defines;
+      std::string              &m_output;
+      std::vector<std::string>  m_files;
+   };
+
+   std::string_view trim_left(const std::string_view &text)
+   {
+      const size_t first = text.find_first_not_of(" \t");
+      return first == std::string_view::npos ? std::string_view{} : text.substr(first);
+   }
+
+   std::string directory_of(const std::string_view &path)
+   {
+      const size_t separator = path.find_last_of("/\\");
+      return separator == std::string_view::npos ? std::string{} : std::string(path.substr(0, separator + 1));
+   }
+
+   void append_line_directive(std::string &output, const int line, const int file)
+   {
+      output += "#line ";
+      output += std::to_string(line);
+      output += " ";
+      output += std::to_string(file);
+      output += "\n";
+   }
+
+   bool preprocess_file(preprocess_state_t &state, const std::string &path, const int depth)
+   {
+      if (depth > max_include_depth) {
+         debug::error("shader include depth exceeded at '%s'", path.c_str());
+         return false;
+      }
+
+      // note: every file is included once, include guards are not needed
+      if (std::find(state.m_files.begin(), state.m_files.end(), path) != state.m_files.end()) {
+         return true;
+      }
+
+      std::string source;
+      if (!file_system_t::load_content(path, source)) {
+         return false;
+      }
+
+      const int file_index = int(state.m_files.size());
+      state.m_files.push_back(path);
+
+      std::string &output = state.m_output;
+      if (depth > 0) {
+         append_line_directive(output, 1, file_index);
+      }
+
+      int line_number = 0;
+      size_t at = 0;
+      while (at < source.size()) {
+         size_t end = source.find('\n', at);
+         if (end == std::string::npos) {
+            end = source.size();
+         }
+
+         std::string_view line(source.data() + at, end - at);
+         if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+         }
+
+         at = end + 1;
+         line_number++;
+
+         const std::string_view directive = trim_left(line);
+         if (directive.starts_with("#include")) {
+            const size_t open = directive.find('"');
+            const size_t close = open == std::string_view::npos ? open : directive.find('"', open + 1);
+            if (close == std::string_view::npos) {
+               debug::error("%s(%d): malformed #include", path.c_str(), line_number);
+               return false;
+            }
+
+            const std::string include_path = directory_of(path) + std::string(directive.substr(open + 1, close - open - 1));
+            if (!preprocess_file(state, include_path, depth + 1)) {
+               return false;
+            }
+
+            append_line_directive(output, line_number + 1, file_index);
+            continue;
+         }
+
+         // note: #version has to come first, the defines go right behind it,
+         //       included files may carry their own for editor tooling, drop those
+         if (directive.starts_with("#version")) {
+            if (depth == 0) {
+               output += line;
+               output += "\n";
+               output += state.m_defines.to_string();
+               append_line_directive(output, line_number + 1, file_index);
+            }
+            else {
+               output += "\n";
+            }
+            continue;
+         }
+
+         output += line;
+         output += "\n";
+      }
+
+      return true;
+   }
+} // !anonymous
+
+bool preprocess_shader(const std::string_view &path,
+                       const shader_defines_t &defines,
+                       std::string &output,
+                       std::vector<std::string> *files)
+{
+   output.clear();
+
+   preprocess_state_t state{ defines, output, {} };
+   const bool success = preprocess_file(state, std::string(path), 0);
+   if (files) {
+      *files = std::move(state.m_files);
+   }
+
+   return success;
+}
+
+shader_program_t &shader_library_t::request(const std::string_view &vertex_path,
+                                             const std::string_view &fragment_path,
+                                             const shader_defines_t &defines,
+                                             const std::span<const char *const> feedback_varyings)
+{
+   uint64_t key = defines.key();
+   key = fnv1a64(vertex_path.data(), vertex_path.size(), key);
+   key = fnv1a64("\0", 1, key);
+   key = fnv1a64(fragment_path.data(), fragment_path.size(), key);
+   for (const char *varying : feedback_varyings) {
+      key = fnv1a64(varying, strlen(varying) + 1, key);
+   }
+
+   for (auto &variant : m_variants) {
+      if (variant->m_key == key) {
+         return variant->m_program;
+      }
+   }
+
+   profile_scope("shader_library_t::request");
+
+   auto variant = std::make_unique<variant_t>();
+   variant->m_key = key;
+   variant->m_name = std::string(vertex_path) + " + " + std::string(fragment_path);
+   for (const auto &[name, value] : defines.m_defines) {
+      variant->m_name += " " + name;
+   }
+
+   std::string vertex_source, fragment_source;
+   std::vector<std::string> vertex_files, fragment_files;
+   const bool preprocessed = preprocess_shader(vertex_path, defines, vertex_source, &vertex_files) &&
+                             preprocess_shader(fragment_path, defines, fragment_source, &fragment_files);
+
+   for (size_t index = 0; index < vertex_files.size(); index++) {
+      variant->m_files.push_back("vertex " + std::to_string(index) + ": " + vertex_files[index]);
+   }
+
+   for (size_t index = 0; index < fragment_files.size(); index++) {
+      variant->m_files.push_back("fragment " + std::to_string(index) + ": " + fragment_files[index]);
+   }
+
+   if (!preprocessed || !variant->m_program.create_async(vertex_source, fragment_source, feedback_varyings)) {
+      debug::error("could not create shader variant '%s'", variant->m_name.c_str());
+   }
+
+   m_variants.push_back(std::move(variant));
+   return m_variants.back()->m_program;
+}
+
+static void
+report_variant(const shader_library_t::variant_t &variant)
+{
+   if (variant.m_program.valid()) {
+      debug::info("shader_library_t: '%s' ready", variant.m_name.c_str());
+      return;
+   }
+
+   debug::error("shader variant '%s' failed, source strings:", variant.m_name.c_str());
+   for (const auto &file : variant.m_files) {
+      debug::error(" + %s", file.c_str());
+   }
+}
+
+void shader_library_t::update()
+{
+   profile_scope("shader_library_t::update");
+
+   for (auto &variant : m_variants) {
+      if (variant->m_program.pending() && variant->m_program.poll()) {
+         report_variant(*variant);
+      }
+   }
+}
+
+bool shader_library_t::finish(shader_program_t &program)
+{
+   for (auto &variant : m_variants) {
+      if (&variant->m_program == &program && program.pending()) {
+         program.wait();
+         report_variant(*variant);
+      }
+   }
+
+   return program.valid();
+}
+
+int shader_library_t::pending() const
+{
+   int count = 0;
+   for (const auto &variant : m_variants) {
+      count += variant->m_program.pending() ? 1 : 0;
+   }
+
+   return count;
+}
+
+void shader_library_t::destroy()
+{
+   for (auto &variant : m_variants) {
+      variant->m_program.destroy();
+   }
+
+   m_variants.clear();
+}
@@ -1,52 +1,172 @@
 // system.cpp
 
 #include "system.hpp"
-#include <GLFW/glfw3.h>
+#include "memory.hpp"
 
 #include <stdio.h>
-#include <stdarg.h>
-
-namespace debug 
-{
-   void info(const char *format, ...)
-   {
-      char message[2048];
-      va_list args;
-      va_start(args, format);
-      vsprintf_s(message, format, args);
-      va_end(args);
-      printf("NFO: %s\n", message);
+#include <chrono>
+#include <cstring>
+
+uint32_t fnv1a32(const void *data, const size_t size) 
+{
+   const uint8_t *at = (uint8_t *)data;
+
+   uint32_t result = 2166136261;
+   for (size_t index = 0; index < size; index++) {
+      result ^= uint32_t(at[index]);
+      result *= 16777619;
+   }
+
+   return result;
+}
+
+// note: pass the previous result as seed to hash several pieces as one stream
+uint64_t fnv1a64(const void *data, const size_t size, const uint64_t seed)
+{
+   const uint8_t *at = (uint8_t *)data;
+
+   uint64_t result = seed;
+   for (size_t index = 0; index < size; index++) {
+      result ^= uint64_t(at[index]);
+      result *= 1099511628211ull;
+   }
+
+   return result;
+}
+
+void input_latch_t::store(const sample_t &sample)
+{
+   uint64_t position = 0;
+   static_assert(sizeof(position) == sizeof(sample.x) + sizeof(sample.y));
+   memcpy(&position, &sample.x, sizeof(sample.x));
+   memcpy((uint8_t *)&position + sizeof(sample.x), &sample.y, sizeof(sample.y));
+
+   // note: odd sequence while writing
+   const uint32_t sequence = m_sequence.load(std::memory_order_relaxed);
+   m_sequence.store(sequence + 1, std::memory_order_relaxed);
+   std::atomic_thread_fence(std::memory_order_release);
+   m_position.store(position, std::memory_order_relaxed);
+   m_time.store(sample.time.m_duration, std::memory_order_relaxed);
+   m_sequence.store(sequence + 2, std::memory_order_release);
+}
+
+input_latch_t::sample_t input_latch_t::load() const
+{
+   for (;;) {
+      const uint32_t sequence = m_sequence.load(std::memory_order_acquire);
+      const uint64_t position = m_position.load(std::memory_order_relaxed);
+      const int64 time = m_time.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if ((sequence & 1) == 0 && sequence == m_sequence.load(std::memory_order_relaxed)) {
+         sample_t sample;
+         memcpy(&sample.x, &position, sizeof(sample.x));
+         memcpy(&sample.y, (const uint8_t *)&position + sizeof(sample.x), sizeof(sample.y));
+         sample.time = timespan_t{ time };
+         return sample;
+      }
    }
+}
 
-   void warn(const char *format, ...)
-   {
-      char message[2048];
-      va_list args;
-      va_start(args, format);
-      vsprintf_s(message, format, args);
-      va_end(args);
-      printf("WRN: %s\n", message);
+event_queue_t::event_queue_t()
+   : m_head(0)
+   , m_tail(0)
+   , m_dropped(0)
+{
+   for (uint32_t index = 0; index < capacity; index++) {
+      m_slots[index].m_sequence.store(index, std::memory_order_relaxed);
+      m_slots[index].m_dispatch = nullptr;
    }
+}
 
-   void error(const char *format, ...) 
-   {
-      char message[2048];
-      va_list args;
-      va_start(args, format);
-      vsprintf_s(message, format, args);
-      va_end(args);
-      printf("ERR: %s\n", message);
+bool event_queue_t::push(dispatch_proc_t dispatch, const void *payload, const size_t size)
+{
+   // note: a slot is free for position 'head' when its sequence equals head,
+   //       producers race for it with a cas on the head, the sequence then 
+   //       publishes the written slot to the consumer
+   uint32_t head = m_head.load(std::memory_order_relaxed);
+   slot_t *slot = nullptr;
+   for (;;) {
+      slot = &m_slots[head & mask];
+      const uint32_t sequence = slot->m_sequence.load(std::memory_order_acquire);
+      const int32_t difference = int32_t(sequence - head);
+      if (difference == 0) {
+         if (m_head.compare_exchange_weak(head, head + 1, std::memory_order_relaxed)) {
+            break;
+         }
+      }
+      else if (difference < 0) {
+         m_dropped.fetch_add(1, std::memory_order_relaxed);
+         return false;
+      }
+      else {
+         head = m_head.load(std::memory_order_relaxed);
+      }
    }
-} // !debug
+
+   slot->m_dispatch = dispatch;
+   memcpy(slot->m_payload, payload, size);
+   slot->m_sequence.store(head + 1, std::memory_order_release);
+
+   return true;
+}
+
+uint32_t event_queue_t::drain()
+{
+   // note: only what was posted before the drain started, events posted by
+   //       listeners are delivered next time so a drain always terminates
+   const uint32_t end = m_head.load(std::memory_order_acquire);
+
+   uint32_t count = 0;
+   while (m_tail != end) {
+      slot_t &slot = m_slots[m_tail & mask];
+      if (slot.m_sequence.load(std::memory_order_acquire) != m_tail + 1) {
+         break; // note: claimed but not yet written, pick it up next time
+      }
+
+      // note: copy out and release the slot before dispatching
+      alignas(max_event_alignment) uint8_t payload[max_event_size];
+      const dispatch_proc_t dispatch = slot.m_dispatch;
+      memcpy(payload, slot.m_payload, max_event_size);
+      slot.m_sequence.store(m_tail + capacity, std::memory_order_release);
+      m_tail++;
+
+      dispatch(payload);
+      count++;
+   }
+
+   return count;
+}
+
+uint64_t event_queue_t::dropped() const
+{
+   return m_dropped.load(std::memory_order_relaxed);
+}
+
+event_queue_t &event_dispatcher_t::queue()
+{
+   static event_queue_t ms_queue;
+   return ms_queue;
+}
+
+static FILE *
+open_file(const std::string_view &filename, const char *mode)
+{
+#if defined(_MSC_VER)
+   FILE *file = nullptr;
+   fopen_s(&file, filename.data(), mode);
+   return file;
+#else
+   return fopen(filename.data(), mode);
+#endif
+}
 
 template <typename T> 
 static bool 
 load_file_content(const std::string_view &filename, T &content)
 {
-   FILE *file = nullptr;
-   fopen_s(&file, filename.data(), "rb");
+   FILE *file = open_file(filename, "rb");
    if (file == nullptr) {
-      debug::warn("could not locate '%s'", filename.data());
+      debug::warn("could not locate '%s'", filename);
       return false;
    }
 
@@ -70,6 +190,41 @@ bool file_system_t::load_content(const std::string_view &filename, std::vector<u
    return load_file_content(filename, content);
 }
 
+bool file_system_t::load_content(const std::string_view &filename, linear_arena_t &arena, std::span<uint8_t> &content)
+{
+   FILE *file = open_file(filename, "rb");
+   if (file == nullptr) {
+      debug::warn("could not locate '%s'", filename);
+      return false;
+   }
+
+   fseek(file, 0, SEEK_END);
+   const size_t size = size_t(ftell(file));
+   fseek(file, 0, SEEK_SET);
+
+   uint8_t *data = arena.allocate_array<uint8_t>(size);
+   const size_t read = fread(data, 1, size, file);
+   fclose(file);
+
+   content = std::span<uint8_t>(data, read);
+
+   return read == size;
+}
+
+bool file_system_t::save_content(const std::string_view &filename, const std::string_view &content)
+{
+   FILE *file = open_file(filename, "wb");
+   if (file == nullptr) {
+      debug::warn("could not open '%s' for writing", filename);
+      return false;
+   }
+
+   const size_t written = fwrite(content.data(), 1, content.size(), file);
+   fclose(file);
+
+   return written == content.size();
+}
+
 bool timespan_t::operator==(const timespan_t &rhs) const
 {
    return m_duration == rhs.m_duration;
@@ -157,6 +312,10 @@ float timespan_t::elapsed_milliseonds() const
 // static 
 timespan_t watch_t::time_since_start()
 {
-   const double now = glfwGetTime();
-   return timespan_t{ int64(now * 1000000.0) };
+   // note: steady clock instead of glfwGetTime, so timing works without a window
+   using clock = std::chrono::steady_clock;
+   static const clock::time_point start = clock::now();
+
+   const auto now = std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start);
+   return timespan_t{ int64(now.count()) };
 }
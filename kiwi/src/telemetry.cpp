@@ -0,0 +1,312 @@
+// telemetry.cpp
+
+#include "telemetry.hpp"
+#include "graphics.hpp"
+
+#include <bit>
+#include <cstdio>
+#include <string>
+
+uint32_t latency_histogram_t::bucket_index(const uint64_t value)
+{
+   if (value < sub_bucket_count) {
+      return uint32_t(value);
+   }
+
+   // note: shift so the value keeps 'sub_bucket_bits' significant bits, the top
+   //       one is always set so only the lower half of the sub buckets is used
+   const uint32_t shift = uint32_t(std::bit_width(value)) - sub_bucket_bits;
+   return shift * sub_bucket_half + uint32_t(value >> shift);
+}
+
+uint64_t latency_histogram_t::bucket_lowest(const uint32_t index)
+{
+   if (index < sub_bucket_count) {
+      return index;
+   }
+
+   const uint32_t shift = index / sub_bucket_half - 1;
+   return uint64_t(index - shift * sub_bucket_half) << shift;
+}
+
+uint64_t latency_histogram_t::bucket_highest(const uint32_t index)
+{
+   if (index < sub_bucket_count) {
+      return index;
+   }
+
+   const uint32_t shift = index / sub_bucket_half - 1;
+   return bucket_lowest(index) + (uint64_t(1) << shift) - 1;
+}
+
+void latency_histogram_t::clear()
+{
+   m_count = 0;
+   for (auto &count : m_counts) {
+      count = 0;
+   }
+}
+
+void latency_histogram_t::add(const uint64_t value)
+{
+   m_counts[bucket_index(value < max_value ? value : max_value)]++;
+   m_count++;
+}
+
+void latency_histogram_t::remove(const uint64_t value)
+{
+   uint32_t &count = m_counts[bucket_index(value < max_value ? value : max_value)];
+   if (count > 0) {
+      count--;
+      m_count--;
+   }
+}
+
+uint64_t latency_histogram_t::percentile(const double percent) const
+{
+   if (m_count == 0) {
+      return 0;
+   }
+
+   // note: nearest rank, the smallest value with at least 'percent' of all values at or below it
+   uint64_t rank = uint64_t(percent * 0.01 * double(m_count) + 0.5);
+   rank = rank < 1 ? 1 : (rank > m_count ? m_count : rank);
+
+   uint64_t seen = 0;
+   for (uint32_t index = 0; index < bucket_count; index++) {
+      const uint32_t count = m_counts[index];
+      if (seen + count >= rank) {
+         // note: the values of a bucket are taken as spread evenly across it
+         const uint64_t lowest = bucket_lowest(index);
+         const uint64_t width = bucket_highest(index) - lowest;
+         const uint64_t position = rank - seen;
+         return lowest + (width * (2 * position - 1) + count) / (2 * uint64_t(count));
+      }
+      seen += count;
+   }
+
+   return max_value;
+}
+
+uint64_t latency_histogram_t::highest() const
+{
+   for (uint32_t index = bucket_count; index > 0; index--) {
+      if (m_counts[index - 1] > 0) {
+         return bucket_highest(index - 1);
+      }
+   }
+
+   return 0;
+}
+
+const char *frame_telemetry_t::metric_name(const frame_metric_t metric)
+{
+   switch (metric) {
+      case frame_metric_t::cpu:     return "cpu";
+      case frame_metric_t::gpu:     return "gpu";
+      case frame_metric_t::present: return "present";
+      default:                      return "unknown";
+   }
+}
+
+void frame_telemetry_t::reset()
+{
+   for (auto &metric : m_metrics) {
+      metric.m_total.clear();
+      metric.m_window.clear();
+      metric.m_total_us = 0;
+      metric.m_window_us = 0;
+      metric.m_min_us = 0;
+      metric.m_max_us = 0;
+      metric.m_hitches = 0;
+      metric.m_window_hitches = 0;
+   }
+}
+
+void frame_telemetry_t::record(const frame_metric_t metric, const timespan_t &duration)
+{
+   metric_t &data = m_metrics[int(metric)];
+
+   const uint64_t clamped = duration.m_duration > 0 ? uint64_t(duration.m_duration) : 0;
+   const uint32_t value = uint32_t(clamped < latency_histogram_t::max_value ? clamped : latency_histogram_t::max_value);
+
+   // note: judged against the frames before it, so a run of hitches does not raise its own bar
+   bool hitch = false;
+   if (data.m_window.m_count >= hitch_min_frames) {
+      const uint64_t median = data.m_window.percentile(50.0);
+      hitch = double(value) > double(median) * hitch_ratio;
+   }
+
+   // note: the slot holds the frame that is now leaving the window
+   const uint32_t slot = uint32_t(data.m_total.m_count % window_size);
+   if (data.m_total.m_count >= window_size) {
+      data.m_window.remove(data.m_samples[slot]);
+      data.m_window_us -= data.m_samples[slot];
+      data.m_window_hitches -= data.m_hitch[slot] ? 1 : 0;
+   }
+
+   data.m_samples[slot] = value;
+   data.m_hitch[slot] = hitch;
+   data.m_window.add(value);
+   data.m_window_us += value;
+   data.m_window_hitches += hitch ? 1 : 0;
+
+   data.m_min_us = data.m_total.m_count == 0 || value < data.m_min_us ? value : data.m_min_us;
+   data.m_max_us = value > data.m_max_us ? value : data.m_max_us;
+   data.m_total.add(value);
+   data.m_total_us += value;
+   data.m_hitches += hitch ? 1 : 0;
+}
+
+void frame_telemetry_t::record_gpu(const gpu_profiler_t &profiler)
+{
+   const gpu_profiler_t::pass_t *pass = profiler.find("frame");
+   if (pass == nullptr) {
+      return;
+   }
+
+   // note: anything that already fell out of the profiler history is lost
+   int64_t first = m_gpu_recorded;
+   if (pass->m_count - first > gpu_profiler_t::history_size) {
+      first = pass->m_count - gpu_profiler_t::history_size;
+   }
+
+   for (int64_t index = first; index < pass->m_count; index++) {
+      const float milliseconds = pass->m_milliseconds[index % gpu_profiler_t::history_size];
+      record(frame_metric_t::gpu, timespan_t::from_milliseconds(milliseconds));
+   }
+
+   m_gpu_recorded = pass->m_count;
+}
+
+// note: an estimate inside the top bucket can land past the largest value recorded
+static float
+clamped_ms(const uint64_t value_us, const uint64_t max_us)
+{
+   return float(value_us < max_us ? value_us : max_us) * 0.001f;
+}
+
+frame_percentiles_t frame_telemetry_t::total(const frame_metric_t metric) const
+{
+   const metric_t &data = m_metrics[int(metric)];
+
+   frame_percentiles_t result;
+   if (data.m_total.m_count == 0) {
+      return result;
+   }
+
+   result.m_frames = data.m_total.m_count;
+   result.m_hitches = data.m_hitches;
+   result.m_mean_ms = float(double(data.m_total_us) / double(data.m_total.m_count) * 0.001);
+   result.m_p50_ms = clamped_ms(data.m_total.percentile(50.0), data.m_max_us);
+   result.m_p95_ms = clamped_ms(data.m_total.percentile(95.0), data.m_max_us);
+   result.m_p99_ms = clamped_ms(data.m_total.percentile(99.0), data.m_max_us);
+   result.m_max_ms = float(data.m_max_us) * 0.001f;
+
+   return result;
+}
+
+frame_percentiles_t frame_telemetry_t::window(const frame_metric_t metric) const
+{
+   const metric_t &data = m_metrics[int(metric)];
+
+   frame_percentiles_t result;
+   if (data.m_window.m_count == 0) {
+      return result;
+   }
+
+   result.m_frames = data.m_window.m_count;
+   result.m_hitches = data.m_window_hitches;
+   result.m_mean_ms = float(double(data.m_window_us) / double(data.m_window.m_count) * 0.001);
+   // note: the exact maximum is still in the samples, the histogram only knows its bucket
+   uint64_t max_us = 0;
+   const uint32_t samples = uint32_t(data.m_window.m_count);
+   for (uint32_t index = 0; index < samples; index++) {
+      max_us = data.m_samples[index] > max_us ? data.m_samples[index] : max_us;
+   }
+
+   result.m_p50_ms = clamped_ms(data.m_window.percentile(50.0), max_us);
+   result.m_p95_ms = clamped_ms(data.m_window.percentile(95.0), max_us);
+   result.m_p99_ms = clamped_ms(data.m_window.percentile(99.0), max_us);
+   result.m_max_ms = float(max_us) * 0.001f;
+
+   return result;
+}
+
+void frame_telemetry_t::log_summary() const
+{
+   for (int index = 0; index < int(frame_metric_t::count); index++) {
+      const frame_metric_t metric = frame_metric_t(index);
+      const frame_percentiles_t stats = total(metric);
+      if (stats.m_frames == 0) {
+         continue;
+      }
+
+      debug::info("telemetry: %-7s frames: %llu mean: %2.3fms p50: %2.3fms p95: %2.3fms p99: %2.3fms max: %2.3fms hitches: %llu",
+                  metric_name(metric),
+                  (unsigned long long)stats.m_frames,
+                  stats.m_mean_ms,
+                  stats.m_p50_ms,
+                  stats.m_p95_ms,
+                  stats.m_p99_ms,
+                  stats.m_max_ms,
+                  (unsigned long long)stats.m_hitches);
+   }
+}
+
+static void
+append_percentiles(std::string &content, const char *name, const frame_percentiles_t &stats)
+{
+   char line[512];
+   snprintf(line, sizeof(line),
+            "    \"%s\": { \"frames\": %llu, \"hitches\": %llu, \"mean_ms\": %.4f, \"p50_ms\": %.4f, \"p95_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f },\n",
+            name,
+            (unsigned long long)stats.m_frames,
+            (unsigned long long)stats.m_hitches,
+            stats.m_mean_ms,
+            stats.m_p50_ms,
+            stats.m_p95_ms,
+            stats.m_p99_ms,
+            stats.m_max_ms);
+   content += line;
+}
+
+bool frame_telemetry_t::save_json(const std::string_view &filename) const
+{
+   // note: percentiles over the run and the last window, plus the non-empty
+   //       buckets of the run as [lowest_us, highest_us, count] to plot or re-aggregate
+   std::string content = "{\n";
+   for (int index = 0; index < int(frame_metric_t::count); index++) {
+      const frame_metric_t metric = frame_metric_t(index);
+      const metric_t &data = m_metrics[index];
+
+      content += "  \"";
+      content += metric_name(metric);
+      content += "\": {\n";
+      append_percentiles(content, "total", total(metric));
+      append_percentiles(content, "window", window(metric));
+      content += "    \"histogram\": [";
+
+      bool first = true;
+      for (uint32_t bucket = 0; bucket < latency_histogram_t::bucket_count; bucket++) {
+         if (data.m_total.m_counts[bucket] == 0) {
+            continue;
+         }
+
+         char entry[96];
+         snprintf(entry, sizeof(entry), "%s[%llu, %llu, %u]",
+                  first ? "" : ", ",
+                  (unsigned long long)latency_histogram_t::bucket_lowest(bucket),
+                  (unsigned long long)latency_histogram_t::bucket_highest(bucket),
+                  data.m_total.m_counts[bucket]);
+         content += entry;
+         first = false;
+      }
+
+      content += "]\n  }";
+      content += index + 1 < int(frame_metric_t::count) ? ",\n" : "\n";
+   }
+   content += "}\n";
+
+   return file_system_t::save_content(filename, content);
+}
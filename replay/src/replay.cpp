@@ -0,0 +1,171 @@
+// replay.cpp
+
+#include "capture.hpp"
+#include "headless.hpp"
+#include "telemetry.hpp"
+#include "profiler.hpp"
+
+#include <glad/glad.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+struct replay_options_t {
+   bool finish = false;
+   int  passes = 5;
+   int  warmup_passes = 1;
+   const char *capture_path = nullptr;
+   const char *telemetry_filename = "replay_telemetry.json";
+};
+
+static replay_options_t
+parse_options(int argc, char **argv)
+{
+   replay_options_t options;
+   for (int index = 1; index < argc; index++) {
+      const char *argument = argv[index];
+      if (strncmp(argument, "--passes=", 9) == 0) {
+         options.passes = std::max(1, atoi(argument + 9));
+      }
+      else if (strncmp(argument, "--warmup=", 9) == 0) {
+         options.warmup_passes = std::max(0, atoi(argument + 9));
+      }
+      else if (strncmp(argument, "--telemetry=", 12) == 0) {
+         options.telemetry_filename = argument + 12;
+      }
+      else if (strcmp(argument, "--finish") == 0) {
+         options.finish = true;
+      }
+      else if (argument[0] != '-' && options.capture_path == nullptr) {
+         options.capture_path = argument;
+      }
+      else {
+         debug::warn("unknown argument '%s'", argument);
+      }
+   }
+
+   return options;
+}
+
+// note: replays every captured frame 'passes' times after 'warmup' untimed ones,
+//       back to back without pacing, the cpu time per frame is the submission
+//       cost of the renderer and the driver alone, unless --finish waits for
+//       the gpu after every frame
+static int
+run_replay(const replay_options_t &options)
+{
+   render_replay_t replay;
+   if (!replay.load(options.capture_path)) {
+      return 1;
+   }
+
+   headless_context_t context;
+   if (!context.create(replay.width(), replay.height())) {
+      return 1;
+   }
+
+   renderer_t *renderer = new renderer_t;
+   frame_telemetry_t *telemetry = new frame_telemetry_t;
+
+   int result = 0;
+   if (replay.prepare(*renderer)) {
+      glFinish();
+
+      uint64_t frames = 0;
+      uint64_t commands = 0;
+      uint64_t draws = 0;
+      timespan_t start_time;
+      for (int pass = 0; pass < options.warmup_passes + options.passes; pass++) {
+         if (pass == options.warmup_passes) {
+            glFinish();
+            telemetry->reset();
+            commands = replay.m_commands;
+            draws = replay.m_draws;
+            start_time = watch_t::time_since_start();
+         }
+
+         replay.rewind();
+         for (;;) {
+            profile_scope("frame");
+            const timespan_t frame_start = watch_t::time_since_start();
+            if (!replay.play_frame(*renderer)) {
+               break;
+            }
+
+            if (options.finish) {
+               glFinish();
+            }
+
+            telemetry->record(frame_metric_t::cpu, watch_t::time_since_start() - frame_start);
+            telemetry->record_gpu(renderer->gpu_profiler());
+            frames += pass >= options.warmup_passes ? 1 : 0;
+         }
+
+         profiler::collect();
+         if (replay.m_failed) {
+            break;
+         }
+      }
+
+      glFinish();
+      const timespan_t total_time = watch_t::time_since_start() - start_time;
+
+      if (replay.m_failed || frames == 0) {
+         debug::error("replay: could not play back '%s'!", options.capture_path);
+         result = 1;
+      }
+      else {
+         debug::info("replay: %d pass(es) %llu frames %dx%d in %2.3fs - avg: %2.3fms fps: %2.3f commands/frame: %llu draws/frame: %llu",
+                     options.passes,
+                     (unsigned long long)frames,
+                     replay.width(),
+                     replay.height(),
+                     total_time.elapsed_seconds(),
+                     total_time.elapsed_milliseonds() / float(frames),
+                     float(frames) / total_time.elapsed_seconds(),
+                     (unsigned long long)((replay.m_commands - commands) / frames),
+                     (unsigned long long)((replay.m_draws - draws) / frames));
+
+         telemetry->log_summary();
+         telemetry->save_json(options.telemetry_filename);
+
+         // note: averages of the last frames, marker names live in the replay
+         for (auto &pass : renderer->gpu_profiler().m_passes) {
+            debug::info("replay: gpu %*s%-24s avg: %2.3fms", pass.m_depth * 2, "", pass.m_name, pass.average());
+         }
+      }
+   }
+   else {
+      result = 1;
+   }
+
+   delete telemetry;
+   replay.destroy();
+   delete renderer;
+   context.destroy();
+
+   return result;
+}
+
+int main(int argc, char **argv)
+{
+   profiler::set_thread_name("main");
+
+   const replay_options_t options = parse_options(argc, argv);
+
+   debug::start_logging();
+
+   int result = 1;
+   if (options.capture_path == nullptr) {
+      debug::error("usage: replay <capture> [--passes=N] [--warmup=N] [--finish] [--telemetry=path]");
+   }
+   else {
+      result = run_replay(options);
+   }
+
+   debug::stop_logging();
+
+   return result;
+}